@@ -344,6 +344,16 @@ if GetOption('mempool_valgrind'):
 if GetOption('trace'):
     conf.Define('MEMPOOL_TRACE', comment='--trace was enabled')
 
+# ----------------------------
+# tsfile checks
+if env.SupportedPlatform('posix'):
+    conf.CheckDeclaration('pwritev', '#include <sys/uio.h>')
+
+# ----------------------------
+# libtsload checks
+if env.SupportedPlatform('linux'):
+    conf.CheckDeclaration('getrandom', '#include <sys/random.h>')
+
 # ----------------------------
 # etrace checks
 if env.SupportedPlatform('win'):
@@ -390,10 +400,30 @@ if env.SupportedPlatform('solaris'):
 # HTTP:
 if conf.CheckDeclaration('curl_easy_perform', '#include <curl/curl.h>') and conf.CheckLib('curl'):
     env['HAVE_CURL'] = True
+    
+    # curl_multi_wakeup() is required for concurrent requests (7.68.0+)
+    conf.CheckDeclaration('curl_multi_wakeup', '#include <curl/curl.h>')
 else:
     env['HAVE_CURL'] = False
     print >> sys.stderr, 'WARNING: libcurl missing, building of `http` module would be disabled'
 
+# TSFile: block compression codecs for v2 files
+env['HAVE_LIBLZ4'] = conf.CheckLibWithHeader('lz4', 'lz4.h', 'C', autoadd = 0)
+env['HAVE_LIBZSTD'] = conf.CheckLibWithHeader('zstd', 'zstd.h', 'C', autoadd = 0)
+
+# SimpleIO: asynchronous I/O engines
+env['HAVE_LIBURING'] = False
+env['HAVE_LIBAIO'] = False
+if env.SupportedPlatform('linux'):
+    env['HAVE_LIBURING'] = conf.CheckLibWithHeader('uring', 'liburing.h', 'C', autoadd = 0)
+    env['HAVE_LIBAIO'] = conf.CheckLibWithHeader('aio', 'libaio.h', 'C', autoadd = 0)
+
+# SimpleIO: fast file preparation
+if env.SupportedPlatform('linux'):
+    conf.CheckDeclaration('fallocate', '#include <fcntl.h>')
+if env.SupportedPlatform('posix'):
+    conf.CheckDeclaration('posix_fallocate', '#include <fcntl.h>')
+
 #==============================
 
 env.Alias('configure', gen_config)
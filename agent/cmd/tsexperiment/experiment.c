@@ -266,7 +266,6 @@ static exp_workload_t* exp_wl_create(const char* name) {
 	 ewl->wl_file_schema = NULL;
 	 ewl->wl_file = NULL;
 	 ewl->wl_file_flags = EXP_OPEN_NONE;
-	 ewl->wl_file_index = 0;
 
 	 ewl->wl_status = EXPERIMENT_UNKNOWN;
 
@@ -250,7 +250,6 @@ typedef struct exp_workload {
 	tsfile_schema_t* wl_file_schema;
 	tsfile_t* wl_file;
 	int wl_file_flags;
-	int wl_file_index;	/* Cached value for trace-based generator */
 
 	struct exp_workload* wl_chain_next;
 	struct exp_workload* wl_next;
@@ -24,6 +24,7 @@
 #include <tsload/defs.h>
 
 #include <tsload/list.h>
+#include <tsload/threads.h>
 
 #include <experiment.h>
 
@@ -64,6 +65,16 @@ typedef struct steps_trace {
 	exp_workload_t* st_ewl;
 
 	list_head_t st_wl_chain;
+
+	/* Next step is prefetched by background thread while current step runs */
+	thread_t st_prefetch_thread;
+	thread_mutex_t st_prefetch_mutex;
+	thread_cv_t st_prefetch_cv;
+
+	boolean_t st_prefetch_started;
+	boolean_t st_prefetch_dead;
+	int st_prefetch_state;
+	long st_prefetch_step;
 } steps_trace_t;
 
 typedef struct steps_generator {
@@ -26,6 +26,8 @@
 #include <tsload/getopt.h>
 #include <tsload/list.h>
 #include <tsload/posixdecl.h>
+#include <tsload/ilog2.h>
+#include <tsload/threads.h>
 
 #include <tsload/load/workload.h>
 
@@ -38,39 +40,142 @@
 #include <math.h>
 #include <ctype.h>
 
-typedef int (*tse_report_wl_func)(experiment_t* exp, exp_workload_t* ewl, void* context);
+/**
+ * Report and export may process workloads in parallel (-j option).
+ *
+ * Work is split into jobs which are picked by worker threads in order of
+ * their indices. Results are kept per-job and then printed or merged by the
+ * main thread in the same order, so output doesn't depend on number of threads.
+ *
+ * Report creates a job per step of each workload. Large steps are split into
+ * chunks of REPORT_CHUNK_SIZE requests which are merged after all of them are processed.
+ * Export creates a job per workload, since backends write files sequentially.
+ */
+#define REPORT_CHUNK_SIZE		(256 * 1024)
+#define REPORT_MAX_JOBS			64
+
+/**
+ * Jobs read requests in batches of REPORT_READ_BATCH entries into their own buffer.
+ * Only fields from report_fields are read, so for TSFile v2 other columns are
+ * not even decoded. Entries are not mapped because mappings of v2 files are
+ * shared by all readers of the file, so they can't be used from parallel jobs.
+ */
+#define REPORT_READ_BATCH		4096
+
+static const char* report_fields[] = {
+	"rq_step", "rq_sched_time", "rq_start_time", "rq_end_time", "rq_flags"
+};
+
+typedef int (*tse_report_wl_func)(experiment_t* exp, exp_workload_t** ewllist,
+								  int ewlcount, void* context);
+typedef int (*tse_report_job_func)(void* context, int idx);
 
 struct report_walk_context {
-	experiment_t* 	   exp;
-	tse_report_wl_func func;
-	void* 			   context;
-	int 			   ret;
+	exp_workload_t** ewllist;
+	int ewlcount;
 };
 
+struct report_jobs {
+	thread_mutex_t mutex;
+
+	tse_report_job_func func;
+	void* context;
+
+	int count;
+	int next;
+
+	int err_idx;
+	int ret;
+};
+
+/**
+ * Streaming statistics are collected in constant memory, so report
+ * could process runs with hundreds of millions of requests.
+ *
+ * Mean and variance are calculated using Welford's algorithm, while
+ * percentiles are taken from log-linear histogram (similar to HDR histogram):
+ * values are kept in nanoseconds, values less than REPORT_HIST_SUB_COUNT
+ * are stored exactly, larger values are grouped into buckets so every power of
+ * two has REPORT_HIST_HALF_COUNT buckets. That gives relative error less than
+ * 1 / REPORT_HIST_HALF_COUNT for percentiles. Both structures could be merged,
+ * so total statistics are merged from per-step statistics.
+ */
+#define REPORT_HIST_SUB_BITS	7
+#define REPORT_HIST_SUB_COUNT	(1 << REPORT_HIST_SUB_BITS)
+#define REPORT_HIST_HALF_COUNT	(REPORT_HIST_SUB_COUNT / 2)
+#define REPORT_HIST_BUCKETS		(REPORT_HIST_SUB_COUNT + 									\
+								 (64 - REPORT_HIST_SUB_BITS) * REPORT_HIST_HALF_COUNT)
+
+#define REPORT_PERCENTILES		4
+
+static const double report_percentiles[REPORT_PERCENTILES] = { 0.5, 0.9, 0.99, 0.999 };
+
 struct report_time_stats {
+	uint64_t count;
 	double mean;
-	double stddev;
+	double m2;
+
+	uint64_t* hist;
+	double percentiles[REPORT_PERCENTILES];
 };
 
 struct report_stats {
-	char step_name[8];
-	int start_idx;
-	int start_rq_idx;
-
 	int ontime;
 	int onstep;
 	int discard;
+	int stolen;
 
 	struct report_time_stats wait;
 	struct report_time_stats exec;
 };
 
+struct report_workload;
+
+struct report_step {
+	long step;
+	unsigned start;
+	unsigned end;
+
+	/* Chunks are processed by different threads, so step histograms
+	 * are shared between them and protected by workload's mutex */
+	int chunk_count;
+	int chunks_done;
+
+	struct report_stats stats;
+};
+
+struct report_task {
+	struct report_workload* rwl;
+	struct report_step* rstep;
+
+	unsigned start;
+	unsigned end;
+
+	struct report_stats stats;
+};
+
+struct report_workload {
+	exp_workload_t* ewl;
+
+	uint64_t field_mask;
+	size_t entry_size;
+	uint32_t rq_count;
+
+	thread_mutex_t mutex;
+
+	struct report_step* steps;
+	int step_count;
+
+	struct report_stats total;
+};
+
 int tse_report_workload_walk(hm_item_t* obj, void* context);
 
 int tse_report_common(experiment_t* root, int argc, char* argv[],
 					  int flags, tse_report_wl_func report, void* context) {
 	experiment_t* exp = NULL;
 	exp_workload_t** ewllist = NULL;
+	int ewlcount = 0, ewli = 0;
 
 	struct report_walk_context ctx;
 
@@ -99,17 +204,16 @@ int tse_report_common(experiment_t* root, int argc, char* argv[],
 	}
 
 	if(argi == argc) {
-		ctx.context = context;
-		ctx.func = report;
-		ctx.exp = exp;
-		ctx.ret = CMD_OK;
+		ctx.ewllist = NULL;
+		ctx.ewlcount = 0;
 
 		hash_map_walk(exp->exp_workloads, tse_report_workload_walk, &ctx);
-		
-		ret = ctx.ret;
+
+		ewllist = ctx.ewllist;
+		ewlcount = ctx.ewlcount;
 	}
 	else {
-		int ewlcount = argc - optind, ewli = 0;
+		ewlcount = argc - optind;
 		ewllist = mp_malloc(sizeof(exp_workload_t*) * ewlcount);
 		
 		for(argi = optind ; ewli < ewlcount; ++argi, ++ewli) {
@@ -121,12 +225,10 @@ int tse_report_common(experiment_t* root, int argc, char* argv[],
 				goto end;
 			}
 		}
-		
-		for(ewli = 0 ; ewli < ewlcount; ++ewli) {
-			ret = report(exp, ewllist[ewli], context);
-			if(ret != CMD_OK)
-				goto end;
-		}
+	}
+
+	if(ewlcount > 0) {
+		ret = report(exp, ewllist, ewlcount, context);
 	}
 
 end:
@@ -140,55 +242,277 @@ end:
 
 int tse_report_workload_walk(hm_item_t* obj, void* context) {
 	struct report_walk_context* ctx = (struct report_walk_context*) context;
-	int ret = ctx->func(ctx->exp, (exp_workload_t*) obj, ctx->context);
-	
-	if(ret != CMD_OK) {
-		ctx->ret = ret;
-		return HM_WALKER_STOP;
-	}
-	
+
+	ctx->ewllist = mp_realloc(ctx->ewllist, (ctx->ewlcount + 1) * sizeof(exp_workload_t*));
+	ctx->ewllist[ctx->ewlcount++] = (exp_workload_t*) obj;
+
 	return HM_WALKER_CONTINUE;
 }
 
-void tse_report_statistics(double* times, int from, int to, struct report_time_stats* stats) {
+static int tse_report_parse_jobs(const char* arg, int* p_jobs) {
+	char* endptr;
+	long jobs = strtol(arg, &endptr, 10);
+
+	if(*endptr != '\0' || jobs < 1 || jobs > REPORT_MAX_JOBS) {
+		tse_command_error_msg(CMD_INVALID_OPT,
+				"Invalid number of jobs '%s', should be in range [1, %d]\n", arg, REPORT_MAX_JOBS);
+		return CMD_INVALID_OPT;
+	}
+
+	*p_jobs = (int) jobs;
+	return CMD_OK;
+}
+
+static int tse_report_jobs_next(struct report_jobs* jobs) {
+	int idx = -1;
+
+	mutex_lock(&jobs->mutex);
+	/* Do not start new jobs after failure, like sequential loop does */
+	if(jobs->next < jobs->count && jobs->ret == CMD_OK)
+		idx = jobs->next++;
+	mutex_unlock(&jobs->mutex);
+
+	return idx;
+}
+
+static void tse_report_jobs_loop(struct report_jobs* jobs) {
 	int idx;
-	double mean = 0.0;
-	double var = 0.0;
+	int ret;
+
+	while((idx = tse_report_jobs_next(jobs)) >= 0) {
+		ret = jobs->func(jobs->context, idx);
+
+		if(ret != CMD_OK) {
+			/* Report error of the earliest job */
+			mutex_lock(&jobs->mutex);
+			if(jobs->err_idx < 0 || idx < jobs->err_idx) {
+				jobs->err_idx = idx;
+				jobs->ret = ret;
+			}
+			mutex_unlock(&jobs->mutex);
+		}
+	}
+}
 
-	for(idx = from; idx < to; ++idx) {
-		mean += times[idx];
+static thread_result_t tse_report_job_thread(thread_arg_t arg) {
+	THREAD_ENTRY(arg, struct report_jobs, jobs);
+
+	tse_report_jobs_loop(jobs);
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+/**
+ * Run jobs [0; count) on nthreads threads (including calling thread)
+ *
+ * @return CMD_OK or error code returned by job with lowest index
+ */
+static int tse_report_run_jobs(int nthreads, int count, tse_report_job_func func, void* context) {
+	struct report_jobs jobs;
+	thread_t* threads = NULL;
+	int tid;
+
+	jobs.func = func;
+	jobs.context = context;
+	jobs.count = count;
+	jobs.next = 0;
+	jobs.err_idx = -1;
+	jobs.ret = CMD_OK;
+
+	if(nthreads > count)
+		nthreads = count;
+
+	mutex_init(&jobs.mutex, "tse_report_jobs");
+
+	if(nthreads > 1) {
+		threads = mp_malloc((nthreads - 1) * sizeof(thread_t));
+
+		for(tid = 0; tid < (nthreads - 1); ++tid) {
+			t_init(threads + tid, (void*) &jobs, tse_report_job_thread,
+				   "tse_report-%d", tid);
+		}
 	}
-	mean = mean / (double) (to - from);
 
-	for(idx = from; idx < to; ++idx) {
-		var += pow(times[idx] - mean, 2);
+	tse_report_jobs_loop(&jobs);
+
+	if(threads != NULL) {
+		for(tid = 0; tid < (nthreads - 1); ++tid) {
+			t_destroy(threads + tid);
+		}
+
+		mp_free(threads);
 	}
-	var = var / (double) (to - from);
 
-	stats->mean = mean;
-	stats->stddev = sqrt(var);
+	mutex_destroy(&jobs.mutex);
+
+	return jobs.ret;
+}
+
+static int tse_report_hist_index(uint64_t value) {
+	int shift;
+
+	if(value < REPORT_HIST_SUB_COUNT)
+		return (int) value;
+
+	/* Keep REPORT_HIST_SUB_BITS - 1 bits after most significant bit */
+	shift = __msb64(value) - (REPORT_HIST_SUB_BITS - 1);
+
+	return REPORT_HIST_SUB_COUNT + (shift - 1) * REPORT_HIST_HALF_COUNT +
+				(int) ((value >> shift) - REPORT_HIST_HALF_COUNT);
+}
+
+static double tse_report_hist_value(int idx) {
+	int shift;
+	uint64_t low;
+
+	if(idx < REPORT_HIST_SUB_COUNT)
+		return (double) idx;
+
+	idx -= REPORT_HIST_SUB_COUNT;
+	shift = idx / REPORT_HIST_HALF_COUNT + 1;
+	low = ((uint64_t) (REPORT_HIST_HALF_COUNT + idx % REPORT_HIST_HALF_COUNT)) << shift;
+
+	/* Return middle of the bucket */
+	return (double) low + (double) ((1ull << shift) - 1) / 2.0;
+}
+
+static void tse_report_hist_merge(uint64_t* dst, const uint64_t* src) {
+	int idx;
+
+	for(idx = 0; idx < REPORT_HIST_BUCKETS; ++idx) {
+		dst[idx] += src[idx];
+	}
+}
+
+/**
+ * Find percentiles in histogram. Percentiles should be sorted in
+ * ascending order, so they are found in a single pass over histogram */
+static void tse_report_hist_percentiles(const uint64_t* hist, double* values) {
+	uint64_t count = 0;
+	uint64_t cumulative = 0;
+	uint64_t rank;
+	int pi = 0;
+	int idx = 0;
+
+	for(idx = 0; idx < REPORT_HIST_BUCKETS; ++idx) {
+		count += hist[idx];
+	}
+
+	for(pi = 0; pi < REPORT_PERCENTILES; ++pi) {
+		values[pi] = 0.0;
+	}
+
+	if(count == 0)
+		return;
+
+	idx = 0;
+	for(pi = 0; pi < REPORT_PERCENTILES; ++pi) {
+		rank = (uint64_t) ceil(report_percentiles[pi] * (double) count);
+		if(rank == 0)
+			rank = 1;
+
+		while(idx < REPORT_HIST_BUCKETS && cumulative + hist[idx] < rank) {
+			cumulative += hist[idx];
+			++idx;
+		}
+
+		values[pi] = tse_report_hist_value(idx);
+	}
+}
+
+static void tse_report_time_stats_hist_init(struct report_time_stats* ts) {
+	ts->hist = mp_malloc(REPORT_HIST_BUCKETS * sizeof(uint64_t));
+	memset(ts->hist, 0, REPORT_HIST_BUCKETS * sizeof(uint64_t));
+}
+
+static void tse_report_time_stats_hist_destroy(struct report_time_stats* ts) {
+	if(ts->hist != NULL) {
+		mp_free(ts->hist);
+		ts->hist = NULL;
+	}
+}
+
+/**
+ * Add time (in nanoseconds) to statistics */
+static void tse_report_time_stats_add(struct report_time_stats* ts, double value) {
+	double delta = value - ts->mean;
+
+	++ts->count;
+	ts->mean += delta / (double) ts->count;
+	ts->m2 += delta * (value - ts->mean);
+
+	/* Wait time may be negative if request was started a bit earlier than
+	 * its arrival time, account it as zero for percentiles */
+	if(value < 0.0)
+		value = 0.0;
+
+	++ts->hist[tse_report_hist_index((uint64_t) value)];
+}
+
+/**
+ * Merge mean and variance from src into dst (Chan et al. parallel variance).
+ * Histograms are merged separately with tse_report_hist_merge() */
+static void tse_report_time_stats_merge(struct report_time_stats* dst,
+										const struct report_time_stats* src) {
+	uint64_t count = dst->count + src->count;
+	double delta = src->mean - dst->mean;
+
+	if(src->count == 0)
+		return;
+
+	dst->mean += delta * ((double) src->count / (double) count);
+	dst->m2 += src->m2 + delta * delta *
+					((double) dst->count * (double) src->count / (double) count);
+	dst->count = count;
 }
 
-void tse_report_step(struct report_stats* stats, double* wait_times, double* exec_times, int idx, int rq_idx) {
+static void tse_report_stats_merge(struct report_stats* dst, const struct report_stats* src) {
+	dst->ontime += src->ontime;
+	dst->onstep += src->onstep;
+	dst->discard += src->discard;
+	dst->stolen += src->stolen;
+
+	tse_report_time_stats_merge(&dst->wait, &src->wait);
+	tse_report_time_stats_merge(&dst->exec, &src->exec);
+}
+
+static void tse_report_time_print(const struct report_time_stats* ts) {
+	double stddev = 0.0;
+	int pi;
+
+	if(ts->count > 0)
+		stddev = sqrt(ts->m2 / (double) ts->count);
+
+	printf(" %-9.3f %-9.3f", ts->mean / (double) T_MS, stddev / (double) T_MS);
+
+	for(pi = 0; pi < REPORT_PERCENTILES; ++pi) {
+		printf(" %-9.3f", ts->percentiles[pi] / (double) T_MS);
+	}
+}
+
+void tse_report_step(const char* step_name, struct report_stats* stats, unsigned count) {
 	/* Report per-step statistics */
-	tse_report_statistics(wait_times, stats->start_idx, idx, &stats->wait);
-	tse_report_statistics(exec_times, stats->start_idx, idx, &stats->exec);
+	printf("%-8s %-6u %-6d %-6d %-8d %-6d",
+			step_name, count, stats->ontime, stats->onstep,
+			stats->discard, stats->stolen);
+
+	tse_report_time_print(&stats->wait);
+	tse_report_time_print(&stats->exec);
 
-	printf("%-8s %-6d %-6d %-6d %-8d %-10.3f %-10.3f %-10.3f %-10.3f\n",
-			stats->step_name, rq_idx - stats->start_rq_idx, stats->ontime, stats->onstep, stats->discard,
-			stats->wait.mean, stats->wait.stddev, stats->exec.mean, stats->exec.stddev);
+	putchar('\n');
 }
 
-void tse_process_rq_time(exp_request_entry_t* rqe, double* wait_times, double* exec_times, int idx) {
-	double sched_time = ((double) rqe->rq_sched_time) / ((double) T_MS);
-	double start_time = ((double) rqe->rq_start_time) / ((double) T_MS);
-	double end_time = ((double) rqe->rq_end_time) / ((double) T_MS);
+void tse_process_rq_time(const exp_request_entry_t* rqe, struct report_stats* stats) {
+	double sched_time = (double) rqe->rq_sched_time;
+	double start_time = (double) rqe->rq_start_time;
+	double end_time = (double) rqe->rq_end_time;
 
-	exec_times[idx] = end_time - start_time;
-	wait_times[idx] = start_time - sched_time;
+	tse_report_time_stats_add(&stats->exec, end_time - start_time);
+	tse_report_time_stats_add(&stats->wait, start_time - sched_time);
 }
 
-void tse_process_rq_flags(exp_request_entry_t* rqe, struct report_stats* stats, long step) {
+void tse_process_rq_flags(const exp_request_entry_t* rqe, struct report_stats* stats, long step) {
 	if(!(rqe->rq_flags & RQF_FINISHED)) {
 		++stats->discard;
 	}
@@ -200,91 +524,341 @@ void tse_process_rq_flags(exp_request_entry_t* rqe, struct report_stats* stats,
 	if(rqe->rq_step == step) {
 		++stats->onstep;
 	}
+
+	if(rqe->rq_flags & RQF_STOLEN) {
+		++stats->stolen;
+	}
 }
 
-int tse_report_workload(experiment_t* exp, exp_workload_t* ewl, void* context) {
-	void* entry = mp_malloc(ewl->wl_file_schema->hdr.entry_size);
-	uint32_t rq_count = tsfile_get_count(ewl->wl_file);
-	exp_request_entry_t* rqe = (exp_request_entry_t*) entry;
+STATIC_INLINE const exp_request_entry_t*
+tse_report_entry(struct report_workload* rwl, const char* entries, unsigned rq_idx) {
+	return (const exp_request_entry_t*) (entries + rq_idx * rwl->entry_size);
+}
+
+static int tse_report_plan_workload(struct report_workload* rwl, exp_workload_t* ewl) {
+	struct report_step* rstep;
+	unsigned start = 0;
+	int max_steps = 0;
+	char* entry = NULL;
+	int fi, rfi;
+	int ret = CMD_OK;
 
-	long step = -1;
+	memset(rwl, 0, sizeof(struct report_workload));
 
-	int idx = 0;
-	int rq_idx;
+	rwl->ewl = ewl;
+	rwl->entry_size = ewl->wl_file_schema->hdr.entry_size;
 
-	struct report_stats total_stats;
-	struct report_stats step_stats;
+	mutex_init(&rwl->mutex, "tse_report-%s", ewl->wl_name);
 
-	/* It costs 1 MB of memory per 32k requests.
-	 * Still have to be careful with this allocation */
-	double* wait_times = mp_malloc(rq_count * sizeof(double));
-	double* exec_times = mp_malloc(rq_count * sizeof(double));
+	tse_report_time_stats_hist_init(&rwl->total.wait);
+	tse_report_time_stats_hist_init(&rwl->total.exec);
 
-	printf("%s\n", ewl->wl_name);
-	printf("%-8s %-6s %-6s %-6s %-8s %-21s %-21s\n", "STEP", "COUNT",
-				"ONTIME", "ONSTEP", "DISCARD", "WAIT TIME (ms)", "SERVICE TIME (ms)");
-	printf("%-8s %-6s %-6s %-6s %-8s %-10s %-10s %-10s %-10s\n", "", "",
-				"", "", "", "MEAN", "STDDEV", "MEAN", "STDDEV");
+	if(tsfile_get_count(ewl->wl_file, &rwl->rq_count) != TSFILE_OK) {
+		tse_command_error_msg(CMD_GENERIC_ERROR,
+				"Couldn't read requests of workload '%s'\n", ewl->wl_name);
+		return CMD_GENERIC_ERROR;
+	}
+
+	if(rwl->rq_count == 0)
+		return CMD_OK;
 
-	memset(&total_stats, 0, sizeof(struct report_stats));
-	strcpy(total_stats.step_name, "total");
+	for(rfi = 0; rfi < sizeof(report_fields) / sizeof(report_fields[0]); ++rfi) {
+		fi = tsfile_find_field(ewl->wl_file, report_fields[rfi]);
 
-	for(rq_idx = 0; rq_idx < rq_count ; ++rq_idx) {
-		tsfile_get_entries(ewl->wl_file, entry, rq_idx, rq_idx + 1);
+		if(fi < 0) {
+			tse_command_error_msg(CMD_GENERIC_ERROR,
+					"Couldn't find field '%s' in requests of workload '%s'\n",
+					report_fields[rfi], ewl->wl_name);
+			return CMD_GENERIC_ERROR;
+		}
+
+		rwl->field_mask |= TSFILE_FIELD_BIT(fi);
+	}
 
-		if(((long) rqe->rq_step) > step) {
-			if(step >= 0 && rq_idx > step_stats.start_rq_idx) {
-				tse_report_step(&step_stats, wait_times, exec_times, idx, rq_idx);
+	/* Steps are found using TSFile index. Like sequential scan, it begins new
+	 * step when request with greater step number is found, so requests that
+	 * were reported late are accounted in the following step. */
+	if(tsfile_set_index(ewl->wl_file, "rq_step") != TSFILE_OK) {
+		tse_command_error_msg(CMD_GENERIC_ERROR,
+				"Couldn't read requests of workload '%s'\n", ewl->wl_name);
+		return CMD_GENERIC_ERROR;
+	}
+
+	entry = mp_malloc(rwl->entry_size);
+
+	while(start < rwl->rq_count) {
+		if(rwl->step_count == max_steps) {
+			max_steps = (max_steps == 0) ? 16 : max_steps * 2;
+			rwl->steps = mp_realloc(rwl->steps, max_steps * sizeof(struct report_step));
+		}
+
+		rstep = rwl->steps + rwl->step_count++;
+		memset(rstep, 0, sizeof(struct report_step));
+
+		rstep->start = start;
+
+		if(tsfile_get_fields(ewl->wl_file, entry, start, start + 1,
+							 rwl->field_mask) != TSFILE_OK ||
+		   tsfile_get_index(ewl->wl_file,
+				   tse_report_entry(rwl, entry, 0)->rq_step + 1, &rstep->end) != TSFILE_OK) {
+			tse_command_error_msg(CMD_GENERIC_ERROR,
+					"Couldn't read step index of workload '%s'\n", ewl->wl_name);
+			ret = CMD_GENERIC_ERROR;
+			break;
+		}
+
+		rstep->step = tse_report_entry(rwl, entry, 0)->rq_step;
+		rstep->chunk_count = (rstep->end - rstep->start + REPORT_CHUNK_SIZE - 1) / REPORT_CHUNK_SIZE;
+
+		if(rstep->chunk_count > 1) {
+			tse_report_time_stats_hist_init(&rstep->stats.wait);
+			tse_report_time_stats_hist_init(&rstep->stats.exec);
+		}
+
+		start = rstep->end;
+	}
+
+	mp_free(entry);
+
+	return ret;
+}
+
+static void tse_report_destroy_workload(struct report_workload* rwl) {
+	int si;
+
+	for(si = 0; si < rwl->step_count; ++si) {
+		tse_report_time_stats_hist_destroy(&rwl->steps[si].stats.wait);
+		tse_report_time_stats_hist_destroy(&rwl->steps[si].stats.exec);
+	}
+
+	if(rwl->steps != NULL)
+		mp_free(rwl->steps);
+
+	tse_report_time_stats_hist_destroy(&rwl->total.wait);
+	tse_report_time_stats_hist_destroy(&rwl->total.exec);
+
+	mutex_destroy(&rwl->mutex);
+}
+
+static int tse_report_task(void* context, int idx) {
+	struct report_task* task = ((struct report_task*) context) + idx;
+	struct report_workload* rwl = task->rwl;
+	struct report_step* rstep = task->rstep;
+	struct report_stats* stats = &task->stats;
+
+	const exp_request_entry_t* rqe;
+	char* entries;
+	unsigned batch_start, batch_end;
+	unsigned rq_idx;
+	int ret = CMD_OK;
+
+	tse_report_time_stats_hist_init(&stats->wait);
+	tse_report_time_stats_hist_init(&stats->exec);
+
+	entries = mp_malloc(min(task->end - task->start, REPORT_READ_BATCH) * rwl->entry_size);
+
+	for(batch_start = task->start; batch_start < task->end; batch_start = batch_end) {
+		batch_end = min(batch_start + REPORT_READ_BATCH, task->end);
+
+		if(tsfile_get_fields(rwl->ewl->wl_file, entries, batch_start, batch_end,
+							 rwl->field_mask) != TSFILE_OK) {
+			tse_command_error_msg(CMD_GENERIC_ERROR,
+					"Couldn't read requests of workload '%s'\n", rwl->ewl->wl_name);
+			ret = CMD_GENERIC_ERROR;
+			break;
+		}
+
+		for(rq_idx = 0; rq_idx < batch_end - batch_start; ++rq_idx) {
+			rqe = tse_report_entry(rwl, entries, rq_idx);
+
+			if(rqe->rq_flags & RQF_FINISHED) {
+				tse_process_rq_time(rqe, stats);
 			}
 
-			/* Save values at the beginning of step */
-			memset(&step_stats, 0, sizeof(struct report_stats));
-			step_stats.start_rq_idx = rq_idx;
-			step_stats.start_idx = idx;
-			step = rqe->rq_step;
-			snprintf(step_stats.step_name, 8, "%ld", step);
+			tse_process_rq_flags(rqe, stats, rstep->step);
 		}
+	}
 
-		if(rqe->rq_flags & RQF_FINISHED) {
-			tse_process_rq_time(rqe, wait_times, exec_times, idx);
-			++idx;
+	mp_free(entries);
+
+	if(ret != CMD_OK) {
+		tse_report_time_stats_hist_destroy(&stats->wait);
+		tse_report_time_stats_hist_destroy(&stats->exec);
+
+		return ret;
+	}
+
+	mutex_lock(&rwl->mutex);
+
+	tse_report_hist_merge(rwl->total.wait.hist, stats->wait.hist);
+	tse_report_hist_merge(rwl->total.exec.hist, stats->exec.hist);
+
+	if(rstep->chunk_count == 1) {
+		tse_report_hist_percentiles(stats->wait.hist, rstep->stats.wait.percentiles);
+		tse_report_hist_percentiles(stats->exec.hist, rstep->stats.exec.percentiles);
+	}
+	else {
+		tse_report_hist_merge(rstep->stats.wait.hist, stats->wait.hist);
+		tse_report_hist_merge(rstep->stats.exec.hist, stats->exec.hist);
+
+		if(++rstep->chunks_done == rstep->chunk_count) {
+			tse_report_hist_percentiles(rstep->stats.wait.hist, rstep->stats.wait.percentiles);
+			tse_report_hist_percentiles(rstep->stats.exec.hist, rstep->stats.exec.percentiles);
+
+			tse_report_time_stats_hist_destroy(&rstep->stats.wait);
+			tse_report_time_stats_hist_destroy(&rstep->stats.exec);
+		}
+	}
+
+	mutex_unlock(&rwl->mutex);
+
+	tse_report_time_stats_hist_destroy(&stats->wait);
+	tse_report_time_stats_hist_destroy(&stats->exec);
+
+	return CMD_OK;
+}
+
+static void tse_report_print_workload(struct report_workload* rwl, struct report_task** p_task) {
+	struct report_step* rstep;
+	char step_name[8];
+	int si;
+
+	printf("%s\n", rwl->ewl->wl_name);
+	printf("%-8s %-6s %-6s %-6s %-8s %-6s %-59s %-59s\n", "STEP", "COUNT",
+				"ONTIME", "ONSTEP", "DISCARD", "STOLEN", "WAIT TIME (ms)", "SERVICE TIME (ms)");
+	printf("%-8s %-6s %-6s %-6s %-8s %-6s"
+		   " %-9s %-9s %-9s %-9s %-9s %-9s"
+		   " %-9s %-9s %-9s %-9s %-9s %-9s\n", "", "", "", "", "", "",
+				"MEAN", "STDDEV", "P50", "P90", "P99", "P99.9",
+				"MEAN", "STDDEV", "P50", "P90", "P99", "P99.9");
+
+	/* Merge chunks and steps in order, so floating point
+	 * results do not depend on scheduling of jobs */
+	for(si = 0; si < rwl->step_count; ++si) {
+		rstep = rwl->steps + si;
+
+		while((*p_task)->rstep == rstep) {
+			tse_report_stats_merge(&rstep->stats, &(*p_task)->stats);
+			++(*p_task);
 		}
 
-		tse_process_rq_flags(rqe, &step_stats, step);
-		tse_process_rq_flags(rqe, &total_stats, step);
+		snprintf(step_name, 8, "%ld", rstep->step);
+		tse_report_step(step_name, &rstep->stats, rstep->end - rstep->start);
+
+		tse_report_stats_merge(&rwl->total, &rstep->stats);
 	}
 
-	tse_report_step(&step_stats, wait_times, exec_times, idx, rq_idx);
-	tse_report_step(&total_stats, wait_times, exec_times, idx, rq_idx);
+	tse_report_hist_percentiles(rwl->total.wait.hist, rwl->total.wait.percentiles);
+	tse_report_hist_percentiles(rwl->total.exec.hist, rwl->total.exec.percentiles);
+
+	tse_report_step("total", &rwl->total, rwl->rq_count);
 
 	puts("\n");
+}
 
-	mp_free(wait_times);
-	mp_free(exec_times);
+int tse_report_workloads(experiment_t* exp, exp_workload_t** ewllist, int ewlcount, void* context) {
+	int nthreads = *((int*) context);
 
-	mp_free(entry);
-	
-	return CMD_OK;
+	struct report_workload* rwls;
+	struct report_workload* rwl;
+	struct report_step* rstep;
+	struct report_task* tasks = NULL;
+	struct report_task* task;
+
+	int task_count = 0;
+	unsigned start;
+	int ewli, si;
+
+	int ret = CMD_OK;
+
+	rwls = mp_malloc(ewlcount * sizeof(struct report_workload));
+
+	for(ewli = 0; ewli < ewlcount; ++ewli) {
+		ret = tse_report_plan_workload(rwls + ewli, ewllist[ewli]);
+
+		if(ret != CMD_OK) {
+			++ewli;
+			goto end;
+		}
+
+		for(si = 0; si < rwls[ewli].step_count; ++si) {
+			task_count += rwls[ewli].steps[si].chunk_count;
+		}
+	}
+
+	/* Extra task acts as a terminator for tse_report_print_workload() */
+	tasks = mp_malloc((task_count + 1) * sizeof(struct report_task));
+	memset(tasks, 0, (task_count + 1) * sizeof(struct report_task));
+	task = tasks;
+
+	for(ewli = 0; ewli < ewlcount; ++ewli) {
+		rwl = rwls + ewli;
+
+		for(si = 0; si < rwl->step_count; ++si) {
+			rstep = rwl->steps + si;
+
+			for(start = rstep->start; start < rstep->end; start += REPORT_CHUNK_SIZE) {
+				task->rwl = rwl;
+				task->rstep = rstep;
+				task->start = start;
+				task->end = min(start + REPORT_CHUNK_SIZE, rstep->end);
+
+				++task;
+			}
+		}
+	}
+
+	ret = tse_report_run_jobs(nthreads, task_count, tse_report_task, tasks);
+
+	if(ret == CMD_OK) {
+		task = tasks;
+
+		for(ewli = 0; ewli < ewlcount; ++ewli) {
+			tse_report_print_workload(rwls + ewli, &task);
+		}
+	}
+
+end:
+	while(ewli-- > 0) {
+		tse_report_destroy_workload(rwls + ewli);
+	}
+
+	if(tasks != NULL)
+		mp_free(tasks);
+
+	mp_free(rwls);
+
+	return ret;
 }
 
 int tse_report(experiment_t* root, int argc, char* argv[]) {
 	int flags = EXP_OPEN_RQPARAMS;
+	int nthreads = 1;
+	int ret;
 	int c;
 
-	while((c = plat_getopt(argc, argv, "S")) != -1) {
+	while((c = plat_getopt(argc, argv, "Sj:")) != -1) {
 		switch(c) {
 		case 'S':
 			/* Undocumented option for compability with run-tsload output */
 			flags = EXP_OPEN_SCHEMA_READ;
 			break;
+		case 'j':
+			ret = tse_report_parse_jobs(optarg, &nthreads);
+			if(ret != CMD_OK)
+				return ret;
+			break;
 		case '?':
-			tse_command_error_msg(CMD_INVALID_OPT, "Invalid show suboption -%c\n", c);
+			if(optopt == 'j')
+				tse_command_error_msg(CMD_INVALID_OPT, "-%c option requires an argument\n", optopt);
+			else
+				tse_command_error_msg(CMD_INVALID_OPT, "Invalid report suboption -%c\n", optopt);
 			return CMD_INVALID_OPT;
 		}
 	}
 
 	return tse_report_common(root, argc, argv,
-						     flags, tse_report_workload, NULL);
+						     flags, tse_report_workloads, &nthreads);
 }
 
 
@@ -303,6 +877,14 @@ struct tse_export_context {
 	char backend_name[8];
 
 	list_head_t options;
+
+	int nthreads;
+};
+
+struct tse_export_jobs {
+	experiment_t* exp;
+	exp_workload_t** ewllist;
+	struct tse_export_context* ctx;
 };
 
 int tse_export_workload(experiment_t* exp, exp_workload_t* ewl, void* context) {
@@ -325,14 +907,7 @@ int tse_export_workload(experiment_t* exp, exp_workload_t* ewl, void* context) {
 	
 	struct stat statbuf;
 
-	/* Process options -- generate file names and process destination path */
-	if(!ctx->have_dest) {
-		/* -d flag was not provided - use experiment dir. Couldn't do this
-		 * inside tse_export, cause it has no experiment we get it in tse_report_common() */
-		path_join(ctx->dest_path, PATHMAXLEN, exp->exp_root, exp->exp_directory, NULL);
-		ctx->have_dest = B_TRUE;
-	}
-
+	/* Process options -- generate file names */
 	j_hostname = experiment_cfg_find(exp->exp_config, "agent:hostname", NULL, JSON_STRING);
 	if(j_hostname != NULL)
 		hostname = json_as_string(j_hostname);
@@ -403,9 +978,13 @@ int tse_export_workload(experiment_t* exp, exp_workload_t* ewl, void* context) {
 		}
 	}
 
-	rq_count = tsfile_get_count(ewl->wl_file);
-	tsfile_backend_set_files(backend, file, ewl->wl_file);
-	err = tsfile_backend_get(backend, 0, rq_count);
+	if(tsfile_get_count(ewl->wl_file, &rq_count) != TSFILE_OK) {
+		err = 1;
+	}
+	else {
+		tsfile_backend_set_files(backend, file, ewl->wl_file);
+		err = tsfile_backend_get(backend, 0, rq_count);
+	}
 	
 	tsfile_backend_destroy(backend);
 	fclose(file);
@@ -421,6 +1000,30 @@ int tse_export_workload(experiment_t* exp, exp_workload_t* ewl, void* context) {
 	return CMD_OK;
 }
 
+static int tse_export_job(void* context, int idx) {
+	struct tse_export_jobs* jobs = (struct tse_export_jobs*) context;
+
+	return tse_export_workload(jobs->exp, jobs->ewllist[idx], jobs->ctx);
+}
+
+int tse_export_workloads(experiment_t* exp, exp_workload_t** ewllist, int ewlcount, void* context) {
+	struct tse_export_context* ctx = (struct tse_export_context*) context;
+	struct tse_export_jobs jobs;
+
+	if(!ctx->have_dest) {
+		/* -d flag was not provided - use experiment dir. Couldn't do this
+		 * inside tse_export, cause it has no experiment we get it in tse_report_common() */
+		path_join(ctx->dest_path, PATHMAXLEN, exp->exp_root, exp->exp_directory, NULL);
+		ctx->have_dest = B_TRUE;
+	}
+
+	jobs.exp = exp;
+	jobs.ewllist = ewllist;
+	jobs.ctx = ctx;
+
+	return tse_report_run_jobs(ctx->nthreads, ewlcount, tse_export_job, &jobs);
+}
+
 static void tse_add_option(list_head_t* options, const char* optarg) {
 	struct tse_export_option* opt = mp_malloc(sizeof(struct tse_export_option));
 
@@ -470,10 +1073,11 @@ int tse_export(experiment_t* root, int argc, char* argv[]) {
 
 	ctx.have_dest = B_FALSE;
 	ctx.external_dest = B_FALSE;
+	ctx.nthreads = 1;
 
 	list_head_init(&ctx.options, "tse_export_opts");
 
-	while((c = plat_getopt(argc, argv, "F:o:d:")) != -1) {
+	while((c = plat_getopt(argc, argv, "F:o:d:j:")) != -1) {
 		switch(c) {
 		case 'F':
 			strncpy(ctx.backend_name, optarg, 8);
@@ -487,8 +1091,15 @@ int tse_export(experiment_t* root, int argc, char* argv[]) {
 		case 'o':
 			tse_add_option(&ctx.options, optarg);
 			break;
+		case 'j':
+			ret = tse_report_parse_jobs(optarg, &ctx.nthreads);
+			if(ret != CMD_OK) {
+				tse_destroy_options(&ctx.options);
+				return ret;
+			}
+			break;
 		case '?':
-			if(optopt == 'F' || optopt == 'd' || optopt == 'o')
+			if(optopt == 'F' || optopt == 'd' || optopt == 'o' || optopt == 'j')
 				tse_command_error_msg(CMD_INVALID_OPT, "-%c option requires an argument\n", optopt);
 			else
 				tse_command_error_msg(CMD_INVALID_OPT, "Unknown option `-%c'.\n", optopt);
@@ -501,7 +1112,7 @@ int tse_export(experiment_t* root, int argc, char* argv[]) {
 	}
 
 	ret = tse_report_common(root, argc, argv,
-						    flags, tse_export_workload, &ctx);
+						    flags, tse_export_workloads, &ctx);
 
 	tse_destroy_options(&ctx.options);
 
@@ -46,6 +46,28 @@ ts_time_t tse_run_intr_poll_interval = 1 * T_SEC;
 
 ts_time_t tse_run_wl_start_delay = 1 * T_SEC;
 
+/**
+ * Size of write-behind buffer (in requests) of workload output files.
+ * Set to 0 to commit tsfile superblock after each batch of reported requests.
+ */
+unsigned tse_run_tsfile_wb_size = 1024;
+
+#define TSE_RUN_REPORT_BATCH_SIZE	64
+
+/**
+ * Batch of requests that belong to a single workload. Requests are reported
+ * by threadpools in order of their arrival, so workloads are interleaved in
+ * request list, but we want to write them with one tsfile_add() call.
+ */
+typedef struct {
+	workload_t* wl;
+	exp_workload_t* ewl;
+
+	char* entries;
+	unsigned count;
+	unsigned size;
+} tse_run_report_batch_t;
+
 experiment_t* running = NULL;
 static thread_mutex_t	running_lock;
 boolean_t interrupted = B_FALSE;
@@ -208,21 +230,51 @@ int experiment_create_steps(experiment_t* exp, experiment_t* base) {
 	return ctx.error;
 }
 
-static void tse_run_report_request(request_t* rq) {
-	exp_workload_t* ewl = hash_map_find(running->exp_workloads,
-						  			    rq->rq_workload->wl_name);
+static tse_run_report_batch_t* tse_run_report_get_batch(tse_run_report_batch_t** p_batches,
+														 int* p_batch_count, workload_t* wl) {
+	tse_run_report_batch_t* batch;
+	exp_workload_t* ewl;
+	int bi;
+
+	for(bi = 0; bi < *p_batch_count; ++bi) {
+		batch = &(*p_batches)[bi];
+
+		if(batch->wl == wl)
+			return batch;
+	}
+
+	ewl = hash_map_find(running->exp_workloads, wl->wl_name);
+	assert(ewl != NULL);
+
+	*p_batches = mp_realloc(*p_batches, (bi + 1) * sizeof(tse_run_report_batch_t));
+	*p_batch_count = bi + 1;
+
+	batch = &(*p_batches)[bi];
+
+	batch->wl = wl;
+	batch->ewl = ewl;
+	batch->count = 0;
+	batch->size = TSE_RUN_REPORT_BATCH_SIZE;
+	batch->entries = mp_malloc(batch->size * ewl->wl_file_schema->hdr.entry_size);
+
+	return batch;
+}
+
+static void tse_run_report_request(tse_run_report_batch_t* batch, request_t* rq) {
 	exp_request_entry_t* rqe;
 
 	size_t rqparams_size = rq->rq_workload->wl_type->wlt_rqparams_size;
 
-	size_t rqe_size;
+	size_t rqe_size = batch->ewl->wl_file_schema->hdr.entry_size;
 	ptrdiff_t rqparams_start;
 
-	assert(ewl != NULL);
-
-	rqe_size = ewl->wl_file_schema->hdr.entry_size;
+	if(batch->count == batch->size) {
+		batch->size *= 2;
+		batch->entries = mp_realloc(batch->entries, batch->size * rqe_size);
+	}
 
-	rqe = mp_malloc(rqe_size);
+	rqe = (exp_request_entry_t*) (batch->entries + batch->count * rqe_size);
+	++batch->count;
 
 	rqe->rq_step = rq->rq_step;
 	rqe->rq_request = rq->rq_id;
@@ -249,26 +301,46 @@ static void tse_run_report_request(request_t* rq) {
 	/* Write raw rqparams */
 	assert((rqe_size - rqparams_start) >= rqparams_size);
 	memcpy(((char*) rqe) + rqparams_start, rq->rq_params, rqparams_size);
-
-	tsfile_add(ewl->wl_file, rqe, 1);
-
-	mp_free(rqe);
 }
 
 void tse_run_requests_report(list_head_t* rq_list) {
 	request_t *rq_root, *rq;
+	tse_run_report_batch_t* batches = NULL;
+	tse_run_report_batch_t* batch = NULL;
+	int batch_count = 0;
+	int bi, err;
 	int count = 0;
 
 	list_for_each_entry(request_t, rq_root, rq_list, rq_node) {
 		rq = rq_root;
 		do {
-			tse_run_report_request(rq);
+			/* Requests of the same workload usually go in a row,
+			 * so try last batch first */
+			if(batch == NULL || batch->wl != rq->rq_workload)
+				batch = tse_run_report_get_batch(&batches, &batch_count, rq->rq_workload);
+
+			tse_run_report_request(batch, rq);
 
 			rq = rq->rq_chain_next;
 			++count;
 		} while(rq != NULL);
 	}
 
+	for(bi = 0; bi < batch_count; ++bi) {
+		batch = &batches[bi];
+
+		err = tsfile_add(batch->ewl->wl_file, batch->entries, batch->count);
+		if(err != TSFILE_OK) {
+			logmsg(LOG_WARN, "Failed to write %u requests of workload '%s' to tsfile: error %d",
+				   batch->count, batch->ewl->wl_name, err);
+		}
+
+		mp_free(batch->entries);
+	}
+
+	if(batches != NULL)
+		mp_free(batches);
+
 	if(count > 0) {
 		/* TODO: Report per-workload statistics */
 		tse_printf(TSE_PRINT_NOLOG, "Reported %d requests\n", count);
@@ -349,6 +421,10 @@ int tse_run_wl_configure_walk(hm_item_t* item, void* context) {
 		return HM_WALKER_STOP;
 	}
 
+	if(ewl->wl_file != NULL) {
+		tsfile_set_buffered(ewl->wl_file, tse_run_tsfile_wb_size);
+	}
+
 	mutex_lock(&running->exp_mutex);
 	++running->exp_wl_count;
 	++running->exp_wl_configuring_count;
@@ -454,6 +530,11 @@ int tse_run_wl_unconfigure_walk(hm_item_t* item, void* context) {
 	if(ewl->wl_status != EXPERIMENT_NOT_CONFIGURED) {
 		tsload_unconfigure_workload(ewl->wl_name);
 
+		/* No more requests would be reported, so commit buffered ones */
+		if(ewl->wl_file != NULL) {
+			tsfile_flush(ewl->wl_file);
+		}
+
 		tse_printf(TSE_PRINT_NOLOG,
 				"Unconfigured workload '%s' (status: %d)\n",
 				ewl->wl_name, ewl->wl_status);
@@ -918,6 +999,7 @@ int run_init(void) {
 	mutex_init(&running_lock, "running_lock");
 
 	tuneit_set_int(ts_time_t, tse_run_wl_start_delay);
+	tuneit_set_int(unsigned, tse_run_tsfile_wb_size);
 
 	return 0;
 }
@@ -33,6 +33,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <assert.h>
 
 /* TODO: Implement TSFile steps */
@@ -41,22 +42,58 @@ int step_get_step_file(steps_file_t* sf, long* step_id, unsigned* p_num_rqs);
 int step_get_step_const(steps_const_t* sc, long* step_id, unsigned* p_num_rqs);
 int step_get_step_trace(steps_trace_t* st, long* p_step_id, unsigned* p_num_rqs, list_head_t* rq_list);
 
-typedef struct step_workload_trace {
-	list_head_t requests;
-
-	exp_workload_t* ewl;
-	list_node_t node;
-} step_workload_trace_t;
+#define STEP_TRACE_PREFETCH_IDLE		0
+#define STEP_TRACE_PREFETCH_REQUESTED	1
+#define STEP_TRACE_PREFETCH_RUNNING		2
+#define STEP_TRACE_PREFETCH_DONE		3
 
 typedef struct step_request_trace {
 	list_node_t node;
 	struct step_request_trace* chain_next;
 
-	exp_request_entry_t* rqe;
+	const exp_request_entry_t* rqe;
 	void* rq_params;
 } step_request_trace_t;
 
-step_request_trace_t* step_trace_create_rq(exp_workload_t* ewl);
+/**
+ * Requests of a single step fetched from base experiment. TSFile is read in batches
+ * of STEP_TRACE_READ_BATCH entries and entries of the step are copied into arena,
+ * so memory is used only for one step even if entries of file are decoded
+ * (TSFile v2). Arenas are reused between steps, so fetching doesn't allocate
+ * memory for each request.
+ */
+#define STEP_TRACE_READ_BATCH	4096
+
+typedef struct step_trace_arena {
+	step_request_trace_t* rqs;
+	char* entries;
+	unsigned count;
+	unsigned size;
+
+	char* batch;			/* Buffer for entries read from file */
+
+	long step_id;
+	unsigned next_index;	/* Index of entry where scanning was stopped */
+} step_trace_arena_t;
+
+typedef struct step_workload_trace {
+	list_head_t requests;
+
+	exp_workload_t* ewl;
+
+	size_t entry_size;
+	uint32_t rq_count;
+
+	step_trace_arena_t* arena;
+	step_trace_arena_t* prefetch;
+	step_trace_arena_t arenas[2];
+
+	list_node_t node;
+} step_workload_trace_t;
+
+static thread_result_t step_trace_prefetch_thread(thread_arg_t arg);
+static void step_trace_arena_init(step_trace_arena_t* arena);
+static void step_trace_arena_destroy(step_trace_arena_t* arena);
 int step_trace_fetch_step(experiment_t* exp, step_workload_trace_t* stwl, long step_id, unsigned num_rqs);
 void step_trace_insert_rq(step_request_trace_t* strq, step_workload_trace_t* stwl);
 void step_trace_destroy_rqs(step_workload_trace_t* stwl);
@@ -133,6 +170,14 @@ steps_generator_t* step_create_trace(steps_generator_t* parent, experiment_t* ba
 
 	list_head_init(&sg->sg_trace.st_wl_chain, "st-wl-%s", ewl->wl_name);
 
+	mutex_init(&sg->sg_trace.st_prefetch_mutex, "st-prefetch-%s", ewl->wl_name);
+	cv_init(&sg->sg_trace.st_prefetch_cv, "st-prefetch-%s", ewl->wl_name);
+
+	sg->sg_trace.st_prefetch_started = B_FALSE;
+	sg->sg_trace.st_prefetch_dead = B_FALSE;
+	sg->sg_trace.st_prefetch_state = STEP_TRACE_PREFETCH_IDLE;
+	sg->sg_trace.st_prefetch_step = -1;
+
 	do {
 		base_ewl = hash_map_find(base->exp_workloads, ewl->wl_name);
 
@@ -147,25 +192,58 @@ steps_generator_t* step_create_trace(steps_generator_t* parent, experiment_t* ba
 		list_head_init(&swt->requests, "swt-%s", ewl->wl_name);
 		list_node_init(&swt->node);
 
+		step_trace_arena_init(&swt->arenas[0]);
+		step_trace_arena_init(&swt->arenas[1]);
+		swt->arena = &swt->arenas[0];
+		swt->prefetch = &swt->arenas[1];
+
 		list_add_tail(&swt->node, &sg->sg_trace.st_wl_chain);
 
+		/* Index requests by their steps */
+		swt->entry_size = base_ewl->wl_file_schema->hdr.entry_size;
+		if(tsfile_get_count(base_ewl->wl_file, &swt->rq_count) != TSFILE_OK ||
+		   tsfile_set_index(base_ewl->wl_file, "rq_step") != TSFILE_OK) {
+			step_destroy(sg);
+			return NULL;
+		}
+
 		ewl = ewl->wl_chain_next;
 	} while(ewl != NULL);
 
+	t_init(&sg->sg_trace.st_prefetch_thread, (void*) &sg->sg_trace,
+		   step_trace_prefetch_thread, "st-prefetch-%s", sg->sg_trace.st_ewl->wl_name);
+	sg->sg_trace.st_prefetch_started = B_TRUE;
+
 	return sg;
 }
 
 void step_destroy_trace(steps_generator_t* sg) {
+	steps_trace_t* st = &sg->sg_trace;
 	step_workload_trace_t* swt;
 	step_workload_trace_t* swt_next;
 
+	if(st->st_prefetch_started) {
+		mutex_lock(&st->st_prefetch_mutex);
+		st->st_prefetch_dead = B_TRUE;
+		cv_notify_all(&st->st_prefetch_cv);
+		mutex_unlock(&st->st_prefetch_mutex);
+
+		t_destroy(&st->st_prefetch_thread);
+	}
+
 	list_for_each_entry_safe(step_workload_trace_t, swt, swt_next,
-			                 &sg->sg_trace.st_wl_chain, node) {
+			                 &st->st_wl_chain, node) {
 		assert(list_empty(&swt->requests));
 
+		step_trace_arena_destroy(&swt->arenas[0]);
+		step_trace_arena_destroy(&swt->arenas[1]);
+
 		list_del(&swt->node);
 		mp_free(swt);
 	}
+
+	cv_destroy(&st->st_prefetch_cv);
+	mutex_destroy(&st->st_prefetch_mutex);
 }
 
 static long step_parse_line(char* line) {
@@ -274,6 +352,14 @@ int step_get_step_trace(steps_trace_t* st, long* p_step_id, unsigned* p_num_rqs,
 	if(ret != STEP_OK)
 		return ret;
 
+	/* Wait until prefetching is finished so arenas are not modified */
+	mutex_lock(&st->st_prefetch_mutex);
+	while(st->st_prefetch_state == STEP_TRACE_PREFETCH_REQUESTED ||
+		  st->st_prefetch_state == STEP_TRACE_PREFETCH_RUNNING) {
+		cv_wait(&st->st_prefetch_cv, &st->st_prefetch_mutex);
+	}
+	mutex_unlock(&st->st_prefetch_mutex);
+
 	/* Fetch */
 	num_rqs_chained = num_requests;
 	list_for_each_entry(step_workload_trace_t, stwl,
@@ -359,93 +445,222 @@ end:
 		step_trace_destroy_rqs(stwl);
 	}
 
+	if(ret == STEP_OK) {
+		/* Start prefetching of next step while this one is running */
+		mutex_lock(&st->st_prefetch_mutex);
+		st->st_prefetch_step = step_id + 1;
+		st->st_prefetch_state = STEP_TRACE_PREFETCH_REQUESTED;
+		cv_notify_all(&st->st_prefetch_cv);
+		mutex_unlock(&st->st_prefetch_mutex);
+	}
+
 	return ret;
 }
 
-step_request_trace_t* step_trace_create_rq(exp_workload_t* ewl) {
+static void step_trace_arena_init(step_trace_arena_t* arena) {
+	arena->rqs = NULL;
+	arena->entries = NULL;
+	arena->count = 0;
+	arena->size = 0;
+
+	arena->batch = NULL;
+
+	arena->step_id = -1;
+	arena->next_index = 0;
+}
+
+static void step_trace_arena_destroy(step_trace_arena_t* arena) {
+	if(arena->rqs != NULL)
+		mp_free(arena->rqs);
+	if(arena->entries != NULL)
+		mp_free(arena->entries);
+	if(arena->batch != NULL)
+		mp_free(arena->batch);
+}
+
+static void step_trace_arena_reset(step_trace_arena_t* arena, long step_id, unsigned index) {
+	arena->count = 0;
+	arena->step_id = step_id;
+	arena->next_index = index;
+}
+
+/**
+ * Scan entries beginning from arena->next_index until num_rqs requests of arena's
+ * step are collected or end index is reached. Because order of requests inside this
+ * file is undetermined, requests of the step may be found after beginning of next
+ * step (which is also an entry from the step index). For example we need to load
+ * 5 requests of step 3:
+ *
+ * (2, 5) (3, 0) (2, 6) (3, 1) (3, 3) (3, 2) (3, 3) (4, 0) (3, 4) (4, 1)
+ *        ^index[3]                                 ^index[4]     |
+ *                                                                + exit here
+ * tuples are (rq_step, rq_id)
+ *
+ * Returns TSFILE_OK or TSFile error code if entries couldn't be read.
+ */
+static int step_trace_scan(step_workload_trace_t* stwl, step_trace_arena_t* arena,
+						   unsigned num_rqs, unsigned end) {
+	tsfile_t* file = stwl->ewl->wl_file;
+	size_t entry_size = stwl->entry_size;
+
+	const exp_request_entry_t* rqe;
 	step_request_trace_t* strq;
-	size_t rqe_size;
+	unsigned index = arena->next_index;
+	unsigned batch_start, batch_end;
+	unsigned rqi;
+	int ret = TSFILE_OK;
 
-	rqe_size = ewl->wl_file_schema->hdr.entry_size;
+	if(arena->batch == NULL)
+		arena->batch = mp_malloc(STEP_TRACE_READ_BATCH * entry_size);
 
-	strq = mp_malloc(rqe_size + sizeof(step_request_trace_t));
+	while(index < end && arena->count < num_rqs) {
+		batch_start = index;
+		batch_end = min(batch_start + STEP_TRACE_READ_BATCH, end);
 
-	list_node_init(&strq->node);
-	strq->chain_next = NULL;
+		ret = tsfile_get_entries(file, arena->batch, batch_start, batch_end);
+		if(ret != TSFILE_OK)
+			break;
 
-	strq->rqe = 
-		(exp_request_entry_t*) (((unsigned long) strq) + sizeof(step_request_trace_t));
-	strq->rq_params = 
-		(void*) (((unsigned long) strq->rqe) + sizeof(exp_request_entry_t));
+		for( ; index < batch_end && arena->count < num_rqs; ++index) {
+			rqe = (const exp_request_entry_t*) (arena->batch + (index - batch_start) * entry_size);
 
-	return strq;
+			if(((long) rqe->rq_step) != arena->step_id)
+				continue;
+
+			if(arena->count == arena->size) {
+				arena->size = (arena->size == 0) ? 256 : arena->size * 2;
+				arena->rqs = mp_realloc(arena->rqs, arena->size * sizeof(step_request_trace_t));
+				arena->entries = mp_realloc(arena->entries, arena->size * entry_size);
+			}
+
+			strq = arena->rqs + arena->count;
+
+			list_node_init(&strq->node);
+			strq->chain_next = NULL;
+
+			memcpy(arena->entries + arena->count * entry_size, rqe, entry_size);
+			++arena->count;
+		}
+	}
+
+	arena->next_index = index;
+
+	/* Entries may be moved by realloc, so point requests to them after scan */
+	for(rqi = 0; rqi < arena->count; ++rqi) {
+		strq = arena->rqs + rqi;
+
+		strq->rqe = (const exp_request_entry_t*) (arena->entries + rqi * entry_size);
+		strq->rq_params = (void*) (((const char*) strq->rqe) + sizeof(exp_request_entry_t));
+	}
+
+	return ret;
 }
 
-int step_trace_fetch_step(experiment_t* exp, step_workload_trace_t* stwl, long step_id, unsigned num_rqs) {
-	step_request_trace_t* strq;
-	exp_workload_t* ewl = stwl->ewl;
-	int next_index = -1;
-	int index = ewl->wl_file_index;
+/**
+ * Collect requests of the step which begin at index[step_id] and end
+ * at index[step_id + 1]. The rest of requests (which were reported late)
+ * are found by step_trace_fetch_step(). Called from prefetch thread.
+ */
+static void step_trace_prefetch_step(step_workload_trace_t* stwl, long step_id) {
+	tsfile_t* file = stwl->ewl->wl_file;
+	unsigned start, end;
 
-	unsigned fetched_rqs = 0;
-	int err;
+	stwl->prefetch->step_id = -1;
 
-	uint32_t rq_count = tsfile_get_count(ewl->wl_file);
-
-	/* Fetch requests for step. Because order of requests inside this file is undetermined
-	 * we save index of beginning of next step and scan entire file until all num_rqs are
-	 * loaded (so if .tss file would be altered, trace would fail). For example we need to
-	 * load 5 requests of step 3:
-	 *
-	 * (2, 5) (3, 0) (2, 6) (3, 1) (3, 3) (3, 2) (3, 3) (4, 0) (3, 4) (4, 1)
-	 *        ^index                                    ^next_index   |
-	 *                                                                + exit here
-	 * tuples are (rq_step, rq_id)
-	 *  */
-
-	while(fetched_rqs < num_rqs) {
-		if(index == rq_count) {
-			/* Request count provided by upper generator differs
-			 * from number of reported requests. Trace failed :( */
-			tse_experiment_error_msg(exp, EXPERR_STEPS_END_OF_TRACE,
-									 "Workload '%s': TSFile ended prematurely on %d entry\n", 
-									  stwl->ewl->wl_name, index);
-			return STEP_ERROR;
+	if(tsfile_get_index(file, step_id, &start) != TSFILE_OK ||
+	   tsfile_get_index(file, step_id + 1, &end) != TSFILE_OK)
+		return;
+
+	step_trace_arena_reset(stwl->prefetch, step_id, start);
+
+	/* If file couldn't be read, step will be fetched again by step_trace_fetch_step() */
+	if(step_trace_scan(stwl, stwl->prefetch, UINT_MAX, end) != TSFILE_OK)
+		stwl->prefetch->step_id = -1;
+}
+
+static thread_result_t step_trace_prefetch_thread(thread_arg_t arg) {
+	THREAD_ENTRY(arg, steps_trace_t, st);
+	step_workload_trace_t* stwl;
+	long step_id;
+
+	mutex_lock(&st->st_prefetch_mutex);
+
+	while(!st->st_prefetch_dead) {
+		if(st->st_prefetch_state != STEP_TRACE_PREFETCH_REQUESTED) {
+			cv_wait(&st->st_prefetch_cv, &st->st_prefetch_mutex);
+			continue;
 		}
 
-		strq = step_trace_create_rq(ewl);
+		step_id = st->st_prefetch_step;
+		st->st_prefetch_state = STEP_TRACE_PREFETCH_RUNNING;
+		mutex_unlock(&st->st_prefetch_mutex);
 
-		while(index < rq_count) {
-			err = tsfile_get_entries(ewl->wl_file, strq->rqe, index, index + 1);
-			if(err != TSFILE_OK) {
-				tse_experiment_error_msg(exp, EXPERR_STEPS_TRACE_TSFILE_ERROR,
-										 "Workload '%s': TSFile read error: %d\n", 
-							             stwl->ewl->wl_name, err);
+		list_for_each_entry(step_workload_trace_t, stwl, &st->st_wl_chain, node) {
+			step_trace_prefetch_step(stwl, step_id);
+		}
 
-				mp_free(strq);
-				return STEP_ERROR;
-			}
+		mutex_lock(&st->st_prefetch_mutex);
+		st->st_prefetch_state = STEP_TRACE_PREFETCH_DONE;
+		cv_notify_all(&st->st_prefetch_cv);
+	}
 
-			if(strq->rqe->rq_step == step_id) {
-				/* This is request of current step - link it */
-				step_trace_insert_rq(strq, stwl);
-				++index;
-				++fetched_rqs;
-				break;
-			}
-			else if((strq->rqe->rq_step > step_id) && next_index == -1) {
-				/* Found beginning of next step */
-				next_index = index;
-			}
+	mutex_unlock(&st->st_prefetch_mutex);
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
 
-			++index;
+int step_trace_fetch_step(experiment_t* exp, step_workload_trace_t* stwl, long step_id, unsigned num_rqs) {
+	step_trace_arena_t* arena;
+	exp_workload_t* ewl = stwl->ewl;
+	unsigned index;
+	unsigned rqi;
+	int err;
+
+	if(stwl->prefetch->step_id == step_id) {
+		arena = stwl->prefetch;
+		stwl->prefetch = stwl->arena;
+		stwl->arena = arena;
+
+		/* Prefetch collects all requests from the step, but
+		 * upper generator may need less of them */
+		if(arena->count > num_rqs)
+			arena->count = num_rqs;
+	}
+	else {
+		arena = stwl->arena;
+
+		err = tsfile_get_index(ewl->wl_file, step_id, &index);
+		if(err != TSFILE_OK) {
+			tse_experiment_error_msg(exp, EXPERR_STEPS_TRACE_TSFILE_ERROR,
+									 "Workload '%s': TSFile read error: %d\n",
+									 ewl->wl_name, err);
+			return STEP_ERROR;
 		}
+
+		step_trace_arena_reset(arena, step_id, index);
 	}
 
-	if(next_index == -1)
-		next_index = index;
+	err = step_trace_scan(stwl, arena, num_rqs, stwl->rq_count);
+	if(err != TSFILE_OK) {
+		tse_experiment_error_msg(exp, EXPERR_STEPS_TRACE_TSFILE_ERROR,
+								 "Workload '%s': TSFile read error: %d\n",
+								 ewl->wl_name, err);
+		return STEP_ERROR;
+	}
 
-	ewl->wl_file_index = next_index;
+	if(arena->count < num_rqs) {
+		/* Request count provided by upper generator differs
+		 * from number of reported requests. Trace failed :( */
+		tse_experiment_error_msg(exp, EXPERR_STEPS_END_OF_TRACE,
+								 "Workload '%s': TSFile ended prematurely on %d entry\n",
+								  ewl->wl_name, arena->next_index);
+		return STEP_ERROR;
+	}
+
+	for(rqi = 0; rqi < arena->count; ++rqi) {
+		step_trace_insert_rq(arena->rqs + rqi, stwl);
+	}
 
 	return STEP_OK;
 }
@@ -479,9 +694,9 @@ void step_trace_destroy_rqs(step_workload_trace_t* stwl) {
 	step_request_trace_t* strq;
 	step_request_trace_t* strq_next;
 
+	/* Requests are kept in arena, so only unlink them */
 	list_for_each_entry_safe(step_request_trace_t, strq, strq_next, &stwl->requests, node) {
 		list_del(&strq->node);
-		mp_free(strq);
 	}
 }
 
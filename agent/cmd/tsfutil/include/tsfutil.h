@@ -31,6 +31,9 @@
 #define COMMAND_ADD			1
 #define COMMAND_GET_COUNT	2
 #define COMMAND_GET_ENTRIES 3
+#define COMMAND_CONVERT		4
+
+#define TSFUTIL_CONVERT_BATCH	4096
 
 #endif /* TSFUTIL_H_ */
 
@@ -50,6 +50,10 @@ extern boolean_t tsfutil_json_print_one;
 char file_path[PATHMAXLEN];
 boolean_t use_std_streams = B_FALSE;
 
+/* Format of created or converted file */
+tsfile_format_t format = { TSFILE_VERSION_V2, TSFILE_CHUNK_ROWS, TSFILE_CODEC_NONE };
+boolean_t format_set = B_FALSE;
+
 int init(void);
 void usage(int ret, const char* reason, ...);
 
@@ -84,6 +88,7 @@ void parse_options_args(int argc, char* const argv[]) {
 	int ok = 1;
 	int c;
 	int argi;
+	int codec;
 
 	boolean_t s_flag = B_FALSE;
 
@@ -134,12 +139,15 @@ void parse_options_args(int argc, char* const argv[]) {
 	else if(strcmp(argv[argi], "create") == 0) {
 		command = COMMAND_CREATE;
 	}
+	else if(strcmp(argv[argi], "convert") == 0) {
+		command = COMMAND_CONVERT;
+	}
 	else {
 		usage(1, "Unknown subcommand '%s'\n", argv[argi]);
 	}
 	++optind;
 
-	while((c = plat_getopt(argc, argv, "g:o:")) != -1) {
+	while((c = plat_getopt(argc, argv, "g:o:V:C:r:")) != -1) {
 		switch(c) {
 		case 'g':
 			if(parse_get_range(optarg) != 0) {
@@ -153,6 +161,28 @@ void parse_options_args(int argc, char* const argv[]) {
 				usage(1, "Unknown backend option '%s'\n", optarg);
 			}
 			break;
+		case 'V':
+			format.version = strtol(optarg, NULL, 10);
+			if(format.version != TSFILE_VERSION && format.version != TSFILE_VERSION_V2) {
+				usage(1, "Invalid tsfile version '%s'\n", optarg);
+			}
+			format_set = B_TRUE;
+			break;
+		case 'C':
+			codec = tsfile_codec_from_name(optarg);
+			if(codec < 0) {
+				usage(1, "Unknown or unsupported codec '%s'\n", optarg);
+			}
+			format.codec = codec;
+			format_set = B_TRUE;
+			break;
+		case 'r':
+			format.chunk_rows = strtol(optarg, NULL, 10);
+			if(format.chunk_rows == 0 || format.chunk_rows > TSFILE_MAX_CHUNK_ROWS) {
+				usage(1, "Invalid number of entries in chunk '%s'\n", optarg);
+			}
+			format_set = B_TRUE;
+			break;
 		case '?':
 			usage(1, "Unknown option `-%c'.\n", optopt);
 			break;
@@ -171,6 +201,9 @@ void parse_options_args(int argc, char* const argv[]) {
 	if(argi < argc) {
 		strncpy(file_path, argv[argi], PATHMAXLEN);
 	}
+	else if(command == COMMAND_CONVERT) {
+		usage(1, "Missing destination tsf-file\n");
+	}
 	else {
 		use_std_streams = B_TRUE;
 	}
@@ -206,6 +239,46 @@ void tsfutil_error_msg(ts_errcode_t errcode, const char* format, ...) {
 	logmsg(LOG_CRIT, error);
 }
 
+/**
+ * Copy entries of src to file_path created with specified format. Entries
+ * are copied chunk by chunk if src is v2 file.
+ */
+int convert_file(tsfile_t* src, tsfile_schema_t* schema) {
+	tsfile_t* dst = tsfile_create_ex(file_path, schema, &format);
+	const void* entries;
+	uint32_t count;
+	unsigned start, batch_end;
+	int ret = 0;
+
+	if(dst == NULL)
+		return 1;
+
+	/* Write v2 files by full chunks and v1 files by large batches */
+	tsfile_set_buffered(dst, TSFUTIL_CONVERT_BATCH);
+
+	if(tsfile_get_count(src, &count) != TSFILE_OK) {
+		tsfile_close(dst);
+		return 1;
+	}
+
+	for(start = 0; start < count; start = batch_end) {
+		batch_end = tsfile_map_batch(src, start, min(count, start + TSFUTIL_CONVERT_BATCH));
+
+		entries = tsfile_map_entries(src, start, batch_end);
+		if(entries == NULL ||
+		   tsfile_add(dst, (void*) entries, batch_end - start) != TSFILE_OK) {
+			ret = 1;
+			break;
+		}
+	}
+
+	if(ret == 0 && tsfile_flush(dst) != TSFILE_OK)
+		ret = 1;
+
+	tsfile_close(dst);
+	return ret;
+}
+
 int do_command(void) {
 	tsfile_t* ts_file;
 	tsfile_schema_t* schema = tsfile_schema_read(schema_path);
@@ -223,22 +296,34 @@ int do_command(void) {
 	}
 	
 	if(command == COMMAND_CREATE) {
-		ts_file = tsfile_create(tsf_path, schema);
+		if(format_set)
+			ts_file = tsfile_create_ex(tsf_path, schema, &format);
+		else
+			ts_file = tsfile_create(tsf_path, schema);
 	}
 	else {
 		ts_file = tsfile_open(tsf_path, schema);
 	}
 
-	mp_free(schema);
 	if(ts_file == NULL) {
+		mp_free(schema);
 		return 1;
 	}
 	
 	if(command != COMMAND_CREATE) {
 		if(command == COMMAND_GET_COUNT) {
-			uint32_t count = tsfile_get_count(ts_file);
+			uint32_t count;
+
+			if(tsfile_get_count(ts_file, &count) != TSFILE_OK) {
+				ret = 1;
+				goto end;
+			}
+
 			fprintf(stdout, "%lu\n", (unsigned long) count);
 		}
+		else if(command == COMMAND_CONVERT) {
+			ret = convert_file(ts_file, schema);
+		}
 		else {
 			file = tsfutil_open_file();
 
@@ -250,11 +335,17 @@ int do_command(void) {
 			tsfile_backend_set_files(backend, file, ts_file);
 
 			if(command == COMMAND_GET_ENTRIES) {
+				uint32_t count;
+
 				if(end == -1) {
-					end = (int) tsfile_get_count(ts_file);
+					if(tsfile_get_count(ts_file, &count) != TSFILE_OK)
+						ret = 1;
+
+					end = (int) count;
 				}
 
-				ret = tsfile_backend_get(backend, start, end);
+				if(ret == 0)
+					ret = tsfile_backend_get(backend, start, end);
 			}
 			else if(command == COMMAND_ADD) {
 				ret = tsfile_backend_add(backend);
@@ -269,6 +360,7 @@ end:
 		fputs("Failure occured. See log for details\n", stderr);
 	}
 
+	mp_free(schema);
 	tsfile_close(ts_file);
 	return ret;
 }
@@ -26,6 +26,7 @@
 #include <tsload/errcode.h>
 #include <tsload/time.h>
 #include <tsload/atomic.h>
+#include <tsload/filemmap.h>
 
 #include <tsload/json/json.h>
 
@@ -37,6 +38,11 @@
 #define TSFILE_MAGIC_LEN	6
 #define TSFILE_MAGIC		"TSFILE"
 #define TSFILE_VERSION		1
+#define TSFILE_VERSION_V2	2
+
+/* Default and maximum number of entries in column chunk of v2 file */
+#define TSFILE_CHUNK_ROWS		16384
+#define TSFILE_MAX_CHUNK_ROWS	(1 << 20)
 
 #define SBCOUNT			4
 #define SBMASK			(SBCOUNT - 1)
@@ -50,6 +56,7 @@
 typedef struct tsfile_sb {
 	ts_time_t 	time;
 	uint32_t	count;
+	uint32_t	chunks;		/* Number of committed chunks (v2 only) */
 } tsfile_sb_t;
 
 typedef enum tsfile_ftype {
@@ -86,8 +93,46 @@ typedef struct tsfile_header {
 
 	tsfile_sb_t		sb[SBCOUNT];
 	tsfile_schema_t schema;
+
+	/* Column chunks format (v2 only) */
+	uint32_t		chunk_rows;
+	uint16_t		codec;
+	uint16_t		pad;
 } tsfile_header_t;
 
+typedef enum tsfile_codec {
+	TSFILE_CODEC_NONE,
+	TSFILE_CODEC_LZ4,
+	TSFILE_CODEC_ZSTD,
+
+	TSFILE_CODEC_MAX
+} tsfile_codec_t;
+
+/**
+ * Format of created tsfile (see tsfile_create_ex())
+ *
+ * @member version TSFILE_VERSION for row-oriented file or TSFILE_VERSION_V2 \
+ * 		   for file which keeps entries in compressed column chunks
+ * @member chunk_rows number of entries in a chunk
+ * @member codec block compression codec applied to chunk columns
+ */
+typedef struct tsfile_format {
+	int				version;
+	uint32_t		chunk_rows;
+	tsfile_codec_t	codec;
+} tsfile_format_t;
+
+struct tsfile_chunks;
+
+/**
+ * Element of tsfile index: first entry with key greater than keys
+ * of all previous entries. Elements are sorted by key.
+ */
+typedef struct tsfile_index_key {
+	uint64_t		key;
+	uint32_t		index;
+} tsfile_index_key_t;
+
 typedef struct tsfile {
 	tsfile_header_t* header;
 
@@ -100,6 +145,28 @@ typedef struct tsfile {
 	int				cur_sb;
 	thread_mutex_t	mutex;
 
+	/* Write-behind buffer (see tsfile_set_buffered()) */
+	void*			wb_entries;
+	unsigned		wb_count;
+	unsigned		wb_size;
+
+	/* Read-only mapping of file (see tsfile_map_entries()) */
+	mmap_file_t		mmf;
+	boolean_t		map_opened;
+	void*			map_area;
+	uint32_t		map_count;
+
+	/* Index of integer key field (see tsfile_set_index()) */
+	int				idx_field;
+	tsfile_index_key_t* idx_entries;
+	uint32_t		idx_size;
+	uint32_t		idx_nkeys;
+	int64_t			idx_max_key;
+	uint32_t		idx_count;
+
+	/* Column chunks of v2 file (see chunk.c) */
+	struct tsfile_chunks* chunks;
+
 	json_node_t**		node_cache;
 
 	int 			node_first;
@@ -133,6 +200,10 @@ LIBEXPORT void tsfile_register_error_msg_func(tsfile_error_msg_func func);
 #define		TSFILE_SB_FAIL	   -1
 #define 	TSFILE_DATA_FAIL   -2
 #define 	TSFILE_INVAL_RANGE -3
+#define 	TSFILE_INVAL_FIELD -4
+
+#define TSFILE_FIELD_BIT(fi)	(((uint64_t) 1) << (fi))
+#define TSFILE_ALL_FIELDS		(~((uint64_t) 0))
 
 /* Schema API */
 
@@ -163,16 +234,38 @@ boolean_t tsfile_put_node(tsfile_t* file, json_node_t* node);
 
 void tsfile_fill_node(tsfile_t* file, json_node_t* node, void* entry);
 int tsfile_fill_entry(tsfile_t* file, json_node_t* node, void* entry);
+int tsfile_stream_entry(tsfile_t* file, json_stream_t* stream, const void* entry);
 
 /* TSFile API */
 
 LIBEXPORT tsfile_t* tsfile_create(const char* filename, tsfile_schema_t* schema);
+LIBEXPORT tsfile_t* tsfile_create_ex(const char* filename, tsfile_schema_t* schema,
+									 const tsfile_format_t* format);
 LIBEXPORT tsfile_t* tsfile_open(const char* filename, tsfile_schema_t* schema);
 LIBEXPORT void tsfile_close(tsfile_t* file);
 
+LIBEXPORT int tsfile_set_buffered(tsfile_t* file, unsigned wb_size);
+LIBEXPORT int tsfile_flush(tsfile_t* file);
+LIBEXPORT int tsfile_sync(tsfile_t* file);
+
 LIBEXPORT int tsfile_add(tsfile_t* file, void* entries, unsigned count);
-LIBEXPORT uint32_t tsfile_get_count(tsfile_t* file);
+LIBEXPORT int tsfile_get_count(tsfile_t* file, uint32_t* p_count);
 LIBEXPORT int tsfile_get_entries(tsfile_t* file, void* entries, unsigned start, unsigned end);
+LIBEXPORT int tsfile_get_fields(tsfile_t* file, void* entries, unsigned start, unsigned end,
+							    uint64_t field_mask);
+
+/* Pointer returned by tsfile_map_entries() is invalidated by the next mapping
+ * of the same file (made by tsfile_map_entries(), tsfile_get_index() or
+ * json_tsfile_get*()/json_tsfile_stream*() in any thread) and by tsfile_close().
+ * Copy entries with tsfile_get_entries() if they are needed for longer. */
+LIBEXPORT const void* tsfile_map_entries(tsfile_t* file, unsigned start, unsigned end);
+LIBEXPORT unsigned tsfile_map_batch(tsfile_t* file, unsigned start, unsigned end);
+
+LIBEXPORT int tsfile_find_field(tsfile_t* file, const char* field_name);
+LIBEXPORT int tsfile_codec_from_name(const char* name);
+
+LIBEXPORT int tsfile_set_index(tsfile_t* file, const char* field_name);
+LIBEXPORT int tsfile_get_index(tsfile_t* file, uint64_t key, unsigned* p_index);
 
 LIBEXPORT json_node_t* json_tsfile_get(tsfile_t* file, unsigned number);
 LIBEXPORT void json_tsfile_put(tsfile_t* file, json_node_t* node);
@@ -182,6 +275,9 @@ LIBEXPORT json_node_t* json_tsfile_get_array(tsfile_t* file, unsigned start, uns
 LIBEXPORT void json_tsfile_put_array(tsfile_t* file, json_node_t* node_array);
 LIBEXPORT int json_tsfile_add_array(tsfile_t* file, json_node_t* node_array);
 
+LIBEXPORT int json_tsfile_stream(tsfile_t* file, json_stream_t* stream, unsigned number);
+LIBEXPORT int json_tsfile_stream_array(tsfile_t* file, json_stream_t* stream, unsigned start, unsigned end);
+
 LIBEXPORT int tsfile_init(void);
 LIBEXPORT void tsfile_fini(void);
 
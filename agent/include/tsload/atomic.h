@@ -68,6 +68,11 @@ STATIC_INLINE long atomic_and(atomic_t* atom, long value) {
 	return  __atomic_fetch_and(atom, value, ATOMIC_MEMMODEL);
 }
 
+STATIC_INLINE boolean_t atomic_cas(atomic_t* atom, long oldval, long newval) {
+	return __atomic_compare_exchange_n(atom, &oldval, newval, B_FALSE,
+									   ATOMIC_MEMMODEL, ATOMIC_MEMMODEL);
+}
+
 #elif defined(HAVE_SYNC_BUILTINS)
 
 typedef volatile long atomic_t;
@@ -108,6 +113,10 @@ STATIC_INLINE long atomic_and(atomic_t* atom, long value) {
         return __sync_fetch_and_and(atom, value);
 }
 
+STATIC_INLINE boolean_t atomic_cas(atomic_t* atom, long oldval, long newval) {
+        return __sync_bool_compare_and_swap(atom, oldval, newval);
+}
+
 
 
 
@@ -162,6 +171,10 @@ STATIC_INLINE long atomic_and(atomic_t* atom, long value) {
 	return InterlockedAnd(atom, value);
 }
 
+STATIC_INLINE boolean_t atomic_cas(atomic_t* atom, long oldval, long newval) {
+	return InterlockedCompareExchange(atom, newval, oldval) == oldval;
+}
+
 
 #else
 
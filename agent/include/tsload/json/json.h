@@ -66,6 +66,52 @@ typedef struct json_buffer {
 	atomic_t    ref_count;
 } json_buffer_t;
 
+/**
+ * JSON arena
+ *
+ * If document is parsed with JSON_PARSE_ARENA flag, all of its nodes are allocated
+ * from a chain of large chunks that belong to arena, and strings reference parsed
+ * buffer which is held once by arena. Whole document is freed in one shot when
+ * root node is destroyed.
+ *
+ * @member ja_chunks list of chunks (most recent first)
+ * @member ja_buf buffer that was parsed
+ * @member ja_root root node of document
+ * @member ja_mixed heap nodes or strings were attached to arena nodes, so \
+ * 				   document has to be walked when it is destroyed
+ */
+#define JSON_ARENA_CHUNK_MIN		(64 * SZ_KB)
+#define JSON_ARENA_CHUNK_MAX		(16 * SZ_MB)
+
+typedef struct json_arena_chunk {
+	struct json_arena_chunk* jac_next;
+
+	size_t jac_size;
+	size_t jac_used;
+
+	/* Data follows header */
+} json_arena_chunk_t;
+
+typedef struct json_arena {
+	json_arena_chunk_t* ja_chunks;
+	size_t ja_chunk_size;
+
+	json_buffer_t* ja_buf;
+	struct json_node* ja_root;
+
+	boolean_t ja_mixed;
+} json_arena_t;
+
+/**
+ * Hash index of children of object node. Open addressing
+ * table with ji_mask + 1 slots, built lazily by json_find_opt()
+ * for nodes with at least json_index_min_children children.
+ */
+typedef struct json_index {
+	unsigned ji_mask;
+	struct json_node* ji_slots[1];
+} json_index_t;
+
 typedef enum {
 	/* Type hints */
 	JSON_ANY = -1,
@@ -95,6 +141,8 @@ typedef enum {
  * @member jn_child_head list of children
  * @member jn_touched that node was touched by json_get_* or json_find* operations. \
  * 						 Helps finding unused optional attributes (i.e. due to typo)
+ * @member jn_arena arena node was allocated from (NULL for heap nodes)
+ * @member jn_index hash index of children (if built)
  */
 typedef struct json_node {
 	struct json_node* jn_parent;
@@ -112,6 +160,9 @@ typedef struct json_node {
 
 	boolean_t 	jn_touched;
 
+	json_arena_t* jn_arena;
+	json_index_t* jn_index;
+
 	union {
 		int64_t		i;
 		double		d;
@@ -313,12 +364,109 @@ LIBEXPORT json_node_t* json_copy_node(json_node_t* node);
 
 LIBEXPORT void json_node_destroy(json_node_t* node);
 
+/**
+ * Parse flags
+ */
+#define JSON_PARSE_DEFAULT		0x0
+#define JSON_PARSE_ARENA		0x1
+
 LIBEXPORT int json_parse(json_buffer_t* buf, json_node_t** root);
+LIBEXPORT int json_parse_ex(json_buffer_t* buf, json_node_t** root, int flags);
+
+LIBEXPORT int json_select_scanner(const char* name);
+LIBEXPORT const char* json_scanner_name(void);
 
 LIBEXPORT size_t json_write_count(json_node_t* node, boolean_t formatted);
 LIBEXPORT int json_write_buf(json_node_t* node, char* buf, size_t len, boolean_t formatted);
 LIBEXPORT int json_write_file(json_node_t* node, FILE* file, boolean_t formatted);
 
+/**
+ * JSON stream
+ *
+ * Push-style writer which serializes values as they are passed to json_stream_*()
+ * calls, so large documents (like arrays of millions of requests) may be written
+ * without building a tree of json_node_t. Output is accumulated in an internal buffer
+ * which is flushed to FILE or file descriptor when it fills up, or grows if stream
+ * is kept in memory. Output is same as json_write_*() gives for equivalent tree.
+ *
+ * Errors are sticky: after first error all calls do nothing and return it.
+ *
+ * @member js_sink where buffer is flushed (JSON_STREAM_MEMORY, JSON_STREAM_FILE \
+ * 				   or JSON_STREAM_FD)
+ * @member js_buf buffer with data that is not yet flushed
+ * @member js_key key was written, so value is expected
+ * @member js_depth number of objects and arrays that are not closed yet
+ * @member js_count number of elements written on each level (level 0 is root)
+ * @member js_is_node level is an object (otherwise it is array or root)
+ */
+#define JSON_STREAM_MEMORY		0
+#define JSON_STREAM_FILE		1
+#define JSON_STREAM_FD			2
+
+#define JSON_STREAM_BUFSIZE		(64 * SZ_KB)
+#define JSON_STREAM_MAX_DEPTH	32
+
+typedef struct json_stream {
+	int js_sink;
+	FILE* js_file;
+	int js_fd;
+
+	char* js_buf;
+	size_t js_len;
+	size_t js_size;
+
+	boolean_t js_formatted;
+	boolean_t js_key;
+	int js_error;
+
+	int js_depth;
+	unsigned js_count[JSON_STREAM_MAX_DEPTH + 1];
+	boolean_t js_is_node[JSON_STREAM_MAX_DEPTH + 1];
+} json_stream_t;
+
+LIBEXPORT json_stream_t* json_stream_create(boolean_t formatted);
+LIBEXPORT json_stream_t* json_stream_create_file(FILE* file, boolean_t formatted);
+LIBEXPORT json_stream_t* json_stream_create_fd(int fd, boolean_t formatted);
+LIBEXPORT void json_stream_destroy(json_stream_t* stream);
+
+LIBEXPORT int json_stream_flush(json_stream_t* stream);
+LIBEXPORT const char* json_stream_data(json_stream_t* stream, size_t* len);
+
+LIBEXPORT int json_stream_begin_object(json_stream_t* stream, const char* node_class);
+LIBEXPORT int json_stream_end_object(json_stream_t* stream);
+LIBEXPORT int json_stream_begin_array(json_stream_t* stream);
+LIBEXPORT int json_stream_end_array(json_stream_t* stream);
+
+LIBEXPORT int json_stream_key(json_stream_t* stream, const char* name);
+
+LIBEXPORT int json_stream_null(json_stream_t* stream);
+LIBEXPORT int json_stream_integer(json_stream_t* stream, int64_t val);
+LIBEXPORT int json_stream_double(json_stream_t* stream, double val);
+LIBEXPORT int json_stream_string(json_stream_t* stream, const char* val);
+LIBEXPORT int json_stream_boolean(json_stream_t* stream, boolean_t val);
+LIBEXPORT int json_stream_node(json_stream_t* stream, json_node_t* node);
+
+STATIC_INLINE int json_stream_error(json_stream_t* stream) {
+	return stream->js_error;
+}
+
+STATIC_INLINE int json_stream_add_integer(json_stream_t* stream, const char* name, int64_t val) {
+	json_stream_key(stream, name);
+	return json_stream_integer(stream, val);
+}
+STATIC_INLINE int json_stream_add_double(json_stream_t* stream, const char* name, double val) {
+	json_stream_key(stream, name);
+	return json_stream_double(stream, val);
+}
+STATIC_INLINE int json_stream_add_string(json_stream_t* stream, const char* name, const char* val) {
+	json_stream_key(stream, name);
+	return json_stream_string(stream, val);
+}
+STATIC_INLINE int json_stream_add_boolean(json_stream_t* stream, const char* name, boolean_t val) {
+	json_stream_key(stream, name);
+	return json_stream_boolean(stream, val);
+}
+
 LIBEXPORT int json_init(void);
 LIBEXPORT void json_fini(void);
 
@@ -39,6 +39,8 @@
 #define RVHASHSIZE		8
 #define RVHASHMASK		(RVHASHSIZE - 1)
 
+#define RGBULKSIZE		256
+
 struct randgen_class;
 struct tsload_param;
 
@@ -89,6 +91,8 @@ typedef void (*randgen_func_t)(randgen_t* rg);
  * @member rg_init			function that initializes PRNG internal state
  * @member rg_destroy		function that frees PRNG internal state resources
  * @member rg_generate_int	generate next random number
+ * @member rg_generate_bulk	(optional) generate n random numbers at once. If it is set to NULL,
+ * 							rg_generate_bulk() would call rg_generate_int n times
  */
 typedef struct randgen_class {
 	AUTOSTRING char* rg_class_name;
@@ -106,6 +110,7 @@ typedef struct randgen_class {
 	void (*rg_destroy)(randgen_t* rg);
 
 	uint64_t (*rg_generate_int)(randgen_t* rg);
+	void (*rg_generate_bulk)(randgen_t* rg, uint64_t* out, size_t n);
 } randgen_class_t;
 
 #define RG_CLASS_HEAD(name, is_singleton, max)		\
@@ -130,6 +135,11 @@ STATIC_INLINE uint64_t rg_generate_int(randgen_t* rg) {
 
 LIBEXPORT double rg_generate_double(randgen_t* rg);
 
+LIBEXPORT void rg_generate_bulk(randgen_t* rg, uint64_t* out, size_t n);
+LIBEXPORT void rg_generate_double_bulk(randgen_t* rg, double* out, size_t n);
+
+LIBEXPORT void rg_philox_set_stream(randgen_t* rg, uint64_t stream);
+
 LIBEXPORT int  rg_init_dummy(randgen_t* rg);
 LIBEXPORT void rg_destroy_dummy(randgen_t* rg);
 
@@ -187,6 +197,8 @@ typedef struct randvar {
  * @member rv_set_double 	function that sets double parameter
  * @member rv_variate_double function that gets random-generated value u, \
  * 							and returns variated value
+ * @member rv_variate_bulk	(optional) function that variates n random-generated values \
+ * 							in array u in-place. May take extra values from generator.
  */
 typedef struct randvar_class {
 	AUTOSTRING char* rv_class_name;
@@ -202,6 +214,7 @@ typedef struct randvar_class {
 	int (*rv_set_double)(randvar_t* rv, const char* name, double value);
 
 	double (*rv_variate_double)(randvar_t* rv, double u);
+	void (*rv_variate_bulk)(randvar_t* rv, double* u, size_t n);
 } randvar_class_t;
 
 #define RV_CLASS_HEAD(name, params)					\
@@ -227,6 +240,8 @@ STATIC_INLINE double rv_variate_double(randvar_t* rv) {
 	return rv->rv_class->rv_variate_double(rv, u);
 }
 
+LIBEXPORT void rv_variate_bulk(randvar_t* rv, double* out, size_t n);
+
 LIBEXPORT int rv_init_dummy(randvar_t* rv);
 LIBEXPORT void rv_destroy_dummy(randvar_t* rv);
 LIBEXPORT int rv_set_int_dummy(randvar_t* rv, const char* name, long value);
@@ -236,6 +251,69 @@ LIBEXPORT randvar_class_t* randvar_find(const char* class_name);
 LIBEXPORT int randvar_register(module_t* mod, randvar_class_t* class);
 LIBEXPORT int randvar_unregister(module_t* mod, randvar_class_t* class);
 
+/**
+ * Buffer of pre-generated random values
+ *
+ * Consumers that need a random value per request (request schedulers, request
+ * param generators) shouldn't call generator through function pointer for each
+ * value. Instead, they keep a buffer which is filled in bulk (at the beginning of
+ * the step) and take values from it. When buffer is exhausted, it is refilled
+ * with RGBUFSIZE values.
+ *
+ * Like generators themselves, buffers are not protected by locks, so each buffer
+ * should have a single consumer at a time. That holds for request schedulers and
+ * parameter generators because requests are created either by control thread or
+ * by benchmark dispatcher under its mutex.
+ *
+ * @member rgb_type 	type of values: RGBUF_INT - raw integers from generator, \
+ * 						RGBUF_DOUBLE - doubles in [0.0, 1.0], RGBUF_VARIATE - values \
+ * 						variated by rgb_rv
+ * @member rgb_rg		random generator
+ * @member rgb_rv		random variator (only for RGBUF_VARIATE)
+ * @member rgb_values	array of RGBUFSIZE values
+ * @member rgb_count	number of values generated by last fill
+ * @member rgb_pos		index of next value to be taken
+ */
+#define RGBUFSIZE		1024
+
+#define RGBUF_INT		0
+#define RGBUF_DOUBLE	1
+#define RGBUF_VARIATE	2
+
+typedef struct rg_buffer {
+	int rgb_type;
+
+	randgen_t* rgb_rg;
+	randvar_t* rgb_rv;
+
+	union {
+		uint64_t* ival;
+		double*   dval;
+	} rgb_values;
+
+	unsigned rgb_count;
+	unsigned rgb_pos;
+} rg_buffer_t;
+
+LIBEXPORT void rg_buffer_init(rg_buffer_t* buf, int type, randgen_t* rg, randvar_t* rv);
+LIBEXPORT void rg_buffer_destroy(rg_buffer_t* buf);
+LIBEXPORT void rg_buffer_fill(rg_buffer_t* buf, unsigned count);
+
+STATIC_INLINE unsigned rg_buffer_next(rg_buffer_t* buf) {
+	if(unlikely(buf->rgb_pos >= buf->rgb_count))
+		rg_buffer_fill(buf, RGBUFSIZE);
+
+	return buf->rgb_pos++;
+}
+
+STATIC_INLINE uint64_t rg_buffer_get_int(rg_buffer_t* buf) {
+	return buf->rgb_values.ival[rg_buffer_next(buf)];
+}
+
+STATIC_INLINE double rg_buffer_get_double(rg_buffer_t* buf) {
+	return buf->rgb_values.dval[rg_buffer_next(buf)];
+}
+
 LIBEXPORT int randgen_init(void);
 LIBEXPORT void randgen_fini(void);
 
@@ -81,6 +81,7 @@ typedef struct rqsched_class {
 
 	void (*rqsched_pre_request)(request_t* rq);		/* Called while request is scheduling */
 	void (*rqsched_post_request)(request_t* rq);		/* Called when request is complete */
+	void (*rqsched_destroy_request)(request_t* rq);		/* Called when request is destroyed (optional) */
 	
 	module_t* rqsched_module;
 	struct rqsched_class* rqsched_next;
@@ -90,6 +91,9 @@ typedef struct rqsched_var {
 	rqsvar_class_t* class;
 	randgen_t* randgen;
 	randvar_t* randvar;
+
+	/* Variated values pre-generated for current step */
+	rg_buffer_t buffer;
 	
 	union {
 		double dval;
@@ -44,6 +44,8 @@
 #define TP_WORKER_MIN_SLEEP 	(200 * T_US)
 #define TP_WORKER_OVERHEAD	 	(30 * T_US)
 
+#define TP_RQ_HEAP_MIN_SIZE		256
+
 #define DEFAULT_TP_NAME	"[DEFAULT]"
 
 #define CONTROL_TID		-1
@@ -86,6 +88,54 @@ typedef struct tp_worker {
 	void* w_tpd_data;
 } tp_worker_t;
 
+/**
+ * Request pushed to arrival heap. Arrival time is saved when request is pushed,
+ * so heap order is kept even if request scheduler changes its schedule time.
+ */
+typedef struct tp_rq_heap_entry {
+	ts_time_t rqh_arrival;
+	struct request* rqh_rq;
+} tp_rq_heap_entry_t;
+
+/**
+ * Run of ascending requests in arrival heap. Entries from rqr_next
+ * to rqr_end (exclusive) are not popped yet.
+ */
+typedef struct tp_rq_heap_run {
+	unsigned rqr_next;
+	unsigned rqr_end;
+} tp_rq_heap_run_t;
+
+/**
+ * Arrival heap of requests ordered by their arrival time
+ * (`rq_sched_time + wl_start_clock`) and then by request id.
+ *
+ * Requests are appended to array of entries which is split into runs of
+ * ascending arrivals. Request schedulers usually generate ascending arrivals
+ * for each workload, so there are only few runs, and popping takes O(log r)
+ * where r is number of runs. Runs are organized into binary min-heap on the
+ * first pop, after that heap should be drained before new requests are pushed.
+ *
+ * @member rqh_entries array of pushed requests
+ * @member rqh_count number of pushed requests
+ * @member rqh_size number of allocated entries
+ * @member rqh_runs heap of runs
+ * @member rqh_num_runs number of runs in heap
+ * @member rqh_runs_size number of allocated runs
+ * @member rqh_draining set when runs are organized into heap
+ */
+typedef struct tp_rq_heap {
+	tp_rq_heap_entry_t* rqh_entries;
+	unsigned rqh_count;
+	unsigned rqh_size;
+
+	tp_rq_heap_run_t* rqh_runs;
+	unsigned rqh_num_runs;
+	unsigned rqh_runs_size;
+
+	boolean_t rqh_draining;
+} tp_rq_heap_t;
+
 /**
  * Threadpool main descriptor
  *
@@ -102,6 +152,7 @@ typedef struct tp_worker {
  * @member tp_disp pointer to dispatcher structure
  * @member tp_discard see discard parameter for tsload_create_threadpool
  * @member tp_rq_head list of requests that are executing by this threadpool
+ * @member tp_rq_heap arrival heap of requests created during current step
  * @member tp_wl_head list of workloads attached to this threadpool
  */
 typedef struct thread_pool {
@@ -124,6 +175,7 @@ typedef struct thread_pool {
 	boolean_t tp_discard;
 
 	list_head_t	   tp_rq_head;
+	tp_rq_heap_t   tp_rq_heap;
 
 	list_head_t	   tp_wl_head;
 	int tp_wl_count;
@@ -152,7 +204,13 @@ void tp_insert_request_impl(list_head_t* rq_list, list_node_t* rq_node,
 								   offsetof(struct request, member))
 void tp_insert_request_initnodes(list_head_t* rq_list, list_node_t** p_prev_node, list_node_t** p_next_node);
 
+void tp_rq_heap_init(tp_rq_heap_t* heap);
+void tp_rq_heap_destroy(tp_rq_heap_t* heap);
+void tp_rq_heap_push(tp_rq_heap_t* heap, struct request* rq);
+struct request* tp_rq_heap_pop(tp_rq_heap_t* heap);
+
 void tp_distribute_requests(struct workload_step* step, thread_pool_t* tp);
+void tp_flush_requests(thread_pool_t* tp);
 
 LIBEXPORT int tp_init(void);
 LIBEXPORT void tp_fini(void);
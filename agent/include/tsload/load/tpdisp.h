@@ -9,6 +9,7 @@
 
 #include <tsload/load/workload.h>
 #include <tsload/load/threadpool.h>
+#include <tsload/load/randgen.h>
 
 #include <stdlib.h>
 
@@ -76,6 +77,8 @@ typedef struct tp_disp {
 	thread_pool_t*	tpd_tp;
 	tp_disp_class_t* tpd_class;
 	void* tpd_data;
+
+	randgen_t* tpd_randgen;		/**< generator for random worker selection */
 } tp_disp_t;
 
 boolean_t tpd_wait_for_arrival(request_t* rq, ts_time_t max_sleep);
@@ -95,8 +98,10 @@ static int tpd_next_wid_rr(thread_pool_t* tp, int wid, request_t* rq) {
 }
 
 STATIC_INLINE int tpd_first_wid_rand(thread_pool_t* tp) {
-	/* FIXME: Should use randgen API */
-	return rand() % tp->tp_num_threads;
+	/* Scale upper 32 bits to number of threads: that is cheaper than modulo */
+	uint64_t r = rg_generate_int(tp->tp_disp->tpd_randgen) >> 32;
+
+	return (int) ((r * tp->tp_num_threads) >> 32);
 }
 
 static int tpd_next_wid_rand(thread_pool_t* tp, int wid, request_t* rq) {
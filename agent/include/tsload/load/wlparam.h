@@ -255,6 +255,14 @@ typedef struct wlpgen_randgen {
 	/* For boolean/stringset - probability map */
 	int pcount;
 	wlpgen_probability_t* pmap;
+
+	/* Alias table for pmap: probability of picking column's own element
+	 * and index of element that is picked otherwise */
+	double* alias_prob;
+	int* alias;
+
+	/* Pre-generated random values: raw integers, doubles (for pmap) or variated values */
+	rg_buffer_t buffer;
 } wlpgen_randgen_t;
 
 /* Generator for per-request params */
@@ -277,7 +285,11 @@ int wlparam_set_default(wlp_descr_t* wlp, void* param, struct workload* wl);
 
 int wlpgen_create_default(wlp_descr_t* wlp, struct workload* wl);
 TESTEXPORT void wlpgen_destroy_all(struct workload* wl);
-void* wlpgen_generate(struct workload* wl);
+void wlpgen_generate(struct workload* wl, void* rq_params);
+LIBEXPORT boolean_t wlpgen_get_max_integer(struct workload* wl, const char* name, wlp_integer_t* p_max);
+
+TESTEXPORT void wlpgen_pmap_build_alias(wlpgen_randgen_t* randgen);
+TESTEXPORT void wlpgen_gen_random(wlp_generator_t* gen, void* param);
 
 tsobj_node_t* tsobj_wlparam_format_all(wlp_descr_t* wlp);
 
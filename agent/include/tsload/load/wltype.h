@@ -48,6 +48,13 @@ typedef int (* wlt_wl_config_func)(struct workload* wl);
 typedef int (* wlt_wl_step_func)(struct workload_step* wls);
 typedef int (* wlt_run_request_func)(struct request* wl);
 
+/**
+ * Return value of wlt_run_request that means that request was submitted
+ * asynchronously and is not finished yet. Module should call wl_request_complete()
+ * when it is done, so worker may pick next request without waiting for it.
+ */
+#define WLT_RUN_PENDING		1
+
 /**
  * Workload classes
  */
@@ -84,7 +91,8 @@ typedef enum wl_class {
  * @member wlt_wl_config pointer to function that configures workload
  * @member wlt_wl_unconfig pointer to function that destroyes worklaod
  * @member wlt_wl_step function that will be called at beginning of each step
- * @member wlt_run_request primary workload function that services request
+ * @member wlt_run_request primary workload function that services request. Returns 0 if request \
+ * 		succeeded, -1 if it failed or WLT_RUN_PENDING if it is still in progress
  * @member wlt_module should be set to module structure passed to mod_config()
  * @member wlt_next field internally used by TSLoad, set to NULL
  */
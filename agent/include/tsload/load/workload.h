@@ -24,6 +24,7 @@
 #include <tsload/defs.h>
 
 #include <tsload/list.h>
+#include <tsload/mempool.h>
 #include <tsload/time.h>
 
 #include <tsload/obj/obj.h>
@@ -54,11 +55,13 @@
 #define RQF_SUCCESS		0x0002
 #define RQF_ONTIME		0x0004
 #define RQF_FINISHED	0x0008
+#define RQF_STOLEN		0x0010
 
 /* Internal flags for TP dispatcher */
 #define RQF_DISPATCHED	0x0100
 #define RQF_DEQUEUED	0x0200
 #define RQF_TRACE		0x0400
+#define RQF_PENDING		0x0800
 
 #define RQF_FLAG_MASK	0x00ff
 
@@ -84,6 +87,7 @@ struct rqsched;
  * @member rq_node link node for threadpool queue
  * @member rq_w_node link node for worker queue
  * @member rq_wl_node link node for workload request list
+ * @member rq_user_node link node for per-user request list (used by think-time scheduler)
  * @member rq_chain_next next request (for workload chaining)
  */
 typedef struct request {
@@ -108,6 +112,7 @@ typedef struct request {
 	list_node_t rq_node;		/* Next request in chain */
 	list_node_t rq_w_node;
 	list_node_t rq_wl_node;
+	list_node_t rq_user_node;
 	struct request* rq_chain_next;	/* Next request in workload chain */
 } request_t;
 
@@ -170,6 +175,9 @@ typedef enum {
  * 		and it is done by separate thread, we should wait for them.
  * @member wl_current_rq Id of last created request
  * @member wl_requests List of workload's requests. Protected by wl_rq_mutex
+ * @member wl_rq_cv Condition variable signalled when asynchronous request is completed. Uses wl_rq_mutex
+ * @member wl_rq_cache Cache of request objects. Each entry is sizeof(request_t) + wlt_rqparams_size	\
+ * 		long, so request params are kept inline right after request structure
  * @member wl_start_time Time when workload was scheduled to start
  * @member wl_notify_time Timestamp when wl_notify was called. Used to reduce number of WLS_CONFIGURING messages
  * @member wl_start_clock Clock when workload was run by threadpool. Used to normalize request times to	\
@@ -201,6 +209,8 @@ typedef struct workload {
 	int				 wl_current_rq;
 	thread_mutex_t	 wl_rq_mutex;
 	list_head_t		 wl_requests;
+	thread_cv_t		 wl_rq_cv;
+	mp_cache_t		 wl_rq_cache;
 
 	ts_time_t		 wl_start_time;
 	ts_time_t		 wl_notify_time;
@@ -260,6 +270,8 @@ request_t* wl_create_request_trace(workload_t* wl, int rq_id, long step, int use
 								   ts_time_t sched_time, void* rq_params);
 
 void wl_run_request(request_t* rq);
+LIBEXPORT void wl_request_complete(request_t* rq, int ret);
+void wl_request_wait(request_t* rq);
 void wl_request_free(request_t* rq);
 void wl_report_requests(list_head_t* rq_list);
 
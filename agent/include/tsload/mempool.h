@@ -34,6 +34,15 @@
 
 struct mp_cache_page;
 
+/**
+ * SLAB cache
+ *
+ * Single items are allocated through per-thread magazines (see mempool.c)
+ * which are kept in per-thread table at index c_id, while full and empty
+ * magazines that are not loaded by threads reside in cache depot protected
+ * by c_depot_lock. c_gen distinguishes cache from destroyed caches which
+ * had the same id.
+ */
 typedef struct mp_cache {
 	thread_mutex_t	c_page_lock;
 	thread_rwlock_t	c_list_lock;
@@ -46,6 +55,18 @@ typedef struct mp_cache {
 
 	ptrdiff_t	c_first_item_off;
 
+	unsigned		c_id;
+	unsigned long	c_gen;
+
+	thread_mutex_t	c_depot_lock;
+	list_head_t		c_depot_full;
+	list_head_t		c_depot_empty;
+	unsigned		c_depot_full_count;
+	unsigned		c_depot_empty_count;
+	list_head_t		c_thread_list;
+
+	list_node_t		c_node;
+
 	char		c_name[MPCACHENAMELEN];
 } mp_cache_t;
 
@@ -64,6 +85,8 @@ LIBEXPORT void* mp_malloc(size_t sz);
 LIBEXPORT void* mp_realloc(void* old, size_t sz);
 LIBEXPORT void mp_free(void* ptr);
 
+LIBEXPORT void mp_thread_fini(void);
+
 LIBEXPORT int mempool_init(void);
 LIBEXPORT void mempool_fini(void);
 
@@ -160,4 +160,67 @@ typedef struct {
 	atomic_t	cp_bitmap[0];
 } mp_cache_page_t;
 
+/* Size-class allocator: allocations up to MPSIZECLASSMAX bytes are served
+ * by SLAB caches with item sizes 16, 32, 64, 128 and 256 bytes */
+#define MPSIZECLASSMINLOG	4
+#define MPSIZECLASSMAXLOG	8
+#define MPSIZECLASSES		(MPSIZECLASSMAXLOG - MPSIZECLASSMINLOG + 1)
+
+#define MPSIZECLASSMIN		(1 << MPSIZECLASSMINLOG)
+#define MPSIZECLASSMAX		(1 << MPSIZECLASSMAXLOG)
+
+/* Magazine layer
+ *
+ * Magazine occupies exactly one page fragment, so MPMAGROUNDS pointers
+ * fit into it after header */
+
+#define MPMAGSIZE			MPFRAGSIZE
+
+/* Maximum number of full and empty magazines kept in cache depot. Excess
+ * full magazines are returned to SLAB pages, empty magazines are freed */
+#define MPDEPOTMAXFULL		64
+#define MPDEPOTMAXEMPTY		16
+
+typedef struct {
+	list_node_t	mag_node;
+	unsigned	mag_rounds;
+
+	void*		mag_objs[0];
+} mp_magazine_t;
+
+#define MPMAGROUNDS			((MPMAGSIZE - sizeof(mp_magazine_t)) / sizeof(void*))
+
+#define MP_MAG_IS_EMPTY(mag)		((mag)->mag_rounds == 0)
+#define MP_MAG_IS_FULL(mag)			((mag)->mag_rounds == MPMAGROUNDS)
+
+/**
+ * Per-thread magazine pair. Loaded magazine may be partially filled,
+ * previous is always full or empty.
+ */
+typedef struct {
+	struct mp_cache*	ct_cache;
+	list_node_t			ct_node;
+
+	mp_magazine_t*		ct_loaded;
+	mp_magazine_t*		ct_previous;
+} mp_cache_thread_t;
+
+/**
+ * Table of magazine pairs of a thread indexed by id of cache. All caches share
+ * single thread key, so number of caches is not limited by number of thread
+ * keys provided by platform. Slot is valid only if its generation matches
+ * generation of cache, so slots left by destroyed caches are never used.
+ */
+#define MPCACHETHREADSLOTS		16
+
+typedef struct {
+	mp_cache_thread_t*	cts_ct;
+	unsigned long		cts_gen;
+} mp_cache_thread_slot_t;
+
+typedef struct {
+	unsigned				ctt_size;
+	mp_cache_thread_slot_t	ctt_slots[0];
+} mp_cache_thread_table_t;
+
 #endif /* MEMPOOL_IMPL_H_ */
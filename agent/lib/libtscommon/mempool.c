@@ -26,10 +26,13 @@
 #include <tsload/time.h>
 #include <tsload/list.h>
 #include <tsload/threads.h>
+#include <tsload/ilog2.h>
 
 #include <mempool.h>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 
@@ -46,6 +49,14 @@ thread_rwlock_t	heap_list_lock;
 list_head_t heap_page_list;
 mp_heap_page_t* last_heap_page;
 
+thread_mutex_t	mp_cache_list_lock;
+list_head_t		mp_cache_list;
+
+thread_key_t	mp_cache_thread_key;
+unsigned long	mp_cache_gen = 0;
+
+mp_cache_t		mp_size_caches[MPSIZECLASSES];
+
 #ifdef MEMPOOL_TRACE
 boolean_t		mp_trace_allocator = B_FALSE;
 boolean_t		mp_trace_bitmaps = B_FALSE;
@@ -83,10 +94,14 @@ boolean_t		mp_trace_slab = B_FALSE;
  *
  * There are three allocators:
  * - Page-frag allocator that allocates memory in 256-bytes fragments.
- * - SLAB-like allocator
- * - Traditional heap for small allocations (4 bytes - 256 bytes)
+ * - SLAB-like allocator. It also serves small mp_malloc() allocations
+ *   (up to 256 bytes) through size-class caches.
+ * - Traditional heap for medium allocations (256 bytes - 3200 bytes)
  *
  * SLAB-allocator and Page-frag allocator are using bitmaps to track allocated areas
+ *
+ * Single-item SLAB allocations are served from per-thread magazines that
+ * are refilled from cache depot, so SLAB pages are rarely touched on hot path.
  */
 
 /**
@@ -281,21 +296,18 @@ int mp_bitmap_alloc_cells(atomic_t* bitmap, int num_items, int alloc_cells) {
 
 			if(bidx != -1) {
 				/* Allocation successfull */
-				if(first_cell == -1) {
+				if(first_cell == -1)
 					first_cell = i;
-				}
-				else {
-					++allocated_cells;
 
-					if(allocated_cells == alloc_cells)
-						return first_cell * MP_BITMAP_BITS;
-				}
+				if(++allocated_cells == alloc_cells)
+					return first_cell * MP_BITMAP_BITS;
 			}
 			else {
 				/* Allocation was unsuccessfull: free allocated cells
-				 * and try again */
+				 * and try again. Cell i is owned by somebody else,
+				 * so it is not touched. */
 				if(first_cell != -1) {
-					for(j = first_cell; j <= i ; ++j) {
+					for(j = first_cell; j < i ; ++j) {
 						atomic_set(bitmap + j, 0l);
 					}
 
@@ -305,6 +317,17 @@ int mp_bitmap_alloc_cells(atomic_t* bitmap, int num_items, int alloc_cells) {
 			}
 		}
 
+		/* Free cells at the end of bitmap are not enough, release them
+		 * so next retry starts from scratch */
+		if(first_cell != -1) {
+			for(j = first_cell; j < num_cells; ++j) {
+				atomic_set(bitmap + j, 0l);
+			}
+
+			allocated_cells = 0;
+			first_cell = -1;
+		}
+
 		tm_sleep_nano(MPWAITTIME);
 
 		++retries;
@@ -337,8 +360,10 @@ void mp_bitmap_free_cells(atomic_t* bitmap, int num, int idx) {
 	int i = 0;
 	long bval;
 
-	idx /= MP_BITMAP_BITS;
-	num /= MP_BITMAP_BITS;
+	/* Last page of multi-page fragment may be partially used, but
+	 * mp_bitmap_alloc_cells() have allocated it entirely */
+	bitmap += idx / MP_BITMAP_BITS;
+	num = (num / MP_BITMAP_BITS) + ((num % MP_BITMAP_BITS) != 0);
 
 	for(i = 0; i < num ; ++i) {
 		bval = atomic_exchange(bitmap + i, 0l);
@@ -525,6 +550,18 @@ size_t mp_frag_get_size(mp_frag_descr_t* descr) {
 	return descr->fd_size * MPFRAGSIZE;
 }
 
+/**
+ * Get beginning of fragment (or multiple fragments) allocated by
+ * mp_frag_alloc() that contains ptr.
+ */
+void* mp_frag_get_base(void* ptr) {
+	mp_frag_descr_t* descr = mp_frag_get_descr(ptr);
+
+	assert(descr != NULL);
+
+	return ((char*) mp_segment) + (descr - mp_frags) * MPFRAGSIZE;
+}
+
 /* Traditional heap
  * ----------------
  *
@@ -1113,23 +1150,17 @@ void* mp_heap_alloc(size_t size) {
 void mp_heap_free(void* ptr) {
 	mp_heap_header_t* hh = MP_HH_FROM_FRAGMENT(ptr);
 
-	mp_heap_page_t* page = NULL, *iter = NULL;
+	mp_heap_page_t* page = NULL;
 
 	VALGRIND_MAKE_MEM_DEFINED(hh, MPHEAPHHSIZE);
 
 	assert(hh->hh_size > 0);
 	assert(MP_HH_IS_ALLOCATED(hh));
 
-	rwlock_lock_read(&heap_list_lock);
-	list_for_each_entry(mp_heap_page_t, iter, &heap_page_list, hp_node) {
-		if(MP_HH_IN_PAGE(hh, iter)) {
-			page = iter;
-			break;
-		}
-	}
-	rwlock_unlock(&heap_list_lock);
+	/* Heap pages are allocated by frag allocator, so no need to walk page list */
+	page = (mp_heap_page_t*) mp_frag_get_base(hh);
 
-	assert(page != NULL);
+	assert(MP_HH_IN_PAGE(hh, page));
 
 	/* Return header on free-tree */
 	mutex_lock(&page->hp_mutex);
@@ -1172,6 +1203,63 @@ static size_t mp_heap_get_size(void* ptr) {
  * SLAB allocator
  * */
 
+void mp_cache_allocator_init() {
+	list_head_init(&mp_cache_list, "mp_cache_list");
+
+	mutex_init(&mp_cache_list_lock, "mp_cache_list");
+
+	tkey_init(&mp_cache_thread_key, "mp_cache_thread");
+}
+
+void mp_cache_allocator_destroy() {
+	mp_cache_thread_table_t* table =
+			(mp_cache_thread_table_t*) tkey_get(&mp_cache_thread_key);
+
+	/* Magazines were released by mp_cache_destroy(), only table is left */
+	if(table != NULL)
+		mp_frag_free(table);
+
+	tkey_destroy(&mp_cache_thread_key);
+
+	mutex_destroy(&mp_cache_list_lock);
+}
+
+/**
+ * Find smallest id which is not used by other caches. Caches are created
+ * rarely, so it simply walks cache list. Should be called with
+ * mp_cache_list_lock held.
+ */
+static unsigned mp_cache_alloc_id(void) {
+	mp_cache_t* cache;
+	unsigned id = 0;
+	boolean_t used;
+
+	do {
+		used = B_FALSE;
+
+		list_for_each_entry(mp_cache_t, cache, &mp_cache_list, c_node) {
+			if(cache->c_id == id) {
+				used = B_TRUE;
+				++id;
+				break;
+			}
+		}
+	} while(used);
+
+	return id;
+}
+
+/**
+ * Find SLAB page that owns item ptr. SLAB pages are allocated by frag
+ * allocator, so we may use fragment descriptor to find its beginning
+ * instead of walking cache page list.
+ */
+STATIC_INLINE mp_cache_page_t* mp_cache_page_lookup(void* ptr) {
+	assert(mp_frag_get_descr(ptr)->fd_type == FRAG_SLAB);
+
+	return (mp_cache_page_t*) mp_frag_get_base(ptr);
+}
+
 mp_cache_page_t* mp_cache_page_alloc(mp_cache_t* cache) {
 	mp_cache_page_t* page;
 	void* raw_page;
@@ -1236,6 +1324,8 @@ void mp_cache_page_free_nolock(mp_cache_page_t* page) {
 		logmsg(LOG_TRACE, "FREE SLAB PAGE %s %p", cache->c_name, page);
 	}
 #	endif
+
+	mp_frag_free(page);
 }
 
 void mp_cache_page_free(mp_cache_page_t* page) {
@@ -1270,6 +1360,19 @@ void mp_cache_init_impl(mp_cache_t* cache, const char* name, size_t item_size) {
 
 	strncpy(cache->c_name, name, MPCACHENAMELEN);
 
+	mutex_init(&cache->c_depot_lock, "cache-%s-depot", name);
+	list_head_init(&cache->c_depot_full, "cache-%s-full", name);
+	list_head_init(&cache->c_depot_empty, "cache-%s-empty", name);
+	list_head_init(&cache->c_thread_list, "cache-%s-threads", name);
+	cache->c_depot_full_count = 0;
+	cache->c_depot_empty_count = 0;
+
+	mutex_lock(&mp_cache_list_lock);
+	cache->c_id = mp_cache_alloc_id();
+	cache->c_gen = ++mp_cache_gen;
+	list_add_tail(&cache->c_node, &mp_cache_list);
+	mutex_unlock(&mp_cache_list_lock);
+
 #	ifdef MEMPOOL_TRACE
 	if(mp_trace_slab) {
 		logmsg(LOG_TRACE, "NEW SLAB CACHE %s %p ipp: %u",
@@ -1278,8 +1381,36 @@ void mp_cache_init_impl(mp_cache_t* cache, const char* name, size_t item_size) {
 #	endif
 }
 
+static void mp_cache_thread_destroy(mp_cache_thread_t* ct);
+static void mp_magazine_free(mp_magazine_t* mag);
+
 void mp_cache_destroy(mp_cache_t* cache) {
 	mp_cache_page_t *page, *temp;
+	mp_cache_thread_t *ct, *ct_temp;
+	mp_magazine_t *mag, *mag_temp;
+
+	mutex_lock(&mp_cache_list_lock);
+	list_del(&cache->c_node);
+	mutex_unlock(&mp_cache_list_lock);
+
+	/* Magazines are not holding SLAB pages, so simply release them */
+	mutex_lock(&cache->c_depot_lock);
+	list_for_each_entry_safe(mp_cache_thread_t, ct, ct_temp, &cache->c_thread_list, ct_node) {
+		list_del(&ct->ct_node);
+
+		ct->ct_loaded->mag_rounds = 0;
+		ct->ct_previous->mag_rounds = 0;
+		mp_cache_thread_destroy(ct);
+	}
+	list_for_each_entry_safe(mp_magazine_t, mag, mag_temp, &cache->c_depot_full, mag_node) {
+		mp_magazine_free(mag);
+	}
+	list_for_each_entry_safe(mp_magazine_t, mag, mag_temp, &cache->c_depot_empty, mag_node) {
+		mp_magazine_free(mag);
+	}
+	mutex_unlock(&cache->c_depot_lock);
+
+	mutex_destroy(&cache->c_depot_lock);
 
 	rwlock_lock_write(&cache->c_list_lock);
 	list_for_each_entry_safe(mp_cache_page_t, page, temp, &cache->c_page_list, cp_node) {
@@ -1292,7 +1423,12 @@ void mp_cache_destroy(mp_cache_t* cache) {
 }
 
 STATIC_INLINE boolean_t mp_cache_reserve(mp_cache_page_t* page, unsigned num) {
-	if(atomic_sub(&page->cp_free_items, num) >= 0) {
+	/* Do not touch cache line of full page with atomic writes */
+	if(atomic_read(&page->cp_free_items) < num)
+		return B_FALSE;
+
+	/* atomic_sub() returns old value */
+	if(atomic_sub(&page->cp_free_items, num) >= num) {
 		return B_TRUE;
 	}
 
@@ -1371,22 +1507,14 @@ void* mp_cache_alloc_array(mp_cache_t* cache, unsigned num) {
 void mp_cache_free_array(mp_cache_t* cache, void* array, unsigned num) {
 	mp_cache_page_t *page = NULL;
 	int idx = 0;
-	boolean_t found_page = B_FALSE;
 
 	/* Align num */
 	if(num > MP_BITMAP_BITS)
 		num += MP_BITMAP_BITS - (num % MP_BITMAP_BITS);
 
-	rwlock_lock_read(&cache->c_list_lock);
-	list_for_each_entry(mp_cache_page_t, page, &cache->c_page_list, cp_node) {
-		if(MP_CACHE_ITEM_IN_PAGE(page, array)) {
-			found_page = B_TRUE;
-			break;
-		}
-	}
-	rwlock_unlock(&cache->c_list_lock);
+	page = mp_cache_page_lookup(array);
 
-	assert(found_page);
+	assert(page->cp_cache == cache && MP_CACHE_ITEM_IN_PAGE(page, array));
 
 	idx = MP_CACHE_ITEM_INDEX(page, array);
 
@@ -1409,17 +1537,312 @@ void mp_cache_free_array(mp_cache_t* cache, void* array, unsigned num) {
 #	endif
 }
 
+/**
+ * Magazine layer
+ * --------------
+ *
+ * Implements Bonwick's magazines: each thread holds a pair of magazines
+ * (arrays of free items) per cache, so mp_cache_alloc() and mp_cache_free()
+ * in most cases do not take locks or touch atomics at all. When both
+ * magazines are empty (or full), thread exchanges one of them with cache
+ * depot under c_depot_lock. Only when depot has no full magazines,
+ * allocation falls back to SLAB pages.
+ *
+ * Magazines of the thread are returned to SLAB pages by mp_thread_fini()
+ * which is called when tsload thread exits.
+ */
+
+static mp_magazine_t* mp_magazine_alloc(void) {
+	mp_magazine_t* mag = (mp_magazine_t*) mp_frag_alloc(MPMAGSIZE, FRAG_COMMON);
+
+	list_node_init(&mag->mag_node);
+	mag->mag_rounds = 0;
+
+	return mag;
+}
+
+static void mp_magazine_free(mp_magazine_t* mag) {
+	mp_frag_free(mag);
+}
+
+/**
+ * Return all items held by magazine to SLAB pages
+ */
+static void mp_magazine_drain(mp_cache_t* cache, mp_magazine_t* mag) {
+	while(mag->mag_rounds > 0) {
+		--mag->mag_rounds;
+		mp_cache_free_array(cache, mag->mag_objs[mag->mag_rounds], 1);
+	}
+}
+
+/**
+ * Give empty magazine to depot and get a full one
+ *
+ * @return full magazine or NULL if depot doesn't have full magazines. In \
+ * latter case, empty magazine remains owned by caller.
+ */
+static mp_magazine_t* mp_cache_depot_get_full(mp_cache_t* cache, mp_magazine_t* empty) {
+	mp_magazine_t* full = NULL;
+
+	mutex_lock(&cache->c_depot_lock);
+	if(!list_empty(&cache->c_depot_full)) {
+		full = list_first_entry(mp_magazine_t, &cache->c_depot_full, mag_node);
+		list_del_init(&full->mag_node);
+		--cache->c_depot_full_count;
+
+		if(cache->c_depot_empty_count < MPDEPOTMAXEMPTY) {
+			list_add(&empty->mag_node, &cache->c_depot_empty);
+			++cache->c_depot_empty_count;
+
+			empty = NULL;
+		}
+	}
+	mutex_unlock(&cache->c_depot_lock);
+
+	if(full != NULL && empty != NULL)
+		mp_magazine_free(empty);
+
+	return full;
+}
+
+/**
+ * Give full magazine to depot and get an empty one. If depot already has
+ * MPDEPOTMAXFULL magazines, items of full magazine are returned to SLAB
+ * pages and it is reused.
+ *
+ * @return empty magazine
+ */
+static mp_magazine_t* mp_cache_depot_get_empty(mp_cache_t* cache, mp_magazine_t* full) {
+	mp_magazine_t* empty = NULL;
+
+	mutex_lock(&cache->c_depot_lock);
+	if(cache->c_depot_full_count < MPDEPOTMAXFULL) {
+		list_add(&full->mag_node, &cache->c_depot_full);
+		++cache->c_depot_full_count;
+
+		full = NULL;
+
+		if(!list_empty(&cache->c_depot_empty)) {
+			empty = list_first_entry(mp_magazine_t, &cache->c_depot_empty, mag_node);
+			list_del_init(&empty->mag_node);
+			--cache->c_depot_empty_count;
+		}
+	}
+	mutex_unlock(&cache->c_depot_lock);
+
+	if(full != NULL) {
+		mp_magazine_drain(cache, full);
+		return full;
+	}
+
+	if(empty == NULL)
+		empty = mp_magazine_alloc();
+
+	return empty;
+}
+
+/**
+ * Allocate magazines of current thread for cache and put them into thread's
+ * table. Table is grown if cache id doesn't fit into it.
+ */
+static mp_cache_thread_t* mp_cache_thread_create(mp_cache_t* cache,
+												 mp_cache_thread_table_t* table) {
+	mp_cache_thread_table_t* new_table;
+	mp_cache_thread_t* ct;
+	unsigned size;
+
+	if(table == NULL || cache->c_id >= table->ctt_size) {
+		size = (table == NULL) ? MPCACHETHREADSLOTS : table->ctt_size;
+		while(size <= cache->c_id)
+			size *= 2;
+
+		new_table = (mp_cache_thread_table_t*) mp_frag_alloc(sizeof(mp_cache_thread_table_t) +
+							size * sizeof(mp_cache_thread_slot_t), FRAG_COMMON);
+		new_table->ctt_size = size;
+
+		/* Generations start from 1, so zeroed slots are never valid */
+		memset(new_table->ctt_slots, 0, size * sizeof(mp_cache_thread_slot_t));
+
+		if(table != NULL) {
+			memcpy(new_table->ctt_slots, table->ctt_slots,
+				   table->ctt_size * sizeof(mp_cache_thread_slot_t));
+			mp_frag_free(table);
+		}
+
+		table = new_table;
+		tkey_set(&mp_cache_thread_key, table);
+	}
+
+	ct = (mp_cache_thread_t*) mp_frag_alloc(sizeof(mp_cache_thread_t), FRAG_COMMON);
+
+	ct->ct_cache = cache;
+	ct->ct_loaded = mp_magazine_alloc();
+	ct->ct_previous = mp_magazine_alloc();
+
+	mutex_lock(&cache->c_depot_lock);
+	list_add(&ct->ct_node, &cache->c_thread_list);
+	mutex_unlock(&cache->c_depot_lock);
+
+	table->ctt_slots[cache->c_id].cts_ct = ct;
+	table->ctt_slots[cache->c_id].cts_gen = cache->c_gen;
+
+	return ct;
+}
+
+/**
+ * Get magazines of current thread for cache. Allocates them on first call.
+ */
+STATIC_INLINE mp_cache_thread_t* mp_cache_thread_get(mp_cache_t* cache) {
+	mp_cache_thread_table_t* table =
+			(mp_cache_thread_table_t*) tkey_get(&mp_cache_thread_key);
+
+	if(likely(table != NULL && cache->c_id < table->ctt_size &&
+			  table->ctt_slots[cache->c_id].cts_gen == cache->c_gen))
+		return table->ctt_slots[cache->c_id].cts_ct;
+
+	return mp_cache_thread_create(cache, table);
+}
+
+/**
+ * Return items of thread's magazines to SLAB pages and free them.
+ * ct should be already unlinked from c_thread_list.
+ */
+static void mp_cache_thread_destroy(mp_cache_thread_t* ct) {
+	mp_magazine_drain(ct->ct_cache, ct->ct_loaded);
+	mp_magazine_drain(ct->ct_cache, ct->ct_previous);
+
+	mp_magazine_free(ct->ct_loaded);
+	mp_magazine_free(ct->ct_previous);
+
+	mp_frag_free(ct);
+}
+
 void* mp_cache_alloc(mp_cache_t* cache) {
-	return mp_cache_alloc_array(cache, 1);
+	mp_cache_thread_t* ct = mp_cache_thread_get(cache);
+	mp_magazine_t* mag;
+
+	if(unlikely(MP_MAG_IS_EMPTY(ct->ct_loaded))) {
+		if(MP_MAG_IS_EMPTY(ct->ct_previous)) {
+			mag = mp_cache_depot_get_full(cache, ct->ct_previous);
+
+			if(mag == NULL)
+				return mp_cache_alloc_array(cache, 1);
+
+			ct->ct_previous = ct->ct_loaded;
+			ct->ct_loaded = mag;
+		}
+		else {
+			mag = ct->ct_previous;
+			ct->ct_previous = ct->ct_loaded;
+			ct->ct_loaded = mag;
+		}
+	}
+
+	mag = ct->ct_loaded;
+
+	return mag->mag_objs[--mag->mag_rounds];
 }
 
 void mp_cache_free(mp_cache_t* cache, void* ptr) {
-	mp_cache_free_array(cache, ptr, 1);
+	mp_cache_thread_t* ct = mp_cache_thread_get(cache);
+	mp_magazine_t* mag;
+
+	if(unlikely(MP_MAG_IS_FULL(ct->ct_loaded))) {
+		if(MP_MAG_IS_FULL(ct->ct_previous)) {
+			mag = mp_cache_depot_get_empty(cache, ct->ct_previous);
+
+			ct->ct_previous = ct->ct_loaded;
+			ct->ct_loaded = mag;
+		}
+		else {
+			mag = ct->ct_previous;
+			ct->ct_previous = ct->ct_loaded;
+			ct->ct_loaded = mag;
+		}
+	}
+
+	mag = ct->ct_loaded;
+	mag->mag_objs[mag->mag_rounds++] = ptr;
+}
+
+/**
+ * Release magazines of current thread in all caches. Should be called
+ * when thread exits, otherwise items cached by it won't be reused until
+ * cache is destroyed.
+ */
+void mp_thread_fini(void) {
+	mp_cache_thread_table_t* table =
+			(mp_cache_thread_table_t*) tkey_get(&mp_cache_thread_key);
+	mp_cache_thread_slot_t* slot;
+	mp_cache_t* cache;
+
+	if(table == NULL)
+		return;
+
+	tkey_set(&mp_cache_thread_key, NULL);
+
+	mutex_lock(&mp_cache_list_lock);
+	list_for_each_entry(mp_cache_t, cache, &mp_cache_list, c_node) {
+		if(cache->c_id >= table->ctt_size)
+			continue;
+
+		slot = &table->ctt_slots[cache->c_id];
+		if(slot->cts_gen != cache->c_gen)
+			continue;
+
+		mutex_lock(&cache->c_depot_lock);
+		list_del(&slot->cts_ct->ct_node);
+		mutex_unlock(&cache->c_depot_lock);
+
+		mp_cache_thread_destroy(slot->cts_ct);
+	}
+	mutex_unlock(&mp_cache_list_lock);
+
+	mp_frag_free(table);
+}
+
+/**
+ * Size-class allocator
+ * --------------------
+ *
+ * Small allocations are very frequent (squeue elements, notification
+ * messages, request parameters), so instead of best-fit search in the heap
+ * they are rounded up to power of two and taken from one of MPSIZECLASSES
+ * SLAB caches. Since these caches are fronted by per-thread magazines,
+ * most of mp_malloc()/mp_free() calls for small sizes are served from
+ * per-thread free lists without locking. */
+
+void mp_size_class_init() {
+	char name[MPCACHENAMELEN];
+	int sc;
+
+	for(sc = 0; sc < MPSIZECLASSES; ++sc) {
+		snprintf(name, MPCACHENAMELEN, "size-%d", MPSIZECLASSMIN << sc);
+		mp_cache_init_impl(&mp_size_caches[sc], name, MPSIZECLASSMIN << sc);
+	}
+}
+
+void mp_size_class_destroy() {
+	int sc;
+
+	for(sc = 0; sc < MPSIZECLASSES; ++sc) {
+		mp_cache_destroy(&mp_size_caches[sc]);
+	}
+}
+
+STATIC_INLINE mp_cache_t* mp_size_class_cache(size_t sz) {
+	int log = ilog2l(sz);
+
+	if(log < MPSIZECLASSMINLOG)
+		return &mp_size_caches[0];
+
+	return &mp_size_caches[log - MPSIZECLASSMINLOG];
 }
 
 /**
  * Allocate at least sz bytes and return it from mempool allocators
  *
+ * Small allocations (sz <= MPSIZECLASSMAX) are served by size-class caches.
  * For large (> MPHEAPMAXALLOC) or aligned (sz & MPFRAGMASK == 0) allocations uses frag allocator
  * Otherwise allocates from mempool heap
  *
@@ -1432,7 +1855,10 @@ void* mp_malloc(size_t sz) {
 	logmsg(LOG_TRACE, "ALLOC %zd", sz);
 #	endif
 
-	if((sz > MPHEAPMAXALLOC) || ((sz & MPFRAGMASK) == 0)) {
+	if(likely(sz <= MPSIZECLASSMAX)) {
+		ptr = mp_cache_alloc(mp_size_class_cache(sz));
+	}
+	else if((sz > MPHEAPMAXALLOC) || ((sz & MPFRAGMASK) == 0)) {
 		ptr = mp_frag_alloc(sz, FRAG_COMMON);
 	}
 	else {
@@ -1453,18 +1879,26 @@ size_t mp_get_size(void* ptr) {
 
 	if(descr->fd_type == FRAG_HEAP)
 		return mp_heap_get_size(ptr);
+	if(descr->fd_type == FRAG_SLAB)
+		return mp_cache_page_lookup(ptr)->cp_cache->c_item_size;
 
 	return mp_frag_get_size(descr);
 }
 
 /**
- * Reallocate memory at oldptr to size sz.
+ * Reallocate memory at oldptr to size sz. If oldptr is NULL,
+ * acts like mp_malloc()
  *
  * Doesn't shrink memory
  * */
 void* mp_realloc(void* oldptr, size_t sz) {
-	void* newptr = mp_malloc(sz);
-	size_t oldsz = mp_get_size(oldptr);
+	void* newptr;
+	size_t oldsz;
+
+	if(oldptr == NULL)
+		return mp_malloc(sz);
+
+	oldsz = mp_get_size(oldptr);
 
 	if(oldsz >= sz)
 		return oldptr;
@@ -1487,7 +1921,9 @@ void mp_free(void* ptr) {
 	logmsg(LOG_TRACE, "FREE %p", ptr);
 #	endif
 
-	if(descr->fd_type == FRAG_HEAP)
+	if(descr->fd_type == FRAG_SLAB)
+		mp_cache_free(mp_cache_page_lookup(ptr)->cp_cache, ptr);
+	else if(descr->fd_type == FRAG_HEAP)
 		mp_heap_free(ptr);
 	else
 		mp_frag_free(ptr);
@@ -1506,6 +1942,8 @@ int mempool_init(void) {
 
 	mp_frag_allocator_init();
 	mp_heap_allocator_init();
+	mp_cache_allocator_init();
+	mp_size_class_init();
 
 	logmsg(LOG_DEBUG, "Allocated mempool segment @%p of size %lx", mp_segment, mp_segment_size);
 
@@ -1513,6 +1951,8 @@ int mempool_init(void) {
 }
 
 void mempool_fini(void) {
+	mp_size_class_destroy();
+	mp_cache_allocator_destroy();
 	mp_heap_allocator_destroy();
 	mp_frag_allocator_destroy();
 
@@ -71,6 +71,10 @@ void mp_free(void* ptr) {
 	free(ptr);
 }
 
+void mp_thread_fini(void) {
+	/* Nothing */
+}
+
 int mempool_init(void) {
 	return 0;
 }
@@ -37,6 +37,7 @@
 #define lseek 	_lseek
 #define read	_read
 #define write	_write
+#define fsync	_commit
 #define access	_access
 #define mkdir   _mkdir
 #define fileno	_fileno
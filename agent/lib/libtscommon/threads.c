@@ -23,6 +23,7 @@
 
 #include <tsload/log.h>
 #include <tsload/threads.h>
+#include <tsload/mempool.h>
 #include <tsload/hashmap.h>
 #include <tsload/atomic.h>
 #include <tsload/schedutil.h>
@@ -143,6 +144,9 @@ thread_t* t_post_init(thread_t* t) {
 void t_exit(thread_t* t) {
 	logmsg(LOG_DEBUG, "Thread %d '%s' exited", t->t_id, t->t_name);
 
+	/* Return per-thread SLAB magazines */
+	mp_thread_fini();
+
 	t_notify_state(t, TS_DEAD);
 }
 
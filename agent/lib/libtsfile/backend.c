@@ -37,7 +37,6 @@
 size_t tsf_json_fragment  = 4096;
 size_t tsf_json_min_alloc = 16384;
 
-unsigned csv_entries_cache_count = 8;
 
 struct tsf_json_backend {
 	boolean_t json_print_one;
@@ -68,33 +67,36 @@ int tsf_json_set(tsf_backend_t* backend, const char* option) {
 }
 
 int tsf_json_get_impl(tsf_backend_t* backend, int start, int end, boolean_t formatted) {
-	json_node_t* node;
+	json_stream_t* stream;
 	int ret = 0;
+	int err;
 
 	struct tsf_json_backend* json = (struct tsf_json_backend*) backend->private;
 
+	/* Entries are streamed directly from mapped file, so exporting large
+	 * files doesn't need a node per entry */
+	stream = json_stream_create_file(backend->file, formatted);
+
 	if(json->json_print_one) {
-		node = json_tsfile_get(backend->ts_file, start);
+		err = json_tsfile_stream(backend->ts_file, stream, start);
 	}
 	else {
-		node = json_tsfile_get_array(backend->ts_file, start, end);
+		err = json_tsfile_stream_array(backend->ts_file, stream, start, end);
 	}
 
-	if(node == NULL) {
+	if(err != TSFILE_OK) {
 		logmsg(LOG_CRIT, "Failed to get JSON entries. Error: %s",
-			   tsfile_error_str[-tsfile_errno]);
-		return 1;
+			   tsfile_error_str[-err]);
+		ret = 1;
 	}
-
-	json_write_file(node, backend->file, formatted);
-
-	if(json->json_print_one) {
-		json_tsfile_put(backend->ts_file, node);
-	}
-	else {
-		json_tsfile_put_array(backend->ts_file, node);
+	else if(json_stream_flush(stream) != JSON_OK) {
+		logmsg(LOG_CRIT, "Failed to write JSON entries. Error: %s",
+			   json_error_message());
+		ret = 1;
 	}
 
+	json_stream_destroy(stream);
+
 	return ret;
 }
 
@@ -241,14 +243,16 @@ int tsf_csv_get(tsf_backend_t* backend, int start, int end) {
 	csv_binding_t* bindings = NULL;
 	int bcount;
 
+	csv_writer_t* writer = NULL;
+
 	tsfile_schema_t* schema = &backend->ts_file->header->schema;
 
 	int ret;
 
 	size_t entry_size = schema->hdr.entry_size;
-	void* entries = NULL;
-	void* entry;
-	int entry_idx = start, entry_count = 0, i = 0;
+	const char* entries = NULL;
+	int entry_idx;
+	int batch_end;
 
 	csv_chars_t chars;
 
@@ -274,29 +278,33 @@ int tsf_csv_get(tsf_backend_t* backend, int start, int end) {
 	if(!csv->csv_no_header)
 		csv_write_header(&chars, backend->file, bindings, bcount);
 
-	entries = mp_malloc(csv_entries_cache_count * entry_size);
+	ret = 0;
 
-	while(entry_idx < end) {
-		entry_count = min((unsigned) (end - entry_idx), 
-						  csv_entries_cache_count);
+	writer = csv_writer_create(&chars, backend->file, bindings, bcount);
 
-		ret = tsfile_get_entries(backend->ts_file, entries, entry_idx, entry_idx + entry_count);
-		if(ret != TSFILE_OK) {
+	/* Entries of v2 files are mapped chunk by chunk */
+	for( ; start < end; start = batch_end) {
+		batch_end = tsfile_map_batch(backend->ts_file, start, end);
+
+		entries = tsfile_map_entries(backend->ts_file, start, batch_end);
+		if(entries == NULL) {
+			ret = tsfile_errno;
 			logmsg(LOG_CRIT, "TSFile error %d", ret);
 			goto end;
 		}
 
-		for(i = 0; i < entry_count; ++i) {
-			entry = ((char*) entries) + i * entry_size;
-			csv_write_entry(&chars, backend->file, bindings, bcount, entry);
+		for(entry_idx = 0; entry_idx < (batch_end - start); ++entry_idx) {
+			ret = csv_writer_write(writer, entries + entry_idx * entry_size);
+			if(ret != CSV_OK)
+				goto end;
 		}
-
-		entry_idx += entry_count;
 	}
 
+	ret = csv_writer_flush(writer);
+
 end:
-	if(entries)
-		mp_free(entries);
+	if(writer)
+		csv_writer_destroy(writer);
 
 	mp_free(bindings);
 	if(ret < 0)		/* Treat CSV errors (which are negative) as general error */
@@ -309,6 +317,7 @@ int tsf_csv_add(tsf_backend_t* backend) {
 
 	csv_binding_t* bindings = NULL; 			/* bindings is a mapping between index in
 												   CSV file and index of field in schema */
+	csv_op_t* ops = NULL;
 	int bcount;
 	list_head_t list;
 	tsfile_schema_t* schema = &backend->ts_file->header->schema;
@@ -341,6 +350,8 @@ int tsf_csv_add(tsf_backend_t* backend) {
 	}
 	bcount = ret;
 
+	ops = csv_compile_bindings(bindings, bcount);
+
 	line_length = csv_max_line_length(bindings, bcount);
 	line = mp_malloc(line_length);
 
@@ -349,18 +360,22 @@ int tsf_csv_add(tsf_backend_t* backend) {
 		if(read_ptr == NULL)
 			break;
 
-		/* Cut out LF */
+		/* Cut out LF or CRLF */
 		read_len = strlen(line);
-		if(line[read_len - 1] == '\n')
+		if(read_len > 0 && line[read_len - 1] == '\n')
+			line[--read_len] = '\0';
+		if(read_len > 0 && line[read_len - 1] == '\r')
 			line[--read_len] = '\0';
 
 		entry = csv_entry_create(&list, schema->hdr.entry_size);
-		ret = csv_read_entry(&chars, line, bindings, bcount, entry);
+		ret = csv_read_entry(&chars, line, ops, bcount, entry);
 
 		if(ret != CSV_OK) {
 			logmsg(LOG_CRIT, "CSV error %d at line %d", ret, lineno);
 			goto end;
 		}
+
+		++lineno;
 	}
 
 	ret = csv_entry_list_add(backend->ts_file, &list);
@@ -368,6 +383,8 @@ int tsf_csv_add(tsf_backend_t* backend) {
 end:
 	if(line)
 		mp_free(line);
+	if(ops)
+		mp_free(ops);
 
 	csv_entry_list_destroy(&list);
 
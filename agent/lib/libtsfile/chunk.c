@@ -0,0 +1,1028 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/posixdecl.h>
+#include <tsload/ilog2.h>
+
+#include <tsfile.h>
+#include <chunk.h>
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+
+/**
+ * Column chunks of TSFile v2
+ *
+ * Request logs are written sequentally and read mostly by reports which touch
+ * only few fields, so v2 files keep entries in chunks of `chunk_rows` entries
+ * where each field is kept as a separate column. Chunks are appended after
+ * the header and are followed by superblock commit which keeps number of
+ * entries and number of chunks, so file stays consistent if agent crashes.
+ *
+ * Integer and boolean columns are encoded with the smallest of: constant
+ * (all values are equal), bit-packed offsets from minimum value (i.e. thread ids
+ * or flags) or zigzag varints of deltas between values (i.e. request ids, steps
+ * and times that grow monotonically). Their minimum and maximum values are kept
+ * in column header, so readers may skip chunks without decoding them.
+ * Float and string columns are kept as is. Each column may be then compressed by
+ * LZ4 or zstd if library was built with them and if compression saves space.
+ *
+ * Entries that do not fill chunk are kept in memory until chunk is full if file
+ * is buffered, otherwise they are committed as a short chunk on each tsfile_add().
+ * Pending entries are visible to readers of the same tsfile_t.
+ *
+ * Decoded chunks are not mapped into memory, so tsfile_map_entries() returns
+ * entries from last decoded chunk or assembles them in a separate buffer.
+ */
+
+extern tsfile_error_msg_func tsfile_error_msg;
+
+STATIC_INLINE uint32_t tsfile_chunk_committed(tsfile_t* file) {
+	return file->header->sb[file->cur_sb].count;
+}
+
+static char* tsfile_chunk_buf(tsfile_chunks_t* chunks, int bi, size_t size) {
+	if(chunks->buf_size[bi] < size) {
+		if(chunks->buf[bi] != NULL)
+			mp_free(chunks->buf[bi]);
+
+		chunks->buf[bi] = mp_malloc(size);
+		chunks->buf_size[bi] = size;
+	}
+
+	return chunks->buf[bi];
+}
+
+static int tsfile_chunk_pread(tsfile_t* file, void* buf, size_t size, uint64_t off) {
+	if(lseek(file->fd, (off_t) off, SEEK_SET) == ((off_t)-1) ||
+	   (size_t) read(file->fd, buf, size) != size)
+		return TSFILE_DATA_FAIL;
+
+	return TSFILE_OK;
+}
+
+static int tsfile_chunk_pwrite(tsfile_t* file, const void* buf, size_t size, uint64_t off) {
+#ifdef HAVE_DECL_PWRITEV
+	if((size_t) pwrite(file->fd, buf, size, (off_t) off) != size)
+		return TSFILE_DATA_FAIL;
+#else
+	if(lseek(file->fd, (off_t) off, SEEK_SET) == ((off_t)-1) ||
+	   (size_t) write(file->fd, buf, size) != size)
+		return TSFILE_DATA_FAIL;
+#endif
+
+	return TSFILE_OK;
+}
+
+/* Codecs */
+
+boolean_t tsfile_codec_supported(int codec) {
+	switch(codec) {
+	case TSFILE_CODEC_NONE:
+		return B_TRUE;
+#ifdef HAVE_LIBLZ4
+	case TSFILE_CODEC_LZ4:
+		return B_TRUE;
+#endif
+#ifdef HAVE_LIBZSTD
+	case TSFILE_CODEC_ZSTD:
+		return B_TRUE;
+#endif
+	}
+
+	return B_FALSE;
+}
+
+static size_t tsfile_codec_bound(int codec, size_t size) {
+	switch(codec) {
+#ifdef HAVE_LIBLZ4
+	case TSFILE_CODEC_LZ4:
+		return LZ4_compressBound(size);
+#endif
+#ifdef HAVE_LIBZSTD
+	case TSFILE_CODEC_ZSTD:
+		return ZSTD_compressBound(size);
+#endif
+	}
+
+	return size;
+}
+
+/**
+ * Compress column data. Returns size of compressed data or 0
+ * if it couldn't be compressed
+ */
+static size_t tsfile_codec_compress(int codec, const char* src, size_t size,
+								    char* dst, size_t capacity) {
+	switch(codec) {
+#ifdef HAVE_LIBLZ4
+	case TSFILE_CODEC_LZ4:
+	{
+		int ret = LZ4_compress_default(src, dst, size, capacity);
+		return (ret > 0) ? ret : 0;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case TSFILE_CODEC_ZSTD:
+	{
+		size_t ret = ZSTD_compress(dst, capacity, src, size, TSFILE_ZSTD_LEVEL);
+		return ZSTD_isError(ret) ? 0 : ret;
+	}
+#endif
+	}
+
+	return 0;
+}
+
+static int tsfile_codec_decompress(int codec, const char* src, size_t csize,
+								   char* dst, size_t size) {
+	switch(codec) {
+#ifdef HAVE_LIBLZ4
+	case TSFILE_CODEC_LZ4:
+		if(LZ4_decompress_safe(src, dst, csize, size) == (int) size)
+			return TSFILE_OK;
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case TSFILE_CODEC_ZSTD:
+		if(ZSTD_decompress(dst, size, src, csize) == size)
+			return TSFILE_OK;
+		break;
+#endif
+	}
+
+	return TSFILE_DATA_FAIL;
+}
+
+/* Column encodings */
+
+STATIC_INLINE unsigned tsfile_col_width(tsfile_field_t* field) {
+	if(field->type == TSFILE_FIELD_BOOLEAN)
+		return sizeof(boolean_t);
+
+	return (unsigned) field->size;
+}
+
+STATIC_INLINE boolean_t tsfile_col_is_int(tsfile_field_t* field) {
+	return field->type == TSFILE_FIELD_INT ||
+		   field->type == TSFILE_FIELD_BOOLEAN;
+}
+
+STATIC_INLINE int64_t tsfile_col_get(const char* value, unsigned width) {
+	int8_t i8; int16_t i16; int32_t i32; int64_t i64;
+
+	switch(width) {
+	case 1:
+		memcpy(&i8, value, 1);
+		return i8;
+	case 2:
+		memcpy(&i16, value, 2);
+		return i16;
+	case 4:
+		memcpy(&i32, value, 4);
+		return i32;
+	}
+
+	memcpy(&i64, value, 8);
+	return i64;
+}
+
+STATIC_INLINE void tsfile_col_put(char* value, unsigned width, int64_t v) {
+	int8_t i8 = (int8_t) v;
+	int16_t i16 = (int16_t) v;
+	int32_t i32 = (int32_t) v;
+
+	switch(width) {
+	case 1:
+		memcpy(value, &i8, 1);
+		return;
+	case 2:
+		memcpy(value, &i16, 2);
+		return;
+	case 4:
+		memcpy(value, &i32, 4);
+		return;
+	}
+
+	memcpy(value, &v, 8);
+}
+
+STATIC_INLINE uint64_t tsfile_zigzag(int64_t d) {
+	return (((uint64_t) d) << 1) ^ ((uint64_t) (d >> 63));
+}
+
+STATIC_INLINE int64_t tsfile_unzigzag(uint64_t u) {
+	return (int64_t) ((u >> 1) ^ (~(u & 1) + 1));
+}
+
+STATIC_INLINE size_t tsfile_varint_len(uint64_t u) {
+	size_t len = 1;
+
+	while(u >= 0x80) {
+		u >>= 7;
+		++len;
+	}
+
+	return len;
+}
+
+/**
+ * Encode column of field into out which should have at least rows * width bytes.
+ * Fills encoding, min/max and raw_size of column header.
+ */
+static void tsfile_col_encode(tsfile_field_t* field, const char* entries, unsigned entry_size,
+							  uint32_t rows, tsfile_col_hdr_t* col, char* out) {
+	unsigned width = tsfile_col_width(field);
+	const char* value = entries + field->offset;
+	size_t raw_size = (size_t) rows * width;
+	size_t bp_size = raw_size + 1;
+	size_t delta_size = 0;
+
+	int64_t v, vmin, vmax, prev;
+	uint64_t acc, range;
+	unsigned nbits;
+	uint32_t ri;
+
+	col->encoding = TSFILE_COL_RAW;
+	col->raw_size = raw_size;
+
+	if(!tsfile_col_is_int(field)) {
+		for(ri = 0; ri < rows; ++ri, value += entry_size, out += width)
+			memcpy(out, value, width);
+
+		return;
+	}
+
+	vmin = vmax = tsfile_col_get(value, width);
+	for(ri = 1; ri < rows; ++ri) {
+		v = tsfile_col_get(value + ri * entry_size, width);
+
+		if(v < vmin)
+			vmin = v;
+		if(v > vmax)
+			vmax = v;
+	}
+
+	col->flags |= TSFILE_COL_MINMAX;
+	col->min = vmin;
+	col->max = vmax;
+
+	if(vmin == vmax) {
+		col->encoding = TSFILE_COL_CONST;
+		col->raw_size = 0;
+		return;
+	}
+
+	range = ((uint64_t) vmax) - ((uint64_t) vmin);
+	col->bits = __msb64(range) + 1;
+
+	/* Accumulator should fit packed value and remaining bits of previous one */
+	if(col->bits <= 56)
+		bp_size = ((uint64_t) rows * col->bits + 7) / 8;
+
+	prev = vmin;
+	for(ri = 0; ri < rows; ++ri) {
+		v = tsfile_col_get(value + ri * entry_size, width);
+		delta_size += tsfile_varint_len(tsfile_zigzag((int64_t) ((uint64_t) v - (uint64_t) prev)));
+		prev = v;
+	}
+
+	if(bp_size <= delta_size && bp_size <= raw_size) {
+		col->encoding = TSFILE_COL_BITPACK;
+		col->raw_size = bp_size;
+
+		acc = 0;
+		nbits = 0;
+
+		for(ri = 0; ri < rows; ++ri, value += entry_size) {
+			v = tsfile_col_get(value, width);
+
+			acc |= (((uint64_t) v) - ((uint64_t) vmin)) << nbits;
+			nbits += col->bits;
+
+			while(nbits >= 8) {
+				*out++ = (char) (acc & 0xff);
+				acc >>= 8;
+				nbits -= 8;
+			}
+		}
+
+		if(nbits > 0)
+			*out = (char) (acc & 0xff);
+	}
+	else if(delta_size < raw_size) {
+		col->encoding = TSFILE_COL_DELTA;
+		col->raw_size = delta_size;
+
+		prev = vmin;
+		for(ri = 0; ri < rows; ++ri, value += entry_size) {
+			v = tsfile_col_get(value, width);
+			acc = tsfile_zigzag((int64_t) ((uint64_t) v - (uint64_t) prev));
+			prev = v;
+
+			while(acc >= 0x80) {
+				*out++ = (char) ((acc & 0x7f) | 0x80);
+				acc >>= 7;
+			}
+			*out++ = (char) acc;
+		}
+	}
+	else {
+		col->bits = 0;
+
+		for(ri = 0; ri < rows; ++ri, value += entry_size, out += width)
+			memcpy(out, value, width);
+	}
+}
+
+/**
+ * Decode column data into entries. Data size is already checked by
+ * tsfile_col_check(), but varints are checked here.
+ */
+static int tsfile_col_decode(tsfile_field_t* field, tsfile_col_hdr_t* col, const char* data,
+							 char* entries, unsigned entry_size, uint32_t rows) {
+	unsigned width = tsfile_col_width(field);
+	char* value = entries + field->offset;
+	const unsigned char* p = (const unsigned char*) data;
+	const unsigned char* end = p + col->raw_size;
+
+	uint64_t acc, mask;
+	unsigned nbits, shift;
+	int64_t prev;
+	uint32_t ri;
+
+	switch(col->encoding) {
+	case TSFILE_COL_RAW:
+		for(ri = 0; ri < rows; ++ri, value += entry_size, p += width)
+			memcpy(value, p, width);
+		break;
+	case TSFILE_COL_CONST:
+		for(ri = 0; ri < rows; ++ri, value += entry_size)
+			tsfile_col_put(value, width, col->min);
+		break;
+	case TSFILE_COL_BITPACK:
+		mask = (((uint64_t) 1) << col->bits) - 1;
+		acc = 0;
+		nbits = 0;
+
+		for(ri = 0; ri < rows; ++ri, value += entry_size) {
+			while(nbits < col->bits) {
+				acc |= ((uint64_t) *p++) << nbits;
+				nbits += 8;
+			}
+
+			tsfile_col_put(value, width, (int64_t) ((uint64_t) col->min + (acc & mask)));
+
+			acc >>= col->bits;
+			nbits -= col->bits;
+		}
+		break;
+	case TSFILE_COL_DELTA:
+		prev = col->min;
+
+		for(ri = 0; ri < rows; ++ri, value += entry_size) {
+			acc = 0;
+			shift = 0;
+
+			do {
+				if(p == end || shift > 63)
+					return TSFILE_DATA_FAIL;
+
+				acc |= ((uint64_t) (*p & 0x7f)) << shift;
+				shift += 7;
+			} while(*p++ & 0x80);
+
+			prev = (int64_t) ((uint64_t) prev + (uint64_t) tsfile_unzigzag(acc));
+			tsfile_col_put(value, width, prev);
+		}
+		break;
+	}
+
+	return TSFILE_OK;
+}
+
+static boolean_t tsfile_col_check(tsfile_field_t* field, tsfile_col_hdr_t* col,
+								  uint32_t rows, uint64_t chunk_size) {
+	size_t raw_size = (size_t) rows * tsfile_col_width(field);
+
+	if(col->encoding >= TSFILE_COL_ENCODING_MAX ||
+	   col->offset + (uint64_t) col->size > chunk_size)
+		return B_FALSE;
+
+	if(col->codec == TSFILE_CODEC_NONE) {
+		if(col->size != col->raw_size)
+			return B_FALSE;
+	}
+	else if(!tsfile_codec_supported(col->codec) || col->size == 0) {
+		return B_FALSE;
+	}
+
+	if(col->encoding != TSFILE_COL_RAW && !tsfile_col_is_int(field))
+		return B_FALSE;
+
+	switch(col->encoding) {
+	case TSFILE_COL_RAW:
+		return col->raw_size == raw_size;
+	case TSFILE_COL_CONST:
+		return col->raw_size == 0;
+	case TSFILE_COL_BITPACK:
+		return col->bits > 0 && col->bits <= 56 &&
+			   col->raw_size == ((uint64_t) rows * col->bits + 7) / 8;
+	case TSFILE_COL_DELTA:
+		return col->raw_size <= raw_size;
+	}
+
+	return B_FALSE;
+}
+
+/* Chunks directory */
+
+static tsfile_chunks_t* tsfile_chunks_alloc(tsfile_header_t* header) {
+	tsfile_chunks_t* chunks = mp_malloc(sizeof(tsfile_chunks_t));
+	size_t rows_size = header->chunk_rows * header->schema.hdr.entry_size;
+
+	chunks->chunk_rows = header->chunk_rows;
+	chunks->codec = header->codec;
+
+	chunks->dir = NULL;
+	chunks->count = 0;
+	chunks->size = 0;
+	chunks->data_end = TSFILE_HEADER_SIZE;
+
+	chunks->pending = mp_malloc(rows_size);
+	chunks->pending_count = 0;
+	chunks->buffered = B_FALSE;
+
+	chunks->dc_chunk = -1;
+	chunks->dc_rows = NULL;
+	chunks->col_rows = NULL;
+
+	chunks->map_buf = NULL;
+	chunks->map_size = 0;
+
+	chunks->buf[0] = chunks->buf[1] = NULL;
+	chunks->buf_size[0] = chunks->buf_size[1] = 0;
+
+	return chunks;
+}
+
+void tsfile_chunks_destroy(tsfile_chunks_t* chunks) {
+	uint32_t ci;
+
+	for(ci = 0; ci < chunks->count; ++ci)
+		mp_free(chunks->dir[ci].cols);
+
+	if(chunks->dir != NULL)
+		mp_free(chunks->dir);
+
+	if(chunks->dc_rows != NULL)
+		mp_free(chunks->dc_rows);
+	if(chunks->col_rows != NULL)
+		mp_free(chunks->col_rows);
+	if(chunks->map_buf != NULL)
+		mp_free(chunks->map_buf);
+	if(chunks->buf[0] != NULL)
+		mp_free(chunks->buf[0]);
+	if(chunks->buf[1] != NULL)
+		mp_free(chunks->buf[1]);
+
+	mp_free(chunks->pending);
+	mp_free(chunks);
+}
+
+static void tsfile_chunks_append(tsfile_chunks_t* chunks, uint32_t first, uint32_t rows,
+								 uint64_t offset, uint64_t size,
+								 const tsfile_col_hdr_t* cols, unsigned ncols) {
+	tsfile_chunk_t* chunk;
+
+	if(chunks->count == chunks->size) {
+		chunks->size = (chunks->size == 0) ? 64 : chunks->size * 2;
+		chunks->dir = mp_realloc(chunks->dir, chunks->size * sizeof(tsfile_chunk_t));
+	}
+
+	chunk = &chunks->dir[chunks->count++];
+
+	chunk->first = first;
+	chunk->rows = rows;
+	chunk->offset = offset;
+	chunk->size = size;
+
+	chunk->cols = mp_malloc(ncols * sizeof(tsfile_col_hdr_t));
+	memcpy(chunk->cols, cols, ncols * sizeof(tsfile_col_hdr_t));
+}
+
+/**
+ * Create chunks state for v2 file and read headers of chunks
+ * committed in superblock sbi. Chunks are kept in file one by one,
+ * so directory is built by walking their headers.
+ */
+tsfile_chunks_t* tsfile_chunks_open(tsfile_t* file, tsfile_header_t* header, int sbi) {
+	tsfile_schema_t* schema = &header->schema;
+	tsfile_chunks_t* chunks;
+
+	size_t hdr_size = sizeof(tsfile_chunk_hdr_t) +
+					  schema->hdr.count * sizeof(tsfile_col_hdr_t);
+	tsfile_chunk_hdr_t* hdr;
+	tsfile_col_hdr_t* cols;
+
+	uint32_t count = header->sb[sbi].count;
+	uint32_t first = 0;
+	uint32_t ci;
+	int fi;
+
+	if(header->chunk_rows == 0 || header->chunk_rows > TSFILE_MAX_CHUNK_ROWS) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid chunk size %u in '%s'",
+						 header->chunk_rows, file->filename);
+		return NULL;
+	}
+
+	if(!tsfile_codec_supported(header->codec)) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Codec #%d of '%s' is not supported",
+						 header->codec, file->filename);
+		return NULL;
+	}
+
+	chunks = tsfile_chunks_alloc(header);
+
+	hdr = (tsfile_chunk_hdr_t*) tsfile_chunk_buf(chunks, 0, hdr_size);
+	cols = (tsfile_col_hdr_t*) (hdr + 1);
+
+	for(ci = 0; ci < header->sb[sbi].chunks; ++ci) {
+		if(tsfile_chunk_pread(file, hdr, hdr_size, chunks->data_end) != TSFILE_OK) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Failed to read chunk #%u of '%s'",
+							 ci, file->filename);
+			goto bad_chunk;
+		}
+
+		if(hdr->magic != TSFILE_CHUNK_MAGIC || hdr->rows == 0 ||
+		   hdr->rows > chunks->chunk_rows || hdr->size < hdr_size ||
+		   hdr->rows > count - first) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid header of chunk #%u in '%s'",
+							 ci, file->filename);
+			goto bad_chunk;
+		}
+
+		for(fi = 0; fi < schema->hdr.count; ++fi) {
+			if(!tsfile_col_check(&schema->fields[fi], &cols[fi], hdr->rows, hdr->size)) {
+				tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid column '%s' of chunk #%u in '%s'",
+								 schema->fields[fi].name, ci, file->filename);
+				goto bad_chunk;
+			}
+		}
+
+		tsfile_chunks_append(chunks, first, hdr->rows, chunks->data_end, hdr->size,
+							 cols, schema->hdr.count);
+
+		first += hdr->rows;
+		chunks->data_end += hdr->size;
+	}
+
+	if(first != count) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Chunks of '%s' have %u entries, "
+						 "superblock has %u", file->filename, first, count);
+		goto bad_chunk;
+	}
+
+	return chunks;
+
+bad_chunk:
+	tsfile_chunks_destroy(chunks);
+	return NULL;
+}
+
+/**
+ * Find chunk which keeps committed entry
+ */
+static uint32_t tsfile_chunk_find(tsfile_chunks_t* chunks, uint32_t index) {
+	uint32_t left = 0, right = chunks->count;
+	uint32_t mid;
+
+	while(right - left > 1) {
+		mid = left + (right - left) / 2;
+
+		if(chunks->dir[mid].first <= index)
+			left = mid;
+		else
+			right = mid;
+	}
+
+	return left;
+}
+
+/* Writing */
+
+/**
+ * Encode pending entries as a chunk, write it to the end of data and
+ * commit superblock. Should be called with file mutex held.
+ */
+static int tsfile_chunk_commit(tsfile_t* file) {
+	tsfile_chunks_t* chunks = file->chunks;
+	tsfile_schema_t* schema = &file->header->schema;
+	unsigned entry_size = schema->hdr.entry_size;
+	uint32_t rows = chunks->pending_count;
+	uint32_t cur_count = tsfile_chunk_committed(file);
+
+	size_t hdr_size = sizeof(tsfile_chunk_hdr_t) +
+					  schema->hdr.count * sizeof(tsfile_col_hdr_t);
+	size_t size = hdr_size;
+	size_t bound;
+	size_t csize;
+	char* buf;
+	char* cbuf;
+
+	tsfile_chunk_hdr_t* hdr;
+	tsfile_col_hdr_t* col;
+	tsfile_field_t* field;
+	int fi;
+	int ret;
+
+	if(rows == 0)
+		return TSFILE_OK;
+
+	/* No column is encoded larger than its raw values */
+	for(fi = 0; fi < schema->hdr.count; ++fi)
+		size += (size_t) rows * tsfile_col_width(&schema->fields[fi]);
+
+	buf = tsfile_chunk_buf(chunks, 0, size);
+	hdr = (tsfile_chunk_hdr_t*) buf;
+	size = hdr_size;
+
+	for(fi = 0; fi < schema->hdr.count; ++fi) {
+		field = &schema->fields[fi];
+		col = ((tsfile_col_hdr_t*) (hdr + 1)) + fi;
+
+		memset(col, 0, sizeof(tsfile_col_hdr_t));
+		tsfile_col_encode(field, chunks->pending, entry_size, rows, col, buf + size);
+
+		col->codec = TSFILE_CODEC_NONE;
+		col->size = col->raw_size;
+		col->offset = size;
+
+		if(chunks->codec != TSFILE_CODEC_NONE && col->raw_size >= TSFILE_CODEC_MIN_SIZE) {
+			bound = tsfile_codec_bound(chunks->codec, col->raw_size);
+			cbuf = tsfile_chunk_buf(chunks, 1, bound);
+
+			csize = tsfile_codec_compress(chunks->codec, buf + size, col->raw_size,
+										  cbuf, bound);
+
+			if(csize > 0 && csize < col->raw_size) {
+				memcpy(buf + size, cbuf, csize);
+
+				col->codec = chunks->codec;
+				col->size = csize;
+			}
+		}
+
+		size += col->size;
+	}
+
+	hdr->magic = TSFILE_CHUNK_MAGIC;
+	hdr->rows = rows;
+	hdr->size = size;
+
+	if(tsfile_chunk_pwrite(file, buf, size, chunks->data_end) != TSFILE_OK)
+		return TSFILE_DATA_FAIL;
+
+	file->size = chunks->data_end + size;
+
+	ret = tsfile_commit_sb(file, cur_count + rows, chunks->count + 1);
+	if(ret != TSFILE_OK)
+		return ret;
+
+	tsfile_chunks_append(chunks, cur_count, rows, chunks->data_end, size,
+						 (tsfile_col_hdr_t*) (hdr + 1), schema->hdr.count);
+
+	chunks->data_end += size;
+	chunks->pending_count = 0;
+
+	return TSFILE_OK;
+}
+
+/**
+ * Add entries to pending chunk and commit chunks when they are full. If flush
+ * is set, remaining entries are committed as short chunk.
+ * Should be called with file mutex held.
+ */
+int tsfile_chunk_add(tsfile_t* file, const void* entries, unsigned count, boolean_t flush) {
+	tsfile_chunks_t* chunks = file->chunks;
+	unsigned entry_size = file->header->schema.hdr.entry_size;
+	const char* entry = entries;
+	unsigned n;
+	int ret;
+
+	while(count > 0) {
+		n = min(count, chunks->chunk_rows - chunks->pending_count);
+
+		memcpy(chunks->pending + chunks->pending_count * entry_size,
+			   entry, n * entry_size);
+
+		chunks->pending_count += n;
+		entry += n * entry_size;
+		count -= n;
+
+		if(chunks->pending_count == chunks->chunk_rows) {
+			ret = tsfile_chunk_commit(file);
+			if(ret != TSFILE_OK)
+				return ret;
+		}
+	}
+
+	if(flush)
+		return tsfile_chunk_commit(file);
+
+	return TSFILE_OK;
+}
+
+uint32_t tsfile_chunk_count(tsfile_t* file) {
+	return tsfile_chunk_committed(file) +
+		   file->chunks->pending_count;
+}
+
+/* Reading */
+
+/**
+ * Decode fields set in field_mask of chunk ci into entries
+ */
+static int tsfile_chunk_decode(tsfile_t* file, uint32_t ci, char* entries, uint64_t field_mask) {
+	tsfile_chunks_t* chunks = file->chunks;
+	tsfile_schema_t* schema = &file->header->schema;
+	tsfile_chunk_t* chunk = &chunks->dir[ci];
+	uint64_t all_mask = (schema->hdr.count == MAXFIELDCOUNT) ?
+							TSFILE_ALL_FIELDS : TSFILE_FIELD_BIT(schema->hdr.count) - 1;
+
+	tsfile_field_t* field;
+	tsfile_col_hdr_t* col;
+	const char* base = NULL;
+	const char* data;
+	char* raw;
+	int fi;
+	int ret;
+
+	/* Read whole chunk at once if all fields are needed */
+	if((field_mask & all_mask) == all_mask) {
+		base = tsfile_chunk_buf(chunks, 0, chunk->size);
+
+		ret = tsfile_chunk_pread(file, (char*) base, chunk->size, chunk->offset);
+		if(ret != TSFILE_OK)
+			return ret;
+	}
+
+	for(fi = 0; fi < schema->hdr.count; ++fi) {
+		if(!(field_mask & TSFILE_FIELD_BIT(fi)))
+			continue;
+
+		field = &schema->fields[fi];
+		col = &chunk->cols[fi];
+
+		if(col->encoding == TSFILE_COL_CONST) {
+			tsfile_col_decode(field, col, NULL, entries, schema->hdr.entry_size, chunk->rows);
+			continue;
+		}
+
+		if(base != NULL) {
+			data = base + col->offset;
+		}
+		else {
+			data = tsfile_chunk_buf(chunks, 0, col->size);
+
+			ret = tsfile_chunk_pread(file, (char*) data, col->size,
+									 chunk->offset + col->offset);
+			if(ret != TSFILE_OK)
+				return ret;
+		}
+
+		if(col->codec != TSFILE_CODEC_NONE) {
+			raw = tsfile_chunk_buf(chunks, 1, col->raw_size);
+
+			ret = tsfile_codec_decompress(col->codec, data, col->size, raw, col->raw_size);
+			if(ret != TSFILE_OK)
+				return ret;
+
+			data = raw;
+		}
+
+		ret = tsfile_col_decode(field, col, data, entries, schema->hdr.entry_size, chunk->rows);
+		if(ret != TSFILE_OK)
+			return ret;
+	}
+
+	return TSFILE_OK;
+}
+
+/**
+ * Decode all fields of chunk ci into decoded chunk cache
+ */
+static int tsfile_chunk_cache(tsfile_t* file, uint32_t ci) {
+	tsfile_chunks_t* chunks = file->chunks;
+	int ret;
+
+	if(chunks->dc_chunk == (int) ci)
+		return TSFILE_OK;
+
+	if(chunks->dc_rows == NULL)
+		chunks->dc_rows = mp_malloc(chunks->chunk_rows * file->header->schema.hdr.entry_size);
+
+	chunks->dc_chunk = -1;
+
+	ret = tsfile_chunk_decode(file, ci, chunks->dc_rows, TSFILE_ALL_FIELDS);
+	if(ret == TSFILE_OK)
+		chunks->dc_chunk = ci;
+
+	return ret;
+}
+
+/**
+ * Get entries [start; end) including pending ones. Only fields from
+ * field_mask are guaranteed to be filled. Range should be already checked.
+ * Should be called with file mutex held.
+ */
+int tsfile_chunk_get(tsfile_t* file, void* entries, unsigned start, unsigned end, uint64_t field_mask) {
+	tsfile_chunks_t* chunks = file->chunks;
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	uint32_t cur_count = tsfile_chunk_committed(file);
+	char* dst = entries;
+
+	tsfile_chunk_t* chunk;
+	uint32_t ci;
+	uint32_t index = start;
+	uint32_t chunk_end;
+	int ret;
+
+	while(index < end && index < cur_count) {
+		ci = tsfile_chunk_find(chunks, index);
+		chunk = &chunks->dir[ci];
+		chunk_end = min(end, chunk->first + chunk->rows);
+
+		if(index == chunk->first && chunk_end == chunk->first + chunk->rows &&
+		   chunks->dc_chunk != (int) ci) {
+			/* Whole chunk is needed - decode directly to entries */
+			ret = tsfile_chunk_decode(file, ci, dst, field_mask);
+		}
+		else {
+			ret = tsfile_chunk_cache(file, ci);
+			if(ret == TSFILE_OK) {
+				memcpy(dst, chunks->dc_rows + (index - chunk->first) * entry_size,
+					   (chunk_end - index) * entry_size);
+			}
+		}
+
+		if(ret != TSFILE_OK)
+			return ret;
+
+		dst += (chunk_end - index) * entry_size;
+		index = chunk_end;
+	}
+
+	if(index < end) {
+		memcpy(dst, chunks->pending + (index - cur_count) * entry_size,
+			   (end - index) * entry_size);
+	}
+
+	return TSFILE_OK;
+}
+
+/**
+ * Map entries [start; end). If they are in one chunk, pointer to decoded chunk
+ * is returned, otherwise entries are assembled in map buffer.
+ * Range should be already checked. Should be called with file mutex held.
+ */
+int tsfile_chunk_map(tsfile_t* file, unsigned start, unsigned end, const void** p_entries) {
+	tsfile_chunks_t* chunks = file->chunks;
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	uint32_t cur_count = tsfile_chunk_committed(file);
+	size_t size = (end - start) * entry_size;
+
+	tsfile_chunk_t* chunk;
+	uint32_t ci;
+	int ret;
+
+	if(end <= cur_count) {
+		ci = tsfile_chunk_find(chunks, start);
+		chunk = &chunks->dir[ci];
+
+		if(end <= chunk->first + chunk->rows) {
+			ret = tsfile_chunk_cache(file, ci);
+			if(ret != TSFILE_OK)
+				return ret;
+
+			*p_entries = chunks->dc_rows + (start - chunk->first) * entry_size;
+			return TSFILE_OK;
+		}
+	}
+
+	if(chunks->map_size < size) {
+		if(chunks->map_buf != NULL)
+			mp_free(chunks->map_buf);
+
+		chunks->map_buf = mp_malloc(size);
+		chunks->map_size = size;
+	}
+
+	ret = tsfile_chunk_get(file, chunks->map_buf, start, end, TSFILE_ALL_FIELDS);
+	if(ret != TSFILE_OK)
+		return ret;
+
+	*p_entries = chunks->map_buf;
+	return TSFILE_OK;
+}
+
+unsigned tsfile_chunk_map_batch(tsfile_t* file, unsigned start, unsigned end) {
+	tsfile_chunks_t* chunks = file->chunks;
+	tsfile_chunk_t* chunk;
+
+	if(start >= tsfile_chunk_committed(file))
+		return end;
+
+	chunk = &chunks->dir[tsfile_chunk_find(chunks, start)];
+
+	return min(end, chunk->first + chunk->rows);
+}
+
+/**
+ * Add entries to index decoding only key column. Chunks which keys
+ * are not greater than maximum indexed key are skipped using their
+ * minimum and maximum values. Should be called with file mutex held.
+ */
+int tsfile_chunk_update_index(tsfile_t* file, uint32_t cur_count) {
+	tsfile_chunks_t* chunks = file->chunks;
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	uint32_t committed = tsfile_chunk_committed(file);
+	uint32_t index = file->idx_count;
+
+	tsfile_chunk_t* chunk;
+	tsfile_col_hdr_t* col;
+	const char* entries;
+	uint32_t ci;
+	int ret;
+
+	while(index < committed) {
+		ci = tsfile_chunk_find(chunks, index);
+		chunk = &chunks->dir[ci];
+		col = &chunk->cols[file->idx_field];
+
+		/* Keys are compared as unsigned values, so negative minimum
+		 * means that chunk may have large keys */
+		if((col->flags & TSFILE_COL_MINMAX) && col->min >= 0 &&
+		   col->max <= file->idx_max_key) {
+			index = chunk->first + chunk->rows;
+			continue;
+		}
+
+		if(chunks->dc_chunk == (int) ci) {
+			entries = chunks->dc_rows;
+		}
+		else {
+			if(chunks->col_rows == NULL)
+				chunks->col_rows = mp_malloc(chunks->chunk_rows * entry_size);
+
+			ret = tsfile_chunk_decode(file, ci, chunks->col_rows,
+									  TSFILE_FIELD_BIT(file->idx_field));
+			if(ret != TSFILE_OK)
+				return ret;
+
+			entries = chunks->col_rows;
+		}
+
+		tsfile_index_entries(file, entries + (index - chunk->first) * entry_size,
+							 index, chunk->first + chunk->rows);
+		index = chunk->first + chunk->rows;
+	}
+
+	if(index < cur_count) {
+		tsfile_index_entries(file, chunks->pending + (index - committed) * entry_size,
+							 index, cur_count);
+	}
+
+	file->idx_count = cur_count;
+
+	return TSFILE_OK;
+}
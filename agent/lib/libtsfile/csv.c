@@ -30,6 +30,7 @@
 
 #include <tsfile.h>
 #include <csv.h>
+#include <numfmt.h>
 
 #include <string.h>
 #include <stdio.h>
@@ -131,8 +132,7 @@ static void csv_header_iter_init(csv_hdr_iter_t* iter, const char* header) {
 
 static void csv_header_iter_next_opt(csv_chars_t* chars, csv_hdr_iter_t* iter) {
 	const char* opt2;
-	const char* next = (iter->tmp == NULL)
-		? (iter->ptr + iter->length) : iter->tmp;
+	const char* next = iter->ptr + iter->length;
 
 	if(!iter->opt)
 		return;
@@ -210,7 +210,7 @@ static int csv_parse_header_opts(csv_chars_t* chars, csv_hdr_iter_t* iter, csv_b
 				binding->opt.int_flags |= CSV_INT_HEX;
 			}
 			else if(strncmp(iter->opt, "unsigned", iter->opt_length) == 0) {
-				binding->opt.int_flags |= CSV_INT_HEX;
+				binding->opt.int_flags |= CSV_INT_UNSIGNED;
 			}
 			else {
 				return CSV_HDR_INVALID_OPT;
@@ -497,237 +497,408 @@ size_t csv_max_line_length(csv_binding_t* bindings, int bcount) {
 	return max_length;
 }
 
-static const char* csv_int_format_table[4][6] = {
-	/* size	{ decimal, hex, unsigned } */
-	/* 1 */ { "%" PRId8,  "%" PRIx8,  "%" PRIu8,
-			  "%" SCNd8,  "%" SCNx8,  "%" SCNu8 },
-	/* 2 */ { "%" PRId16, "%" PRIx16, "%" PRIu16,
-			  "%" SCNd16, "%" SCNx16, "%" SCNu16 },
-	/* 8 */ { "%" PRId64, "%" PRIx64, "%" PRIu64,
-			  "%" SCNd64, "%" SCNx64, "%" SCNu64 },
-	/* 4 */ { "%" PRId32, "%" PRIx32, "%" PRIu32,
-			  "%" SCNd32, "%" SCNx32, "%" SCNu32 }
-};
-
-static const char* csv_int_format_str(csv_binding_t* binding, boolean_t is_scanf) {
-	unsigned i, j;
-	int int_flags = binding->opt.int_flags;
-
-	i = (binding->field->size == 8)
-			? 2
-			: (unsigned)(binding->field->size - 1);
-
-	j = (int_flags & CSV_INT_HEX)
-			? 1
-			: (int_flags & CSV_INT_UNSIGNED)
-			  ? 2
-			  :	0;
-
-	j = (is_scanf)? j + 3 : j;
-
-	return csv_int_format_table[i][j];
+/**
+ * Compile bindings into list of operations used by csv_read_entry()
+ * and CSV writer. Returned array should be freed with mp_free().
+ */
+csv_op_t* csv_compile_bindings(csv_binding_t* bindings, int bcount) {
+	csv_op_t* ops = mp_malloc(bcount * sizeof(csv_op_t));
+	csv_op_t* op;
+	int bid;
+
+	tsfile_field_t* field;
+	int int_flags;
+
+	for(bid = 0; bid < bcount; ++bid) {
+		field = bindings[bid].field;
+		op = ops + bid;
+
+		op->offset = field->offset;
+		op->size = field->size;
+
+		switch(field->type) {
+		case TSFILE_FIELD_BOOLEAN:
+			op->op = CSV_OP_BOOL;
+
+			strncpy(op->literal[B_TRUE], bindings[bid].opt.bool.true_literal, CSVBOOLLEN);
+			strncpy(op->literal[B_FALSE], bindings[bid].opt.bool.false_literal, CSVBOOLLEN);
+			op->literal[B_TRUE][CSVBOOLLEN - 1] = '\0';
+			op->literal[B_FALSE][CSVBOOLLEN - 1] = '\0';
+
+			op->literal_len[B_TRUE] = strlen(op->literal[B_TRUE]);
+			op->literal_len[B_FALSE] = strlen(op->literal[B_FALSE]);
+		break;
+		case TSFILE_FIELD_INT:
+			int_flags = bindings[bid].opt.int_flags;
+
+			/* Small integers were always written as unsigned due to integer
+			 * promotion in printf(), so keep that for compatibility */
+			if(int_flags & CSV_INT_HEX) {
+				op->op = CSV_OP_HEX;
+			}
+			else if((int_flags & CSV_INT_UNSIGNED) || field->size < sizeof(uint32_t)) {
+				op->op = CSV_OP_UINT;
+			}
+			else {
+				op->op = CSV_OP_INT;
+			}
+		break;
+		case TSFILE_FIELD_FLOAT:
+			op->op = (field->size == sizeof(float)) ? CSV_OP_FLOAT : CSV_OP_DOUBLE;
+		break;
+		case TSFILE_FIELD_STRING:
+			op->op = CSV_OP_STRING;
+		break;
+		}
+	}
+
+	return ops;
 }
 
-static void csv_write_string(csv_chars_t* chars, FILE* file, const char* string) {
-	const char* ptr = strchr(string, chars->csv_separator);
+static uint64_t csv_get_int(char* value, size_t size, boolean_t is_signed) {
+	switch(size) {
+	case 1:
+		return (is_signed) ? (uint64_t) (int8_t) FIELD_GET_VALUE(uint8_t, value)
+						   : FIELD_GET_VALUE(uint8_t, value);
+	case 2:
+		return (is_signed) ? (uint64_t) (int16_t) FIELD_GET_VALUE(uint16_t, value)
+						   : FIELD_GET_VALUE(uint16_t, value);
+	case 4:
+		return (is_signed) ? (uint64_t) (int32_t) FIELD_GET_VALUE(uint32_t, value)
+						   : FIELD_GET_VALUE(uint32_t, value);
+	case 8:
+		return FIELD_GET_VALUE(uint64_t, value);
+	}
 
-	if(ptr == NULL) {
-		fputs(string, file);
-		return;
+	return 0;
+}
+
+static void csv_put_int(char* value, size_t size, uint64_t u) {
+	switch(size) {
+	case 1:
+		FIELD_PUT_VALUE(uint8_t, value, u);
+	break;
+	case 2:
+		FIELD_PUT_VALUE(uint16_t, value, u);
+	break;
+	case 4:
+		FIELD_PUT_VALUE(uint32_t, value, u);
+	break;
+	case 8:
+		FIELD_PUT_VALUE(uint64_t, value, u);
+	break;
 	}
+}
+
+/**
+ * Create CSV writer for entries described by bindings
+ */
+csv_writer_t* csv_writer_create(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount) {
+	csv_writer_t* writer = mp_malloc(sizeof(csv_writer_t));
+	size_t max_line = 0;
+	int bid;
+
+	csv_op_t* op;
+
+	writer->chars = *chars;
+	writer->file = file;
 
-	ptr = string;
+	writer->ops = csv_compile_bindings(bindings, bcount);
+	writer->count = bcount;
+
+	/* Find longest line that could be written, so we check free space
+	 * in buffer only once per entry */
+	for(bid = 0; bid < bcount; ++bid) {
+		op = writer->ops + bid;
 
-	/* If commas are in string - escape double quotas */
-	fputc('"', file);
-	while(*ptr) {
-		fputc(*ptr, file);
+		switch(op->op) {
+		case CSV_OP_BOOL:
+			max_line += max(op->literal_len[B_TRUE], op->literal_len[B_FALSE]);
+		break;
+		case CSV_OP_STRING:
+			/* Worst case when string consists only from DQUOTEs */
+			max_line += 2 * op->size + 2;
+		break;
+		default:
+			max_line += NUMFMT_MAX_LEN;
+		break;
+		}
+
+		/* Separator or newline */
+		++max_line;
+	}
+
+	writer->max_line = max_line + 1;
+
+	writer->size = max(CSV_WRITER_BUFSIZE, writer->max_line);
+	writer->buf = mp_malloc(writer->size);
+	writer->len = 0;
+
+	writer->error = CSV_OK;
+
+	return writer;
+}
+
+void csv_writer_destroy(csv_writer_t* writer) {
+	mp_free(writer->ops);
+	mp_free(writer->buf);
+	mp_free(writer);
+}
+
+int csv_writer_flush(csv_writer_t* writer) {
+	if(writer->error != CSV_OK)
+		return writer->error;
+
+	if(writer->len > 0) {
+		if(fwrite(writer->buf, 1, writer->len, writer->file) != writer->len) {
+			logmsg(LOG_CRIT, "Failed to write CSV data");
+			writer->error = CSV_WRITE_ERROR;
+		}
+
+		writer->len = 0;
+	}
+
+	return writer->error;
+}
+
+static char* csv_write_string(csv_chars_t* chars, char* p, const char* string, size_t size) {
+	const char* end = memchr(string, '\0', size);
+	const char* ptr;
+	size_t length = (end != NULL) ? (size_t) (end - string) : size;
+
+	boolean_t quote = B_FALSE;
+
+	for(ptr = string; ptr < string + length; ++ptr) {
+		if(*ptr == chars->csv_separator || *ptr == '"') {
+			quote = B_TRUE;
+			break;
+		}
+	}
+
+	if(!quote) {
+		memcpy(p, string, length);
+		return p + length;
+	}
+
+	/* If separators or quotes are in string - escape double quotes */
+	*p++ = '"';
+	for(ptr = string; ptr < string + length; ++ptr) {
+		*p++ = *ptr;
 		if(*ptr == '"')
-			fputc('"', file);
+			*p++ = '"';
+	}
+	*p++ = '"';
+
+	return p;
+}
+
+/**
+ * Format entry into writer's buffer
+ *
+ * @return CSV_OK or CSV_WRITE_ERROR if previous flush has failed
+ */
+int csv_writer_write(csv_writer_t* writer, const void* entry) {
+	csv_op_t* op;
+	csv_op_t* end = writer->ops + writer->count;
+
+	char* value;
+	char* p;
+	boolean_t b;
+
+	if(writer->size - writer->len < writer->max_line) {
+		if(csv_writer_flush(writer) != CSV_OK)
+			return writer->error;
+	}
+
+	p = writer->buf + writer->len;
 
-		++ptr;
+	for(op = writer->ops; op < end; ++op) {
+		value = ((char*) entry) + op->offset;
+
+		switch(op->op) {
+		case CSV_OP_BOOL:
+			b = (FIELD_GET_VALUE(boolean_t, value)) ? B_TRUE : B_FALSE;
+			memcpy(p, op->literal[b], op->literal_len[b]);
+			p += op->literal_len[b];
+		break;
+		case CSV_OP_INT:
+			p += numfmt_int(p, (int64_t) csv_get_int(value, op->size, B_TRUE));
+		break;
+		case CSV_OP_UINT:
+			p += numfmt_uint(p, csv_get_int(value, op->size, B_FALSE));
+		break;
+		case CSV_OP_HEX:
+			p += numfmt_hex(p, csv_get_int(value, op->size, B_FALSE));
+		break;
+		case CSV_OP_FLOAT:
+			p += numfmt_float(p, FIELD_GET_VALUE(float, value));
+		break;
+		case CSV_OP_DOUBLE:
+			p += numfmt_double(p, FIELD_GET_VALUE(double, value));
+		break;
+		case CSV_OP_STRING:
+			p = csv_write_string(&writer->chars, p, value, op->size);
+		break;
+		}
+
+		*p++ = writer->chars.csv_separator;
 	}
-	fputc('"', file);
+
+	/* Replace last separator with newline */
+	if(writer->count > 0)
+		--p;
+	*p++ = '\n';
+
+	writer->len = p - writer->buf;
+
+	return CSV_OK;
 }
 
-static size_t csv_read_string(csv_chars_t* chars, const char* ptr, char* string, size_t str_length) {
-	const char* src = ptr;
+/**
+ * Read string or boolean literal from CSV line. Copies at most size - 1
+ * characters and zeroes rest of destination.
+ *
+ * @return pointer to character after the field
+ */
+static const char* csv_read_string(csv_chars_t* chars, const char* src, char* string, size_t size) {
 	char* dst = string;
-	size_t length = str_length;
-
-	boolean_t unescape = B_FALSE;
+	char* end = string + size - 1;
 
 	if(*src == '"') {
 		/* Unescape */
+		++src;
+
 		while(*src) {
 			if(*src == '"') {
 				++src;
 
-				/* Reached end-of field */
-				if(*src == chars->csv_separator || !*src)
+				/* Closing quote */
+				if(*src != '"')
 					break;
 			}
 
-			if(length > 0) {
-				*dst = *src;
-				++dst;
-				--length;
-			}
+			if(dst < end)
+				*dst++ = *src;
 
 			++src;
 		}
 	}
 	else {
 		while(*src != chars->csv_separator && *src) {
-			if(length > 0) {
-				*dst = *src;
-				++dst;
-				--length;
-			}
+			if(dst < end)
+				*dst++ = *src;
 
 			++src;
 		}
 	}
 
-	*dst = '\0';
+	memset(dst, 0, end - dst + 1);
 
-	return src - ptr + 1;
+	return src;
 }
 
-void csv_write_entry(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount, void* entry) {
-	int bid;
+STATIC_INLINE const char* csv_skip_space(const char* p) {
+	while(*p == ' ' || *p == '\t')
+		++p;
 
-	tsfile_field_t* field;
-	char* value;
-
-	for(bid = 0; bid < bcount; ++bid) {
-		field = bindings[bid].field;
-		value = ((char*) entry) + field->offset;
-
-		switch(field->type) {
-		case TSFILE_FIELD_BOOLEAN:
-				fputs((FIELD_GET_VALUE(boolean_t, value))
-					   ? bindings[bid].opt.bool.true_literal
-					   : bindings[bid].opt.bool.false_literal, file);
-			break;
-		case TSFILE_FIELD_INT:
-			{
-			const char* fmt = csv_int_format_str(&bindings[bid], B_FALSE);
-			switch(field->size) {
-				case 1:
-					fprintf(file, fmt, FIELD_GET_VALUE(uint8_t, value));
-				break;
-				case 2:
-					fprintf(file, fmt, FIELD_GET_VALUE(uint16_t, value));
-				break;
-				case 4:
-					fprintf(file, fmt, FIELD_GET_VALUE(uint32_t, value));
-				break;
-				case 8:
-					fprintf(file, fmt, FIELD_GET_VALUE(uint64_t, value));
-				break;
-			}
-			}
-			break;
-		case TSFILE_FIELD_FLOAT:
-			switch(field->size) {
-			case sizeof(float):
-				fprintf(file, "%f", FIELD_GET_VALUE(float, value));
-			break;
-			case sizeof(double):
-				fprintf(file, "%f", FIELD_GET_VALUE(double, value));
-			break;
-			}
-			break;
-		case TSFILE_FIELD_STRING:
-			csv_write_string(chars, file, value);
-		break;
-		}
-
-		if(bid < (bcount - 1))
-			fputc(chars->csv_separator, file);
-	}
-
-	fputc('\n', file);
+	return p;
 }
 
-int csv_read_entry(csv_chars_t* chars, const char* line, csv_binding_t* bindings, int bcount, void* entry) {
+/**
+ * Parse CSV line into entry
+ *
+ * @param chars csv characters
+ * @param line line without trailing newline
+ * @param ops compiled bindings (see csv_compile_bindings())
+ * @param bcount number of bindings
+ * @param entry destination entry
+ */
+int csv_read_entry(csv_chars_t* chars, const char* line, csv_op_t* ops, int bcount, void* entry) {
 	int bid;
 
-	tsfile_field_t* field;
+	csv_op_t* op;
 	char* value;
 
-	size_t pos = 0;
-	int scan_len;
-	int scan_count = 0;
-	size_t line_len = strlen(line);
+	const char* p = line;
+	const char* field;
 
 	char bool_value[CSVBOOLLEN];
-	char fmttmp[12];
-	const char* fmtstr;
+	uint64_t u;
+	float f;
+	double d;
 
 	for(bid = 0; bid < bcount; ++bid) {
-		field = bindings[bid].field;
-		value = ((char*) entry) + field->offset;
+		op = ops + bid;
+		value = ((char*) entry) + op->offset;
+		field = p;
 
-		if(pos == line_len) {
-			logmsg(LOG_CRIT, "Line ended prematurely at %" PRIsz, pos);
-			return CSV_PARSE_LINE_ERROR;
-		}
-		if(pos > line_len) {
-			logmsg(LOG_CRIT, "Internal error: 'pos' %"PRIsz" is outside line", pos);
-			return CSV_INTERNAL_ERROR;
-		}
-
-		if(field->type == TSFILE_FIELD_STRING) {
-			pos += csv_read_string(chars, line + pos, value, field->size);
-			continue;
-		}
-		else if(field->type == TSFILE_FIELD_BOOLEAN) {
-			pos += csv_read_string(chars, line + pos, bool_value, CSVBOOLLEN);
+		switch(op->op) {
+		case CSV_OP_STRING:
+			p = csv_read_string(chars, p, value, op->size);
+		break;
+		case CSV_OP_BOOL:
+			p = csv_read_string(chars, p, bool_value, CSVBOOLLEN);
 
-			if(strncmp(bool_value, bindings[bid].opt.bool.true_literal, CSVBOOLLEN) == 0) {
+			if(strcmp(bool_value, op->literal[B_TRUE]) == 0) {
 				FIELD_PUT_VALUE(boolean_t, value, B_TRUE);
-				continue;
 			}
-			else if (strncmp(bool_value, bindings[bid].opt.bool.false_literal, CSVBOOLLEN) == 0) {
+			else if(strcmp(bool_value, op->literal[B_FALSE]) == 0) {
 				FIELD_PUT_VALUE(boolean_t, value, B_FALSE);
-				continue;
 			}
 			else {
 				logmsg(LOG_CRIT, "Boolean parse error, unexpected literal '%s' at %"PRIsz,
-						bool_value, pos);
+						bool_value, (size_t) (field - line));
 				return CSV_PARSE_BOOL_ERROR;
 			}
+		break;
+		case CSV_OP_INT:
+		case CSV_OP_UINT:
+		case CSV_OP_HEX:
+			p = (op->op == CSV_OP_HEX) ? numfmt_parse_hex(p, &u)
+									   : numfmt_parse_int(p, &u);
+			if(p != NULL)
+				csv_put_int(value, op->size, u);
+		break;
+		case CSV_OP_FLOAT:
+			p = numfmt_parse_float(p, &f);
+			if(p != NULL)
+				FIELD_PUT_VALUE(float, value, f);
+		break;
+		case CSV_OP_DOUBLE:
+			p = numfmt_parse_double(p, &d);
+			if(p != NULL)
+				FIELD_PUT_VALUE(double, value, d);
+		break;
 		}
 
-		if(field->type == TSFILE_FIELD_INT) {
-			fmtstr = csv_int_format_str(&bindings[bid], B_TRUE);
-		}
-		else if(field->type == TSFILE_FIELD_FLOAT) {
-			fmtstr = "%f";
+		if(p == NULL) {
+			logmsg(LOG_CRIT, "Failed to parse field #%d at %"PRIsz, bid + 1,
+				   (size_t) (field - line));
+			return CSV_PARSE_FMT_ERROR;
 		}
 
+		if(op->op != CSV_OP_STRING && op->op != CSV_OP_BOOL)
+			p = csv_skip_space(p);
+
 		if(bid < (bcount - 1)) {
-			sprintf(fmttmp, "%s%c%%n", fmtstr, chars->csv_separator);
-			fmtstr = fmttmp;
-		}
-		else {
-			sprintf(fmttmp, "%s%%n", fmtstr);
-			fmtstr = fmttmp;
-		}
+			if(*p == '\0') {
+				logmsg(LOG_CRIT, "Line ended prematurely at %" PRIsz, (size_t) (p - line));
+				return CSV_PARSE_LINE_ERROR;
+			}
 
-		scan_count = sscanf(line + pos, fmtstr, value, &scan_len);
+			if(*p != chars->csv_separator) {
+				logmsg(LOG_CRIT, "Unexpected character '%c' in field #%d at %" PRIsz,
+					   *p, bid + 1, (size_t) (p - line));
+				return CSV_PARSE_FMT_ERROR;
+			}
 
-		if(scan_count == 0) {
-			logmsg(LOG_CRIT, "Failed to parse field at %"PRIsz". Format: %s", pos, fmtstr);
+			++p;
+		}
+		else if(*p != '\0') {
+			logmsg(LOG_CRIT, "Unexpected data after last field at %" PRIsz, (size_t) (p - line));
 			return CSV_PARSE_FMT_ERROR;
 		}
-
-		pos += scan_len;
 	}
 
 	return CSV_OK;
 }
-
-
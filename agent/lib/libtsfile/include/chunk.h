@@ -0,0 +1,133 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+#include <tsload/defs.h>
+
+#include <tsfile.h>
+
+
+#define TSFILE_CHUNK_MAGIC		0x4b4e4843		/* "CHNK" */
+
+/* Columns smaller than that are not compressed */
+#define TSFILE_CODEC_MIN_SIZE	64
+
+#define TSFILE_ZSTD_LEVEL		3
+
+typedef enum tsfile_col_encoding {
+	TSFILE_COL_RAW,			/* Values as they are kept in entries */
+	TSFILE_COL_CONST,		/* All values are equal to min, no data */
+	TSFILE_COL_BITPACK,		/* (value - min) packed into `bits` bits */
+	TSFILE_COL_DELTA,		/* Zigzag varints of differences between values */
+
+	TSFILE_COL_ENCODING_MAX
+} tsfile_col_encoding_t;
+
+/* Column has valid min and max values (integer and boolean columns) */
+#define TSFILE_COL_MINMAX		0x01
+
+/**
+ * On-disk chunk is a chunk header followed by headers of each field
+ * of schema (in order of schema) and column data. Offsets of column data are
+ * relative to beginning of the chunk. Integers are in host byte order like entries
+ * of v1 files.
+ */
+typedef struct tsfile_chunk_hdr {
+	uint32_t		magic;
+	uint32_t		rows;
+	uint64_t		size;
+} tsfile_chunk_hdr_t;
+
+typedef struct tsfile_col_hdr {
+	uint8_t			encoding;
+	uint8_t			codec;
+	uint8_t			bits;
+	uint8_t			flags;
+
+	uint32_t		raw_size;		/* Size of encoded data before compression */
+	uint32_t		size;			/* Size of data kept in chunk */
+	uint32_t		offset;
+
+	int64_t			min;
+	int64_t			max;
+} tsfile_col_hdr_t;
+
+typedef struct tsfile_chunk {
+	uint32_t		first;
+	uint32_t		rows;
+	uint64_t		offset;
+	uint64_t		size;
+
+	tsfile_col_hdr_t* cols;
+} tsfile_chunk_t;
+
+typedef struct tsfile_chunks {
+	uint32_t		chunk_rows;
+	tsfile_codec_t	codec;
+
+	/* Directory of committed chunks */
+	tsfile_chunk_t*	dir;
+	uint32_t		count;
+	uint32_t		size;
+	uint64_t		data_end;
+
+	/* Entries that do not fill chunk yet */
+	char*			pending;
+	uint32_t		pending_count;
+	boolean_t		buffered;
+
+	/* Last chunk decoded entirely */
+	int				dc_chunk;
+	char*			dc_rows;
+
+	/* Chunk with some columns decoded (for index) */
+	char*			col_rows;
+
+	/* Entries assembled from several chunks by tsfile_map_entries() */
+	char*			map_buf;
+	size_t			map_size;
+
+	/* Scratch buffers for column data */
+	char*			buf[2];
+	size_t			buf_size[2];
+} tsfile_chunks_t;
+
+tsfile_chunks_t* tsfile_chunks_open(tsfile_t* file, tsfile_header_t* header, int sbi);
+void tsfile_chunks_destroy(tsfile_chunks_t* chunks);
+
+int tsfile_chunk_add(tsfile_t* file, const void* entries, unsigned count, boolean_t flush);
+uint32_t tsfile_chunk_count(tsfile_t* file);
+
+int tsfile_chunk_get(tsfile_t* file, void* entries, unsigned start, unsigned end, uint64_t field_mask);
+int tsfile_chunk_map(tsfile_t* file, unsigned start, unsigned end, const void** p_entries);
+unsigned tsfile_chunk_map_batch(tsfile_t* file, unsigned start, unsigned end);
+
+int tsfile_chunk_update_index(tsfile_t* file, uint32_t cur_count);
+
+boolean_t tsfile_codec_supported(int codec);
+
+/* Implemented in tsfile.c */
+
+int tsfile_commit_sb(tsfile_t* file, uint32_t count, uint32_t chunks);
+void tsfile_index_entries(tsfile_t* file, const char* entries, uint32_t index, uint32_t end);
+
+#endif /* CHUNK_H_ */
@@ -67,6 +67,32 @@ typedef struct {
 	} opt;
 } csv_binding_t;
 
+/**
+ * Compiled binding. Bindings are resolved once into a flat list of
+ * operations, so reading or writing an entry doesn't need to check field
+ * types, sizes and options for each value.
+ */
+typedef enum {
+	CSV_OP_BOOL,
+	CSV_OP_INT,			/* signed decimal */
+	CSV_OP_UINT,		/* unsigned decimal */
+	CSV_OP_HEX,
+	CSV_OP_FLOAT,
+	CSV_OP_DOUBLE,
+	CSV_OP_STRING
+} csv_op_type_t;
+
+typedef struct {
+	csv_op_type_t	op;
+
+	size_t			offset;
+	size_t			size;
+
+	/* Boolean literals: [B_FALSE] and [B_TRUE] */
+	char			literal[2][CSVBOOLLEN];
+	size_t			literal_len[2];
+} csv_op_t;
+
 typedef enum {
 	CSV_HDR_PARSE_ALL,
 	CSV_HDR_PARSE_OPT,
@@ -82,20 +108,49 @@ typedef struct {
 	int csv_opt_separator;
 } csv_chars_t;
 
-void* csv_entry_create(list_head_t* list, size_t entry_size);
+#define CSV_WRITER_BUFSIZE		(256 * SZ_KB)
+
+/**
+ * Buffered CSV writer. Entries are formatted into a large buffer which
+ * is written with fwrite() when it can't hold another line.
+ */
+typedef struct {
+	csv_chars_t		chars;
+
+	csv_op_t*		ops;
+	int				count;
+
+	FILE*			file;
+
+	char*			buf;
+	size_t			len;
+	size_t			size;
+
+	size_t			max_line;
+
+	int				error;
+} csv_writer_t;
+
+LIBEXPORT void* csv_entry_create(list_head_t* list, size_t entry_size);
+
+LIBEXPORT int csv_entry_list_add(tsfile_t* ts_file, list_head_t* list);
+LIBEXPORT int csv_entry_list_destroy(list_head_t* list);
+
+LIBEXPORT size_t csv_max_line_length(csv_binding_t* bindings, int bcount);
+LIBEXPORT int csv_read_header(csv_chars_t* chars, FILE* file, const char* header, csv_binding_t* bindings,
+							  tsfile_schema_t* schema);
+LIBEXPORT int csv_read_entry(csv_chars_t* chars, const char* line, csv_op_t* ops, int bcount, void* entry);
 
-int csv_entry_list_add(tsfile_t* ts_file, list_head_t* list);
-int csv_entry_list_destroy(list_head_t* list);
+LIBEXPORT csv_op_t* csv_compile_bindings(csv_binding_t* bindings, int bcount);
 
-size_t csv_max_line_length(csv_binding_t* bindings, int bcount);
-int csv_read_header(csv_chars_t* chars, FILE* file, const char* header, csv_binding_t* bindings,
-					tsfile_schema_t* schema);
-int csv_read_entry(csv_chars_t* chars, const char* line, csv_binding_t* bindings, int bcount, void* entry);
+LIBEXPORT int csv_generate_bindings(csv_chars_t* chars, const char* header, csv_binding_t* bindings,
+									tsfile_schema_t* schema, csv_hdr_mode_t mode);
+LIBEXPORT void csv_write_header(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount);
 
-int csv_generate_bindings(csv_chars_t* chars, const char* header, csv_binding_t* bindings,
-						  tsfile_schema_t* schema, csv_hdr_mode_t mode);
-void csv_write_header(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount);
-void csv_write_entry(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount, void* entry);
+LIBEXPORT csv_writer_t* csv_writer_create(csv_chars_t* chars, FILE* file, csv_binding_t* bindings, int bcount);
+LIBEXPORT void csv_writer_destroy(csv_writer_t* writer);
+LIBEXPORT int csv_writer_write(csv_writer_t* writer, const void* entry);
+LIBEXPORT int csv_writer_flush(csv_writer_t* writer);
 
 #endif /* CSV_H_ */
 
@@ -0,0 +1,52 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef NUMFMT_H_
+#define NUMFMT_H_
+
+#include <tsload/defs.h>
+
+
+/**
+ * Number formatting and parsing routines used by exporters.
+ *
+ * Formatters write number into buf without null-terminator and return
+ * its length. Buffer should have at least NUMFMT_MAX_LEN bytes.
+ *
+ * Parsers skip leading spaces and return pointer to first character after
+ * the number or NULL if there is no number.
+ */
+
+#define NUMFMT_MAX_LEN		32
+
+LIBEXPORT size_t numfmt_uint(char* buf, uint64_t u);
+LIBEXPORT size_t numfmt_int(char* buf, int64_t i);
+LIBEXPORT size_t numfmt_hex(char* buf, uint64_t u);
+
+LIBEXPORT size_t numfmt_double(char* buf, double d);
+LIBEXPORT size_t numfmt_float(char* buf, float f);
+
+LIBEXPORT const char* numfmt_parse_int(const char* s, uint64_t* u);
+LIBEXPORT const char* numfmt_parse_hex(const char* s, uint64_t* u);
+
+LIBEXPORT const char* numfmt_parse_double(const char* s, double* d);
+LIBEXPORT const char* numfmt_parse_float(const char* s, float* f);
+
+#endif /* NUMFMT_H_ */
@@ -44,6 +44,9 @@
  * possible. These functions are internal and called from json_tsfile_* routines.
  *
  * tsfile_fill_node() deserializes entry, while tsfile_fill_entry() serializes it
+ *
+ * Exporters which only write entries as JSON should use tsfile_stream_entry()
+ * which writes fields directly to json_stream_t and doesn't need nodes at all.
  */
 
 DECLARE_FIELD_FUNCTION_BYTE(uint8_t);
@@ -225,6 +228,65 @@ void tsfile_fill_node(tsfile_t* file, json_node_t* node, void* entry) {
 	}
 }
 
+int tsfile_stream_entry(tsfile_t* file, json_stream_t* stream, const void* entry) {
+	/* TODO: endianess conversion */
+	tsfile_schema_t* schema = &file->header->schema;
+	tsfile_field_t* field;
+	int fi;
+
+	void* value;
+
+	json_stream_begin_object(stream, NULL);
+
+	for(fi = 0; fi < schema->hdr.count; ++fi) {
+		field = &schema->fields[fi];
+		value = ((char*) entry) + field->offset;
+
+		json_stream_key(stream, field->name);
+
+		switch(field->type) {
+		case TSFILE_FIELD_BOOLEAN:
+			json_stream_boolean(stream, FIELD_GET_VALUE(boolean_t, value));
+		break;
+		case TSFILE_FIELD_INT:
+		{
+			switch(field->size) {
+			case 1:
+				json_stream_integer(stream, FIELD_GET_VALUE(uint8_t, value));
+			break;
+			case 2:
+				json_stream_integer(stream, FIELD_GET_VALUE(uint16_t, value));
+			break;
+			case 4:
+				json_stream_integer(stream, FIELD_GET_VALUE(uint32_t, value));
+			break;
+			case 8:
+				json_stream_integer(stream, FIELD_GET_VALUE(uint64_t, value));
+			break;
+			}
+		}
+		break;
+		case TSFILE_FIELD_FLOAT:
+		{
+			switch(field->size) {
+			case sizeof(float):
+				json_stream_double(stream, FIELD_GET_VALUE(float, value));
+			break;
+			case sizeof(double):
+				json_stream_double(stream, FIELD_GET_VALUE(double, value));
+			break;
+			}
+		}
+		break;
+		case TSFILE_FIELD_STRING:
+			json_stream_string(stream, (const char*) value);
+		break;
+		}
+	}
+
+	return json_stream_end_object(stream);
+}
+
 int tsfile_fill_entry(tsfile_t* file, json_node_t* node, void* entry) {
 	/* TODO: endianess conversion */
 	tsfile_schema_t* schema = &file->header->schema;
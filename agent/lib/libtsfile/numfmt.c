@@ -0,0 +1,960 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <numfmt.h>
+#include <pow5tbl.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+
+/**
+ * numfmt.c - fast number formatting
+ *
+ * Integers are formatted two digits at a time from a table of digit pairs.
+ *
+ * Floating point numbers are formatted with Ryu algorithm (Ulf Adams, "Ryu: fast
+ * float-to-string conversion", PLDI 2018): it finds shortest decimal that parses back
+ * to the same binary value using only integer arithmetic and tables of powers of 5
+ * from pow5tbl.h. Output follows Python repr(): fixed notation for decimal exponents
+ * in [-5; 16), scientific otherwise, and integral values keep ".0" so they are still
+ * recognized as floats.
+ *
+ * Parsers use Clinger's fast path: if mantissa and power of ten are exactly
+ * representable, single multiplication or division gives correctly rounded result.
+ * Other numbers are passed to strtod().
+ */
+
+#define DOUBLE_MANTISSA_BITS	52
+#define DOUBLE_EXPONENT_BITS	11
+#define DOUBLE_BIAS				1023
+
+#define DOUBLE_POW5_INV_BITCOUNT	125
+#define DOUBLE_POW5_BITCOUNT		125
+
+#define FLOAT_MANTISSA_BITS		23
+#define FLOAT_EXPONENT_BITS		8
+#define FLOAT_BIAS				127
+
+#define FLOAT_POW5_INV_BITCOUNT		59
+#define FLOAT_POW5_BITCOUNT			61
+
+static const char numfmt_digits2[200] = {
+	'0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+	'1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+	'2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+	'3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+	'4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+	'5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+	'6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+	'7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+	'8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+	'9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const char numfmt_hex_digits[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/* Integers
+ * -------------------------- */
+
+static unsigned numfmt_uint_length(uint64_t u) {
+	if(u < 10000ull) {
+		if(u < 100ull)
+			return (u < 10ull) ? 1 : 2;
+		return (u < 1000ull) ? 3 : 4;
+	}
+	if(u < 100000000ull) {
+		if(u < 1000000ull)
+			return (u < 100000ull) ? 5 : 6;
+		return (u < 10000000ull) ? 7 : 8;
+	}
+	if(u < 10000000000000000ull) {
+		if(u < 1000000000000ull) {
+			if(u < 10000000000ull)
+				return (u < 1000000000ull) ? 9 : 10;
+			return (u < 100000000000ull) ? 11 : 12;
+		}
+		if(u < 100000000000000ull)
+			return (u < 10000000000000ull) ? 13 : 14;
+		return (u < 1000000000000000ull) ? 15 : 16;
+	}
+	if(u < 1000000000000000000ull)
+		return (u < 100000000000000000ull) ? 17 : 18;
+	return (u < 10000000000000000000ull) ? 19 : 20;
+}
+
+/* Writes exactly len digits of u ending at buf + len */
+static void numfmt_digits(char* buf, uint64_t u, unsigned len) {
+	char* p = buf + len;
+	uint32_t u32;
+	unsigned r;
+
+	while(u >= 100000000ull) {
+		/* Switch to 32-bit divisions as soon as possible */
+		u32 = (uint32_t) (u % 100000000ull);
+		u /= 100000000ull;
+
+		r = u32 % 100; u32 /= 100;
+		memcpy(p - 2, numfmt_digits2 + 2 * r, 2);
+		r = u32 % 100; u32 /= 100;
+		memcpy(p - 4, numfmt_digits2 + 2 * r, 2);
+		r = u32 % 100; u32 /= 100;
+		memcpy(p - 6, numfmt_digits2 + 2 * r, 2);
+		memcpy(p - 8, numfmt_digits2 + 2 * u32, 2);
+
+		p -= 8;
+	}
+
+	u32 = (uint32_t) u;
+
+	while(u32 >= 100) {
+		r = u32 % 100;
+		u32 /= 100;
+
+		p -= 2;
+		memcpy(p, numfmt_digits2 + 2 * r, 2);
+	}
+
+	if(u32 >= 10) {
+		memcpy(p - 2, numfmt_digits2 + 2 * u32, 2);
+	}
+	else {
+		*--p = (char) ('0' + u32);
+	}
+}
+
+size_t numfmt_uint(char* buf, uint64_t u) {
+	unsigned len = numfmt_uint_length(u);
+
+	numfmt_digits(buf, u, len);
+
+	return len;
+}
+
+size_t numfmt_int(char* buf, int64_t i) {
+	if(i < 0) {
+		*buf = '-';
+		return 1 + numfmt_uint(buf + 1, -((uint64_t) i));
+	}
+
+	return numfmt_uint(buf, (uint64_t) i);
+}
+
+size_t numfmt_hex(char* buf, uint64_t u) {
+	unsigned len = 1;
+	char* p;
+
+	while(len < 16 && (u >> (4 * len)) != 0)
+		++len;
+
+	p = buf + len;
+	do {
+		*--p = numfmt_hex_digits[u & 0xf];
+		u >>= 4;
+	} while(p != buf);
+
+	return len;
+}
+
+/* Ryu
+ * -------------------------- */
+
+/* ceil(log2(5^e)) for 0 <= e <= 3528 (returns 1 for e == 0) */
+STATIC_INLINE int32_t numfmt_pow5bits(int32_t e) {
+	return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) for 0 <= e <= 1650 */
+STATIC_INLINE uint32_t numfmt_log10_pow2(int32_t e) {
+	return ((uint32_t) e * 78913) >> 18;
+}
+
+/* floor(log10(5^e)) for 0 <= e <= 2620 */
+STATIC_INLINE uint32_t numfmt_log10_pow5(int32_t e) {
+	return ((uint32_t) e * 732923) >> 20;
+}
+
+static uint32_t numfmt_pow5_factor(uint64_t value) {
+	uint32_t count = 0;
+
+	while(value % 5 == 0) {
+		value /= 5;
+		++count;
+	}
+
+	return count;
+}
+
+STATIC_INLINE boolean_t numfmt_multiple_of_pow5(uint64_t value, uint32_t p) {
+	return numfmt_pow5_factor(value) >= p;
+}
+
+STATIC_INLINE boolean_t numfmt_multiple_of_pow2(uint64_t value, uint32_t p) {
+	return (value & ((1ull << p) - 1)) == 0;
+}
+
+#if defined(__SIZEOF_INT128__) && !defined(NUMFMT_NO_INT128)
+
+/* (m * mul) >> j, where mul is 128-bit number and 64 < j < 128 */
+static uint64_t numfmt_mul_shift64(uint64_t m, const uint64_t* mul, int32_t j) {
+	unsigned __int128 b0 = ((unsigned __int128) m) * mul[0];
+	unsigned __int128 b2 = ((unsigned __int128) m) * mul[1];
+
+	return (uint64_t) (((b0 >> 64) + b2) >> (j - 64));
+}
+
+#else
+
+static uint64_t numfmt_umul128(uint64_t a, uint64_t b, uint64_t* hi) {
+	uint32_t a_lo = (uint32_t) a, a_hi = (uint32_t) (a >> 32);
+	uint32_t b_lo = (uint32_t) b, b_hi = (uint32_t) (b >> 32);
+
+	uint64_t b00 = (uint64_t) a_lo * b_lo;
+	uint64_t b01 = (uint64_t) a_lo * b_hi;
+	uint64_t b10 = (uint64_t) a_hi * b_lo;
+	uint64_t b11 = (uint64_t) a_hi * b_hi;
+
+	uint64_t mid1 = b10 + (b00 >> 32);
+	uint64_t mid2 = b01 + (uint32_t) mid1;
+
+	*hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+	return (mid2 << 32) | (uint32_t) b00;
+}
+
+static uint64_t numfmt_mul_shift64(uint64_t m, const uint64_t* mul, int32_t j) {
+	uint64_t high0, high1;
+	uint64_t low1 = numfmt_umul128(m, mul[1], &high1);
+	uint64_t sum;
+
+	numfmt_umul128(m, mul[0], &high0);
+
+	sum = high0 + low1;
+	if(sum < high0)
+		++high1;
+
+	return (high1 << (128 - j)) | (sum >> (j - 64));
+}
+
+#endif
+
+/**
+ * Find shortest decimal representation of positive finite double
+ * which is closest to it if there are several of them
+ *
+ * @param digits decimal digits of representation
+ * @param exponent decimal exponent of last digit
+ */
+static void numfmt_d2d(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+					   uint64_t* digits, int32_t* exponent) {
+	int32_t e2;
+	uint64_t m2;
+	boolean_t accept_bounds;
+
+	uint64_t mv, vr, vp, vm;
+	uint32_t mm_shift;
+	int32_t e10;
+
+	boolean_t vm_is_trailing_zeros = B_FALSE;
+	boolean_t vr_is_trailing_zeros = B_FALSE;
+
+	int32_t removed = 0;
+	uint8_t last_removed_digit = 0;
+	boolean_t round_up = B_FALSE;
+	uint64_t output;
+
+	if(ieee_exponent == 0) {
+		e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = ieee_mantissa;
+	}
+	else {
+		e2 = (int32_t) ieee_exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+	}
+
+	accept_bounds = (m2 & 1) == 0;
+
+	/* Interval of values which are rounded to this double is (4 * m2 - 1 - mm_shift;
+	 * 4 * m2 + 2) * 2^e2. Lower bound is closer when mantissa is a power of two */
+	mv = 4 * m2;
+	mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1) ? 1 : 0;
+
+	if(e2 >= 0) {
+		uint32_t q = numfmt_log10_pow2(e2) - (e2 > 3);
+		int32_t k = DOUBLE_POW5_INV_BITCOUNT + numfmt_pow5bits(q) - 1;
+		int32_t i = -e2 + (int32_t) q + k;
+
+		e10 = (int32_t) q;
+
+		vr = numfmt_mul_shift64(4 * m2, pow5_inv_split_d[q], i);
+		vp = numfmt_mul_shift64(4 * m2 + 2, pow5_inv_split_d[q], i);
+		vm = numfmt_mul_shift64(4 * m2 - 1 - mm_shift, pow5_inv_split_d[q], i);
+
+		if(q <= 21) {
+			/* Only one of mp, mv, and mm can be a multiple of 5, if any */
+			if(mv % 5 == 0) {
+				vr_is_trailing_zeros = numfmt_multiple_of_pow5(mv, q);
+			}
+			else if(accept_bounds) {
+				vm_is_trailing_zeros = numfmt_multiple_of_pow5(mv - 1 - mm_shift, q);
+			}
+			else {
+				vp -= numfmt_multiple_of_pow5(mv + 2, q);
+			}
+		}
+	}
+	else {
+		uint32_t q = numfmt_log10_pow5(-e2) - (-e2 > 1);
+		int32_t i = -e2 - (int32_t) q;
+		int32_t k = numfmt_pow5bits(i) - DOUBLE_POW5_BITCOUNT;
+		int32_t j = (int32_t) q - k;
+
+		e10 = (int32_t) q + e2;
+
+		vr = numfmt_mul_shift64(4 * m2, pow5_split_d[i], j);
+		vp = numfmt_mul_shift64(4 * m2 + 2, pow5_split_d[i], j);
+		vm = numfmt_mul_shift64(4 * m2 - 1 - mm_shift, pow5_split_d[i], j);
+
+		if(q <= 1) {
+			/* mv = 4 * m2 always has at least two trailing zero bits */
+			vr_is_trailing_zeros = B_TRUE;
+
+			if(accept_bounds) {
+				vm_is_trailing_zeros = mm_shift == 1;
+			}
+			else {
+				--vp;
+			}
+		}
+		else if(q < 63) {
+			vr_is_trailing_zeros = numfmt_multiple_of_pow2(mv, q);
+		}
+	}
+
+	if(vm_is_trailing_zeros || vr_is_trailing_zeros) {
+		/* Rare case: exact decimal is on a boundary of the interval */
+		while(vp / 10 > vm / 10) {
+			vm_is_trailing_zeros &= (vm % 10) == 0;
+			vr_is_trailing_zeros &= last_removed_digit == 0;
+
+			last_removed_digit = (uint8_t) (vr % 10);
+
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+
+		if(vm_is_trailing_zeros) {
+			while(vm % 10 == 0) {
+				vr_is_trailing_zeros &= last_removed_digit == 0;
+
+				last_removed_digit = (uint8_t) (vr % 10);
+
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				++removed;
+			}
+		}
+
+		if(vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) {
+			/* Round even if exact number is .....50..0 */
+			last_removed_digit = 4;
+		}
+
+		output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) ||
+					   last_removed_digit >= 5);
+	}
+	else {
+		/* Common case: remove two digits at a time while we can */
+		if(vp / 100 > vm / 100) {
+			round_up = (vr % 100) >= 50;
+
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+
+		while(vp / 10 > vm / 10) {
+			round_up = (vr % 10) >= 5;
+
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+
+		output = vr + (vr == vm || round_up);
+	}
+
+	*digits = output;
+	*exponent = e10 + removed;
+}
+
+STATIC_INLINE uint32_t numfmt_mul_shift32(uint32_t m, uint64_t factor, int32_t shift) {
+	uint64_t bits0 = (uint64_t) m * (uint32_t) factor;
+	uint64_t bits1 = (uint64_t) m * (uint32_t) (factor >> 32);
+
+	return (uint32_t) (((bits0 >> 32) + bits1) >> (shift - 32));
+}
+
+/* Same as numfmt_d2d for floats */
+static void numfmt_f2d(uint32_t ieee_mantissa, uint32_t ieee_exponent,
+					   uint64_t* digits, int32_t* exponent) {
+	int32_t e2;
+	uint32_t m2;
+	boolean_t accept_bounds;
+
+	uint32_t mv, mp, mm, vr, vp, vm;
+	uint32_t mm_shift;
+	int32_t e10;
+
+	boolean_t vm_is_trailing_zeros = B_FALSE;
+	boolean_t vr_is_trailing_zeros = B_FALSE;
+
+	int32_t removed = 0;
+	uint8_t last_removed_digit = 0;
+	uint32_t output;
+
+	if(ieee_exponent == 0) {
+		e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+		m2 = ieee_mantissa;
+	}
+	else {
+		e2 = (int32_t) ieee_exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+		m2 = (1u << FLOAT_MANTISSA_BITS) | ieee_mantissa;
+	}
+
+	accept_bounds = (m2 & 1) == 0;
+
+	mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1) ? 1 : 0;
+	mv = 4 * m2;
+	mp = 4 * m2 + 2;
+	mm = 4 * m2 - 1 - mm_shift;
+
+	if(e2 >= 0) {
+		uint32_t q = numfmt_log10_pow2(e2);
+		int32_t k = FLOAT_POW5_INV_BITCOUNT + numfmt_pow5bits(q) - 1;
+		int32_t i = -e2 + (int32_t) q + k;
+
+		e10 = (int32_t) q;
+
+		vr = numfmt_mul_shift32(mv, pow5_inv_split_f[q], i);
+		vp = numfmt_mul_shift32(mp, pow5_inv_split_f[q], i);
+		vm = numfmt_mul_shift32(mm, pow5_inv_split_f[q], i);
+
+		if(q != 0 && (vp - 1) / 10 <= vm / 10) {
+			/* We need to know one removed digit even if we are not going to
+			 * loop below, because of rounding */
+			int32_t l = FLOAT_POW5_INV_BITCOUNT + numfmt_pow5bits(q - 1) - 1;
+
+			last_removed_digit = (uint8_t) (numfmt_mul_shift32(mv, pow5_inv_split_f[q - 1],
+												-e2 + (int32_t) q - 1 + l) % 10);
+		}
+
+		if(q <= 9) {
+			if(mv % 5 == 0) {
+				vr_is_trailing_zeros = numfmt_multiple_of_pow5(mv, q);
+			}
+			else if(accept_bounds) {
+				vm_is_trailing_zeros = numfmt_multiple_of_pow5(mm, q);
+			}
+			else {
+				vp -= numfmt_multiple_of_pow5(mp, q);
+			}
+		}
+	}
+	else {
+		uint32_t q = numfmt_log10_pow5(-e2);
+		int32_t i = -e2 - (int32_t) q;
+		int32_t k = numfmt_pow5bits(i) - FLOAT_POW5_BITCOUNT;
+		int32_t j = (int32_t) q - k;
+
+		e10 = (int32_t) q + e2;
+
+		vr = numfmt_mul_shift32(mv, pow5_split_f[i], j);
+		vp = numfmt_mul_shift32(mp, pow5_split_f[i], j);
+		vm = numfmt_mul_shift32(mm, pow5_split_f[i], j);
+
+		if(q != 0 && (vp - 1) / 10 <= vm / 10) {
+			j = (int32_t) q - 1 - (numfmt_pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+			last_removed_digit = (uint8_t) (numfmt_mul_shift32(mv, pow5_split_f[i + 1], j) % 10);
+		}
+
+		if(q <= 1) {
+			vr_is_trailing_zeros = B_TRUE;
+
+			if(accept_bounds) {
+				vm_is_trailing_zeros = mm_shift == 1;
+			}
+			else {
+				--vp;
+			}
+		}
+		else if(q < 31) {
+			vr_is_trailing_zeros = numfmt_multiple_of_pow2(mv, q - 1);
+		}
+	}
+
+	if(vm_is_trailing_zeros || vr_is_trailing_zeros) {
+		while(vp / 10 > vm / 10) {
+			vm_is_trailing_zeros &= (vm % 10) == 0;
+			vr_is_trailing_zeros &= last_removed_digit == 0;
+
+			last_removed_digit = (uint8_t) (vr % 10);
+
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+
+		if(vm_is_trailing_zeros) {
+			while(vm % 10 == 0) {
+				vr_is_trailing_zeros &= last_removed_digit == 0;
+
+				last_removed_digit = (uint8_t) (vr % 10);
+
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				++removed;
+			}
+		}
+
+		if(vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) {
+			last_removed_digit = 4;
+		}
+
+		output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) ||
+					   last_removed_digit >= 5);
+	}
+	else {
+		while(vp / 10 > vm / 10) {
+			last_removed_digit = (uint8_t) (vr % 10);
+
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+
+		output = vr + (vr == vm || last_removed_digit >= 5);
+	}
+
+	*digits = output;
+	*exponent = e10 + removed;
+}
+
+/**
+ * Write decimal digits * 10^exponent like Python repr() does
+ */
+static size_t numfmt_decimal(char* buf, boolean_t sign, uint64_t digits, int32_t exponent) {
+	char* p = buf;
+	unsigned length = numfmt_uint_length(digits);
+	int32_t decpt = exponent + (int32_t) length;
+	int32_t exp10;
+
+	if(sign)
+		*p++ = '-';
+
+	if(decpt > -4 && decpt <= 16) {
+		if(decpt <= 0) {
+			/* 0.000ddd */
+			*p++ = '0';
+			*p++ = '.';
+			memset(p, '0', -decpt);
+			p += -decpt;
+
+			numfmt_digits(p, digits, length);
+			p += length;
+		}
+		else if((unsigned) decpt < length) {
+			/* dd.ddd */
+			numfmt_digits(p + 1, digits, length);
+			memmove(p, p + 1, decpt);
+			p[decpt] = '.';
+			p += length + 1;
+		}
+		else {
+			/* ddd000.0 */
+			numfmt_digits(p, digits, length);
+			p += length;
+
+			memset(p, '0', decpt - length);
+			p += decpt - length;
+
+			*p++ = '.';
+			*p++ = '0';
+		}
+
+		return p - buf;
+	}
+
+	/* d.ddde+XX */
+	numfmt_digits(p + 1, digits, length);
+	p[0] = p[1];
+	if(length > 1) {
+		p[1] = '.';
+		p += length + 1;
+	}
+	else {
+		++p;
+	}
+
+	*p++ = 'e';
+
+	exp10 = decpt - 1;
+	if(exp10 < 0) {
+		*p++ = '-';
+		exp10 = -exp10;
+	}
+	else {
+		*p++ = '+';
+	}
+
+	if(exp10 < 10) {
+		*p++ = '0';
+		*p++ = (char) ('0' + exp10);
+	}
+	else {
+		p += numfmt_uint(p, (uint64_t) exp10);
+	}
+
+	return p - buf;
+}
+
+static size_t numfmt_special(char* buf, boolean_t sign, boolean_t is_nan, boolean_t is_zero) {
+	const char* str = is_zero ? "0.0" : (is_nan ? "nan" : "inf");
+	size_t len = strlen(str);
+	char* p = buf;
+
+	if(sign && !is_nan)
+		*p++ = '-';
+
+	memcpy(p, str, len);
+
+	return (p - buf) + len;
+}
+
+size_t numfmt_double(char* buf, double d) {
+	uint64_t bits;
+	uint64_t ieee_mantissa;
+	uint32_t ieee_exponent;
+	boolean_t sign;
+
+	uint64_t digits;
+	int32_t exponent;
+
+	memcpy(&bits, &d, sizeof(double));
+
+	sign = (bits >> (DOUBLE_MANTISSA_BITS + DOUBLE_EXPONENT_BITS)) != 0;
+	ieee_mantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+	ieee_exponent = (uint32_t) ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+	if(ieee_exponent == ((1u << DOUBLE_EXPONENT_BITS) - 1u) ||
+	   (ieee_exponent == 0 && ieee_mantissa == 0)) {
+		return numfmt_special(buf, sign, ieee_mantissa != 0, ieee_exponent == 0);
+	}
+
+	numfmt_d2d(ieee_mantissa, ieee_exponent, &digits, &exponent);
+
+	return numfmt_decimal(buf, sign, digits, exponent);
+}
+
+size_t numfmt_float(char* buf, float f) {
+	uint32_t bits;
+	uint32_t ieee_mantissa;
+	uint32_t ieee_exponent;
+	boolean_t sign;
+
+	uint64_t digits;
+	int32_t exponent;
+
+	memcpy(&bits, &f, sizeof(float));
+
+	sign = (bits >> (FLOAT_MANTISSA_BITS + FLOAT_EXPONENT_BITS)) != 0;
+	ieee_mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+	ieee_exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+
+	if(ieee_exponent == ((1u << FLOAT_EXPONENT_BITS) - 1u) ||
+	   (ieee_exponent == 0 && ieee_mantissa == 0)) {
+		return numfmt_special(buf, sign, ieee_mantissa != 0, ieee_exponent == 0);
+	}
+
+	numfmt_f2d(ieee_mantissa, ieee_exponent, &digits, &exponent);
+
+	return numfmt_decimal(buf, sign, digits, exponent);
+}
+
+/* Parsers
+ * -------------------------- */
+
+STATIC_INLINE const char* numfmt_skip_space(const char* s) {
+	while(*s == ' ' || *s == '\t')
+		++s;
+
+	return s;
+}
+
+/**
+ * Parse decimal integer with optional sign. Negative numbers
+ * are returned in two's complement, so they may be truncated to
+ * field of any size.
+ */
+const char* numfmt_parse_int(const char* s, uint64_t* u) {
+	boolean_t negative = B_FALSE;
+	uint64_t value = 0;
+	const char* start;
+
+	s = numfmt_skip_space(s);
+
+	if(*s == '-' || *s == '+') {
+		negative = *s == '-';
+		++s;
+	}
+
+	start = s;
+	while((unsigned) (*s - '0') < 10) {
+		value = value * 10 + (unsigned) (*s - '0');
+		++s;
+	}
+
+	if(s == start)
+		return NULL;
+
+	*u = negative ? -value : value;
+	return s;
+}
+
+const char* numfmt_parse_hex(const char* s, uint64_t* u) {
+	uint64_t value = 0;
+	const char* start;
+	unsigned digit;
+
+	s = numfmt_skip_space(s);
+
+	if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s += 2;
+
+	for(start = s; ; ++s) {
+		if((unsigned) (*s - '0') < 10) {
+			digit = *s - '0';
+		}
+		else if((unsigned) ((*s | 0x20) - 'a') < 6) {
+			digit = (*s | 0x20) - 'a' + 10;
+		}
+		else {
+			break;
+		}
+
+		value = (value << 4) | digit;
+	}
+
+	if(s == start)
+		return NULL;
+
+	*u = value;
+	return s;
+}
+
+static const double numfmt_pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Scan decimal floating point number. If it is simple enough for fast path, i.e.
+ * has at most 19 significant digits and exponent is not larger than 308, returns
+ * its mantissa and decimal exponent. Otherwise caller should fall back to strtod().
+ *
+ * @return pointer after number, NULL if there is no number
+ */
+static const char* numfmt_scan_decimal(const char* s, boolean_t* negative, uint64_t* mantissa,
+									   int32_t* exponent, boolean_t* simple) {
+	uint64_t m = 0;
+	int32_t e = 0;
+	int32_t exp_value = 0;
+	int ndigits = 0;
+	boolean_t has_digits = B_FALSE;
+	boolean_t exp_negative = B_FALSE;
+	const char* exp_start;
+
+	*negative = B_FALSE;
+	*simple = B_TRUE;
+
+	if(*s == '-' || *s == '+') {
+		*negative = *s == '-';
+		++s;
+	}
+
+	/* Leading zeroes are not significant */
+	while(*s == '0') {
+		has_digits = B_TRUE;
+		++s;
+	}
+
+	while((unsigned) (*s - '0') < 10) {
+		if(ndigits < 19) {
+			m = m * 10 + (unsigned) (*s - '0');
+		}
+		else {
+			*simple = B_FALSE;
+		}
+
+		has_digits = B_TRUE;
+		++ndigits;
+		++s;
+	}
+
+	if(ndigits > 19)
+		e += ndigits - 19;
+
+	if(*s == '.') {
+		++s;
+
+		if(ndigits == 0) {
+			while(*s == '0') {
+				has_digits = B_TRUE;
+				--e;
+				++s;
+			}
+		}
+
+		while((unsigned) (*s - '0') < 10) {
+			if(ndigits < 19) {
+				m = m * 10 + (unsigned) (*s - '0');
+				--e;
+			}
+			else {
+				*simple = B_FALSE;
+			}
+
+			has_digits = B_TRUE;
+			++ndigits;
+			++s;
+		}
+	}
+
+	if(!has_digits)
+		return NULL;
+
+	if(*s == 'e' || *s == 'E') {
+		exp_start = s++;
+
+		if(*s == '-' || *s == '+') {
+			exp_negative = *s == '-';
+			++s;
+		}
+
+		if((unsigned) (*s - '0') >= 10) {
+			/* Not an exponent, i.e. "1e" */
+			s = exp_start;
+		}
+		else {
+			while((unsigned) (*s - '0') < 10) {
+				if(exp_value < 10000)
+					exp_value = exp_value * 10 + (*s - '0');
+				++s;
+			}
+
+			e += exp_negative ? -exp_value : exp_value;
+		}
+	}
+
+	*mantissa = m;
+	*exponent = e;
+
+	return s;
+}
+
+const char* numfmt_parse_double(const char* s, double* d) {
+	boolean_t negative, simple;
+	uint64_t mantissa;
+	int32_t exponent;
+	const char* end;
+	char* strtod_end;
+	double value;
+
+	s = numfmt_skip_space(s);
+	end = numfmt_scan_decimal(s, &negative, &mantissa, &exponent, &simple);
+
+	if(end != NULL && simple && mantissa <= (1ull << 53) &&
+	   exponent >= -22 && exponent <= 22) {
+		value = (double) mantissa;
+
+		if(exponent < 0) {
+			value /= numfmt_pow10[-exponent];
+		}
+		else {
+			value *= numfmt_pow10[exponent];
+		}
+
+		*d = negative ? -value : value;
+		return end;
+	}
+
+	/* Long mantissas, large exponents, inf and nan */
+	value = strtod(s, &strtod_end);
+	if(strtod_end == s)
+		return NULL;
+
+	*d = value;
+	return strtod_end;
+}
+
+const char* numfmt_parse_float(const char* s, float* f) {
+	boolean_t negative, simple;
+	uint64_t mantissa;
+	int32_t exponent;
+	const char* end;
+	char* strtod_end;
+	float value;
+
+	s = numfmt_skip_space(s);
+	end = numfmt_scan_decimal(s, &negative, &mantissa, &exponent, &simple);
+
+	if(end != NULL && simple && mantissa <= (1ull << 24) &&
+	   exponent >= -10 && exponent <= 10) {
+		value = (float) mantissa;
+
+		if(exponent < 0) {
+			value /= (float) numfmt_pow10[-exponent];
+		}
+		else {
+			value *= (float) numfmt_pow10[exponent];
+		}
+
+		*f = negative ? -value : value;
+		return end;
+	}
+
+	value = strtof(s, &strtod_end);
+	if(strtod_end == s)
+		return NULL;
+
+	*f = value;
+	return strtod_end;
+}
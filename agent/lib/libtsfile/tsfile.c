@@ -23,14 +23,20 @@
 #include <tsload/mempool.h>
 #include <tsload/tuneit.h>
 #include <tsload/posixdecl.h>
+#include <tsload/field.h>
 
 #include <tsload/json/json.h>
 
 #include <tsfile.h>
+#include <chunk.h>
 
 #include <assert.h>
 #include <string.h>
 
+#ifdef HAVE_DECL_PWRITEV
+#include <sys/uio.h>
+#endif
+
 
 mp_cache_t	tsfile_cache;
 
@@ -48,8 +54,34 @@ int tsfile_errno;
  */
 boolean_t tsfile_sync_mode = B_FALSE;
 
+/**
+ * Format of files created by tsfile_create(): 1 - entries are kept
+ * as is, 2 - entries are kept in column chunks (see chunk.c)
+ */
+int tsfile_format_version = TSFILE_VERSION;
+
+/**
+ * Number of entries in chunk of v2 files
+ */
+unsigned tsfile_chunk_rows = TSFILE_CHUNK_ROWS;
+
+/**
+ * Compression codec for chunks of v2 files: "none", "lz4" or "zstd"
+ */
+#define TSFILECODECLEN		16
+char tsfile_codec[TSFILECODECLEN] = "none";
+
+static const char* tsfile_codec_names[TSFILE_CODEC_MAX] = {
+	"none", "lz4", "zstd"
+};
+
 extern int tsfile_nodes_count;
 
+DECLARE_FIELD_FUNCTION_BYTE(uint8_t);
+DECLARE_FIELD_FUNCTIONS(uint16_t);
+DECLARE_FIELD_FUNCTIONS(uint32_t);
+DECLARE_FIELD_FUNCTIONS(uint64_t);
+
 /**
  * TimeSeries File Format Library
  *
@@ -71,6 +103,34 @@ extern int tsfile_nodes_count;
  * Library may be used in both agent and standalone context, but you need to override
  * tsfile_error_msg function pointer with tsfile_register_error_msg_func() call.
  *
+ * By default each tsfile_add() call writes entries and commits new superblock, so
+ * appending single entries costs two syscalls per entry. Writers that produce a lot
+ * of small batches (like request reporting in tsexperiment) may enable write-behind
+ * buffer with tsfile_set_buffered(): entries are accumulated in memory and written
+ * with a single vectored write followed by a single superblock commit when buffer
+ * fills up, on tsfile_flush()/tsfile_sync() or when file is closed. Readers always
+ * see buffered entries because tsfile_get_count()/tsfile_get_entries() flush buffer
+ * before accessing file. If agent crashes, buffered entries are lost, but file remains
+ * consistent because superblock is committed only after entries are written.
+ *
+ * Readers that scan many entries should use tsfile_map_entries() which maps file
+ * into memory (using filemmap API) and returns pointer to entries without copying
+ * them. Mapping is re-created only when file grows beyond mapped area, which
+ * invalidates pointers returned earlier.
+ *
+ * Files where entries are grouped by increasing integer key (i.e. request logs
+ * which are written step by step) may have an index over that key field set by
+ * tsfile_set_index(). Index keeps number of first entry for each key, so
+ * tsfile_get_index() finds where entries of that key begin without scanning
+ * file. Index is built lazily over mapped entries and kept only in memory.
+ *
+ * Version 2 of format keeps entries in compressed column chunks which are
+ * much smaller for request logs (see chunk.c). It is chosen by tsfile_create_ex()
+ * or tsfile_format_version tunable, while API remains the same for both versions,
+ * so readers do not care about format of file. tsfile_get_fields() reads only
+ * needed fields of v2 entries, and tsfile_map_batch() helps to avoid copying
+ * entries of different chunks when they are mapped.
+ *
  * NOTE: superblocks are located in same disk block, so multiple copies are useless */
 
 void tsfile_register_error_msg_func(tsfile_error_msg_func func) {
@@ -121,10 +181,38 @@ static tsfile_t* tsfile_open_file(const char* filename, boolean_t create) {
 
 	file->header = NULL;
 
+	file->wb_entries = NULL;
+	file->wb_count = 0;
+	file->wb_size = 0;
+
+	file->map_opened = B_FALSE;
+	file->map_area = NULL;
+	file->map_count = 0;
+
+	file->idx_field = -1;
+	file->idx_entries = NULL;
+	file->idx_size = 0;
+	file->idx_nkeys = 0;
+	file->idx_max_key = -1;
+	file->idx_count = 0;
+
+	file->chunks = NULL;
+
 	return file;
 }
 
 static void tsfile_close_file(tsfile_t* file) {
+	if(file->chunks != NULL)
+		tsfile_chunks_destroy(file->chunks);
+
+	if(file->idx_entries != NULL)
+		mp_free(file->idx_entries);
+
+	if(file->map_area != NULL)
+		mmf_destroy(&file->mmf, file->map_area);
+	if(file->map_opened)
+		mmf_close(&file->mmf);
+
 	if(file->header)
 		mp_free(file->header);
 
@@ -231,7 +319,67 @@ static boolean_t tsfile_validate_schema(tsfile_header_t* header, tsfile_schema_t
 	return B_TRUE;
 }
 
+/**
+ * Find field in schema of file
+ *
+ * @return index of field or -1 if it doesn't exist
+ */
+int tsfile_find_field(tsfile_t* file, const char* field_name) {
+	tsfile_schema_t* schema = &file->header->schema;
+	int fi;
+
+	for(fi = 0; fi < schema->hdr.count; ++fi) {
+		if(strcmp(schema->fields[fi].name, field_name) == 0)
+			return fi;
+	}
+
+	return -1;
+}
+
+/**
+ * Get codec by its name
+ *
+ * @return codec or -1 if codec is unknown or library was built without it
+ */
+int tsfile_codec_from_name(const char* name) {
+	int codec;
+
+	for(codec = 0; codec < TSFILE_CODEC_MAX; ++codec) {
+		if(strcmp(tsfile_codec_names[codec], name) == 0)
+			return tsfile_codec_supported(codec) ? codec : -1;
+	}
+
+	return -1;
+}
+
+/**
+ * Create tsfile using format set by tunables
+ */
 tsfile_t* tsfile_create(const char* filename, tsfile_schema_t* schema) {
+	tsfile_format_t format;
+	int codec = tsfile_codec_from_name(tsfile_codec);
+
+	if(codec < 0) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Unsupported tsfile codec '%s'", tsfile_codec);
+		codec = TSFILE_CODEC_NONE;
+	}
+
+	format.version = tsfile_format_version;
+	format.chunk_rows = tsfile_chunk_rows;
+	format.codec = codec;
+
+	return tsfile_create_ex(filename, schema, &format);
+}
+
+/**
+ * Create tsfile of specified format
+ *
+ * @param filename path to file
+ * @param schema schema of entries
+ * @param format format of file. chunk_rows and codec are used only for v2 files.
+ */
+tsfile_t* tsfile_create_ex(const char* filename, tsfile_schema_t* schema,
+						   const tsfile_format_t* format) {
 	tsfile_t* file = NULL;
 	tsfile_header_t* header = NULL;
 
@@ -242,6 +390,23 @@ tsfile_t* tsfile_create(const char* filename, tsfile_schema_t* schema) {
 		return NULL;
 	}
 
+	if(format->version != TSFILE_VERSION && format->version != TSFILE_VERSION_V2) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid tsfile version %d", format->version);
+		return NULL;
+	}
+
+	if(format->version == TSFILE_VERSION_V2) {
+		if(format->chunk_rows == 0 || format->chunk_rows > TSFILE_MAX_CHUNK_ROWS) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid tsfile chunk size %u", format->chunk_rows);
+			return NULL;
+		}
+
+		if(!tsfile_codec_supported(format->codec)) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Unsupported tsfile codec #%d", format->codec);
+			return NULL;
+		}
+	}
+
 	file = tsfile_open_file(filename, B_TRUE);
 	if(file == NULL)
 		return NULL;
@@ -250,14 +415,23 @@ tsfile_t* tsfile_create(const char* filename, tsfile_schema_t* schema) {
 	header = mp_malloc(TSFILE_HEADER_SIZE);
 
 	memcpy(&header->magic, TSFILE_MAGIC, TSFILE_MAGIC_LEN);
-	header->version = TSFILE_VERSION;
+	header->version = format->version;
 
-	memset(&header->sb[1], 0, sizeof(tsfile_sb_t) * (SBCOUNT - 1));
+	memset(&header->sb, 0, sizeof(tsfile_sb_t) * SBCOUNT);
 	TSFILE_SB_SET_COUNT(header, 0, 0, 0);
 
 	memset(&header->schema, 0, sizeof(tsfile_schema_t));
 	memcpy(&header->schema, schema, schema_size);
 
+	header->chunk_rows = 0;
+	header->codec = TSFILE_CODEC_NONE;
+	header->pad = 0;
+
+	if(format->version == TSFILE_VERSION_V2) {
+		header->chunk_rows = format->chunk_rows;
+		header->codec = format->codec;
+	}
+
 	memset(header + 1, 0, TSFILE_HEADER_SIZE - sizeof(tsfile_header_t));
 
 	if(write(file->fd, header, TSFILE_HEADER_SIZE) < TSFILE_HEADER_SIZE) {
@@ -269,6 +443,17 @@ tsfile_t* tsfile_create(const char* filename, tsfile_schema_t* schema) {
 		return NULL;
 	}
 
+	if(header->version == TSFILE_VERSION_V2) {
+		file->chunks = tsfile_chunks_open(file, header, 0);
+
+		if(file->chunks == NULL) {
+			mp_free(header);
+			tsfile_close_file(file);
+
+			return NULL;
+		}
+	}
+
 	file->header = header;
 	file->cur_sb = 0ul;
 	file->sb_diff = 0;
@@ -300,7 +485,7 @@ tsfile_t* tsfile_open(const char* filename, tsfile_schema_t* schema) {
 	}
 
 	if(memcmp(&header->magic, TSFILE_MAGIC, TSFILE_MAGIC_LEN) != 0 ||
-	   header->version != TSFILE_VERSION) {
+	   (header->version != TSFILE_VERSION && header->version != TSFILE_VERSION_V2)) {
 		tsfile_error_msg(TSE_INTERNAL_ERROR, "Invalid tsfile magic/version '%s'", filename);
 		goto bad_file;
 	}
@@ -331,6 +516,12 @@ tsfile_t* tsfile_open(const char* filename, tsfile_schema_t* schema) {
 		file->sb_diff = header->sb[cur_sb].time - cur_time;
 	}
 
+	if(header->version == TSFILE_VERSION_V2) {
+		file->chunks = tsfile_chunks_open(file, header, cur_sb);
+		if(file->chunks == NULL)
+			goto bad_file;
+	}
+
 	file->cur_sb = cur_sb;
 	file->header = header;
 
@@ -348,43 +539,170 @@ bad_file:
 }
 
 void tsfile_close(tsfile_t* file) {
+	if(file->wb_entries != NULL) {
+		if(tsfile_flush(file) != TSFILE_OK) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Failed to flush %d buffered entries to '%s'",
+							 file->wb_count, file->filename);
+		}
+
+		mp_free(file->wb_entries);
+	}
+
+	if(file->chunks != NULL && file->chunks->pending_count > 0) {
+		if(tsfile_flush(file) != TSFILE_OK) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Failed to write chunk of %d entries to '%s'",
+							 file->chunks->pending_count, file->filename);
+		}
+	}
+
 	mutex_destroy(&file->mutex);
 	tsfile_destroy_nodes(file);
 	tsfile_close_file(file);
 }
 
-int tsfile_add(tsfile_t* file, void* entries, unsigned count) {
+/**
+ * Switch to the next superblock and rewrite it with new count of entries and
+ * chunks. Should be called with file mutex held after entries are written.
+ */
+int tsfile_commit_sb(tsfile_t* file, uint32_t count, uint32_t chunks) {
+	ts_time_t prev_time = file->header->sb[file->cur_sb].time;
+
+	file->cur_sb = (file->cur_sb + 1) & SBMASK;
+	TSFILE_SB_SET_COUNT(file->header, file->cur_sb, count, file->sb_diff);
+	file->header->sb[file->cur_sb].chunks = chunks;
+
+	/* Actual superblock is found by maximum time, so superblocks committed
+	 * within resolution of timer should still have increasing time */
+	if(file->header->sb[file->cur_sb].time <= prev_time)
+		file->header->sb[file->cur_sb].time = prev_time + 1;
+
+	/* Rewrite header (only first 512 bytes actually) */
+#ifdef HAVE_DECL_PWRITEV
+	if(pwrite(file->fd, file->header, TSFILE_SB_WRITE_LEN, 0) < TSFILE_SB_WRITE_LEN)
+		return TSFILE_SB_FAIL;
+#else
+	if(lseek(file->fd, 0, SEEK_SET) == ((off_t)-1) ||
+	   write(file->fd, file->header,
+			 TSFILE_SB_WRITE_LEN) < TSFILE_SB_WRITE_LEN)
+		return TSFILE_SB_FAIL;
+#endif
+
+	return TSFILE_OK;
+}
+
+/**
+ * Write buffered entries followed by `count` entries from `entries` to the end
+ * of file and commit new superblock. Should be called with file mutex held.
+ */
+static int tsfile_write_entries(tsfile_t* file, void* entries, unsigned count) {
 	uint32_t cur_count;
 	unsigned long entry_size = file->header->schema.hdr.entry_size;
-	unsigned long size = count * entry_size;
+	unsigned long wb_len = file->wb_count * entry_size;
+	unsigned long len = count * entry_size;
 	off_t end;
 
-	tsfile_errno = TSFILE_OK;
+#ifdef HAVE_DECL_PWRITEV
+	struct iovec iov[2];
+	int iovcnt = 0;
+#endif
 
-	mutex_lock(&file->mutex);
+	/* Pending entries of v2 file are written as a chunk */
+	if(file->chunks != NULL)
+		return tsfile_chunk_add(file, entries, count, B_TRUE);
+
+	if(wb_len == 0 && len == 0)
+		return TSFILE_OK;
 
 	/* Calculate counts and offsets */
 	cur_count = TSFILE_SB_GET_COUNT(file->header, file->cur_sb);
 	end = TSFILE_HEADER_SIZE + cur_count * entry_size;
 
 	/* Write to the end of file */
-	if(lseek(file->fd, end, SEEK_SET) == ((off_t)-1) ||
-	   write(file->fd, entries, size) < size) {
-		tsfile_errno = TSFILE_DATA_FAIL;
-		goto end;
+#ifdef HAVE_DECL_PWRITEV
+	if(wb_len > 0) {
+		iov[iovcnt].iov_base = file->wb_entries;
+		iov[iovcnt].iov_len = wb_len;
+		++iovcnt;
 	}
+	if(len > 0) {
+		iov[iovcnt].iov_base = entries;
+		iov[iovcnt].iov_len = len;
+		++iovcnt;
+	}
+
+	if(pwritev(file->fd, iov, iovcnt, end) < (ssize_t) (wb_len + len))
+		return TSFILE_DATA_FAIL;
+#else
+	if(lseek(file->fd, end, SEEK_SET) == ((off_t)-1))
+		return TSFILE_DATA_FAIL;
+
+	if(wb_len > 0 && write(file->fd, file->wb_entries, wb_len) < wb_len)
+		return TSFILE_DATA_FAIL;
+	if(len > 0 && write(file->fd, entries, len) < len)
+		return TSFILE_DATA_FAIL;
+#endif
 
-	file->size += size;
+	file->size += wb_len + len;
 
 	/* Update superblock */
-	file->cur_sb = (file->cur_sb + 1) & SBMASK;
-	TSFILE_SB_SET_COUNT(file->header, file->cur_sb, cur_count + count, file->sb_diff);
+	cur_count += file->wb_count + count;
+	file->wb_count = 0;
 
-	/* Rewrite header (only first 512 bytes actually) */
-	if(lseek(file->fd, 0, SEEK_SET) == ((off_t)-1) ||
-	   write(file->fd, file->header,
-			 TSFILE_SB_WRITE_LEN) < TSFILE_SB_WRITE_LEN) {
-		tsfile_errno = TSFILE_SB_FAIL;
+	return tsfile_commit_sb(file, cur_count, 0);
+}
+
+/**
+ * Make entries added to file visible to readers and get their count. Write-behind
+ * buffer of v1 file is flushed, while entries of v2 file which do not fill chunk
+ * are read from memory. Should be called with file mutex held.
+ */
+static int tsfile_read_count(tsfile_t* file, uint32_t* p_count) {
+	int ret;
+
+	if(file->chunks != NULL) {
+		*p_count = tsfile_chunk_count(file);
+		return TSFILE_OK;
+	}
+
+	ret = tsfile_write_entries(file, NULL, 0);
+	*p_count = TSFILE_SB_GET_COUNT(file->header, file->cur_sb);
+
+	return ret;
+}
+
+/**
+ * Enable write-behind buffering of entries for file
+ *
+ * @param file tsfile
+ * @param wb_size size of buffer in entries. If set to 0, buffering is disabled \
+ * 		and file becomes synchronous again. v2 files ignore buffer size and keep \
+ * 		entries until chunk is full.
+ *
+ * @return TSFILE_OK or error code if buffered entries couldn't be written
+ */
+int tsfile_set_buffered(tsfile_t* file, unsigned wb_size) {
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+
+	mutex_lock(&file->mutex);
+
+	tsfile_errno = tsfile_write_entries(file, NULL, 0);
+	if(tsfile_errno != TSFILE_OK)
+		goto end;
+
+	if(file->chunks != NULL) {
+		file->chunks->buffered = TO_BOOLEAN(wb_size > 0);
+		goto end;
+	}
+
+	if(file->wb_entries != NULL) {
+		mp_free(file->wb_entries);
+		file->wb_entries = NULL;
+	}
+
+	file->wb_size = wb_size;
+
+	if(wb_size > 0) {
+		file->wb_entries = mp_malloc(wb_size * entry_size);
 	}
 
 end:
@@ -393,17 +711,93 @@ end:
 	return tsfile_errno;
 }
 
-uint32_t tsfile_get_count(tsfile_t* file) {
-	uint32_t cur_count;
+/**
+ * Write entries kept in write-behind buffer and commit superblock
+ */
+int tsfile_flush(tsfile_t* file) {
+	mutex_lock(&file->mutex);
+	tsfile_errno = tsfile_write_entries(file, NULL, 0);
+	mutex_unlock(&file->mutex);
+
+	return tsfile_errno;
+}
 
+/**
+ * Flush write-behind buffer and ask OS to write file to the disk
+ */
+int tsfile_sync(tsfile_t* file) {
 	mutex_lock(&file->mutex);
-	cur_count = TSFILE_SB_GET_COUNT(file->header, file->cur_sb);
+
+	tsfile_errno = tsfile_write_entries(file, NULL, 0);
+
+	if(tsfile_errno == TSFILE_OK && fsync(file->fd) == -1) {
+		tsfile_errno = TSFILE_DATA_FAIL;
+	}
+
 	mutex_unlock(&file->mutex);
 
-	return cur_count;
+	return tsfile_errno;
+}
+
+int tsfile_add(tsfile_t* file, void* entries, unsigned count) {
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+
+	tsfile_errno = TSFILE_OK;
+
+	mutex_lock(&file->mutex);
+
+	if(file->chunks != NULL) {
+		tsfile_errno = tsfile_chunk_add(file, entries, count, !file->chunks->buffered);
+	}
+	else if(file->wb_size > 0 && (file->wb_count + count) <= file->wb_size) {
+		memcpy(((char*) file->wb_entries) + file->wb_count * entry_size,
+			   entries, count * entry_size);
+		file->wb_count += count;
+
+		if(file->wb_count == file->wb_size) {
+			tsfile_errno = tsfile_write_entries(file, NULL, 0);
+		}
+	}
+	else {
+		/* Buffering is disabled or entries do not fit into buffer - write
+		 * them along with buffered entries */
+		tsfile_errno = tsfile_write_entries(file, entries, count);
+	}
+
+	mutex_unlock(&file->mutex);
+
+	return tsfile_errno;
+}
+
+/**
+ * Get number of entries in file. Entries kept in write-behind buffer are
+ * flushed first, so they are counted only if they were written successfully.
+ *
+ * @param file tsfile
+ * @param p_count pointer where count of entries is saved
+ *
+ * @return TSFILE_OK or error code if buffered entries couldn't be written
+ */
+int tsfile_get_count(tsfile_t* file, uint32_t* p_count) {
+	mutex_lock(&file->mutex);
+	tsfile_errno = tsfile_read_count(file, p_count);
+	mutex_unlock(&file->mutex);
+
+	return tsfile_errno;
 }
 
 int tsfile_get_entries(tsfile_t* file, void* entries, unsigned start, unsigned end) {
+	return tsfile_get_fields(file, entries, start, end, TSFILE_ALL_FIELDS);
+}
+
+/**
+ * Get entries [start; end) but fill only fields which bits are set in field_mask
+ * (use TSFILE_FIELD_BIT() with index of field returned by tsfile_find_field()).
+ * Other fields of entries are left untouched. Only v2 files may skip reading
+ * fields, entries of v1 files are read entirely.
+ */
+int tsfile_get_fields(tsfile_t* file, void* entries, unsigned start, unsigned end,
+					  uint64_t field_mask) {
 	uint32_t cur_count;
 
 	unsigned long entry_size = file->header->schema.hdr.entry_size;
@@ -418,7 +812,12 @@ int tsfile_get_entries(tsfile_t* file, void* entries, unsigned start, unsigned e
 	tsfile_errno = TSFILE_OK;
 
 	mutex_lock(&file->mutex);
-	cur_count = TSFILE_SB_GET_COUNT(file->header, file->cur_sb);
+
+	tsfile_errno = tsfile_read_count(file, &cur_count);
+	if(tsfile_errno != TSFILE_OK) {
+		mutex_unlock(&file->mutex);
+		return tsfile_errno;
+	}
 
 	if(start > cur_count || end > cur_count) {
 		mutex_unlock(&file->mutex);
@@ -426,8 +825,11 @@ int tsfile_get_entries(tsfile_t* file, void* entries, unsigned start, unsigned e
 		return tsfile_errno;
 	}
 
-	if(lseek(file->fd, off, SEEK_SET) == ((off_t)-1) ||
-	   read(file->fd, entries, size) < size) {
+	if(file->chunks != NULL) {
+		tsfile_errno = tsfile_chunk_get(file, entries, start, end, field_mask);
+	}
+	else if(lseek(file->fd, off, SEEK_SET) == ((off_t)-1) ||
+			read(file->fd, entries, size) < size) {
 		tsfile_errno = TSFILE_DATA_FAIL;
 	}
 
@@ -436,26 +838,328 @@ int tsfile_get_entries(tsfile_t* file, void* entries, unsigned start, unsigned e
 	return tsfile_errno;
 }
 
+/**
+ * Re-create read-only mapping of file so it covers all committed entries.
+ * Should be called with file mutex held.
+ */
+static int tsfile_remap(tsfile_t* file, uint32_t cur_count) {
+	if(file->map_area != NULL) {
+		mmf_destroy(&file->mmf, file->map_area);
+
+		file->map_area = NULL;
+		file->map_count = 0;
+	}
+
+	if(!file->map_opened) {
+		if(mmf_open(&file->mmf, file->filename, MMFL_RDONLY) != MME_OK) {
+			tsfile_error_msg(TSE_INTERNAL_ERROR, "Failed to open '%s' for mapping", file->filename);
+			return TSFILE_DATA_FAIL;
+		}
+
+		file->map_opened = B_TRUE;
+	}
+
+	/* Entries are written before superblock is committed, so file is
+	 * at least as large as committed entries need. */
+	if(mmf_create(&file->mmf, MMF_MAP_ALL, 0, &file->map_area) != MME_OK) {
+		tsfile_error_msg(TSE_INTERNAL_ERROR, "Failed to map '%s'", file->filename);
+
+		file->map_area = NULL;
+		return TSFILE_DATA_FAIL;
+	}
+
+	file->map_count = cur_count;
+
+	return TSFILE_OK;
+}
+
+/**
+ * Get entries [start; end) without copying them
+ *
+ * Returned pointer is valid only until next mapping of the same file or until
+ * file is closed: file is re-mapped when it grows and v2 chunks are decoded into
+ * a single buffer, so old pointers become dangling. Mappings are also made by
+ * tsfile_get_index(), json_tsfile_get*() and json_tsfile_stream*(), and by calls
+ * from other threads, so callers that share file should serialize access to it
+ * or copy entries with tsfile_get_entries(). Entries should not be modified.
+ * Entries of v2 files are decoded, so range should not cross chunks to avoid
+ * copying (see tsfile_map_batch()).
+ *
+ * @param file tsfile
+ * @param start index of first entry
+ * @param end index of entry after last one
+ *
+ * @return pointer to first entry or NULL if range is invalid or file couldn't be \
+ * 		   mapped. In latter case tsfile_errno is set to error code.
+ */
+const void* tsfile_map_entries(tsfile_t* file, unsigned start, unsigned end) {
+	uint32_t cur_count;
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	const void* entries = NULL;
+
+	if(start >= end) {
+		tsfile_errno = TSFILE_INVAL_RANGE;
+		return NULL;
+	}
+
+	mutex_lock(&file->mutex);
+
+	tsfile_errno = tsfile_read_count(file, &cur_count);
+	if(tsfile_errno != TSFILE_OK)
+		goto end;
+
+	if(end > cur_count) {
+		tsfile_errno = TSFILE_INVAL_RANGE;
+		goto end;
+	}
+
+	if(file->chunks != NULL) {
+		tsfile_errno = tsfile_chunk_map(file, start, end, &entries);
+		goto end;
+	}
+
+	if(file->map_area == NULL || end > file->map_count) {
+		tsfile_errno = tsfile_remap(file, cur_count);
+		if(tsfile_errno != TSFILE_OK)
+			goto end;
+	}
+
+	entries = ((char*) file->map_area) + TSFILE_HEADER_SIZE + start * entry_size;
+
+end:
+	mutex_unlock(&file->mutex);
+
+	return entries;
+}
+
+/**
+ * Find end of range starting at start that may be mapped without copying
+ * entries. Readers that process large ranges should map them in batches:
+ *
+ * ```
+ * while(start < end) {
+ *     batch_end = tsfile_map_batch(file, start, end);
+ *     entries = tsfile_map_entries(file, start, batch_end);
+ *     ...
+ *     start = batch_end;
+ * }
+ * ```
+ *
+ * @return end for v1 files or end of chunk which keeps start entry (but \
+ * 		   not greater than end) for v2 files
+ */
+unsigned tsfile_map_batch(tsfile_t* file, unsigned start, unsigned end) {
+	if(file->chunks == NULL || start >= end)
+		return end;
+
+	mutex_lock(&file->mutex);
+	end = tsfile_chunk_map_batch(file, start, end);
+	mutex_unlock(&file->mutex);
+
+	return end;
+}
+
+static uint64_t tsfile_get_key(tsfile_field_t* field, const void* entry) {
+	char* value = ((char*) entry) + field->offset;
+
+	switch(field->size) {
+	case 1:
+		return FIELD_GET_VALUE(uint8_t, value);
+	case 2:
+		return FIELD_GET_VALUE(uint16_t, value);
+	case 4:
+		return FIELD_GET_VALUE(uint32_t, value);
+	}
+
+	return FIELD_GET_VALUE(uint64_t, value);
+}
+
+/**
+ * Add entries [index; end) to index. entries points to entry #index.
+ * Should be called with file mutex held.
+ */
+void tsfile_index_entries(tsfile_t* file, const char* entries, uint32_t index, uint32_t end) {
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	tsfile_field_t* field = &file->header->schema.fields[file->idx_field];
+	const char* entry = entries;
+	uint64_t key;
+
+	for( ; index < end; ++index, entry += entry_size) {
+		key = tsfile_get_key(field, entry);
+
+		/* Entries with smaller keys may be found after next key begins
+		 * (i.e. late requests of previous step), they are not indexed.
+		 * So keys are appended in ascending order and there are no more
+		 * of them than entries even if keys are sparse. */
+		if(((int64_t) key) <= file->idx_max_key)
+			continue;
+
+		if(file->idx_size == file->idx_nkeys) {
+			file->idx_size = (file->idx_size == 0) ? 64 : file->idx_size * 2;
+			file->idx_entries = mp_realloc(file->idx_entries,
+										   file->idx_size * sizeof(tsfile_index_key_t));
+		}
+
+		file->idx_entries[file->idx_nkeys].key = key;
+		file->idx_entries[file->idx_nkeys].index = index;
+		++file->idx_nkeys;
+
+		file->idx_max_key = key;
+	}
+}
+
+/**
+ * Binary search of first indexed key which is greater or equal than key.
+ * Key shouldn't be greater than idx_max_key.
+ */
+static uint32_t tsfile_find_index(tsfile_t* file, uint64_t key) {
+	uint32_t left = 0, right = file->idx_nkeys - 1, mid;
+
+	while(left < right) {
+		mid = left + (right - left) / 2;
+
+		if(file->idx_entries[mid].key < key)
+			left = mid + 1;
+		else
+			right = mid;
+	}
+
+	return file->idx_entries[left].index;
+}
+
+/**
+ * Add entries that were committed after index was last updated.
+ * Should be called with file mutex held.
+ */
+static int tsfile_update_index(tsfile_t* file, uint32_t cur_count) {
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	const char* entries;
+	int ret;
+
+	if(file->idx_count == cur_count)
+		return TSFILE_OK;
+
+	if(file->chunks != NULL)
+		return tsfile_chunk_update_index(file, cur_count);
+
+	if(file->map_area == NULL || cur_count > file->map_count) {
+		ret = tsfile_remap(file, cur_count);
+		if(ret != TSFILE_OK)
+			return ret;
+	}
+
+	entries = ((char*) file->map_area) + TSFILE_HEADER_SIZE + file->idx_count * entry_size;
+	tsfile_index_entries(file, entries, file->idx_count, cur_count);
+
+	file->idx_count = cur_count;
+
+	return TSFILE_OK;
+}
+
+/**
+ * Set index over integer field of file. Index is built immediately
+ * over committed entries and updated by tsfile_get_index() when file grows.
+ *
+ * Index keeps entry number for each key which is greater than keys of
+ * all previous entries, so keys should grow (like step numbers), but may
+ * be sparse.
+ *
+ * @param file tsfile
+ * @param field_name name of integer field from schema
+ *
+ * @return TSFILE_OK, TSFILE_INVAL_FIELD if there is no such integer field \
+ * 		   or error code if file couldn't be mapped
+ */
+int tsfile_set_index(tsfile_t* file, const char* field_name) {
+	tsfile_schema_t* schema = &file->header->schema;
+	uint32_t cur_count;
+	int fi = tsfile_find_field(file, field_name);
+
+	if(fi < 0 || schema->fields[fi].type != TSFILE_FIELD_INT) {
+		tsfile_errno = TSFILE_INVAL_FIELD;
+		return tsfile_errno;
+	}
+
+	mutex_lock(&file->mutex);
+
+	if(file->idx_entries != NULL) {
+		mp_free(file->idx_entries);
+		file->idx_entries = NULL;
+	}
+
+	file->idx_field = fi;
+	file->idx_size = 0;
+	file->idx_nkeys = 0;
+	file->idx_max_key = -1;
+	file->idx_count = 0;
+
+	tsfile_errno = tsfile_read_count(file, &cur_count);
+	if(tsfile_errno != TSFILE_OK)
+		goto end;
+
+	tsfile_errno = tsfile_update_index(file, cur_count);
+
+end:
+	mutex_unlock(&file->mutex);
+
+	return tsfile_errno;
+}
+
+/**
+ * Find first entry which key is greater or equal than key
+ *
+ * @param file tsfile with index set by tsfile_set_index()
+ * @param key value of key
+ * @param p_index pointer where entry number is saved. If there are no such \
+ * 		  entries, it is set to count of entries.
+ *
+ * @return TSFILE_OK, TSFILE_INVAL_FIELD if index wasn't set or error code
+ */
+int tsfile_get_index(tsfile_t* file, uint64_t key, unsigned* p_index) {
+	uint32_t cur_count;
+
+	mutex_lock(&file->mutex);
+
+	if(file->idx_field < 0) {
+		tsfile_errno = TSFILE_INVAL_FIELD;
+		goto end;
+	}
+
+	tsfile_errno = tsfile_read_count(file, &cur_count);
+	if(tsfile_errno != TSFILE_OK)
+		goto end;
+
+	tsfile_errno = tsfile_update_index(file, cur_count);
+	if(tsfile_errno != TSFILE_OK)
+		goto end;
+
+	if(((int64_t) key) <= file->idx_max_key)
+		*p_index = tsfile_find_index(file, key);
+	else
+		*p_index = cur_count;
+
+end:
+	mutex_unlock(&file->mutex);
+
+	return tsfile_errno;
+}
+
 json_node_t* json_tsfile_get(tsfile_t* file, unsigned number) {
 	json_node_t** nodes = NULL;
-	unsigned long entry_size = file->header->schema.hdr.entry_size;
-	void* entry = mp_malloc(entry_size);
+	const void* entry = tsfile_map_entries(file, number, number + 1);
 
 	json_node_t* node = NULL;
 
-	if(tsfile_get_entries(file, entry, number, number + 1) != TSFILE_OK) {
-		goto end;
+	if(entry == NULL) {
+		return NULL;
 	}
 
 	nodes = tsfile_get_nodes(file, 1);
 	node = nodes[0];
 
-	tsfile_fill_node(file, node, entry);
+	tsfile_fill_node(file, node, (void*) entry);
 
-end:
-	if(nodes)
-		mp_free(nodes);
-	mp_free(entry);
+	mp_free(nodes);
 
 	return node;
 }
@@ -481,35 +1185,60 @@ json_node_t* json_tsfile_get_array(tsfile_t* file, unsigned start, unsigned end)
 	json_node_t** nodes = NULL;
 	json_node_t* node_array = NULL;
 	unsigned long entry_size = file->header->schema.hdr.entry_size;
-	void* entries = NULL;
-	void* entry;
+	const char* entries = NULL;
+	const char* entry;
+	unsigned batch_end;
+	uint32_t cur_count;
 	int count = end - start;
-	int ni;
+	int ni = 0;
 
 	if(count <= 0) {
 		tsfile_errno = TSFILE_INVAL_RANGE;
 		return NULL;
 	}
 
-	entries = mp_malloc(entry_size * count);
-	if(tsfile_get_entries(file, entries, start, end) != TSFILE_OK) {
-		goto end;
+	batch_end = tsfile_map_batch(file, start, end);
+	entries = tsfile_map_entries(file, start, batch_end);
+	if(entries == NULL) {
+		return NULL;
+	}
+
+	if(tsfile_get_count(file, &cur_count) != TSFILE_OK)
+		return NULL;
+
+	if(end > cur_count) {
+		tsfile_errno = TSFILE_INVAL_RANGE;
+		return NULL;
 	}
 
 	nodes = tsfile_get_nodes(file, count);
 	node_array = json_new_array();
 
-	for(ni = 0; ni < count; ++ni) {
-		entry = ((char*) entries) + entry_size * ni;
-		tsfile_fill_node(file, nodes[ni], entry);
+	while(B_TRUE) {
+		for(entry = entries; start < batch_end; ++start, ++ni, entry += entry_size) {
+			tsfile_fill_node(file, nodes[ni], (void*) entry);
+
+			json_add_node(node_array, NULL, nodes[ni]);
+		}
+
+		if(start == end)
+			break;
+
+		/* Entries of v2 files are mapped chunk by chunk */
+		batch_end = tsfile_map_batch(file, start, end);
+		entries = tsfile_map_entries(file, start, batch_end);
 
-		json_add_node(node_array, NULL, nodes[ni]);
+		if(entries == NULL) {
+			for( ; ni < count; ++ni)
+				tsfile_put_node(file, nodes[ni]);
+
+			json_tsfile_put_array(file, node_array);
+			mp_free(nodes);
+			return NULL;
+		}
 	}
 
-end:
-	if(nodes)
-		mp_free(nodes);
-	mp_free(entries);
+	mp_free(nodes);
 	return node_array;
 }
 
@@ -556,9 +1285,78 @@ int json_tsfile_add_array(tsfile_t* file, json_node_t* node_array) {
 	return ret;
 }
 
+/**
+ * Write entry as JSON object to stream without creating nodes.
+ *
+ * @return TSFILE_OK or tsfile error if entry couldn't be read. Errors \
+ * 		   of stream are checked with json_stream_error()
+ */
+int json_tsfile_stream(tsfile_t* file, json_stream_t* stream, unsigned number) {
+	const void* entry = tsfile_map_entries(file, number, number + 1);
+
+	if(entry == NULL) {
+		return tsfile_errno;
+	}
+
+	tsfile_stream_entry(file, stream, entry);
+
+	return TSFILE_OK;
+}
+
+/**
+ * Write entries [start; end) as JSON array to stream. Same as
+ * json_tsfile_get_array() followed by json_write_*(), but entries are
+ * serialized directly from mapped file.
+ */
+int json_tsfile_stream_array(tsfile_t* file, json_stream_t* stream, unsigned start, unsigned end) {
+	unsigned long entry_size = file->header->schema.hdr.entry_size;
+	const char* entries = NULL;
+	const char* entry;
+	unsigned batch_end;
+	uint32_t cur_count;
+	int count = end - start;
+
+	if(count <= 0) {
+		tsfile_errno = TSFILE_INVAL_RANGE;
+		return tsfile_errno;
+	}
+
+	if(tsfile_get_count(file, &cur_count) != TSFILE_OK)
+		return tsfile_errno;
+
+	if(end > cur_count) {
+		tsfile_errno = TSFILE_INVAL_RANGE;
+		return tsfile_errno;
+	}
+
+	json_stream_begin_array(stream);
+
+	for( ; start < end; start = batch_end) {
+		batch_end = tsfile_map_batch(file, start, end);
+
+		entries = tsfile_map_entries(file, start, batch_end);
+		if(entries == NULL) {
+			return tsfile_errno;
+		}
+
+		for(entry = entries; start < batch_end; ++start, entry += entry_size) {
+			if(tsfile_stream_entry(file, stream, entry) != JSON_OK)
+				goto end;
+		}
+	}
+
+end:
+	json_stream_end_array(stream);
+
+	return TSFILE_OK;
+}
+
 int tsfile_init(void) {
 	tuneit_set_bool(tsfile_sync_mode);
 	tuneit_set_int(int, tsfile_nodes_count);
+	tuneit_set_int(int, tsfile_format_version);
+	tuneit_set_int(unsigned, tsfile_chunk_rows);
+	tuneit_set_string(tsfile_codec, TSFILECODECLEN);
 
 	mp_cache_init(&tsfile_cache, tsfile_t);
 
@@ -36,6 +36,16 @@ mp_cache_t		json_node_mp;
 mp_cache_t		json_buffer_mp;
 
 extern boolean_t json_ignore_unused;
+extern unsigned json_index_min_children;
+
+/**
+ * Scanner used by parser: "auto" selects widest vector instructions
+ * supported by CPU, "scalar", "sse2" or "avx2" forces specific one.
+ */
+#define JSONSCANMODELEN		16
+char json_scan_mode[JSONSCANMODELEN] = "auto";
+
+#define JSON_ARENA_ALIGN(size, align)	(((size) + (align) - 1) & ~((size_t) (align) - 1))
 
 json_buffer_t* json_buf_create(char* data, size_t sz, boolean_t reuse) {
 	json_buffer_t* buf;
@@ -122,11 +132,13 @@ json_str_t json_str_create(const char* str) {
  * @param buf Pointer to JSON buffer
  * @param from Index of first character
  * @param to Index to last character
+ * @param hold Hold buffer for the string (not needed for arena strings)
  */
-json_str_t json_str_reference(json_buffer_t* buf, size_t from, size_t to) {
+json_str_t json_str_reference(json_buffer_t* buf, size_t from, size_t to, boolean_t hold) {
 	char* json_buf = buf->buffer;
 
-	json_buf_hold(buf);
+	if(hold)
+		json_buf_hold(buf);
 
 	json_buf[from - 1] = JSON_STR_REFERENCE;
 	json_buf[to] = '\0';
@@ -170,6 +182,91 @@ json_str_t json_str_copy(json_str_t json_str, json_buffer_t* buf) {
 	return json_str;
 }
 
+/**
+ * Create arena for parsing buffer buf. Arena holds buffer
+ * until it is destroyed.
+ */
+json_arena_t* json_arena_create(json_buffer_t* buf) {
+	json_arena_t* arena = mp_malloc(sizeof(json_arena_t));
+
+	if(!arena)
+		return NULL;
+
+	arena->ja_chunks = NULL;
+	arena->ja_chunk_size = JSON_ARENA_CHUNK_MIN;
+	arena->ja_buf = buf;
+	arena->ja_root = NULL;
+	arena->ja_mixed = B_FALSE;
+
+	json_buf_hold(buf);
+
+	return arena;
+}
+
+void json_arena_destroy(json_arena_t* arena) {
+	json_arena_chunk_t* chunk;
+	json_arena_chunk_t* next;
+
+	for(chunk = arena->ja_chunks; chunk != NULL; chunk = next) {
+		next = chunk->jac_next;
+		mp_free(chunk);
+	}
+
+	json_buf_rele(arena->ja_buf);
+	mp_free(arena);
+}
+
+/**
+ * Allocate size bytes from arena. Chunks are grown twice each time
+ * new chunk is needed, until they reach JSON_ARENA_CHUNK_MAX so
+ * number of chunks is logarithmic to document size.
+ */
+void* json_arena_alloc(json_arena_t* arena, size_t size) {
+	json_arena_chunk_t* chunk = arena->ja_chunks;
+	size_t hdrsize = JSON_ARENA_ALIGN(sizeof(json_arena_chunk_t), sizeof(void*) * 2);
+	void* ptr;
+
+	size = JSON_ARENA_ALIGN(size, sizeof(void*));
+
+	if(unlikely(chunk == NULL || (chunk->jac_size - chunk->jac_used) < size)) {
+		chunk = mp_malloc(hdrsize + arena->ja_chunk_size);
+		if(!chunk)
+			return NULL;
+
+		chunk->jac_size = arena->ja_chunk_size;
+		chunk->jac_used = 0;
+
+		chunk->jac_next = arena->ja_chunks;
+		arena->ja_chunks = chunk;
+
+		if(arena->ja_chunk_size < JSON_ARENA_CHUNK_MAX)
+			arena->ja_chunk_size *= 2;
+	}
+
+	ptr = ((char*) chunk) + hdrsize + chunk->jac_used;
+	chunk->jac_used += size;
+
+	return ptr;
+}
+
+STATIC_INLINE void json_node_init(json_node_t* node, json_buffer_t* buf, json_type_t type) {
+	node->jn_parent = NULL;
+
+	node->jn_buf	= buf;
+	node->jn_name	= NULL;
+
+	node->jn_type 	= type;
+
+	node->jn_touched = B_FALSE;
+
+	node->jn_arena = NULL;
+	node->jn_index = NULL;
+
+	node->jn_children_count = 0;
+	list_head_init(&node->jn_child_head, "jn_child_head");
+	list_node_init(&node->jn_child_node);
+}
+
 /**
  * Create a raw JSON node object.
  *
@@ -184,18 +281,25 @@ json_node_t* json_node_create(json_buffer_t* buf, json_type_t type) {
 	if(!node)
 		return NULL;
 
-	node->jn_parent = NULL;
+	json_node_init(node, buf, type);
 
-	node->jn_buf	= buf;
-	node->jn_name	= NULL;
+	return node;
+}
 
-	node->jn_type 	= type;
+/**
+ * Create a raw JSON node object inside arena. Such nodes reference
+ * arena buffer but do not hold it.
+ *
+ * @note Do not use this function directly.
+ */
+json_node_t* json_node_create_arena(json_arena_t* arena, json_type_t type) {
+	json_node_t* node = json_arena_alloc(arena, sizeof(json_node_t));
 
-	node->jn_touched = B_FALSE;
+	if(!node)
+		return NULL;
 
-	node->jn_children_count = 0;
-	list_head_init(&node->jn_child_head, "jn_child_head");
-	list_node_init(&node->jn_child_node);
+	json_node_init(node, arena->ja_buf, type);
+	node->jn_arena = arena;
 
 	return node;
 }
@@ -222,6 +326,9 @@ json_node_t* json_node_create_copy(json_node_t* node) {
 
 	copy->jn_touched = B_FALSE;
 
+	copy->jn_arena = NULL;
+	copy->jn_index = NULL;
+
 	if(copy->jn_type == JSON_STRING) {
 		copy->jn_data.s = json_str_copy(node->jn_data.s, node->jn_buf);
 	}
@@ -232,26 +339,50 @@ json_node_t* json_node_create_copy(json_node_t* node) {
 	return copy;
 }
 
+/**
+ * Destroy JSON node and its children.
+ *
+ * Nodes allocated from arena do not own their strings and memory,
+ * so they are only unlinked. When root of arena is destroyed, whole
+ * arena is freed, so nodes that were popped out of arena document should
+ * not be used after that.
+ */
 void json_node_destroy(json_node_t* node) {
 	json_node_t* child;
 	json_node_t* next;
+	json_arena_t* arena = node->jn_arena;
 
 	list_del(&node->jn_child_node);
 
+	/* Document consists only of arena nodes, no need to walk it */
+	if(arena != NULL && arena->ja_root == node && !arena->ja_mixed) {
+		json_arena_destroy(arena);
+		return;
+	}
+
 	list_for_each_entry_safe(json_node_t, child, next,
 							 &node->jn_child_head, jn_child_node) {
 		json_node_destroy(child);
 	}
 
+	if(node->jn_index != NULL) {
+		json_index_destroy(node);
+	}
+
 	if(node->jn_name) {
-		json_str_free(node->jn_name, node->jn_buf);
+		json_node_str_free(node, node->jn_name);
 	}
 
 	if(node->jn_type == JSON_STRING) {
-		json_str_free(node->jn_data.s, node->jn_buf);
+		json_node_str_free(node, node->jn_data.s);
 	}
 
-	mp_cache_free(&json_node_mp, node);
+	if(arena == NULL) {
+		mp_cache_free(&json_node_mp, node);
+	}
+	else if(arena->ja_root == node) {
+		json_arena_destroy(arena);
+	}
 }
 
 int json_init(void) {
@@ -259,6 +390,11 @@ int json_init(void) {
 	mp_cache_init(&json_buffer_mp, json_buffer_t);
 
 	tuneit_set_bool(json_ignore_unused);
+	tuneit_set_int(unsigned, json_index_min_children);
+	tuneit_set_string(json_scan_mode, JSONSCANMODELEN);
+
+	if(json_select_scanner(json_scan_mode) != JSON_OK)
+		json_select_scanner("auto");
 
 	return json_init_errors();
 }
@@ -36,8 +36,28 @@ struct json_parser {
 	size_t newline;		/* Last index of newline character */
 
 	size_t index;
+
+	json_arena_t* arena;	/* Arena for nodes or NULL for heap nodes */
 };
 
+/**
+ * Vectorized scanners used by parser
+ *
+ * @member skip_space returns number of whitespace characters at the beginning \
+ * 			of data, increments lines for each newline and sets newline to offset \
+ * 			of last newline character (relative to data)
+ * @member find_special returns offset of first '"', '\\' or '\n' character in \
+ * 			data or len if there are no such characters
+ */
+typedef struct json_scanner {
+	const char* name;
+
+	size_t (*skip_space)(const char* data, size_t len, int* lines, size_t* newline);
+	size_t (*find_special)(const char* data, size_t len);
+} json_scanner_t;
+
+extern json_scanner_t* json_scanner;
+
 struct json_writer {
 	int  (* writer_error)(void* state);
 	void (* write_byte)(void* state, char byte);
@@ -45,6 +65,14 @@ struct json_writer {
 	void (* write_byte_array)(void* state, const char* array, size_t sz);
 };
 
+#define JSON_NUMBER_LEN		32
+
+extern int json_write_node_indent;
+
+int json_format_integer(char* buf, int64_t i);
+int json_format_double(char* buf, double d);
+
+int json_write_string(json_str_t str, struct json_writer* writer, void* state);
 int json_write_impl(json_node_t* node, struct json_writer* writer, void* state, boolean_t formatted, int indent);
 
 void json_buf_free(json_buffer_t* buf);
@@ -59,10 +87,26 @@ STATIC_INLINE void json_buf_rele(json_buffer_t* buf) {
 	}
 }
 
-json_str_t json_str_reference(json_buffer_t* buf, size_t from, size_t to);
+json_str_t json_str_reference(json_buffer_t* buf, size_t from, size_t to, boolean_t hold);
 void json_str_free(json_str_t json_str, json_buffer_t* buf);
 
+json_arena_t* json_arena_create(json_buffer_t* buf);
+void json_arena_destroy(json_arena_t* arena);
+void* json_arena_alloc(json_arena_t* arena, size_t size);
+
+/**
+ * Free string owned by node. Arena nodes do not hold their buffer, so
+ * references to it are not released.
+ */
+STATIC_INLINE void json_node_str_free(json_node_t* node, json_str_t json_str) {
+	if(node->jn_arena != NULL && ((const char*) json_str)[-1] == JSON_STR_REFERENCE)
+		return;
+
+	json_str_free(json_str, node->jn_buf);
+}
+
 json_node_t* json_node_create(json_buffer_t* buf, json_type_t type);
+json_node_t* json_node_create_arena(json_arena_t* arena, json_type_t type);
 json_node_t* json_node_create_copy(json_node_t* node);
 
 int json_set_error_va(struct json_parser* parser, int error, const char* fmt, va_list va);
@@ -103,6 +147,8 @@ STATIC_INLINE int json_set_error_str(int error, const char* fmt, ...) {
 	return ret;
 }
 
+void json_index_destroy(json_node_t* parent);
+
 int json_init_errors(void);
 void json_destroy_errors(void);
 
@@ -19,6 +19,7 @@
 #include <tsload/defs.h>
 
 #include <tsload/autostring.h>
+#include <tsload/mempool.h>
 
 #include <tsload/json/json.h>
 #include <jsonimpl.h>
@@ -34,6 +35,12 @@
  */
 boolean_t json_ignore_unused = B_FALSE;
 
+/**
+ * Minimum number of children of object node for which json_find_opt() builds
+ * hash index instead of walking list of children. Set to 0 to disable indexing.
+ */
+LIBEXPORT unsigned json_index_min_children = 16;
+
 static const char* json_type_names[] = {
 	"NULL",
 	"STRING",
@@ -160,21 +167,127 @@ json_node_t* json_first(json_node_t* parent, int* id) {
 	return list_first_entry(json_node_t, &parent->jn_child_head, jn_child_node);
 }
 
+/* Hash index of children
+ * ------------------------- */
+
+/* FNV-1a */
+STATIC_INLINE unsigned json_index_hash(const char* name) {
+	const unsigned char* p = (const unsigned char*) name;
+	unsigned hash = 2166136261u;
+
+	while(*p != 0) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Insert node into index. If node with same name already exists,
+ * it is kept so index returns first child like list walk do.
+ */
+static void json_index_insert(json_index_t* index, json_node_t* node) {
+	const char* name = json_name(node);
+	unsigned slot;
+
+	if(name == NULL)
+		return;
+
+	slot = json_index_hash(name) & index->ji_mask;
+
+	while(index->ji_slots[slot] != NULL) {
+		if(strcmp(json_name(index->ji_slots[slot]), name) == 0)
+			return;
+
+		slot = (slot + 1) & index->ji_mask;
+	}
+
+	index->ji_slots[slot] = node;
+}
+
+static json_index_t* json_index_build(json_node_t* parent) {
+	json_index_t* index;
+	json_node_t* node;
+	unsigned size = 1;
+
+	/* Keep load factor below 1/2 */
+	while(size < parent->jn_children_count * 2)
+		size <<= 1;
+
+	/* Indexes of arena nodes are kept in arena, so they do not need to
+	 * be freed when document is destroyed */
+	if(parent->jn_arena != NULL)
+		index = json_arena_alloc(parent->jn_arena, sizeof(json_index_t) + (size - 1) * sizeof(json_node_t*));
+	else
+		index = mp_malloc(sizeof(json_index_t) + (size - 1) * sizeof(json_node_t*));
+
+	if(index == NULL)
+		return NULL;
+
+	index->ji_mask = size - 1;
+	memset(index->ji_slots, 0, size * sizeof(json_node_t*));
+
+	list_for_each_entry(json_node_t, node, &parent->jn_child_head, jn_child_node) {
+		json_index_insert(index, node);
+	}
+
+	parent->jn_index = index;
+
+	return index;
+}
+
+void json_index_destroy(json_node_t* parent) {
+	if(parent->jn_arena == NULL)
+		mp_free(parent->jn_index);
+
+	parent->jn_index = NULL;
+}
+
+static json_node_t* json_index_find(json_index_t* index, const char* name) {
+	unsigned slot = json_index_hash(name) & index->ji_mask;
+	json_node_t* node;
+
+	while((node = index->ji_slots[slot]) != NULL) {
+		if(strcmp(json_name(node), name) == 0)
+			return node;
+
+		slot = (slot + 1) & index->ji_mask;
+	}
+
+	return NULL;
+}
+
 /**
  * Find child by name.
  *
+ * For nodes with large number of children (json_index_min_children), hash
+ * index is built on first lookup and maintained until child is removed.
+ *
  * If node is not found, returns NULL, if parent is not JSON_NODE, sets JSON_INVALID_TYPE
  */
 json_node_t* json_find_opt(json_node_t* parent, const char* name) {
 	json_node_t* node;
+	json_index_t* index = parent->jn_index;
 
 	if(parent->jn_type != JSON_NODE) {
 		json_set_error(JSON_INVALID_TYPE);
 		return NULL;
 	}
 
-	/* TODO: Implement dynamic hash_map for parents with large
-	 * number of children */
+	if(index == NULL && json_index_min_children > 0 &&
+			parent->jn_children_count >= json_index_min_children) {
+		index = json_index_build(parent);
+	}
+
+	if(index != NULL) {
+		node = json_index_find(index, name);
+
+		if(node != NULL)
+			node->jn_touched = B_TRUE;
+
+		return node;
+	}
 
 	list_for_each_entry(json_node_t, node, &parent->jn_child_head, jn_child_node) {
 		if(strcmp(json_name(node), name) == 0) {
@@ -246,6 +359,9 @@ json_node_t* json_popitem(json_node_t* parent, unsigned int id) {
 	json_node_t* node = json_getitem(parent, id);
 
 	if(node != NULL) {
+		if(parent->jn_index != NULL)
+			json_index_destroy(parent);
+
 		list_del(&node->jn_child_node);
 	}
 
@@ -409,6 +525,10 @@ int json_get_node(json_node_t* parent, const char* name, json_node_t** val) {
 
 /* Node constructors
  * ------------------------- */
+json_node_t* json_new_null(void) {
+	return json_node_create(NULL, JSON_NULL);
+}
+
 json_node_t* json_new_integer(int64_t val) {
 	json_node_t* node = json_node_create(NULL, JSON_NUMBER);
 
@@ -493,9 +613,12 @@ void json_set_double(json_node_t* node, double val) {
 void json_set_string(json_node_t* node, json_str_t val) {
 	if(node->jn_type == JSON_STRING) {
 		if(node->jn_data.s != NULL) {
-			json_str_free(node->jn_data.s, node->jn_buf);
+			json_node_str_free(node, node->jn_data.s);
 		}
 
+		if(node->jn_arena != NULL)
+			node->jn_arena->ja_mixed = B_TRUE;
+
 		node->jn_data.s = val;
 	}
 
@@ -509,6 +632,7 @@ int json_set_number(json_node_t* node, const char* val) {
 	parser.index = 0;
 	parser.lineno = 0;
 	parser.newline = 0;
+	parser.arena = NULL;
 	
 	/* JSON buffers may alter data, but json_parse_number()
 	   shouldn't do it, so we play nice like non-const data was passed*/
@@ -530,9 +654,25 @@ int json_add_node(json_node_t* parent, json_str_t name, json_node_t* node) {
 	node->jn_parent = parent;
 	node->jn_name = name;
 
+	/* Heap nodes and dynamic names have to be freed separately from arena */
+	if(parent->jn_arena != NULL &&
+			(node->jn_arena != parent->jn_arena ||
+			 (name != NULL && ((const char*) name)[-1] == JSON_STR_DYNAMIC))) {
+		parent->jn_arena->ja_mixed = B_TRUE;
+	}
+
 	list_add_tail(&node->jn_child_node, &parent->jn_child_head);
 	++parent->jn_children_count;
 
+	if(parent->jn_index != NULL) {
+		/* Insert into index if it won't become too dense,
+		 * otherwise it will be rebuilt by next lookup */
+		if(parent->jn_children_count * 2 <= parent->jn_index->ji_mask + 1)
+			json_index_insert(parent->jn_index, node);
+		else
+			json_index_destroy(parent);
+	}
+
 	return JSON_OK;
 }
 
@@ -540,6 +680,9 @@ int json_remove_node(json_node_t* parent, json_node_t* node) {
 	if(node->jn_parent != parent)
 		return json_set_error(JSON_NOT_CHILD);
 
+	if(parent->jn_index != NULL)
+		json_index_destroy(parent);
+
 	--parent->jn_children_count;
 	list_del(&node->jn_child_node);
 	return JSON_OK;
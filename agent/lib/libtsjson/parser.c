@@ -52,6 +52,17 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 #define INC_STATE()					\
 	++parser->index
 
+/**
+ * Create node from parser arena or from heap
+ */
+STATIC_INLINE json_node_t* json_parser_node_create(struct json_parser* parser, json_buffer_t* buf,
+												   json_type_t type) {
+	if(parser->arena != NULL)
+		return json_node_create_arena(parser->arena, type);
+
+	return json_node_create(buf, type);
+}
+
 static char json_whitespace_table[256] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 1, 1, 1, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -82,22 +93,23 @@ static char json_whitespace_table[256] = {
 
 static boolean_t skip_whitespace(struct json_parser* parser, json_buffer_t* buf) {
 	size_t idx; char* data;
-	char mode = JSON_SPACE;
+	size_t newline = 0;
+	int lines = 0;
 
 	GET_STATE(idx, data);
 
-	while(idx < buf->size) {
-		mode = json_whitespace_table[(unsigned char) *data];
+	if(idx >= buf->size)
+		return B_FALSE;
 
-		if(mode == JSON_NEWLINE) {
-			++parser->lineno;
-			parser->newline = idx;
-		}
+	/* Most tokens in compact JSON are not preceded by whitespace */
+	if(json_whitespace_table[(unsigned char) *data] == JSON_NOTSPACE)
+		return B_TRUE;
 
-		if(mode == JSON_NOTSPACE)
-			break;
+	idx += json_scanner->skip_space(data, buf->size - idx, &lines, &newline);
 
-		++data; ++idx;
+	if(lines > 0) {
+		parser->lineno += lines;
+		parser->newline = parser->index + newline;
 	}
 
 	PUT_STATE(idx, data);
@@ -242,13 +254,30 @@ int json_parse_string(struct json_parser* parser, json_buffer_t* buf, json_str_t
 	size_t from, to;
 	int ret;
 
+	size_t skip;
+
 	boolean_t have_escaped = B_FALSE;
 
 	INC_STATE();
 	GET_STATE(idx, data);
 	from = idx;
 
-	while(*data != '"') {
+	for(;;) {
+		/* Skip to the next quote, backslash or newline */
+		if(idx < buf->size) {
+			skip = json_scanner->find_special(data, buf->size - idx);
+			idx += skip; data += skip;
+		}
+
+		if(idx >= buf->size) {
+			PUT_STATE(idx, data);
+			return json_set_parser_error(parser, JSON_END_OF_BUFFER,
+										 "Unexpected end of buffer while parsing STRING");
+		}
+
+		if(*data == '"')
+			break;
+
 		/* TODO: check other characters as well */
 		if(*data == '\n') {
 			PUT_STATE(idx, data);
@@ -256,10 +285,9 @@ int json_parse_string(struct json_parser* parser, json_buffer_t* buf, json_str_t
 										 "Unescaped character '%d' while parsing STRING", *data);
 		}
 
-		if(*data == '\\') {
-			++idx; ++data;
-			have_escaped = B_TRUE;
-		}
+		/* Backslash - skip escaped character */
+		++idx; ++data;
+		have_escaped = B_TRUE;
 
 		if(idx >= buf->size) {
 			PUT_STATE(idx, data);
@@ -284,7 +312,7 @@ int json_parse_string(struct json_parser* parser, json_buffer_t* buf, json_str_t
 		to -= ret;
 	}
 
-	*string = json_str_reference(buf, from, to);
+	*string = json_str_reference(buf, from, to, parser->arena == NULL);
 
 	return JSON_OK;
 }
@@ -321,6 +349,36 @@ static char number_table_get(int c) {
 	return JSON_NUM_MODE_INVAL;
 }
 
+/**
+ * Convert integer literal of up to 18 digits (so it can't overflow) without
+ * strtoll(). Returns B_FALSE if literal should be handled by strtoll().
+ */
+STATIC_INLINE boolean_t json_parse_integer_fast(const char* literal, const char* end, int64_t* result) {
+	const char* p = literal;
+	boolean_t negative = B_FALSE;
+	int64_t i = 0;
+	unsigned digit;
+
+	if(*p == '-') {
+		negative = B_TRUE;
+		++p;
+	}
+
+	if(p == end || (end - p) > 18)
+		return B_FALSE;
+
+	for( ; p < end; ++p) {
+		digit = (unsigned char) *p - '0';
+		if(digit > 9)
+			return B_FALSE;
+
+		i = i * 10 + digit;
+	}
+
+	*result = negative ? -i : i;
+	return B_TRUE;
+}
+
 int json_parse_number(struct json_parser* parser, json_buffer_t* buf, json_node_t** object) {
 	int mode = 0;
 
@@ -350,6 +408,9 @@ int json_parse_number(struct json_parser* parser, json_buffer_t* buf, json_node_
 	if(mode & JSON_NUM_MODE_FLOAT) {
 		d = strtod(literal, &endptr);
 	}
+	else if(json_parse_integer_fast(literal, data, &i)) {
+		endptr = data;
+	}
 	else {
 		i = strtoll(literal, &endptr, 10);
 	}
@@ -367,7 +428,7 @@ int json_parse_number(struct json_parser* parser, json_buffer_t* buf, json_node_
 	}
 
 	if(*object == NULL) {
-		*object = json_node_create(buf, JSON_NUMBER);
+		*object = json_parser_node_create(parser, buf, JSON_NUMBER);
 	}
 
 	if(mode & JSON_NUM_MODE_FLOAT) {
@@ -391,7 +452,7 @@ int json_parse_node(struct json_parser* parser, json_buffer_t* buf, json_node_t*
 
 	char end_char = (is_array)? ']' : '}';
 
-	*object = json_node_create(buf, (is_array)? JSON_ARRAY : JSON_NODE);
+	*object = json_parser_node_create(parser, buf, (is_array)? JSON_ARRAY : JSON_NODE);
 
 	INC_STATE();
 
@@ -475,7 +536,7 @@ eob:
 							 	 "Unexpected end of buffer while parsing %s",
 							 	(is_array)? "ARRAY": "OBJECT");
 error:
-	if(name != NULL)
+	if(name != NULL && parser->arena == NULL)
 		json_str_free(name, buf);
 	if(value != NULL)
 		json_node_destroy(value);
@@ -533,7 +594,7 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 		if(ret != JSON_OK)
 			return ret;
 
-		*object = json_node_create(buf, JSON_STRING);
+		*object = json_parser_node_create(parser, buf, JSON_STRING);
 		(*object)->jn_data.s = str;
 
 		return JSON_OK;
@@ -542,7 +603,7 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 		if(ret != JSON_OK)
 			return ret;
 
-		*object = json_node_create(buf, JSON_BOOLEAN);
+		*object = json_parser_node_create(parser, buf, JSON_BOOLEAN);
 		(*object)->jn_data.b = B_TRUE;
 
 		return JSON_OK;
@@ -551,7 +612,7 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 		if(ret != JSON_OK)
 			return ret;
 
-		*object = json_node_create(buf, JSON_BOOLEAN);
+		*object = json_parser_node_create(parser, buf, JSON_BOOLEAN);
 		(*object)->jn_data.b = B_FALSE;
 
 		return JSON_OK;
@@ -560,7 +621,7 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 		if(ret != JSON_OK)
 			return ret;
 
-		*object = json_node_create(buf, JSON_NULL);
+		*object = json_parser_node_create(parser, buf, JSON_NULL);
 
 		return JSON_OK;
 	}
@@ -573,6 +634,18 @@ int json_parse_value(struct json_parser* parser, json_buffer_t* buf, json_node_t
 }
 
 int json_parse(json_buffer_t* buf, json_node_t** root) {
+	return json_parse_ex(buf, root, JSON_PARSE_DEFAULT);
+}
+
+/**
+ * Parse JSON buffer
+ *
+ * @param buf buffer to be parsed
+ * @param root pointer to root node of parsed document
+ * @param flags parse flags. If JSON_PARSE_ARENA is set, nodes of document are \
+ * 				allocated from arena which is freed when root is destroyed
+ */
+int json_parse_ex(json_buffer_t* buf, json_node_t** root, int flags) {
 	struct json_parser parser;
 
 	int ret;
@@ -580,13 +653,35 @@ int json_parse(json_buffer_t* buf, json_node_t** root) {
 	parser.lineno = 1;
 	parser.newline = 0;
 	parser.index = 0;
+	parser.arena = NULL;
 
 	*root = NULL;
 
+	if(flags & JSON_PARSE_ARENA) {
+		/* Arena holds buffer until document is destroyed */
+		parser.arena = json_arena_create(buf);
+
+		if(parser.arena == NULL)
+			return json_set_error_str(JSON_INTERNAL_ERROR, "Failed to create arena");
+	}
+
 	json_buf_hold(buf);
 	ret = json_parse_value(&parser, buf, root);
 	json_buf_rele(buf);
 
+	if(parser.arena != NULL) {
+		if(ret != JSON_OK) {
+			json_arena_destroy(parser.arena);
+			*root = NULL;
+
+			return ret;
+		}
+
+		parser.arena->ja_root = *root;
+
+		return ret;
+	}
+
 	if(ret != JSON_OK && *root != NULL) {
 		json_node_destroy(*root);
 		*root = NULL;
@@ -0,0 +1,375 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/json/json.h>
+#include <jsonimpl.h>
+
+#include <string.h>
+
+/**
+ * JSON scanners
+ *
+ * Parser spends most of its time skipping whitespace between tokens and
+ * looking for end of string, so these loops are vectorized. Scalar scanner is
+ * always available, SSE2 and AVX2 scanners are compiled on x86 with GCC,
+ * Clang or MSVC and chosen at runtime by json_select_scanner() based on
+ * CPU features.
+ *
+ * Whitespace is same as in json_whitespace_table: 0x09-0x0D and space.
+ * String specials are '"', '\\' and '\n'.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SCAN_X86
+#define JSON_SCAN_TARGET(isa)	__attribute__((target(isa)))
+
+#define JSON_SCAN_CTZ(mask)			__builtin_ctz(mask)
+#define JSON_SCAN_CLZ(mask)			__builtin_clz(mask)
+#define JSON_SCAN_POPCNT(mask)		__builtin_popcount(mask)
+
+STATIC_INLINE boolean_t json_scan_have_sse2(void) {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? B_TRUE : B_FALSE;
+}
+
+STATIC_INLINE boolean_t json_scan_have_avx2(void) {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? B_TRUE : B_FALSE;
+}
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define JSON_SCAN_X86
+#define JSON_SCAN_TARGET(isa)
+
+#include <intrin.h>
+
+STATIC_INLINE int JSON_SCAN_CTZ(unsigned mask) {
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (int) idx;
+}
+
+STATIC_INLINE int JSON_SCAN_CLZ(unsigned mask) {
+	unsigned long idx;
+	_BitScanReverse(&idx, mask);
+	return 31 - (int) idx;
+}
+
+STATIC_INLINE int JSON_SCAN_POPCNT(unsigned mask) {
+	/* __popcnt() requires SSE4.2 CPU, so count bits manually */
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+STATIC_INLINE boolean_t json_scan_have_sse2(void) {
+	int info[4];
+
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) ? B_TRUE : B_FALSE;
+}
+
+STATIC_INLINE boolean_t json_scan_have_avx2(void) {
+	int info[4];
+
+	__cpuid(info, 0);
+	if(info[0] < 7)
+		return B_FALSE;
+
+	/* Check that OS saves YMM registers */
+	__cpuid(info, 1);
+	if((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+		return B_FALSE;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) ? B_TRUE : B_FALSE;
+}
+#endif
+
+#ifdef JSON_SCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+/* Scalar scanner
+ * ------------------------- */
+
+static size_t json_skip_space_scalar(const char* data, size_t len, int* lines, size_t* newline) {
+	size_t idx;
+	char c;
+
+	for(idx = 0; idx < len; ++idx) {
+		c = data[idx];
+
+		if(c == '\n') {
+			++(*lines);
+			*newline = idx;
+		}
+		else if(c != ' ' && (c < '\t' || c > '\r')) {
+			break;
+		}
+	}
+
+	return idx;
+}
+
+static size_t json_find_special_scalar(const char* data, size_t len) {
+	size_t idx;
+	char c;
+
+	for(idx = 0; idx < len; ++idx) {
+		c = data[idx];
+
+		if(c == '"' || c == '\\' || c == '\n')
+			break;
+	}
+
+	return idx;
+}
+
+json_scanner_t json_scanner_scalar = {
+	"scalar",
+	json_skip_space_scalar,
+	json_find_special_scalar
+};
+
+#ifdef JSON_SCAN_X86
+
+/* SSE2 scanner
+ * ------------------------- */
+
+/**
+ * Account newlines from mask nl that precede first non-space character
+ * at position first of block that starts at offset base
+ */
+STATIC_INLINE void json_scan_newlines(unsigned nl, int first, size_t base, int* lines, size_t* newline) {
+	if(first < 32)
+		nl &= (1u << first) - 1;
+
+	if(nl != 0) {
+		*lines += JSON_SCAN_POPCNT(nl);
+		*newline = base + 31 - JSON_SCAN_CLZ(nl);
+	}
+}
+
+/**
+ * Handle tail of data that is shorter than vector width with narrower
+ * scanner. Newline offsets are relative to data passed to that scanner.
+ */
+STATIC_INLINE size_t json_skip_space_tail(size_t (*skip_space)(const char*, size_t, int*, size_t*),
+										  const char* data, size_t idx, size_t len,
+										  int* lines, size_t* newline) {
+	int tail_lines = 0;
+	size_t tail_newline = 0;
+	size_t count = skip_space(data + idx, len - idx, &tail_lines, &tail_newline);
+
+	if(tail_lines > 0) {
+		*lines += tail_lines;
+		*newline = idx + tail_newline;
+	}
+
+	return idx + count;
+}
+
+JSON_SCAN_TARGET("sse2")
+static size_t json_skip_space_sse2(const char* data, size_t len, int* lines, size_t* newline) {
+	const __m128i v_tab = _mm_set1_epi8('\t');
+	const __m128i v_range = _mm_set1_epi8('\r' - '\t');
+	const __m128i v_space = _mm_set1_epi8(' ');
+	const __m128i v_newline = _mm_set1_epi8('\n');
+
+	__m128i chunk, offset, is_space;
+	unsigned space, nl;
+	size_t idx = 0;
+	int first;
+
+	while(idx + 16 <= len) {
+		chunk = _mm_loadu_si128((const __m128i*) (data + idx));
+
+		/* Unsigned (c - '\t') <= ('\r' - '\t') or c == ' ' */
+		offset = _mm_sub_epi8(chunk, v_tab);
+		is_space = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(offset, v_range), offset),
+								_mm_cmpeq_epi8(chunk, v_space));
+
+		space = (unsigned) _mm_movemask_epi8(is_space);
+		nl = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, v_newline));
+
+		if(space != 0xFFFF) {
+			first = JSON_SCAN_CTZ(~space);
+			json_scan_newlines(nl, first, idx, lines, newline);
+
+			return idx + first;
+		}
+
+		json_scan_newlines(nl, 32, idx, lines, newline);
+		idx += 16;
+	}
+
+	return json_skip_space_tail(json_skip_space_scalar, data, idx, len, lines, newline);
+}
+
+JSON_SCAN_TARGET("sse2")
+static size_t json_find_special_sse2(const char* data, size_t len) {
+	const __m128i v_quote = _mm_set1_epi8('"');
+	const __m128i v_backslash = _mm_set1_epi8('\\');
+	const __m128i v_newline = _mm_set1_epi8('\n');
+
+	__m128i chunk, special;
+	unsigned mask;
+	size_t idx = 0;
+
+	while(idx + 16 <= len) {
+		chunk = _mm_loadu_si128((const __m128i*) (data + idx));
+
+		special = _mm_or_si128(_mm_cmpeq_epi8(chunk, v_quote),
+							   _mm_or_si128(_mm_cmpeq_epi8(chunk, v_backslash),
+							   	   	   	    _mm_cmpeq_epi8(chunk, v_newline)));
+		mask = (unsigned) _mm_movemask_epi8(special);
+
+		if(mask != 0)
+			return idx + JSON_SCAN_CTZ(mask);
+
+		idx += 16;
+	}
+
+	return idx + json_find_special_scalar(data + idx, len - idx);
+}
+
+json_scanner_t json_scanner_sse2 = {
+	"sse2",
+	json_skip_space_sse2,
+	json_find_special_sse2
+};
+
+/* AVX2 scanner
+ * ------------------------- */
+
+JSON_SCAN_TARGET("avx2")
+static size_t json_skip_space_avx2(const char* data, size_t len, int* lines, size_t* newline) {
+	const __m256i v_tab = _mm256_set1_epi8('\t');
+	const __m256i v_range = _mm256_set1_epi8('\r' - '\t');
+	const __m256i v_space = _mm256_set1_epi8(' ');
+	const __m256i v_newline = _mm256_set1_epi8('\n');
+
+	__m256i chunk, offset, is_space;
+	unsigned space, nl;
+	size_t idx = 0;
+	int first;
+
+	while(idx + 32 <= len) {
+		chunk = _mm256_loadu_si256((const __m256i*) (data + idx));
+
+		offset = _mm256_sub_epi8(chunk, v_tab);
+		is_space = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(offset, v_range), offset),
+								   _mm256_cmpeq_epi8(chunk, v_space));
+
+		space = (unsigned) _mm256_movemask_epi8(is_space);
+		nl = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, v_newline));
+
+		if(space != 0xFFFFFFFFu) {
+			first = JSON_SCAN_CTZ(~space);
+			json_scan_newlines(nl, first, idx, lines, newline);
+
+			return idx + first;
+		}
+
+		json_scan_newlines(nl, 32, idx, lines, newline);
+		idx += 32;
+	}
+
+	return json_skip_space_tail(json_skip_space_sse2, data, idx, len, lines, newline);
+}
+
+JSON_SCAN_TARGET("avx2")
+static size_t json_find_special_avx2(const char* data, size_t len) {
+	const __m256i v_quote = _mm256_set1_epi8('"');
+	const __m256i v_backslash = _mm256_set1_epi8('\\');
+	const __m256i v_newline = _mm256_set1_epi8('\n');
+
+	__m256i chunk, special;
+	unsigned mask;
+	size_t idx = 0;
+
+	while(idx + 32 <= len) {
+		chunk = _mm256_loadu_si256((const __m256i*) (data + idx));
+
+		special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, v_quote),
+								  _mm256_or_si256(_mm256_cmpeq_epi8(chunk, v_backslash),
+								  	  	  	  	  _mm256_cmpeq_epi8(chunk, v_newline)));
+		mask = (unsigned) _mm256_movemask_epi8(special);
+
+		if(mask != 0)
+			return idx + JSON_SCAN_CTZ(mask);
+
+		idx += 32;
+	}
+
+	return idx + json_find_special_sse2(data + idx, len - idx);
+}
+
+json_scanner_t json_scanner_avx2 = {
+	"avx2",
+	json_skip_space_avx2,
+	json_find_special_avx2
+};
+
+#endif /* JSON_SCAN_X86 */
+
+json_scanner_t* json_scanner = &json_scanner_scalar;
+
+/**
+ * Select JSON scanner by name: "scalar", "sse2", "avx2" or "auto"
+ * which picks widest scanner supported by CPU.
+ *
+ * @return JSON_OK or JSON_NOT_FOUND if scanner is not supported
+ */
+int json_select_scanner(const char* name) {
+	boolean_t is_auto = B_FALSE;
+
+	if(name == NULL || strcmp(name, "auto") == 0)
+		is_auto = B_TRUE;
+
+#ifdef JSON_SCAN_X86
+	if((is_auto || strcmp(name, "avx2") == 0) && json_scan_have_avx2()) {
+		json_scanner = &json_scanner_avx2;
+		return JSON_OK;
+	}
+
+	if((is_auto || strcmp(name, "sse2") == 0) && json_scan_have_sse2()) {
+		json_scanner = &json_scanner_sse2;
+		return JSON_OK;
+	}
+#endif
+
+	if(is_auto || strcmp(name, "scalar") == 0) {
+		json_scanner = &json_scanner_scalar;
+		return JSON_OK;
+	}
+
+	return JSON_NOT_FOUND;
+}
+
+/**
+ * Returns name of currently used JSON scanner
+ */
+const char* json_scanner_name(void) {
+	return json_scanner->name;
+}
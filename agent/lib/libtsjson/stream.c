@@ -0,0 +1,478 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/json/json.h>
+#include <jsonimpl.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef PLAT_WIN
+#include <io.h>
+#define write	_write
+#else
+#include <unistd.h>
+#endif
+
+
+/**
+ * stream.c - push-style JSON writer
+ *
+ * Each value is prefixed with separator and indentation when it is written,
+ * and closing bracket adds final newline, so output matches json_write_impl()
+ * without knowing in advance which element is last. Strings are escaped
+ * by json_write_string() through json_writer_stream.
+ */
+
+#define JSON_STREAM_INDENT_LEN		64
+
+static char json_stream_spaces[JSON_STREAM_INDENT_LEN + 1] =
+	"                                                                ";
+
+static int json_stream_set_error(json_stream_t* stream, int error, const char* msg) {
+	if(stream->js_error == JSON_OK)
+		stream->js_error = json_set_error_str(error, "%s", msg);
+
+	return stream->js_error;
+}
+
+static int json_stream_write_sink(json_stream_t* stream, const char* data, size_t len) {
+	long ret;
+
+	switch(stream->js_sink) {
+	case JSON_STREAM_FILE:
+		if(fwrite(data, 1, len, stream->js_file) != len)
+			return json_stream_set_error(stream, JSON_FILE_ERROR, "Failed to write JSON stream to file");
+		break;
+	case JSON_STREAM_FD:
+		while(len > 0) {
+			ret = write(stream->js_fd, data, len);
+
+			if(ret < 0) {
+				if(errno == EINTR)
+					continue;
+
+				return json_stream_set_error(stream, JSON_FILE_ERROR, "Failed to write JSON stream to descriptor");
+			}
+
+			data += ret;
+			len -= ret;
+		}
+		break;
+	}
+
+	return JSON_OK;
+}
+
+/* Makes room for len bytes (and a null-terminator) in buffer: memory
+ * stream grows, others flush their buffer. Returns B_FALSE if data
+ * shouldn't be buffered because it was written directly or error occured */
+static boolean_t json_stream_reserve(json_stream_t* stream, const char* data, size_t len) {
+	size_t size = stream->js_size;
+
+	if(stream->js_error != JSON_OK)
+		return B_FALSE;
+
+	if(stream->js_sink == JSON_STREAM_MEMORY) {
+		while(stream->js_len + len >= size)
+			size *= 2;
+
+		stream->js_buf = mp_realloc(stream->js_buf, size);
+		stream->js_size = size;
+
+		return B_TRUE;
+	}
+
+	if(json_stream_flush(stream) != JSON_OK)
+		return B_FALSE;
+
+	if(len >= stream->js_size) {
+		json_stream_write_sink(stream, data, len);
+		return B_FALSE;
+	}
+
+	return B_TRUE;
+}
+
+STATIC_INLINE void json_stream_put(json_stream_t* stream, const char* data, size_t len) {
+	if(unlikely(stream->js_len + len >= stream->js_size)) {
+		if(!json_stream_reserve(stream, data, len))
+			return;
+	}
+
+	memcpy(stream->js_buf + stream->js_len, data, len);
+	stream->js_len += len;
+}
+
+STATIC_INLINE void json_stream_put_byte(json_stream_t* stream, char byte) {
+	if(unlikely(stream->js_len + 1 >= stream->js_size)) {
+		if(!json_stream_reserve(stream, &byte, 1))
+			return;
+	}
+
+	stream->js_buf[stream->js_len++] = byte;
+}
+
+static void json_stream_indent(json_stream_t* stream, int level) {
+	int indent = level * json_write_node_indent;
+	int len;
+
+	while(indent > 0) {
+		len = min(indent, JSON_STREAM_INDENT_LEN);
+		json_stream_put(stream, json_stream_spaces, len);
+		indent -= len;
+	}
+}
+
+/* Stream writer - used to write strings and nodes into stream
+ * -------------------------- */
+
+static int json_writer_error_stream(void* state) {
+	return ((json_stream_t*) state)->js_error;
+}
+
+static void json_write_byte_stream(void* state, char byte) {
+	json_stream_put_byte((json_stream_t*) state, byte);
+}
+
+static void json_write_string_stream(void* state, const char* str) {
+	json_stream_put((json_stream_t*) state, str, strlen(str));
+}
+
+static void json_write_byte_array_stream(void* state, const char* array, size_t sz) {
+	json_stream_put((json_stream_t*) state, array, sz);
+}
+
+struct json_writer json_writer_stream = {
+	json_writer_error_stream,
+	json_write_byte_stream,
+	json_write_string_stream,
+	json_write_byte_array_stream
+};
+
+/* Stream API
+ * -------------------------- */
+
+static json_stream_t* json_stream_create_impl(int sink, boolean_t formatted) {
+	json_stream_t* stream = mp_malloc(sizeof(json_stream_t));
+
+	stream->js_sink = sink;
+	stream->js_file = NULL;
+	stream->js_fd = -1;
+
+	stream->js_size = JSON_STREAM_BUFSIZE;
+	stream->js_buf = mp_malloc(stream->js_size);
+	stream->js_len = 0;
+
+	stream->js_formatted = formatted;
+	stream->js_key = B_FALSE;
+	stream->js_error = JSON_OK;
+
+	stream->js_depth = 0;
+	stream->js_count[0] = 0;
+	stream->js_is_node[0] = B_FALSE;
+
+	return stream;
+}
+
+/**
+ * Create stream which keeps output in memory. Use json_stream_data()
+ * to get it.
+ */
+json_stream_t* json_stream_create(boolean_t formatted) {
+	return json_stream_create_impl(JSON_STREAM_MEMORY, formatted);
+}
+
+json_stream_t* json_stream_create_file(FILE* file, boolean_t formatted) {
+	json_stream_t* stream = json_stream_create_impl(JSON_STREAM_FILE, formatted);
+	stream->js_file = file;
+
+	return stream;
+}
+
+json_stream_t* json_stream_create_fd(int fd, boolean_t formatted) {
+	json_stream_t* stream = json_stream_create_impl(JSON_STREAM_FD, formatted);
+	stream->js_fd = fd;
+
+	return stream;
+}
+
+/**
+ * Flush buffered data and destroy stream. File or descriptor
+ * is not closed. To check if all data was written, call
+ * json_stream_flush() before destroying stream.
+ */
+void json_stream_destroy(json_stream_t* stream) {
+	json_stream_flush(stream);
+
+	mp_free(stream->js_buf);
+	mp_free(stream);
+}
+
+/**
+ * Write buffered data to a file or descriptor. Doesn't flush
+ * stdio buffers of a FILE.
+ *
+ * @return JSON_OK or first error that occured in stream
+ */
+int json_stream_flush(json_stream_t* stream) {
+	if(stream->js_sink == JSON_STREAM_MEMORY || stream->js_error != JSON_OK)
+		return stream->js_error;
+
+	if(stream->js_len > 0) {
+		json_stream_write_sink(stream, stream->js_buf, stream->js_len);
+		stream->js_len = 0;
+	}
+
+	return stream->js_error;
+}
+
+/**
+ * Returns null-terminated output of memory stream. Pointer is valid until
+ * stream is written again or destroyed.
+ *
+ * @param len if not NULL, receives length of output
+ *
+ * @return output or NULL if stream is not memory stream
+ */
+const char* json_stream_data(json_stream_t* stream, size_t* len) {
+	if(stream->js_sink != JSON_STREAM_MEMORY)
+		return NULL;
+
+	stream->js_buf[stream->js_len] = '\0';
+
+	if(len != NULL)
+		*len = stream->js_len;
+
+	return stream->js_buf;
+}
+
+/* Writes separator and indentation before key (in object) or value
+ * (in array or root). Value which follows key needs no prefix. */
+static int json_stream_element(json_stream_t* stream, boolean_t is_key) {
+	int level = stream->js_depth;
+
+	if(stream->js_error != JSON_OK)
+		return stream->js_error;
+
+	if(stream->js_key) {
+		if(is_key)
+			return json_stream_set_error(stream, JSON_INTERNAL_ERROR, "Expected value after key in JSON stream");
+
+		stream->js_key = B_FALSE;
+		return JSON_OK;
+	}
+
+	if(stream->js_is_node[level] != is_key) {
+		return json_stream_set_error(stream, JSON_INTERNAL_ERROR,
+					is_key ? "Key is written outside of object in JSON stream"
+						   : "Value without key is written into object in JSON stream");
+	}
+
+	if(level == 0 && stream->js_count[0] > 0)
+		return json_stream_set_error(stream, JSON_INTERNAL_ERROR, "Only one root value is allowed in JSON stream");
+
+	if(stream->js_count[level] > 0)
+		json_stream_put_byte(stream, ',');
+
+	if(stream->js_formatted && level > 0) {
+		if(stream->js_count[level] > 0)
+			json_stream_put_byte(stream, '\n');
+
+		json_stream_indent(stream, level);
+	}
+
+	++stream->js_count[level];
+
+	return stream->js_error;
+}
+
+static int json_stream_begin(json_stream_t* stream, boolean_t is_node) {
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	if(stream->js_depth == JSON_STREAM_MAX_DEPTH)
+		return json_stream_set_error(stream, JSON_INTERNAL_ERROR, "Too deep nesting of JSON stream");
+
+	json_stream_put_byte(stream, is_node ? '{' : '[');
+
+	if(stream->js_formatted)
+		json_stream_put_byte(stream, '\n');
+
+	++stream->js_depth;
+	stream->js_count[stream->js_depth] = 0;
+	stream->js_is_node[stream->js_depth] = is_node;
+
+	return stream->js_error;
+}
+
+static int json_stream_end(json_stream_t* stream, boolean_t is_node) {
+	if(stream->js_error != JSON_OK)
+		return stream->js_error;
+
+	if(stream->js_depth == 0 || stream->js_key ||
+	   stream->js_is_node[stream->js_depth] != is_node) {
+		return json_stream_set_error(stream, JSON_INTERNAL_ERROR, "Unbalanced end of object or array in JSON stream");
+	}
+
+	if(stream->js_formatted && stream->js_count[stream->js_depth] > 0)
+		json_stream_put_byte(stream, '\n');
+
+	--stream->js_depth;
+
+	if(stream->js_formatted && stream->js_depth > 0)
+		json_stream_indent(stream, stream->js_depth);
+
+	json_stream_put_byte(stream, is_node ? '}' : ']');
+
+	if(stream->js_formatted && stream->js_depth == 0)
+		json_stream_put_byte(stream, '\n');
+
+	return stream->js_error;
+}
+
+/**
+ * Begin object. If node_class is not NULL, adds "_type" attribute
+ * like json_new_node() does.
+ */
+int json_stream_begin_object(json_stream_t* stream, const char* node_class) {
+	if(json_stream_begin(stream, B_TRUE) != JSON_OK)
+		return stream->js_error;
+
+	if(node_class != NULL)
+		return json_stream_add_string(stream, "_type", node_class);
+
+	return JSON_OK;
+}
+
+int json_stream_end_object(json_stream_t* stream) {
+	return json_stream_end(stream, B_TRUE);
+}
+
+int json_stream_begin_array(json_stream_t* stream) {
+	return json_stream_begin(stream, B_FALSE);
+}
+
+int json_stream_end_array(json_stream_t* stream) {
+	return json_stream_end(stream, B_FALSE);
+}
+
+int json_stream_key(json_stream_t* stream, const char* name) {
+	if(json_stream_element(stream, B_TRUE) != JSON_OK)
+		return stream->js_error;
+
+	json_write_string((json_str_t) name, &json_writer_stream, stream);
+
+	json_stream_put_byte(stream, ':');
+	if(stream->js_formatted)
+		json_stream_put_byte(stream, ' ');
+
+	stream->js_key = B_TRUE;
+
+	return stream->js_error;
+}
+
+int json_stream_null(json_stream_t* stream) {
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	json_stream_put(stream, "null", 4);
+
+	return stream->js_error;
+}
+
+int json_stream_integer(json_stream_t* stream, int64_t val) {
+	char buf[JSON_NUMBER_LEN];
+	int count;
+
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	count = json_format_integer(buf, val);
+	json_stream_put(stream, buf, count);
+
+	return stream->js_error;
+}
+
+int json_stream_double(json_stream_t* stream, double val) {
+	char buf[JSON_NUMBER_LEN];
+	int count;
+
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	count = json_format_double(buf, val);
+	if(count >= JSON_NUMBER_LEN)
+		return json_stream_set_error(stream, JSON_BUFFER_OVERFLOW, "Too long number that didn't fit into buffer.");
+
+	json_stream_put(stream, buf, count);
+
+	return stream->js_error;
+}
+
+int json_stream_string(json_stream_t* stream, const char* val) {
+	int ret;
+
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	ret = json_write_string((json_str_t) val, &json_writer_stream, stream);
+	if(ret != JSON_OK && stream->js_error == JSON_OK)
+		stream->js_error = ret;
+
+	return stream->js_error;
+}
+
+int json_stream_boolean(json_stream_t* stream, boolean_t val) {
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	if(val) {
+		json_stream_put(stream, "true", 4);
+	}
+	else {
+		json_stream_put(stream, "false", 5);
+	}
+
+	return stream->js_error;
+}
+
+/**
+ * Write existing tree as a value. Allows to mix nodes that are already
+ * built (i.e. parameters of workloads) with streamed data.
+ */
+int json_stream_node(json_stream_t* stream, json_node_t* node) {
+	int ret;
+
+	if(json_stream_element(stream, B_FALSE) != JSON_OK)
+		return stream->js_error;
+
+	ret = json_write_impl(node, &json_writer_stream, stream, stream->js_formatted,
+						  stream->js_depth * json_write_node_indent);
+	if(ret != JSON_OK && stream->js_error == JSON_OK)
+		stream->js_error = ret;
+
+	return stream->js_error;
+}
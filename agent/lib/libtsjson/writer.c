@@ -128,31 +128,58 @@ unicode1:
 
 #undef ESCAPE_CHARACTER
 
-int json_write_number(json_node_t* num, struct json_writer* writer, void* state) {
+/**
+ * Format integer in decimal notation. Same as "%" PRId64 but doesn't
+ * interpret format which is noticeable when millions of numbers are written.
+ * Buffer should be at least JSON_NUMBER_LEN bytes long.
+ */
+int json_format_integer(char* buf, int64_t i) {
+	char digits[JSON_NUMBER_LEN];
+	char* p = digits + JSON_NUMBER_LEN;
+	uint64_t u = (i < 0) ? -((uint64_t) i) : (uint64_t) i;
+	int count;
+
+	do {
+		*--p = '0' + (char) (u % 10);
+		u /= 10;
+	} while(u != 0);
+
+	if(i < 0)
+		*--p = '-';
+
+	count = (digits + JSON_NUMBER_LEN) - p;
+	memcpy(buf, p, count);
+	buf[count] = '\0';
+
+	return count;
+}
+
+int json_format_double(char* buf, double d) {
 	/* Use E-format for laaaaaarge doubles, so it wouldn't be overflown */
-	char buf[32];
+	if(labs((long) log10(d)) > 17) {
+		return snprintf(buf, JSON_NUMBER_LEN, "%.20e", d);
+	}
+
+	return snprintf(buf, JSON_NUMBER_LEN, "%f", d);
+}
+
+int json_write_number(json_node_t* num, struct json_writer* writer, void* state) {
+	char buf[JSON_NUMBER_LEN];
 	int count;
 
 	if(num->jn_is_integer) {
-		count = snprintf(buf, 32, "%" PRId64, num->jn_data.i);
+		count = json_format_integer(buf, num->jn_data.i);
 	}
 	else {
-		double d = num->jn_data.d;
-
-		if(labs((long) log10(d)) > 17) {
-			count = snprintf(buf, 32, "%.20e", d);
-		}
-		else {
-			count = snprintf(buf, 32, "%f", d);
-		}
+		count = json_format_double(buf, num->jn_data.d);
 	}
 	
-	if(count > 31) {
+	if(count >= JSON_NUMBER_LEN) {
 		/* This shouldn't happen, but it did. Report as error */
 		return json_set_error_str(JSON_BUFFER_OVERFLOW, "Too long number that didn't fit into buffer.");
 	}
 	
-	writer->write_string(state, buf);
+	writer->write_byte_array(state, buf, count);
 
 	return writer->writer_error(state);
 }
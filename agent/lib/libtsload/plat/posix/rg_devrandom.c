@@ -21,17 +21,45 @@
 #include <tsload/defs.h>
 
 #include <tsload/mempool.h>
+#include <tsload/threads.h>
+#include <tsload/list.h>
 #include <tsload/posixdecl.h>
+#include <tsload/log.h>
 
 #include <tsload/load/randgen.h>
 
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef HAVE_DECL_GETRANDOM
+#include <sys/random.h>
+#endif
+
 
 #define DEV_RANDOM		"/dev/urandom"
 
+/**
+ * Size of per-thread block of random bytes. Should be multiple of 8
+ */
+#define RGDEVRANDOMBLOCK	65536
+
 /**
  * #### /dev/urandom generator
  *
- * Generates random numbers using /dev/urandom character device
+ * Generates random numbers using /dev/urandom character device or getrandom()
+ * system call (if it is supported by platform)
+ *
+ * Since devrandom is a singleton generator shared between all threads, each
+ * thread keeps its own block of random bytes which is refilled with a single
+ * syscall when it is exhausted, so generating a number costs a memcpy in most
+ * cases. Blocks are linked into generator's list and freed either by
+ * thread-specific data destructor when thread exits or when generator is
+ * destroyed.
+ *
+ * If random bytes can't be read at all, TSLoad aborts: the generator has no
+ * way to report an error to a caller.
  *
  * NOTE: Since /dev/random doesn't guarantee non-blocking, (and TSLoad is
  * not an cryptography software) it is not implemented
@@ -39,16 +67,113 @@
  * NOTE: doesn't use seed
  * */
 
+struct rq_devrandom;
+
+typedef struct rq_devrandom_block {
+	size_t pos;
+	list_node_t node;
+	struct rq_devrandom* dr;
+
+	char data[RGDEVRANDOMBLOCK];
+} rq_devrandom_block_t;
+
 typedef struct rq_devrandom {
 	int fd;
+
+	/* Uses pthread key directly because tkey_* doesn't support destructors */
+	pthread_key_t block_key;
+
+	thread_mutex_t block_lock;
+	list_head_t block_list;
 } rq_devrandom_t;
 
+/**
+ * Fill buffer with random bytes. Short reads (getrandom() may return less bytes than
+ * requested for large buffers if it is interrupted) are retried. Aborts if
+ * neither getrandom() nor read() can provide random bytes, so buffer is never
+ * left partially filled.
+ */
+static void rg_devrandom_fill(rq_devrandom_t* dr, void* buf, size_t size) {
+	char* ptr = (char*) buf;
+	ssize_t ret;
+
+	while(size > 0) {
+#ifdef HAVE_DECL_GETRANDOM
+		ret = getrandom(ptr, size, 0);
+
+		/* getrandom() is declared, but not supported by kernel: fall back
+		 * to a character device */
+		if(ret == -1 && errno != EINTR)
+			ret = read(dr->fd, ptr, size);
+#else
+		ret = read(dr->fd, ptr, size);
+#endif
+
+		if(ret == -1 && errno == EINTR)
+			continue;
+
+		if(ret <= 0) {
+			logmsg(LOG_CRIT, "Failed to read random bytes from " DEV_RANDOM ": %s. Abort.",
+				   (ret == 0) ? "unexpected end of file" : strerror(errno));
+			abort();
+		}
+
+		ptr += ret;
+		size -= ret;
+	}
+}
+
+/**
+ * Thread-specific data destructor: unlinks and frees block of exiting thread
+ */
+static void rg_devrandom_free_block(void* arg) {
+	rq_devrandom_block_t* block = (rq_devrandom_block_t*) arg;
+	rq_devrandom_t* dr = block->dr;
+
+	mutex_lock(&dr->block_lock);
+	list_del(&block->node);
+	mutex_unlock(&dr->block_lock);
+
+	mp_free(block);
+}
+
+static rq_devrandom_block_t* rg_devrandom_get_block(rq_devrandom_t* dr) {
+	rq_devrandom_block_t* block = (rq_devrandom_block_t*) pthread_getspecific(dr->block_key);
+
+	if(block != NULL)
+		return block;
+
+	block = mp_malloc(sizeof(rq_devrandom_block_t));
+	block->pos = RGDEVRANDOMBLOCK;
+	block->dr = dr;
+	list_node_init(&block->node);
+
+	mutex_lock(&dr->block_lock);
+	list_add_tail(&block->node, &dr->block_list);
+	mutex_unlock(&dr->block_lock);
+
+	pthread_setspecific(dr->block_key, block);
+
+	return block;
+}
+
 int rg_init_devrandom(randgen_t* rg) {
 	rq_devrandom_t* dr = mp_malloc(sizeof(rq_devrandom_t));
 
 	dr->fd = open(DEV_RANDOM, O_RDONLY);
-	if(dr->fd == -1)
+	if(dr->fd == -1) {
+		mp_free(dr);
+		return -1;
+	}
+
+	if(pthread_key_create(&dr->block_key, rg_devrandom_free_block) != 0) {
+		close(dr->fd);
+		mp_free(dr);
 		return -1;
+	}
+
+	mutex_init(&dr->block_lock, "rg-devrandom-%p", rg);
+	list_head_init(&dr->block_list, "rg-devrandom-%p", rg);
 
 	rg->rg_private = dr;
 
@@ -57,6 +182,22 @@ int rg_init_devrandom(randgen_t* rg) {
 
 void rg_destroy_devrandom(randgen_t* rg) {
 	rq_devrandom_t* dr = (rq_devrandom_t*) rg->rg_private;
+	rq_devrandom_block_t* block;
+	rq_devrandom_block_t* next;
+
+	/* Deleting key first guarantees that destructors won't be called for
+	 * blocks that are freed here. Blocks of the current thread and threads
+	 * that are still alive are freed by the loop below. */
+	pthread_key_delete(dr->block_key);
+
+	mutex_lock(&dr->block_lock);
+	list_for_each_entry_safe(rq_devrandom_block_t, block, next, &dr->block_list, node) {
+		list_del(&block->node);
+		mp_free(block);
+	}
+	mutex_unlock(&dr->block_lock);
+
+	mutex_destroy(&dr->block_lock);
 
 	close(dr->fd);
 
@@ -65,20 +206,53 @@ void rg_destroy_devrandom(randgen_t* rg) {
 
 uint64_t rg_generate_int_devrandom(randgen_t* rg) {
 	rq_devrandom_t* dr = (rq_devrandom_t*) rg->rg_private;
+	rq_devrandom_block_t* block = rg_devrandom_get_block(dr);
 	uint64_t value;
 
-	read(dr->fd, &value, sizeof(uint64_t));
+	if(block->pos == RGDEVRANDOMBLOCK) {
+		rg_devrandom_fill(dr, block->data, RGDEVRANDOMBLOCK);
+		block->pos = 0;
+	}
+
+	memcpy(&value, block->data + block->pos, sizeof(uint64_t));
+	block->pos += sizeof(uint64_t);
 
 	return value;
 }
 
+void rg_generate_bulk_devrandom(randgen_t* rg, uint64_t* out, size_t n) {
+	rq_devrandom_t* dr = (rq_devrandom_t*) rg->rg_private;
+	rq_devrandom_block_t* block = rg_devrandom_get_block(dr);
+	size_t size = n * sizeof(uint64_t);
+	size_t avail = RGDEVRANDOMBLOCK - block->pos;
+
+	/* Consume rest of the block first, then read large requests directly
+	 * to the destination and leave the block for smaller ones */
+	if(size <= avail) {
+		memcpy(out, block->data + block->pos, size);
+		block->pos += size;
+		return;
+	}
+
+	memcpy(out, block->data + block->pos, avail);
+	block->pos = RGDEVRANDOMBLOCK;
+	size -= avail;
+
+	if(size >= RGDEVRANDOMBLOCK) {
+		rg_devrandom_fill(dr, ((char*) out) + avail, size);
+		return;
+	}
+
+	rg_devrandom_fill(dr, block->data, RGDEVRANDOMBLOCK);
+	memcpy(((char*) out) + avail, block->data, size);
+	block->pos = size;
+}
+
 randgen_class_t rg_devrandom_class = {
 	RG_CLASS_HEAD("devrandom", B_TRUE, ULLONG_MAX),
 
 	SM_INIT(.rg_init, 		  rg_init_devrandom),
 	SM_INIT(.rg_destroy, 	  rg_destroy_devrandom),
 	SM_INIT(.rg_generate_int, rg_generate_int_devrandom),
+	SM_INIT(.rg_generate_bulk, rg_generate_bulk_devrandom),
 };
-
-
-
@@ -44,6 +44,9 @@ extern randvar_class_t rv_normal_class;
 extern randgen_class_t rg_libc_class;
 extern randgen_class_t rg_seq_class;
 extern randgen_class_t rg_lcg_class;
+extern randgen_class_t rg_xoshiro_class;
+extern randgen_class_t rg_pcg_class;
+extern randgen_class_t rg_philox_class;
 #ifdef PLAT_POSIX
 extern randgen_class_t rg_devrandom_class;
 #endif
@@ -88,10 +91,11 @@ void rg_destroy(randgen_t* rg) {
 }
 
 /**
- * Generates double with uniform distribution in range
- * [0.0; 1.0]
- * */
-double rg_generate_double(randgen_t* rg) {
+ * Convert integer generated by PRNG with maximum value max to double. Used by
+ * both scalar and bulk paths, so buffered values are the same as ones returned by
+ * rg_generate_double() for the same seed.
+ */
+static double rg_int_to_double(uint64_t max, uint64_t r) {
 	/* By raw conversion integer to doubles we may lose precision
 	 * and create bad sequences. So do the integer division and
 	 * convert to double then do the double calculations:
@@ -108,24 +112,76 @@ double rg_generate_double(randgen_t* rg) {
 	 * pretty precise type. So, it's a configuration option
 	 *  */
 #ifndef TSLOAD_RANDGEN_FAST
-	uint64_t r = rg_generate_int(rg);
 	uint64_t x, y;
-	double   u;
 
 	if(r == 0)
 		return 0.0;
 
-	x = rg->rg_class->rg_max / r;
-	y = rg->rg_class->rg_max % r;
+	x = max / r;
+	y = max % r;
 
-	u = 1.0 / ((double)x + ((double)y / (double)r));
-
-	return u;
+	return 1.0 / ((double)x + ((double)y / (double)r));
 #else
-	return ((double) rg_generate_int(rg)) / ((double) rg->rg_class->rg_max);
+	/* For full-range generators take 53 most significant bits (they are also
+	 * better than lower bits for LCG): they fit into mantissa of double, so
+	 * conversion is exact and doesn't need division. Result is in [0.0; 1.0).
+	 * Note that these values differ from default mapping. */
+	if(max == ULLONG_MAX)
+		return (double) (r >> 11) * (1.0 / 9007199254740992.0);
+
+	return ((double) r) / ((double) max);
 #endif
 }
 
+/**
+ * Generates double with uniform distribution in range
+ * [0.0; 1.0]
+ * */
+double rg_generate_double(randgen_t* rg) {
+	return rg_int_to_double(rg->rg_class->rg_max, rg_generate_int(rg));
+}
+
+/**
+ * Generates n integers with uniform distribution in range
+ * [0; rg_class->rg_max] and puts them into out
+ * */
+void rg_generate_bulk(randgen_t* rg, uint64_t* out, size_t n) {
+	randgen_class_t* class = rg->rg_class;
+	size_t i;
+
+	if(class->rg_generate_bulk != NULL) {
+		class->rg_generate_bulk(rg, out, n);
+		return;
+	}
+
+	for(i = 0; i < n; ++i) {
+		out[i] = class->rg_generate_int(rg);
+	}
+}
+
+/**
+ * Generates n doubles with uniform distribution in range
+ * [0.0; 1.0] and puts them into out
+ * */
+void rg_generate_double_bulk(randgen_t* rg, double* out, size_t n) {
+	uint64_t values[RGBULKSIZE];
+	uint64_t max = rg->rg_class->rg_max;
+	size_t i, count;
+
+	while(n > 0) {
+		count = min(n, RGBULKSIZE);
+
+		rg_generate_bulk(rg, values, count);
+
+		for(i = 0; i < count; ++i) {
+			out[i] = rg_int_to_double(max, values[i]);
+		}
+
+		out += count;
+		n -= count;
+	}
+}
+
 int rg_init_dummy(randgen_t* rg) {
 	return 0;
 }
@@ -159,6 +215,26 @@ void rv_destroy(randvar_t* rv) {
 	mp_free(rv);
 }
 
+/**
+ * Generates n values with distribution of random variator rv
+ * and puts them into out
+ */
+void rv_variate_bulk(randvar_t* rv, double* out, size_t n) {
+	randvar_class_t* class = rv->rv_class;
+	size_t i;
+
+	rg_generate_double_bulk(rv->rv_generator, out, n);
+
+	if(class->rv_variate_bulk != NULL) {
+		class->rv_variate_bulk(rv, out, n);
+		return;
+	}
+
+	for(i = 0; i < n; ++i) {
+		out[i] = class->rv_variate_double(rv, out[i]);
+	}
+}
+
 int rv_init_dummy(randvar_t* rv) {
 	return 0;
 }
@@ -174,6 +250,46 @@ int rv_set_double_dummy(randvar_t* rv, const char* name, double value) {
 	return RV_INVALID_PARAM_NAME;
 }
 
+/* Random buffers */
+
+void rg_buffer_init(rg_buffer_t* buf, int type, randgen_t* rg, randvar_t* rv) {
+	buf->rgb_type = type;
+	buf->rgb_rg = rg;
+	buf->rgb_rv = rv;
+
+	buf->rgb_values.ival = mp_malloc(RGBUFSIZE * sizeof(uint64_t));
+
+	buf->rgb_count = 0;
+	buf->rgb_pos = 0;
+}
+
+void rg_buffer_destroy(rg_buffer_t* buf) {
+	mp_free(buf->rgb_values.ival);
+}
+
+/**
+ * Drop values left in buffer and generate count new values.
+ * count is limited by RGBUFSIZE.
+ */
+void rg_buffer_fill(rg_buffer_t* buf, unsigned count) {
+	count = max(min(count, RGBUFSIZE), 1);
+
+	switch(buf->rgb_type) {
+	case RGBUF_INT:
+		rg_generate_bulk(buf->rgb_rg, buf->rgb_values.ival, count);
+		break;
+	case RGBUF_DOUBLE:
+		rg_generate_double_bulk(buf->rgb_rg, buf->rgb_values.dval, count);
+		break;
+	case RGBUF_VARIATE:
+		rv_variate_bulk(buf->rgb_rv, buf->rgb_values.dval, count);
+		break;
+	}
+
+	buf->rgb_count = count;
+	buf->rgb_pos = 0;
+}
+
 tsobj_node_t* tsobj_randgen_class_format(randgen_class_t* rg_class) {
 	AUTOSTRING char* max_value_str;
 	tsobj_node_t* node = tsobj_new_node("tsload.randgen.GeneratorClass");
@@ -343,6 +459,9 @@ int randgen_init(void) {
 	randgen_register(NULL, &rg_libc_class);
 	randgen_register(NULL, &rg_lcg_class);
 	randgen_register(NULL, &rg_seq_class);
+	randgen_register(NULL, &rg_xoshiro_class);
+	randgen_register(NULL, &rg_pcg_class);
+	randgen_register(NULL, &rg_philox_class);
 #ifdef PLAT_POSIX
 	randgen_register(NULL, &rg_devrandom_class);
 #endif
@@ -364,6 +483,9 @@ void randgen_fini(void) {
 #ifdef PLAT_POSIX
 	randgen_unregister(NULL, &rg_devrandom_class);
 #endif	
+	randgen_unregister(NULL, &rg_philox_class);
+	randgen_unregister(NULL, &rg_pcg_class);
+	randgen_unregister(NULL, &rg_xoshiro_class);
 	randgen_unregister(NULL, &rg_seq_class);
 	randgen_unregister(NULL, &rg_lcg_class);
 	randgen_unregister(NULL, &rg_libc_class);
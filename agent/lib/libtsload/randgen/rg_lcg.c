@@ -33,17 +33,29 @@
  *
  * Unlike libc generator (that is most likely LCG too), non-singleton, so it
  * provides independent streams of pseudo-random numbers.
+ *
+ * Bulk generation splits sequence into 4 interleaved lanes, each of them is
+ * advanced by 4 steps at once: x[n + 4] = A4 * x[n] + C4, so multiplications
+ * of different lanes do not depend on each other and may be pipelined or
+ * vectorized by compiler. Output is the same as for sequental generation.
  * */
 
 uint64_t rg_lcg_multiplier = 6364136223846793005ll;
 uint64_t rg_lcg_increment = 1442695040888963407ll;
 
+#define RG_LCG_LANES	4
+
 typedef struct rq_lcg {
 	uint64_t lcg_seed;
+
+	/* Multiplier and increment for jumping 4 steps ahead */
+	uint64_t lcg_multiplier4;
+	uint64_t lcg_increment4;
 } rq_lcg_t;
 
 int rg_init_lcg(randgen_t* rg) {
 	rq_lcg_t* lcg = mp_malloc(sizeof(rq_lcg_t));
+	int i;
 
 	if(rg->rg_seed == 0)
 		rg->rg_seed = 1;
@@ -51,6 +63,14 @@ int rg_init_lcg(randgen_t* rg) {
 	lcg->lcg_seed = rg->rg_seed;
 	rg->rg_private = lcg;
 
+	/* A4 = a^4, C4 = c * (a^3 + a^2 + a + 1) */
+	lcg->lcg_multiplier4 = 1;
+	lcg->lcg_increment4 = 0;
+	for(i = 0; i < RG_LCG_LANES; ++i) {
+		lcg->lcg_increment4 = rg_lcg_multiplier * lcg->lcg_increment4 + rg_lcg_increment;
+		lcg->lcg_multiplier4 *= rg_lcg_multiplier;
+	}
+
 	return 0;
 }
 
@@ -66,12 +86,52 @@ uint64_t rg_generate_int_lcg(randgen_t* rg) {
 	return lcg->lcg_seed;
 }
 
+void rg_generate_bulk_lcg(randgen_t* rg, uint64_t* out, size_t n) {
+	rq_lcg_t* lcg = (rq_lcg_t*) rg->rg_private;
+	uint64_t a = rg_lcg_multiplier;
+	uint64_t c = rg_lcg_increment;
+	uint64_t a4 = lcg->lcg_multiplier4;
+	uint64_t c4 = lcg->lcg_increment4;
+	uint64_t x = lcg->lcg_seed;
+	uint64_t x0, x1, x2, x3;
+	size_t i = 0;
+
+	if(n >= RG_LCG_LANES) {
+		x0 = a * x + c;
+		x1 = a * x0 + c;
+		x2 = a * x1 + c;
+		x3 = a * x2 + c;
+
+		for( ; (i + RG_LCG_LANES) <= n; i += RG_LCG_LANES) {
+			out[i] = x0;
+			out[i + 1] = x1;
+			out[i + 2] = x2;
+			out[i + 3] = x3;
+
+			x0 = a4 * x0 + c4;
+			x1 = a4 * x1 + c4;
+			x2 = a4 * x2 + c4;
+			x3 = a4 * x3 + c4;
+		}
+
+		x = out[i - 1];
+	}
+
+	for( ; i < n; ++i) {
+		x = a * x + c;
+		out[i] = x;
+	}
+
+	lcg->lcg_seed = x;
+}
+
 randgen_class_t rg_lcg_class = {
 	RG_CLASS_HEAD("lcg", B_FALSE, ULLONG_MAX),
 
 	SM_INIT(.rg_init, 		  rg_init_lcg),
 	SM_INIT(.rg_destroy, 	  rg_destroy_lcg),
 	SM_INIT(.rg_generate_int, rg_generate_int_lcg),
+	SM_INIT(.rg_generate_bulk, rg_generate_bulk_lcg),
 };
 
 
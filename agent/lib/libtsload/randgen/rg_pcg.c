@@ -0,0 +1,147 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
+*/    
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/load/randgen.h>
+
+#include <limits.h>
+
+
+/**
+ * #### PCG64 generator
+ *
+ * See [PCG, A Family of Better Random Number Generators](http://www.pcg-random.org/)
+ *
+ * Uses 128-bit LCG as a state and XSL-RR permutation (xor of halves of state
+ * rotated by its upper bits) as output function, which hides weak lower bits
+ * of LCG. Non-singleton, period is 2^128.
+ *
+ * If compiler has no 128-bit integers, multiplication is emulated
+ * with 64-bit halves.
+ * */
+
+#define RG_PCG_MULTIPLIER_HI	0x2360ED051FC65DA4ull
+#define RG_PCG_MULTIPLIER_LO	0x4385DF649FCCF645ull
+#define RG_PCG_INCREMENT_HI		0x5851F42D4C957F2Dull
+#define RG_PCG_INCREMENT_LO		0x14057B7EF767814Full
+
+typedef struct rg_pcg {
+	uint64_t state_hi;
+	uint64_t state_lo;
+} rg_pcg_t;
+
+STATIC_INLINE void rg_pcg_step(rg_pcg_t* pcg) {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 state = ((unsigned __int128) pcg->state_hi << 64) | pcg->state_lo;
+	unsigned __int128 mult = ((unsigned __int128) RG_PCG_MULTIPLIER_HI << 64) | RG_PCG_MULTIPLIER_LO;
+	unsigned __int128 inc = ((unsigned __int128) RG_PCG_INCREMENT_HI << 64) | RG_PCG_INCREMENT_LO;
+
+	state = state * mult + inc;
+
+	pcg->state_hi = (uint64_t) (state >> 64);
+	pcg->state_lo = (uint64_t) state;
+#else
+	/* Low 64x64 -> 128 product is built from 32-bit halves,
+	 * cross products only affect upper half of the result */
+	uint64_t a = pcg->state_lo;
+	uint64_t b = RG_PCG_MULTIPLIER_LO;
+	uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+
+	uint64_t p0 = a_lo * b_lo;
+	uint64_t p1 = a_lo * b_hi;
+	uint64_t p2 = a_hi * b_lo;
+	uint64_t p3 = a_hi * b_hi;
+
+	uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFF) + (p2 & 0xFFFFFFFF);
+
+	uint64_t lo = (p0 & 0xFFFFFFFF) | (mid << 32);
+	uint64_t hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+
+	hi += pcg->state_hi * RG_PCG_MULTIPLIER_LO + pcg->state_lo * RG_PCG_MULTIPLIER_HI;
+
+	/* Add increment with carry */
+	pcg->state_lo = lo + RG_PCG_INCREMENT_LO;
+	pcg->state_hi = hi + RG_PCG_INCREMENT_HI + (pcg->state_lo < lo);
+#endif
+}
+
+STATIC_INLINE uint64_t rg_pcg_output(rg_pcg_t* pcg) {
+	uint64_t x = pcg->state_hi ^ pcg->state_lo;
+	int rot = (int) (pcg->state_hi >> 58);
+
+	return (x >> rot) | (x << ((-rot) & 63));
+}
+
+int rg_init_pcg(randgen_t* rg) {
+	rg_pcg_t* pcg = mp_malloc(sizeof(rg_pcg_t));
+
+	if(pcg == NULL)
+		return 1;
+
+	/* Same as pcg_setseq_128_srandom_r() with seed as low part of initial state */
+	pcg->state_hi = 0;
+	pcg->state_lo = 0;
+	rg_pcg_step(pcg);
+
+	pcg->state_lo += rg->rg_seed;
+	pcg->state_hi += (pcg->state_lo < rg->rg_seed);
+	rg_pcg_step(pcg);
+
+	rg->rg_private = pcg;
+
+	return 0;
+}
+
+void rg_destroy_pcg(randgen_t* rg) {
+	mp_free(rg->rg_private);
+}
+
+uint64_t rg_generate_int_pcg(randgen_t* rg) {
+	rg_pcg_t* pcg = (rg_pcg_t*) rg->rg_private;
+
+	rg_pcg_step(pcg);
+
+	return rg_pcg_output(pcg);
+}
+
+void rg_generate_bulk_pcg(randgen_t* rg, uint64_t* out, size_t n) {
+	rg_pcg_t pcg = * (rg_pcg_t*) rg->rg_private;
+	size_t i;
+
+	for(i = 0; i < n; ++i) {
+		rg_pcg_step(&pcg);
+		out[i] = rg_pcg_output(&pcg);
+	}
+
+	* (rg_pcg_t*) rg->rg_private = pcg;
+}
+
+randgen_class_t rg_pcg_class = {
+	RG_CLASS_HEAD("pcg64", B_FALSE, ULLONG_MAX),
+
+	SM_INIT(.rg_init, 		  rg_init_pcg),
+	SM_INIT(.rg_destroy, 	  rg_destroy_pcg),
+	SM_INIT(.rg_generate_int, rg_generate_int_pcg),
+	SM_INIT(.rg_generate_bulk, rg_generate_bulk_pcg),
+};
@@ -0,0 +1,170 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
+*/    
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/load/randgen.h>
+
+#include <limits.h>
+
+
+/**
+ * #### Philox counter-based generator
+ *
+ * See J. K. Salmon et al. "Parallel Random Numbers: As Easy as 1, 2, 3" (SC'11)
+ *
+ * Philox4x32-10 doesn't have state in traditional sense: n-th block of random
+ * numbers is a bijection (10 rounds of multiply-and-xor) of 128-bit counter n
+ * under key derived from seed. Each block provides two 64-bit values.
+ *
+ * Since any block may be computed directly, generator may jump ahead for free:
+ * rg_philox_set_stream() puts stream id into upper half of counter, so
+ * generators created with same seed but different stream ids produce
+ * independent sequences of 2^65 values (i.e. one stream per worker).
+ * */
+
+#define RG_PHILOX_M0		0xD2511F53u
+#define RG_PHILOX_M1		0xCD9E8D57u
+#define RG_PHILOX_W0		0x9E3779B9u
+#define RG_PHILOX_W1		0xBB67AE85u
+#define RG_PHILOX_ROUNDS	10
+
+typedef struct rg_philox {
+	uint32_t key[2];
+
+	/* Counter of next block: ctr_lo is incremented,
+	 * ctr_hi contains stream id */
+	uint64_t ctr_lo;
+	uint64_t ctr_hi;
+
+	/* Second value of last generated block (if has_next is set) */
+	uint64_t next;
+	boolean_t has_next;
+} rg_philox_t;
+
+STATIC_INLINE void rg_philox_block(rg_philox_t* ph, uint64_t ctr_lo, uint64_t* out) {
+	uint32_t c0 = (uint32_t) ctr_lo, c1 = (uint32_t) (ctr_lo >> 32);
+	uint32_t c2 = (uint32_t) ph->ctr_hi, c3 = (uint32_t) (ph->ctr_hi >> 32);
+	uint32_t k0 = ph->key[0], k1 = ph->key[1];
+	uint64_t p0, p1;
+	int round;
+
+	for(round = 0; round < RG_PHILOX_ROUNDS; ++round) {
+		p0 = (uint64_t) RG_PHILOX_M0 * c0;
+		p1 = (uint64_t) RG_PHILOX_M1 * c2;
+
+		c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+		c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t) p1;
+		c3 = (uint32_t) p0;
+
+		k0 += RG_PHILOX_W0;
+		k1 += RG_PHILOX_W1;
+	}
+
+	out[0] = ((uint64_t) c1 << 32) | c0;
+	out[1] = ((uint64_t) c3 << 32) | c2;
+}
+
+int rg_init_philox(randgen_t* rg) {
+	rg_philox_t* ph = mp_malloc(sizeof(rg_philox_t));
+
+	if(ph == NULL)
+		return 1;
+
+	ph->key[0] = (uint32_t) rg->rg_seed;
+	ph->key[1] = (uint32_t) (rg->rg_seed >> 32);
+
+	ph->ctr_lo = 0;
+	ph->ctr_hi = 0;
+	ph->has_next = B_FALSE;
+
+	rg->rg_private = ph;
+
+	return 0;
+}
+
+void rg_destroy_philox(randgen_t* rg) {
+	mp_free(rg->rg_private);
+}
+
+/**
+ * Switch philox generator rg to the beginning of stream with id stream.
+ */
+void rg_philox_set_stream(randgen_t* rg, uint64_t stream) {
+	rg_philox_t* ph = (rg_philox_t*) rg->rg_private;
+
+	ph->ctr_lo = 0;
+	ph->ctr_hi = stream;
+	ph->has_next = B_FALSE;
+}
+
+uint64_t rg_generate_int_philox(randgen_t* rg) {
+	rg_philox_t* ph = (rg_philox_t*) rg->rg_private;
+	uint64_t block[2];
+
+	if(ph->has_next) {
+		ph->has_next = B_FALSE;
+		return ph->next;
+	}
+
+	rg_philox_block(ph, ph->ctr_lo++, block);
+
+	ph->next = block[1];
+	ph->has_next = B_TRUE;
+
+	return block[0];
+}
+
+void rg_generate_bulk_philox(randgen_t* rg, uint64_t* out, size_t n) {
+	rg_philox_t* ph = (rg_philox_t*) rg->rg_private;
+	uint64_t block[2];
+	size_t i = 0;
+
+	if(n > 0 && ph->has_next) {
+		out[i++] = ph->next;
+		ph->has_next = B_FALSE;
+	}
+
+	/* Blocks are independent of each other, so this loop has
+	 * no dependencies between iterations */
+	for( ; (i + 2) <= n; i += 2) {
+		rg_philox_block(ph, ph->ctr_lo++, out + i);
+	}
+
+	if(i < n) {
+		rg_philox_block(ph, ph->ctr_lo++, block);
+
+		out[i] = block[0];
+		ph->next = block[1];
+		ph->has_next = B_TRUE;
+	}
+}
+
+randgen_class_t rg_philox_class = {
+	RG_CLASS_HEAD("philox", B_FALSE, ULLONG_MAX),
+
+	SM_INIT(.rg_init, 		  rg_init_philox),
+	SM_INIT(.rg_destroy, 	  rg_destroy_philox),
+	SM_INIT(.rg_generate_int, rg_generate_int_philox),
+	SM_INIT(.rg_generate_bulk, rg_generate_bulk_philox),
+};
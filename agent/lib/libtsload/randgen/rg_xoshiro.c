@@ -0,0 +1,134 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
+*/    
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/load/randgen.h>
+
+#include <limits.h>
+
+
+/**
+ * #### xoshiro256** generator
+ *
+ * See [xoshiro / xoroshiro generators](http://prng.di.unimi.it/)
+ *
+ * Fast non-singleton generator with 256-bit state and period of 2^256 - 1.
+ * Unlike LCG, all bits of generated value have good quality, so it is
+ * safe to use lower bits or reduce value with modulo. State is initialized
+ * from seed with splitmix64.
+ * */
+
+typedef struct rg_xoshiro {
+	uint64_t s[4];
+} rg_xoshiro_t;
+
+STATIC_INLINE uint64_t rg_xoshiro_rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+STATIC_INLINE uint64_t rg_splitmix64(uint64_t* x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+	return z ^ (z >> 31);
+}
+
+int rg_init_xoshiro(randgen_t* rg) {
+	rg_xoshiro_t* xs = mp_malloc(sizeof(rg_xoshiro_t));
+	uint64_t seed = rg->rg_seed;
+	int i;
+
+	if(xs == NULL)
+		return 1;
+
+	for(i = 0; i < 4; ++i) {
+		xs->s[i] = rg_splitmix64(&seed);
+	}
+
+	rg->rg_private = xs;
+
+	return 0;
+}
+
+void rg_destroy_xoshiro(randgen_t* rg) {
+	mp_free(rg->rg_private);
+}
+
+uint64_t rg_generate_int_xoshiro(randgen_t* rg) {
+	rg_xoshiro_t* xs = (rg_xoshiro_t*) rg->rg_private;
+	uint64_t* s = xs->s;
+
+	uint64_t result = rg_xoshiro_rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+
+	s[2] ^= t;
+
+	s[3] = rg_xoshiro_rotl(s[3], 45);
+
+	return result;
+}
+
+void rg_generate_bulk_xoshiro(randgen_t* rg, uint64_t* out, size_t n) {
+	rg_xoshiro_t* xs = (rg_xoshiro_t*) rg->rg_private;
+	uint64_t s0 = xs->s[0], s1 = xs->s[1],
+			 s2 = xs->s[2], s3 = xs->s[3];
+	uint64_t t;
+	size_t i;
+
+	/* Keep state in registers while generating values */
+	for(i = 0; i < n; ++i) {
+		out[i] = rg_xoshiro_rotl(s1 * 5, 7) * 9;
+
+		t = s1 << 17;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+
+		s2 ^= t;
+
+		s3 = rg_xoshiro_rotl(s3, 45);
+	}
+
+	xs->s[0] = s0;
+	xs->s[1] = s1;
+	xs->s[2] = s2;
+	xs->s[3] = s3;
+}
+
+randgen_class_t rg_xoshiro_class = {
+	RG_CLASS_HEAD("xoshiro256", B_FALSE, ULLONG_MAX),
+
+	SM_INIT(.rg_init, 		  rg_init_xoshiro),
+	SM_INIT(.rg_destroy, 	  rg_destroy_xoshiro),
+	SM_INIT(.rg_generate_int, rg_generate_int_xoshiro),
+	SM_INIT(.rg_generate_bulk, rg_generate_bulk_xoshiro),
+};
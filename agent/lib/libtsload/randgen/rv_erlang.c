@@ -97,6 +97,43 @@ double rv_variate_double_erlang(randvar_t* rv, double u) {
 	return x;
 }
 
+/**
+ * Bulk version multiplies arrays of uniform values, so inner loops
+ * do not contain branches. Zero products (if generator returned 0.0)
+ * are rare, so they are regenerated by scalar variator.
+ */
+void rv_variate_bulk_erlang(randvar_t* rv, double* u, size_t n) {
+	rv_erlang_t* rve = (rv_erlang_t*) rv->rv_private;
+	double values[RGBULKSIZE];
+	double k = -1.0 / rve->rate;
+	size_t i, count;
+	long j;
+
+	while(n > 0) {
+		count = min(n, RGBULKSIZE);
+
+		for(j = 1; j < rve->shape; ++j) {
+			rg_generate_double_bulk(rv->rv_generator, values, count);
+
+			for(i = 0; i < count; ++i) {
+				u[i] *= values[i];
+			}
+		}
+
+		for(i = 0; i < count; ++i) {
+			if(likely(u[i] > 0.0)) {
+				u[i] = log(u[i]) * k;
+			}
+			else {
+				u[i] = rv_variate_double_erlang(rv, rg_generate_double(rv->rv_generator));
+			}
+		}
+
+		u += count;
+		n -= count;
+	}
+}
+
 tsload_param_t rv_erlang_params[] = {
 	{ TSLOAD_PARAM_INTEGER, "shape", "must be greater than 1"},
 	{ TSLOAD_PARAM_FLOAT, "rate", "cannot be negative"},
@@ -113,4 +150,5 @@ randvar_class_t rv_erlang_class = {
 	SM_INIT(.rv_set_double, rv_set_double_erlang),
 
 	SM_INIT(.rv_variate_double, rv_variate_double_erlang),
+	SM_INIT(.rv_variate_bulk, rv_variate_bulk_erlang),
 };
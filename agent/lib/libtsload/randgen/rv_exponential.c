@@ -80,6 +80,16 @@ double rv_variate_double_exp(randvar_t* rv, double u) {
 	return x;
 }
 
+void rv_variate_bulk_exp(randvar_t* rv, double* u, size_t n) {
+	rv_exp_t* rve = (rv_exp_t*) rv->rv_private;
+	double k = -1.0 / rve->rate;
+	size_t i;
+
+	for(i = 0; i < n; ++i) {
+		u[i] = log(1.0 - u[i]) * k;
+	}
+}
+
 tsload_param_t rv_exponential_params[] = {
 	{ TSLOAD_PARAM_FLOAT, "rate", "cannot be negative" },
 	{ TSLOAD_PARAM_NULL, NULL, NULL }
@@ -95,5 +105,6 @@ randvar_class_t rv_exponential_class = {
 	SM_INIT(.rv_set_double, rv_set_double_exp),
 
 	SM_INIT(.rv_variate_double, rv_variate_double_exp),
+	SM_INIT(.rv_variate_bulk, rv_variate_bulk_exp),
 };
 
@@ -28,14 +28,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
 
 
 static const double rv_normal_magic_const = 1.7155277699214135;
+static const double rv_normal_2pi = 6.283185307179586;
 
 /**
  * #### Normal distribution
  *
- * Uses Kinderman and Monahan method
+ * Uses Kinderman and Monahan method. Bulk variator uses Box-Muller transform
+ * instead: it doesn't need rejection loop and takes exactly one uniform value
+ * per normal value, so it is friendly to vectorization.
  *
  * Params:
  * 		* mean (double) - mean value
@@ -103,6 +107,28 @@ double rv_variate_double_normal(randvar_t* rv, double u) {
 	return x;
 }
 
+void rv_variate_bulk_normal(randvar_t* rv, double* u, size_t n) {
+	rv_normal_t* rvn = (rv_normal_t*) rv->rv_private;
+	double r, theta, v;
+	size_t i;
+
+	for(i = 0; (i + 1) < n; i += 2) {
+		/* u is in [0.0; 1.0], so clamp 1 - u to keep logarithm finite */
+		v = 1.0 - u[i];
+		v = (v > 0.0) ? v : DBL_MIN;
+
+		r = sqrt(-2.0 * log(v)) * rvn->stddev;
+		theta = rv_normal_2pi * u[i + 1];
+
+		u[i] = rvn->mean + r * cos(theta);
+		u[i + 1] = rvn->mean + r * sin(theta);
+	}
+
+	if(i < n) {
+		u[i] = rv_variate_double_normal(rv, u[i]);
+	}
+}
+
 tsload_param_t rv_normal_params[] = {
 	{ TSLOAD_PARAM_FLOAT, "mean", "" },
 	{ TSLOAD_PARAM_FLOAT, "stddev", "should be positive" },
@@ -119,5 +145,6 @@ randvar_class_t rv_normal_class = {
 	SM_INIT(.rv_set_double, rv_set_double_normal),
 
 	SM_INIT(.rv_variate_double, rv_variate_double_normal),
+	SM_INIT(.rv_variate_bulk, rv_variate_bulk_normal),
 };
 
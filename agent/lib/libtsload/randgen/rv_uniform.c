@@ -62,6 +62,17 @@ double rv_variate_double_uniform(randvar_t* rv, double u) {
 	return u * (rvu->max - rvu->min) + rvu->min;
 }
 
+void rv_variate_bulk_uniform(randvar_t* rv, double* u, size_t n) {
+	rv_uniform_t* rvu = (rv_uniform_t*) rv->rv_private;
+	double scale = rvu->max - rvu->min;
+	double shift = rvu->min;
+	size_t i;
+
+	for(i = 0; i < n; ++i) {
+		u[i] = u[i] * scale + shift;
+	}
+}
+
 tsload_param_t rv_uniform_params[] = {
 	{ TSLOAD_PARAM_FLOAT, "min", "" },
 	{ TSLOAD_PARAM_FLOAT, "max", "" },
@@ -78,4 +89,5 @@ randvar_class_t rv_uniform_class = {
 	SM_INIT(.rv_set_double, rv_set_double_uniform),
 
 	SM_INIT(.rv_variate_double, rv_variate_double_uniform),
+	SM_INIT(.rv_variate_bulk, rv_variate_bulk_uniform),
 };
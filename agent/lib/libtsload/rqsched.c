@@ -54,6 +54,7 @@ void rqsvar_destroy(rqsched_var_t* var) {
 		if(var->class->rqsvar_destroy)
 			var->class->rqsvar_destroy(var);
 		
+		rg_buffer_destroy(&var->buffer);
 		rv_destroy(var->randvar);
 		rg_destroy(var->randgen);
 		
@@ -139,6 +140,8 @@ int tsobj_rqsched_proc_variator(tsobj_node_t* node, workload_t* wl, rqsched_var_
 		rg_destroy(var->randgen);
 		return RQSCHED_TSOBJ_ERROR;
 	}
+
+	rg_buffer_init(&var->buffer, RGBUF_VARIATE, var->randgen, var->randvar);
 	
 	if(var_class->rqsvar_init)
 		var_class->rqsvar_init(var);
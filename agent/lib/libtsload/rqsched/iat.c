@@ -63,13 +63,17 @@ void rqsched_step_iat(workload_step_t* step) {
 	double iat = (double) (end_time - max(last_time, start_time))/ (double) (step->wls_rq_count + 1);
 
 	rqsvar_step(rqs, iat);
+
+	/* Distribution was changed, so drop values generated for previous
+	 * step and generate inter-arrival times for all requests of this step */
+	rg_buffer_fill(&rqs->rqs_var->buffer, step->wls_rq_count);
 }
 
 void rqsched_pre_request_iat(request_t* rq) {
 	rqsched_t* rqs = (rqsched_t*) rq->rq_workload->wl_rqsched_private;
 	workload_t* wl = rq->rq_workload;
 
-	ts_time_t iat = (ts_time_t) rv_variate_double(rqs->rqs_var->randvar);
+	ts_time_t iat = (ts_time_t) rg_buffer_get_double(&rqs->rqs_var->buffer);
 
 	ts_time_t last_time = rqsched_iat_get_last_time(wl, 0);
 	ts_time_t start_time = wl->wl_current_step * wl->wl_tp->tp_quantum;
@@ -96,6 +100,7 @@ rqsched_class_t rqsched_iat_class = {
 	SM_INIT(.rqsched_fini, rqsched_fini_iat),
 	SM_INIT(.rqsched_step, rqsched_step_iat),
 	SM_INIT(.rqsched_pre_request, rqsched_pre_request_iat),
-	SM_INIT(.rqsched_post_request, rqsched_post_request_iat)
+	SM_INIT(.rqsched_post_request, rqsched_post_request_iat),
+	SM_INIT(.rqsched_destroy_request, NULL)
 };
 
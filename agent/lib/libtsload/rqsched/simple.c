@@ -55,6 +55,7 @@ rqsched_class_t rqsched_simple_class = {
 	SM_INIT(.rqsched_fini, rqsched_fini_simple),
 	SM_INIT(.rqsched_step, rqsched_step_simple),
 	SM_INIT(.rqsched_pre_request, rqsched_pre_request_simple),
-	SM_INIT(.rqsched_post_request, rqsched_post_request_simple)
+	SM_INIT(.rqsched_post_request, rqsched_post_request_simple),
+	SM_INIT(.rqsched_destroy_request, NULL)
 };
 
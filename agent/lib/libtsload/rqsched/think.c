@@ -38,18 +38,30 @@
 
 /**
  * #### Think-time based request scheduler
+ * 
+ * Each user keeps its own list of pending requests (linked through 
+ * `rq_user_node`), so completion of request only walks over requests 
+ * that were issued by the same user and doesn't need `wl_rq_mutex`
  *  */
 
 extern void rqsched_pre_request_iat(request_t* rq);
 extern void rqsched_step_iat(workload_step_t* step);
 
+typedef struct rqsched_think_user {
+	thread_mutex_t mutex;
+	list_head_t rq_list;
+} rqsched_think_user_t;
+
 typedef struct rqsched_think {
 	int nusers;
 	randgen_t* user_randgen;
+	rqsched_think_user_t* users;
 } rqsched_think_t;
 
 int tsobj_rqsched_proc_think(tsobj_node_t* node, workload_t* wl, rqsched_t* rqs) {
 	rqsched_think_t* rqs_think = mp_malloc(sizeof(rqsched_think_t));
+	rqsched_think_user_t* user;
+	int userid;
 	int ret;
 	
 	if(tsobj_get_integer_i(node, "nusers", &rqs_think->nusers) != TSOBJ_OK) {
@@ -68,6 +80,15 @@ int tsobj_rqsched_proc_think(tsobj_node_t* node, workload_t* wl, rqsched_t* rqs)
 	if(ret != RQSCHED_TSOBJ_OK)
 		goto error;
 	
+	rqs_think->users = mp_malloc(rqs_think->nusers * sizeof(rqsched_think_user_t));
+	
+	for(userid = 0; userid < rqs_think->nusers; ++userid) {
+		user = rqs_think->users + userid;
+		
+		mutex_init(&user->mutex, "think-%s-%d", wl->wl_name, userid);
+		list_head_init(&user->rq_list, "think-%s-%d", wl->wl_name, userid);
+	}
+	
 	rqs->rqs_private = rqs_think;
 	return RQSCHED_TSOBJ_OK;
 	
@@ -78,7 +99,13 @@ error:
 
 void rqsched_fini_think(workload_t* wl, rqsched_t* rqs) {
 	rqsched_think_t* rqs_think = (rqsched_think_t*) rqs->rqs_private;
+	int userid;
 
+	for(userid = 0; userid < rqs_think->nusers; ++userid) {
+		mutex_destroy(&rqs_think->users[userid].mutex);
+	}
+	
+	mp_free(rqs_think->users);
 	rg_destroy(rqs_think->user_randgen);
 	
 	mp_free(rqs_think);
@@ -87,32 +114,60 @@ void rqsched_fini_think(workload_t* wl, rqsched_t* rqs) {
 void rqsched_pre_request_think(request_t* rq) {
 	rqsched_t* rqs = (rqsched_t*) rq->rq_workload->wl_rqsched_private;
 	rqsched_think_t* rqs_think = (rqsched_think_t*) rqs->rqs_private;
+	rqsched_think_user_t* user;
 	
 	rqsched_pre_request_iat(rq);
 
 	rq->rq_user_id = rg_generate_int(rqs_think->user_randgen) % rqs_think->nusers;
+	user = rqs_think->users + rq->rq_user_id;
+	
+	mutex_lock(&user->mutex);
+	list_add_tail(&rq->rq_user_node, &user->rq_list);
+	mutex_unlock(&user->mutex);
 }
 
 void rqsched_post_request_think(request_t* rq) {
+	rqsched_t* rqs = (rqsched_t*) rq->rq_workload->wl_rqsched_private;
+	rqsched_think_t* rqs_think = (rqsched_think_t*) rqs->rqs_private;
 	ts_time_t rq_time = tm_diff(rq->rq_start_time, rq->rq_end_time);
 	thread_pool_t* tp = rq->rq_workload->wl_tp;
-	workload_t* wl = rq->rq_workload;
-	request_t* next_rq = NULL;
-
-	mutex_lock(&wl->wl_rq_mutex);
+	rqsched_think_user_t* user;
+	request_t* next_rq = rq;
+	
+	/* Request wasn't scheduled by us (i.e. it was cloned or
+	 * taken from trace) so it has no followers */
+	if(list_node_alone(&rq->rq_user_node))
+		return;
+	
+	user = rqs_think->users + rq->rq_user_id;
 
-	if(!list_is_last(&rq->rq_wl_node, &wl->wl_requests)) {
-		next_rq = list_next_entry(request_t, rq, rq_wl_node);
+	mutex_lock(&user->mutex);
 
-		list_for_each_entry_continue(request_t, next_rq, &wl->wl_requests, rq_wl_node) {
-			if(next_rq->rq_user_id == rq->rq_user_id) {
-				next_rq->rq_sched_time += rq_time;
-				tp->tp_disp->tpd_class->relink_request(tp, next_rq);
-			}
-		}
+	list_for_each_entry_continue(request_t, next_rq, &user->rq_list, rq_user_node) {
+		next_rq->rq_sched_time += rq_time;
+		tp->tp_disp->tpd_class->relink_request(tp, next_rq);
 	}
+	
+	list_del_init(&rq->rq_user_node);
+
+	mutex_unlock(&user->mutex);
+}
 
-	mutex_unlock(&wl->wl_rq_mutex);
+void rqsched_destroy_request_think(request_t* rq) {
+	rqsched_t* rqs = (rqsched_t*) rq->rq_workload->wl_rqsched_private;
+	rqsched_think_t* rqs_think = (rqsched_think_t*) rqs->rqs_private;
+	rqsched_think_user_t* user;
+	
+	/* Normally post_request unlinks request, but discarded requests 
+	 * are destroyed without being run, so unlink them here */
+	if(list_node_alone(&rq->rq_user_node))
+		return;
+	
+	user = rqs_think->users + rq->rq_user_id;
+	
+	mutex_lock(&user->mutex);
+	list_del_init(&rq->rq_user_node);
+	mutex_unlock(&user->mutex);
 }
 
 tsload_param_t rqsched_think_params[] = {
@@ -136,6 +191,7 @@ rqsched_class_t rqsched_think_class = {
 	SM_INIT(.rqsched_fini, rqsched_fini_think),
 	SM_INIT(.rqsched_step, rqsched_step_iat),
 	SM_INIT(.rqsched_pre_request, rqsched_pre_request_think),
-	SM_INIT(.rqsched_post_request, rqsched_post_request_think)
+	SM_INIT(.rqsched_post_request, rqsched_post_request_think),
+	SM_INIT(.rqsched_destroy_request, rqsched_destroy_request_think)
 };
 
@@ -244,6 +244,7 @@ thread_pool_t* tp_create(const char* name, unsigned num_threads, ts_time_t quant
 	/*Initialize objects*/
 	list_head_init(&tp->tp_wl_head, "tp-%s", name);
 	list_head_init(&tp->tp_rq_head, "tp-rq-%s", name);
+	tp_rq_heap_init(&tp->tp_rq_heap);
 
     mutex_init(&tp->tp_mutex, "tp-%s", name);
 
@@ -305,9 +306,12 @@ static void tp_destroy_impl(thread_pool_t* tp, boolean_t may_remove) {
 	assert(list_empty(&tp->tp_wl_head));
 
 	tp->tp_discard = B_TRUE;
+	tp_flush_requests(tp);
 	tp->tp_disp->tpd_class->control_report(tp);
 	tpd_destroy(tp->tp_disp);
 
+	tp_rq_heap_destroy(&tp->tp_rq_heap);
+
 	for(tid = 0; tid < tp->tp_num_threads; ++tid) {
 		tp_destroy_worker(tp, tid);
 	}
@@ -566,10 +570,152 @@ void tp_insert_request_initnodes(list_head_t* rq_list, list_node_t** p_prev_node
 	*p_next_node = next_rq_node;
 }
 
+/**
+ * Initialize request arrival heap. Arrays are allocated lazily.
+ */
+void tp_rq_heap_init(tp_rq_heap_t* heap) {
+	heap->rqh_entries = NULL;
+	heap->rqh_count = 0;
+	heap->rqh_size = 0;
+
+	heap->rqh_runs = NULL;
+	heap->rqh_num_runs = 0;
+	heap->rqh_runs_size = 0;
+
+	heap->rqh_draining = B_FALSE;
+}
+
+void tp_rq_heap_destroy(tp_rq_heap_t* heap) {
+	assert(heap->rqh_num_runs == 0);
+
+	if(heap->rqh_entries != NULL)
+		mp_free(heap->rqh_entries);
+	if(heap->rqh_runs != NULL)
+		mp_free(heap->rqh_runs);
+}
+
+/**
+ * Returns B_TRUE if entry e1 should be popped before e2. Same order
+ * as tp_compare_requests() provides.
+ */
+STATIC_INLINE boolean_t tp_rq_heap_less(tp_rq_heap_entry_t* e1, tp_rq_heap_entry_t* e2) {
+	if(e1->rqh_arrival != e2->rqh_arrival)
+		return e1->rqh_arrival < e2->rqh_arrival;
+
+	return e1->rqh_rq->rq_id < e2->rqh_rq->rq_id;
+}
+
+STATIC_INLINE boolean_t tp_rq_heap_run_less(tp_rq_heap_t* heap, tp_rq_heap_run_t* r1,
+											tp_rq_heap_run_t* r2) {
+	return tp_rq_heap_less(&heap->rqh_entries[r1->rqr_next],
+						   &heap->rqh_entries[r2->rqr_next]);
+}
+
+static void tp_rq_heap_sift_down(tp_rq_heap_t* heap, unsigned idx) {
+	tp_rq_heap_run_t* runs = heap->rqh_runs;
+	tp_rq_heap_run_t run = runs[idx];
+	unsigned child;
+
+	while((child = 2 * idx + 1) < heap->rqh_num_runs) {
+		if(child + 1 < heap->rqh_num_runs &&
+				tp_rq_heap_run_less(heap, &runs[child + 1], &runs[child]))
+			++child;
+
+		if(!tp_rq_heap_run_less(heap, &runs[child], &run))
+			break;
+
+		runs[idx] = runs[child];
+		idx = child;
+	}
+
+	runs[idx] = run;
+}
+
+/**
+ * Push request onto arrival heap. Takes O(1) time: request either
+ * extends last run or starts new one.
+ */
+void tp_rq_heap_push(tp_rq_heap_t* heap, request_t* rq) {
+	tp_rq_heap_entry_t* entry;
+
+	assert(!heap->rqh_draining);
+
+	if(heap->rqh_count == heap->rqh_size) {
+		heap->rqh_size = (heap->rqh_size == 0) ? TP_RQ_HEAP_MIN_SIZE : heap->rqh_size * 2;
+		heap->rqh_entries = mp_realloc(heap->rqh_entries,
+									   heap->rqh_size * sizeof(tp_rq_heap_entry_t));
+	}
+
+	entry = &heap->rqh_entries[heap->rqh_count];
+	entry->rqh_arrival = rq->rq_sched_time + rq->rq_workload->wl_start_clock;
+	entry->rqh_rq = rq;
+
+	if(heap->rqh_num_runs > 0 && !tp_rq_heap_less(entry, entry - 1)) {
+		heap->rqh_runs[heap->rqh_num_runs - 1].rqr_end++;
+	}
+	else {
+		if(heap->rqh_num_runs == heap->rqh_runs_size) {
+			heap->rqh_runs_size = (heap->rqh_runs_size == 0)
+									? TP_RQ_HEAP_MIN_SIZE : heap->rqh_runs_size * 2;
+			heap->rqh_runs = mp_realloc(heap->rqh_runs,
+										heap->rqh_runs_size * sizeof(tp_rq_heap_run_t));
+		}
+
+		heap->rqh_runs[heap->rqh_num_runs].rqr_next = heap->rqh_count;
+		heap->rqh_runs[heap->rqh_num_runs].rqr_end = heap->rqh_count + 1;
+		++heap->rqh_num_runs;
+	}
+
+	++heap->rqh_count;
+}
+
+/**
+ * Pop request with earliest arrival from heap. Takes O(log r) time
+ * where r is number of runs. First pop builds heap of runs in O(r).
+ *
+ * @return request or NULL if heap is empty
+ */
+request_t* tp_rq_heap_pop(tp_rq_heap_t* heap) {
+	tp_rq_heap_run_t* root = heap->rqh_runs;
+	request_t* rq;
+	unsigned idx;
+
+	if(heap->rqh_num_runs == 0)
+		return NULL;
+
+	if(!heap->rqh_draining) {
+		for(idx = heap->rqh_num_runs / 2; idx-- > 0; ) {
+			tp_rq_heap_sift_down(heap, idx);
+		}
+
+		heap->rqh_draining = B_TRUE;
+	}
+
+	rq = heap->rqh_entries[root->rqr_next].rqh_rq;
+
+	if(++root->rqr_next == root->rqr_end) {
+		/* Run is exhausted - replace it with last run */
+		*root = heap->rqh_runs[--heap->rqh_num_runs];
+
+		if(heap->rqh_num_runs == 0) {
+			/* Heap is drained, reuse arrays for next step */
+			heap->rqh_count = 0;
+			heap->rqh_draining = B_FALSE;
+			return rq;
+		}
+	}
+
+	if(heap->rqh_num_runs > 1)
+		tp_rq_heap_sift_down(heap, 0);
+
+	return rq;
+}
+
 /**
  * Create requests instances according to step data or attach
- * trace-based requests to threadpool request queue. Automatically sorts
- * requests by its arrival time.
+ * trace-based requests to threadpool arrival heap. Requests are
+ * put into request queue by tp_flush_requests() when all workloads
+ * of threadpool are processed.
  *
  * Distribution across workers is actually done by threadpool dispatcher. */
 void tp_distribute_requests(workload_step_t* step, thread_pool_t* tp) {
@@ -577,28 +723,18 @@ void tp_distribute_requests(workload_step_t* step, thread_pool_t* tp) {
 
 	request_t* rq;
 	request_t* rq_chain;
-	request_t* prev_rq = NULL;
 	request_t* next_rq = NULL;
 
-	list_head_t* rq_list = &tp->tp_rq_head;
-	list_node_t* prev_rq_node = NULL;
-	list_node_t* next_rq_node = NULL;
-
-	int tid;
-
-	tp_insert_request_initnodes(rq_list, &prev_rq_node, &next_rq_node);
-
-	/* Create sorted list of requests */
 	if(list_empty(&step->wls_trace_rqs)) {
 		while(rq_count != 0) {
 			rq = wl_create_request(step->wls_workload, NULL);
-			tp_insert_request(rq_list, &rq->rq_node, &prev_rq_node, &next_rq_node, rq_node);
+			tp_rq_heap_push(&tp->tp_rq_heap, rq);
 			--rq_count;
 		}
 	}
 	else {
 		list_for_each_entry_safe(request_t, rq, next_rq, &step->wls_trace_rqs, rq_node) {
-			list_del(&rq->rq_node);
+			list_del_init(&rq->rq_node);
 
 			rq_chain = rq;
 			do {
@@ -606,12 +742,37 @@ void tp_distribute_requests(workload_step_t* step, thread_pool_t* tp) {
 				rq_chain = rq_chain->rq_chain_next;
 			} while(rq_chain != NULL);
 
-			tp_insert_request(rq_list, &rq->rq_node, &prev_rq_node, &next_rq_node, rq_node);
+			tp_rq_heap_push(&tp->tp_rq_heap, rq);
 			++step->wls_rq_count;
 		}
 	}
 }
 
+/**
+ * Merge requests from arrival heap into threadpool request queue which is
+ * sorted by arrival time. Queue may already contain requests left from previous
+ * steps, so merge is done in a single pass over it and takes O(n + m log r)
+ * where n is number of requests in the queue, m is number of new requests and
+ * r is number of ascending runs in arrival heap.
+ */
+void tp_flush_requests(thread_pool_t* tp) {
+	list_node_t* head_node = list_head_node(&tp->tp_rq_head);
+	list_node_t* next_rq_node = head_node->next;
+	request_t* rq;
+
+	while((rq = tp_rq_heap_pop(&tp->tp_rq_heap)) != NULL) {
+		/* Skip requests that arrive before new one */
+		while(next_rq_node != head_node &&
+			  tp_compare_requests(list_entry(next_rq_node, request_t, rq_node), rq) >= 0) {
+			next_rq_node = next_rq_node->next;
+		}
+
+		__list_add(&rq->rq_node, next_rq_node->prev, next_rq_node);
+
+		tp_trace_insert_request(rq, &tp->tp_rq_head, offsetof(request_t, rq_node));
+	}
+}
+
 tsobj_node_t* tsobj_tp_format(hm_item_t* object) {
 	tsobj_node_t* node = NULL;
 	tsobj_node_t* wl_list = NULL;
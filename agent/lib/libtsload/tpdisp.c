@@ -45,9 +45,13 @@ extern tp_disp_class_t tpd_rand_class;
 extern tp_disp_class_t tpd_user_class;
 extern tp_disp_class_t tpd_trace_class;
 extern tp_disp_class_t tpd_fill_up_class;
+extern tp_disp_class_t tpd_ring_class;
+extern tp_disp_class_t tpd_steal_class;
 extern tp_disp_class_t tpd_ff_class;
 extern tp_disp_class_t tpd_bench_class;
 
+extern randgen_class_t rg_xoshiro_class;
+
 extern ts_time_t tp_worker_min_sleep;
 
 extern ts_time_t tp_worker_overhead;
@@ -188,6 +192,10 @@ tp_disp_t* tsobj_tp_disp_proc(tsobj_node_t* node) {
 		goto bad_tsobj;
 	}
 
+	/* Each threadpool has its own generator, so dispatchers
+	 * do not contend on global state of libc rand() */
+	tpd->tpd_randgen = rg_create(&rg_xoshiro_class, tm_get_clock());
+
 	return tpd;
 
 bad_tsobj:
@@ -197,6 +205,7 @@ bad_tsobj:
 
 void tpd_destroy(tp_disp_t* tpd) {
 	tpd->tpd_class->destroy(tpd->tpd_tp);
+	rg_destroy(tpd->tpd_randgen);
 	mp_free(tpd);
 }
 
@@ -219,6 +228,8 @@ int tpdisp_init(void) {
 	tpdisp_register(NULL, &tpd_user_class);
 	tpdisp_register(NULL, &tpd_trace_class);
 	tpdisp_register(NULL, &tpd_fill_up_class);
+	tpdisp_register(NULL, &tpd_ring_class);
+	tpdisp_register(NULL, &tpd_steal_class);
 	tpdisp_register(NULL, &tpd_ff_class);
 	tpdisp_register(NULL, &tpd_bench_class);
 	
@@ -228,6 +239,8 @@ int tpdisp_init(void) {
 void tpdisp_fini(void) {
 	tpdisp_unregister(NULL, &tpd_bench_class);
 	tpdisp_unregister(NULL, &tpd_ff_class);
+	tpdisp_unregister(NULL, &tpd_steal_class);
+	tpdisp_unregister(NULL, &tpd_ring_class);
 	tpdisp_unregister(NULL, &tpd_fill_up_class);
 	tpdisp_unregister(NULL, &tpd_trace_class);
 	tpdisp_unregister(NULL, &tpd_user_class);
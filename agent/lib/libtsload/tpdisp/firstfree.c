@@ -305,6 +305,13 @@ void tpd_relink_request_ff(thread_pool_t* tp, request_t* rq) {
 
 	mutex_lock(&ff->ff_mutex);
 
+	if(list_node_alone(&rq->rq_node)) {
+		/* Request is still in arrival heap, tp_flush_requests() will
+		 * put it to the right place of tp_rq_head */
+		mutex_unlock(&ff->ff_mutex);
+		return;
+	}
+
 	if(rq->rq_flags & RQF_DISPATCHED) {
 		/* Already in control thread -- oops */
 		mutex_unlock(&ff->ff_mutex);
@@ -228,8 +228,11 @@ void tpd_control_report_queue(thread_pool_t* tp) {
 	wl_report_requests(rq_list);
 }
 
-void tpd_relink_request_queue(thread_pool_t* tp, request_t* rq) {
-	tp_worker_t* worker = NULL;
+/**
+ * Move request to its new position in worker's queue according to updated
+ * schedule time. Should be called with worker's `w_rq_mutex` held.
+ */
+void tpd_relink_request_nolock(thread_pool_t* tp, tp_worker_t* worker, request_t* rq) {
 	request_t* prev_rq = NULL;
 	request_t* next_rq = NULL;
 
@@ -238,18 +241,6 @@ void tpd_relink_request_queue(thread_pool_t* tp, request_t* rq) {
 
 	boolean_t need_relink = B_FALSE;
 
-	if(list_node_alone(&rq->rq_w_node)) {
-		/* Request not yet linked - concurrency between relink and tpd_control_sleep_queue().
-		 * So tpd_control_sleep_queue() will link request correctly - abandon it. */
-		return;
-	}
-
-	assert((rq->rq_thread_id >= 0) && (rq->rq_thread_id < tp->tp_num_threads));
-
-	worker = tp->tp_workers + rq->rq_thread_id;
-
-	mutex_lock(&worker->w_rq_mutex);
-
 	if(!list_is_first(&rq->rq_w_node, &worker->w_rq_head)) {
 		prev_rq = list_prev_entry(request_t, rq, rq_w_node);
 		prev_rq_node = &prev_rq->rq_w_node;
@@ -272,7 +263,23 @@ void tpd_relink_request_queue(thread_pool_t* tp, request_t* rq) {
 		list_del(&rq->rq_w_node);
 		tp_insert_request(&worker->w_rq_head, &rq->rq_w_node, &prev_rq_node, &next_rq_node, rq_w_node);
 	}
+}
+
+void tpd_relink_request_queue(thread_pool_t* tp, request_t* rq) {
+	tp_worker_t* worker = NULL;
 
+	if(list_node_alone(&rq->rq_w_node)) {
+		/* Request not yet linked - concurrency between relink and tpd_control_sleep_queue().
+		 * So tpd_control_sleep_queue() will link request correctly - abandon it. */
+		return;
+	}
+
+	assert((rq->rq_thread_id >= 0) && (rq->rq_thread_id < tp->tp_num_threads));
+
+	worker = tp->tp_workers + rq->rq_thread_id;
+
+	mutex_lock(&worker->w_rq_mutex);
+	tpd_relink_request_nolock(tp, worker, rq);
 	mutex_unlock(&worker->w_rq_mutex);
 }
 
@@ -0,0 +1,525 @@
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#define LOG_SOURCE "tpd-ring"
+#include <tsload/log.h>
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+#include <tsload/list.h>
+#include <tsload/atomic.h>
+#include <tsload/errcode.h>
+
+#include <tsload/load/tpdisp.h>
+#include <tsload/load/threadpool.h>
+#include <tsload/load/workload.h>
+#include <tsload.h>
+
+#include <errormsg.h>
+
+#include <string.h>
+#include <assert.h>
+
+
+/**
+ * #### Ring-based dispatcher
+ *
+ * Lock-free variant of queue-based dispatchers. Each worker has bounded
+ * single-producer/single-consumer ring of slots. At the beginning of the
+ * step control thread fills slots with requests (which are already sorted by
+ * arrival time in tp_rq_head) and publishes entire batch by advancing tail
+ * once per worker, so worker picks and completes requests without taking
+ * `w_rq_mutex`. Mutex and condition variable are used only when worker runs
+ * out of requests and goes to sleep or if control thread waits for worker
+ * to finish its current request (discard mode).
+ *
+ * Ring indexes are monotonic counters:
+ * 		- `head` - next slot to be picked. Worker claims slot with compare-and-swap,
+ * 		  so control thread can take unpicked slots away in discard mode
+ * 		- `done` - number of requests completed by worker
+ * 		- `tail` - number of published slots. Modified only by control thread
+ *
+ * Because slots are published in batch, order of requests can't be changed
+ * after that, so relink_request is no-op: worker still waits for updated
+ * `rq_sched_time` of the request, but doesn't reorder the ring.
+ *
+ * If ring is full, the rest of requests is not dispatched, and they are
+ * reported as unfinished at the end of step.
+ * */
+
+#define TPD_RING_DEFAULT_SIZE		4096
+
+typedef enum {
+	TPD_RING_RR,
+	TPD_RING_RAND,
+	TPD_RING_USER,
+	TPD_RING_FILL_UP,
+	TPD_RING_TRACE
+} tpd_ring_policy_t;
+
+/**
+ * Slot of the ring. Arrival time is precomputed by control thread, so
+ * worker may calculate queue length without touching requests that
+ * may be taken away by control thread.
+ */
+typedef struct {
+	request_t* rq;
+	ts_time_t arrival;
+} tpd_ring_slot_t;
+
+typedef struct {
+	atomic_t head;
+	atomic_t done;
+	atomic_t tail;
+	atomic_t waiting;
+
+	long ptail;
+
+	unsigned long mask;
+	tpd_ring_slot_t* slots;
+} tpd_ring_t;
+
+typedef struct {
+	tpd_ring_policy_t policy;
+	unsigned size;
+
+	/* fill-up parameters */
+	unsigned fill_requests;
+	unsigned num_rqs;
+	int first_wid;
+
+	int num_rings;
+	tpd_ring_t** rings;
+} tpd_ring_disp_t;
+
+tsload_param_t tpdisp_ring_params[] = {
+	{ TSLOAD_PARAM_STRING, "dispatch", "round-robin, random, user, fill-up or trace (optional)"},
+	{ TSLOAD_PARAM_INTEGER, "size", "number of slots in per-worker ring (optional)"},
+	{ TSLOAD_PARAM_INTEGER, "n", "for fill-up dispatch: number of requests per batch"},
+	{ TSLOAD_PARAM_INTEGER, "wid", "for fill-up dispatch: first worker id"},
+	{ TSLOAD_PARAM_NULL, NULL, NULL }
+};
+
+static tpd_ring_disp_t* tpd_ring_disp_create(void) {
+	tpd_ring_disp_t* rd = mp_malloc(sizeof(tpd_ring_disp_t));
+
+	rd->policy = TPD_RING_RR;
+	rd->size = TPD_RING_DEFAULT_SIZE;
+
+	rd->fill_requests = 1;
+	rd->num_rqs = 0;
+	rd->first_wid = 0;
+
+	rd->num_rings = 0;
+	rd->rings = NULL;
+
+	return rd;
+}
+
+int tsobj_proc_tpd_ring(struct tp_disp* tpd, tsobj_node_t* node) {
+	tpd_ring_disp_t* rd = tpd_ring_disp_create();
+	const char* dispatch = NULL;
+	unsigned size;
+	int err;
+
+	err = tsobj_get_string(node, "dispatch", &dispatch);
+	if(err == TSOBJ_INVALID_TYPE)
+		goto bad_tsobj;
+
+	err = tsobj_get_integer_u(node, "size", &size);
+	if(err == TSOBJ_INVALID_TYPE)
+		goto bad_tsobj;
+	if(err == TSOBJ_OK)
+		rd->size = size;
+
+	if(dispatch == NULL || strcmp(dispatch, "round-robin") == 0) {
+		rd->policy = TPD_RING_RR;
+	}
+	else if(strcmp(dispatch, "random") == 0) {
+		rd->policy = TPD_RING_RAND;
+	}
+	else if(strcmp(dispatch, "user") == 0) {
+		rd->policy = TPD_RING_USER;
+	}
+	else if(strcmp(dispatch, "trace") == 0) {
+		rd->policy = TPD_RING_TRACE;
+	}
+	else if(strcmp(dispatch, "fill-up") == 0) {
+		rd->policy = TPD_RING_FILL_UP;
+
+		if(tsobj_get_integer_u(node, "n", &rd->fill_requests) != TSOBJ_OK)
+			goto bad_tsobj;
+		if(tsobj_get_integer_i(node, "wid", &rd->first_wid) != TSOBJ_OK)
+			goto bad_tsobj;
+	}
+	else {
+		tsload_error_msg(TSE_INVALID_VALUE,
+						 TPD_ERROR_PREFIX "invalid ring dispatch policy '%s'", dispatch);
+		mp_free(rd);
+		return TPD_ERROR;
+	}
+
+	if(rd->size == 0 || rd->fill_requests == 0) {
+		tsload_error_msg(TSE_INVALID_VALUE,
+						 TPD_ERROR_PREFIX "ring size and number of requests should be positive");
+		mp_free(rd);
+		return TPD_ERROR;
+	}
+
+	tpd->tpd_data = rd;
+
+	return TPD_OK;
+
+bad_tsobj:
+	mp_free(rd);
+	return TPD_BAD;
+}
+
+int tpd_init_ring(thread_pool_t* tp) {
+	tpd_ring_disp_t* rd = (tpd_ring_disp_t*) tp->tp_disp->tpd_data;
+	tpd_ring_t* ring;
+	unsigned long size = 1;
+	int wid;
+
+	if(rd == NULL) {
+		rd = tpd_ring_disp_create();
+		tp->tp_disp->tpd_data = rd;
+	}
+
+	if(rd->first_wid < 0 || rd->first_wid >= tp->tp_num_threads) {
+		tsload_error_msg(TSE_INVALID_DATA,
+						 "Ring dispatcher: Worker id #%d is too large for tp '%s'",
+						 rd->first_wid, tp->tp_name);
+		return TPD_ERROR;
+	}
+
+	/* Round size up to power of two, so we can use mask instead of modulo */
+	while(size < rd->size)
+		size <<= 1;
+
+	rd->rings = mp_malloc(tp->tp_num_threads * sizeof(tpd_ring_t*));
+
+	for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+		ring = mp_malloc(sizeof(tpd_ring_t));
+
+		atomic_set(&ring->head, 0);
+		atomic_set(&ring->done, 0);
+		atomic_set(&ring->tail, 0);
+		atomic_set(&ring->waiting, 0);
+
+		ring->ptail = 0;
+		ring->mask = size - 1;
+		ring->slots = mp_malloc(size * sizeof(tpd_ring_slot_t));
+
+		rd->rings[wid] = ring;
+		++rd->num_rings;
+
+		tp->tp_workers[wid].w_tpd_data = ring;
+	}
+
+	return TPD_OK;
+}
+
+void tpd_destroy_ring(thread_pool_t* tp) {
+	tpd_ring_disp_t* rd = (tpd_ring_disp_t*) tp->tp_disp->tpd_data;
+	int wid;
+
+	if(rd == NULL)
+		return;
+
+	for(wid = 0; wid < rd->num_rings; ++wid) {
+		mp_free(rd->rings[wid]->slots);
+		mp_free(rd->rings[wid]);
+	}
+
+	if(rd->rings != NULL)
+		mp_free(rd->rings);
+
+	mp_free(rd);
+}
+
+static int tpd_next_wid_ring(thread_pool_t* tp, int wid, request_t* rq) {
+	tpd_ring_disp_t* rd = (tpd_ring_disp_t*) tp->tp_disp->tpd_data;
+
+	switch(rd->policy) {
+	case TPD_RING_RR:
+		return tpd_next_wid_rr(tp, wid, rq);
+	case TPD_RING_RAND:
+		return tpd_next_wid_rand(tp, wid, rq);
+	case TPD_RING_USER:
+		return rq->rq_user_id % tp->tp_num_threads;
+	case TPD_RING_TRACE:
+		if(rq->rq_thread_id < 0)
+			return tpd_next_wid_rand(tp, wid, rq);
+		return rq->rq_thread_id % tp->tp_num_threads;
+	case TPD_RING_FILL_UP:
+		if(++rd->num_rqs == rd->fill_requests) {
+			rd->num_rqs = 0;
+
+			if(++wid == tp->tp_num_threads)
+				wid = 0;
+		}
+		return wid;
+	}
+
+	return wid;
+}
+
+static int tpd_first_wid_ring(thread_pool_t* tp) {
+	tpd_ring_disp_t* rd = (tpd_ring_disp_t*) tp->tp_disp->tpd_data;
+
+	/* Same first workers as queue-based dispatchers use in their
+	 * tpd_control_sleep_* functions (queue.c) */
+	switch(rd->policy) {
+	case TPD_RING_RR:
+	case TPD_RING_RAND:
+		return tpd_first_wid_rand(tp);
+	case TPD_RING_USER:
+	case TPD_RING_TRACE:
+		return 0;
+	case TPD_RING_FILL_UP:
+		rd->num_rqs = 0;
+		return rd->first_wid;
+	}
+
+	return 0;
+}
+
+/**
+ * Wait until control thread publishes new requests. Returns B_FALSE
+ * if threadpool is dead.
+ */
+static boolean_t tpd_ring_wait(thread_pool_t* tp, tp_worker_t* worker, tpd_ring_t* ring) {
+	boolean_t alive = B_TRUE;
+
+	mutex_lock(&worker->w_rq_mutex);
+
+	while(atomic_read(&ring->head) == atomic_read(&ring->tail)) {
+		if(tp->tp_is_dead) {
+			alive = B_FALSE;
+			break;
+		}
+
+		cv_wait(&worker->w_rq_cv, &worker->w_rq_mutex);
+	}
+
+	mutex_unlock(&worker->w_rq_mutex);
+
+	return alive;
+}
+
+request_t* tpd_worker_pick_ring(thread_pool_t* tp, tp_worker_t* worker) {
+	tpd_ring_t* ring = (tpd_ring_t*) worker->w_tpd_data;
+	ts_time_t cur_time;
+	request_t* rq;
+	long head, tail, i;
+	int qlen = 0;
+
+	while(B_TRUE) {
+		head = atomic_read(&ring->head);
+		tail = atomic_read(&ring->tail);
+
+		if(head == tail) {
+			if(!tpd_ring_wait(tp, worker, ring))
+				return NULL;
+
+			continue;
+		}
+
+		rq = ring->slots[head & ring->mask].rq;
+
+		/* CAS may fail only if control thread took away our slots */
+		if(atomic_cas(&ring->head, head, head + 1))
+			break;
+	}
+
+	rq->rq_flags |= RQF_DEQUEUED;
+
+	/* Count requests that already arrived (including current). Only precomputed
+	 * arrival times are used as slots after head may be taken by control thread */
+	cur_time = tm_get_clock();
+	for(i = head; i != tail; ++i) {
+		if(ring->slots[i & ring->mask].arrival > cur_time)
+			break;
+
+		++qlen;
+	}
+
+	rq->rq_queue_len = qlen;
+
+	tpd_wait_for_arrival(rq, TS_TIME_MAX);
+
+	return rq;
+}
+
+void tpd_worker_done_ring(thread_pool_t* tp, tp_worker_t* worker, request_t* rq) {
+	tpd_ring_t* ring = (tpd_ring_t*) worker->w_tpd_data;
+
+	atomic_inc(&ring->done);
+
+	/* Slow path: control thread waits for current request in discard mode */
+	if(unlikely(atomic_read(&ring->waiting) != 0)) {
+		mutex_lock(&worker->w_rq_mutex);
+		cv_notify_one(&worker->w_rq_cv);
+		mutex_unlock(&worker->w_rq_mutex);
+	}
+}
+
+void tpd_control_sleep_ring(thread_pool_t* tp) {
+	request_t* rq;
+	tp_worker_t* worker;
+	tpd_ring_t* ring;
+	tpd_ring_slot_t* slot;
+	ts_time_t cur_time;
+	int wid = tpd_first_wid_ring(tp);
+	int lwid;
+	int overflow = 0;
+
+	/* Fill slots. Workers can't see them until tail is advanced */
+	list_for_each_entry(request_t, rq, &tp->tp_rq_head, rq_node) {
+		/* Requests left from previous steps are already in rings */
+		if(rq->rq_step != rq->rq_workload->wl_current_step)
+			continue;
+
+		wid = tpd_next_wid_ring(tp, wid, rq);
+		ring = (tpd_ring_t*) tp->tp_workers[wid].w_tpd_data;
+
+		if((unsigned long) (ring->ptail - atomic_read(&ring->done)) > ring->mask) {
+			++overflow;
+			continue;
+		}
+
+		rq->rq_thread_id = wid;
+
+		slot = &ring->slots[ring->ptail & ring->mask];
+		slot->rq = rq;
+		slot->arrival = rq->rq_sched_time + rq->rq_workload->wl_start_clock;
+
+		++ring->ptail;
+	}
+
+	/* Publish batches */
+	for(lwid = 0; lwid < tp->tp_num_threads; ++lwid) {
+		worker = tp->tp_workers + lwid;
+		ring = (tpd_ring_t*) worker->w_tpd_data;
+
+		if(ring->ptail == atomic_read(&ring->tail))
+			continue;
+
+		atomic_set(&ring->tail, ring->ptail);
+
+		mutex_lock(&worker->w_rq_mutex);
+		cv_notify_one(&worker->w_rq_cv);
+		mutex_unlock(&worker->w_rq_mutex);
+	}
+
+	if(overflow > 0) {
+		logmsg(LOG_WARN, "Threadpool '%s': %d requests were not dispatched because "
+			   "worker rings are full", tp->tp_name, overflow);
+	}
+
+	cur_time = tm_get_clock();
+	if(cur_time < tp->tp_time + tp->tp_quantum)
+			tm_sleep_nano(tm_diff(cur_time, tp->tp_time + tp->tp_quantum));
+}
+
+void tpd_control_report_ring(thread_pool_t* tp) {
+	int wid = 0;
+	tp_worker_t* worker;
+	tpd_ring_t* ring;
+	request_t* rq;
+	long head, done, i;
+
+	list_head_t* rq_list = (list_head_t*) mp_malloc(sizeof(list_head_t));
+
+	list_head_init(rq_list, "rqs-%s-out", tp->tp_name);
+	list_splice_init(&tp->tp_rq_head, list_head_node(rq_list));
+
+	for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+		worker = tp->tp_workers + wid;
+		ring = (tpd_ring_t*) worker->w_tpd_data;
+
+		/* tp_create() failed in tpd_init_ring() */
+		if(ring == NULL)
+			continue;
+
+		if(tp->tp_discard) {
+			/* Take away requests that are not picked by worker yet, then wait
+			 * until worker finishes requests it already picked */
+			head = atomic_exchange(&ring->head, ring->ptail);
+
+			if(atomic_read(&ring->done) != head) {
+				mutex_lock(&worker->w_rq_mutex);
+				atomic_set(&ring->waiting, 1);
+
+				while(atomic_read(&ring->done) != head) {
+					cv_wait(&worker->w_rq_cv, &worker->w_rq_mutex);
+				}
+
+				atomic_set(&ring->waiting, 0);
+				mutex_unlock(&worker->w_rq_mutex);
+			}
+
+			atomic_set(&ring->done, ring->ptail);
+		}
+		else {
+			/* Return requests that not yet finished back to TP queue.
+			 * If worker finishes some of them meanwhile, they will be
+			 * simply reported on next step. */
+			done = atomic_read(&ring->done);
+
+			for(i = done; i != ring->ptail; ++i) {
+				rq = ring->slots[i & ring->mask].rq;
+
+				list_del(&rq->rq_node);
+				list_add_tail(&rq->rq_node, &tp->tp_rq_head);
+			}
+		}
+	}
+
+	wl_report_requests(rq_list);
+}
+
+void tpd_relink_request_ring(thread_pool_t* tp, request_t* rq) {
+	/* NOTHING: order of slots is fixed after publishing */
+}
+
+tp_disp_class_t tpd_ring_class = {
+	AAS_CONST_STR("ring"),
+
+	"Lock-free variant of queue-based dispatchers. Queues requests "
+	"at the beginning of step into per-worker rings. Parameter "
+	"`dispatch` selects policy: round-robin (default), random, user, "
+	"fill-up (requires `n` and `wid`) or trace. `size` sets number of "
+	"slots in each worker's ring (default is 4096).",
+
+	tpdisp_ring_params,
+
+	tpd_init_ring,
+	tpd_destroy_ring,
+	tsobj_proc_tpd_ring,
+	tpd_control_report_ring,
+	tpd_control_sleep_ring,
+	tpd_worker_pick_ring,
+	tpd_worker_done_ring,
+	tpd_wqueue_signal,
+	tpd_relink_request_ring
+};
@@ -0,0 +1,409 @@
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#define LOG_SOURCE "tpd-steal"
+#include <tsload/log.h>
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+#include <tsload/list.h>
+#include <tsload/errcode.h>
+
+#include <tsload/load/tpdisp.h>
+#include <tsload/load/threadpool.h>
+#include <tsload/load/workload.h>
+#include <tsload.h>
+
+#include <errormsg.h>
+
+#include <string.h>
+#include <assert.h>
+
+
+/**
+ * #### Work-stealing dispatcher
+ *
+ * Pre-distributes requests into per-worker queues at the beginning of step
+ * like queue-based dispatchers, but when worker has no request that arrives
+ * soon, it looks into queues of workers that are busy executing their current
+ * request and steals request that is already arrived (due) but still waits in
+ * the queue. Victim's queue is walked from the head, and the latest due request
+ * is taken, so thief doesn't compete with victim for the request it will pick
+ * next. Stolen requests are marked with RQF_STOLEN flag, so steals could be
+ * seen in experiment results.
+ *
+ * Idle worker polls other queues every `interval` nanoseconds. Because
+ * stolen request is moved between queues with both worker mutexes held
+ * (they are always taken in order of worker ids), request is always linked
+ * to some worker's queue, so control thread locks all queues at once when
+ * reports requests.
+ * */
+
+#define TPD_STEAL_DEFAULT_INTERVAL		(200 * T_US)
+
+#define TPD_STEAL_ARRIVAL(rq)		((rq)->rq_sched_time + (rq)->rq_workload->wl_start_clock)
+
+typedef enum {
+	TPD_STEAL_RR,
+	TPD_STEAL_RAND,
+	TPD_STEAL_USER,
+	TPD_STEAL_TRACE
+} tpd_steal_policy_t;
+
+typedef struct {
+	tpd_steal_policy_t policy;
+	ts_time_t interval;
+} tpd_steal_t;
+
+int tpd_get_queue_len_queue(thread_pool_t* tp, tp_worker_t* worker, request_t* rq);
+void tpd_worker_done_queue(thread_pool_t* tp, tp_worker_t* worker, request_t* rq);
+void tpd_control_sleep_queue(thread_pool_t* tp, int wid,
+							 int (*next_wid)(thread_pool_t* tp, int wid, request_t* rq));
+void tpd_relink_request_nolock(thread_pool_t* tp, tp_worker_t* worker, request_t* rq);
+
+tsload_param_t tpdisp_steal_params[] = {
+	{ TSLOAD_PARAM_STRING, "dispatch", "round-robin, random, user or trace (optional)"},
+	{ TSLOAD_PARAM_INTEGER, "interval", "polling interval of idle worker in ns (optional)"},
+	{ TSLOAD_PARAM_NULL, NULL, NULL }
+};
+
+static tpd_steal_t* tpd_steal_create(void) {
+	tpd_steal_t* steal = mp_malloc(sizeof(tpd_steal_t));
+
+	steal->policy = TPD_STEAL_RR;
+	steal->interval = TPD_STEAL_DEFAULT_INTERVAL;
+
+	return steal;
+}
+
+int tsobj_proc_tpd_steal(struct tp_disp* tpd, tsobj_node_t* node) {
+	tpd_steal_t* steal = tpd_steal_create();
+	const char* dispatch = NULL;
+	int err;
+
+	err = tsobj_get_string(node, "dispatch", &dispatch);
+	if(err == TSOBJ_INVALID_TYPE)
+		goto bad_tsobj;
+
+	err = tsobj_get_integer_i64(node, "interval", &steal->interval);
+	if(err == TSOBJ_INVALID_TYPE)
+		goto bad_tsobj;
+
+	if(dispatch == NULL || strcmp(dispatch, "round-robin") == 0) {
+		steal->policy = TPD_STEAL_RR;
+	}
+	else if(strcmp(dispatch, "random") == 0) {
+		steal->policy = TPD_STEAL_RAND;
+	}
+	else if(strcmp(dispatch, "user") == 0) {
+		steal->policy = TPD_STEAL_USER;
+	}
+	else if(strcmp(dispatch, "trace") == 0) {
+		steal->policy = TPD_STEAL_TRACE;
+	}
+	else {
+		tsload_error_msg(TSE_INVALID_VALUE,
+						 TPD_ERROR_PREFIX "invalid work-stealing dispatch policy '%s'", dispatch);
+		mp_free(steal);
+		return TPD_ERROR;
+	}
+
+	if(steal->interval <= 0) {
+		tsload_error_msg(TSE_INVALID_VALUE,
+						 TPD_ERROR_PREFIX "work-stealing interval should be positive");
+		mp_free(steal);
+		return TPD_ERROR;
+	}
+
+	tpd->tpd_data = steal;
+
+	return TPD_OK;
+
+bad_tsobj:
+	mp_free(steal);
+	return TPD_BAD;
+}
+
+int tpd_init_steal(thread_pool_t* tp) {
+	if(tp->tp_disp->tpd_data == NULL) {
+		tp->tp_disp->tpd_data = tpd_steal_create();
+	}
+
+	return TPD_OK;
+}
+
+void tpd_destroy_steal(thread_pool_t* tp) {
+	if(tp->tp_disp->tpd_data != NULL)
+		mp_free(tp->tp_disp->tpd_data);
+}
+
+/**
+ * Find request that could be stolen by thief from victim's queue. Victim should
+ * be busy executing request, and stolen request should already be arrived.
+ * Should be called with both worker's mutexes held.
+ */
+static request_t* tpd_steal_find(tp_worker_t* victim, ts_time_t cur_time) {
+	request_t* rq;
+	request_t* stolen = NULL;
+	boolean_t busy = B_FALSE;
+
+	list_for_each_entry(request_t, rq, &victim->w_rq_head, rq_w_node) {
+		if(rq->rq_flags & RQF_DEQUEUED) {
+			busy = B_TRUE;
+			continue;
+		}
+
+		if(TPD_STEAL_ARRIVAL(rq) > cur_time)
+			break;
+
+		stolen = rq;
+	}
+
+	return (busy) ? stolen : NULL;
+}
+
+static request_t* tpd_steal_request(thread_pool_t* tp, tp_worker_t* worker, ts_time_t cur_time) {
+	int wid = worker - tp->tp_workers;
+	int vwid, i;
+	tp_worker_t* victim;
+	request_t* rq;
+
+	for(i = 1; i < tp->tp_num_threads; ++i) {
+		vwid = (wid + i) % tp->tp_num_threads;
+		victim = tp->tp_workers + vwid;
+
+		/* Victim has nothing except request it is executing. This check is
+		 * done without holding lock, so it is only a hint. */
+		if(list_empty(&victim->w_rq_head) || list_is_singular(&victim->w_rq_head))
+			continue;
+
+		if(vwid < wid) {
+			mutex_lock(&victim->w_rq_mutex);
+			mutex_lock(&worker->w_rq_mutex);
+		}
+		else {
+			mutex_lock(&worker->w_rq_mutex);
+			mutex_lock(&victim->w_rq_mutex);
+		}
+
+		rq = tpd_steal_find(victim, cur_time);
+
+		if(rq != NULL) {
+			/* Request is due and all own requests arrive later, so
+			 * putting stolen request to the head keeps queue sorted */
+			list_del(&rq->rq_w_node);
+			list_add(&rq->rq_w_node, &worker->w_rq_head);
+
+			rq->rq_thread_id = wid;
+			rq->rq_flags |= RQF_DEQUEUED | RQF_STOLEN;
+		}
+
+		mutex_unlock(&victim->w_rq_mutex);
+		mutex_unlock(&worker->w_rq_mutex);
+
+		if(rq != NULL)
+			return rq;
+	}
+
+	return NULL;
+}
+
+request_t* tpd_worker_pick_steal(thread_pool_t* tp, tp_worker_t* worker) {
+	tpd_steal_t* steal = (tpd_steal_t*) tp->tp_disp->tpd_data;
+	ts_time_t cur_time;
+	request_t* rq = NULL;
+
+	while(!tp->tp_is_dead) {
+		cur_time = tm_get_clock();
+
+		mutex_lock(&worker->w_rq_mutex);
+
+		if(!list_empty(&worker->w_rq_head)) {
+			rq = list_first_entry(request_t, &worker->w_rq_head, rq_w_node);
+
+			if(TPD_STEAL_ARRIVAL(rq) <= (cur_time + steal->interval)) {
+				rq->rq_flags |= RQF_DEQUEUED;
+				mutex_unlock(&worker->w_rq_mutex);
+
+				goto picked;
+			}
+		}
+
+		mutex_unlock(&worker->w_rq_mutex);
+
+		rq = tpd_steal_request(tp, worker, cur_time);
+		if(rq != NULL)
+			goto picked;
+
+		/* Nothing to do for now. Sleep until next request from our
+		 * queue arrives or other workers got due requests */
+		mutex_lock(&worker->w_rq_mutex);
+		if(!tp->tp_is_dead)
+			cv_wait_timed(&worker->w_rq_cv, &worker->w_rq_mutex, steal->interval);
+		mutex_unlock(&worker->w_rq_mutex);
+	}
+
+	return NULL;
+
+picked:
+	rq->rq_queue_len = tpd_get_queue_len_queue(tp, worker, rq);
+
+	tpd_wait_for_arrival(rq, TS_TIME_MAX);
+
+	return rq;
+}
+
+static int tpd_next_wid_steal(thread_pool_t* tp, int wid, request_t* rq) {
+	tpd_steal_t* steal = (tpd_steal_t*) tp->tp_disp->tpd_data;
+
+	switch(steal->policy) {
+	case TPD_STEAL_RR:
+		return tpd_next_wid_rr(tp, wid, rq);
+	case TPD_STEAL_RAND:
+		return tpd_next_wid_rand(tp, wid, rq);
+	case TPD_STEAL_USER:
+		return rq->rq_user_id % tp->tp_num_threads;
+	case TPD_STEAL_TRACE:
+		if(rq->rq_thread_id < 0)
+			return tpd_next_wid_rand(tp, wid, rq);
+		return rq->rq_thread_id % tp->tp_num_threads;
+	}
+
+	return wid;
+}
+
+void tpd_control_sleep_steal(thread_pool_t* tp) {
+	int wid = tpd_first_wid_rand(tp);
+
+	tpd_control_sleep_queue(tp, wid, tpd_next_wid_steal);
+}
+
+void tpd_control_report_steal(thread_pool_t* tp) {
+	int wid = 0;
+	tp_worker_t* worker;
+	request_t* rq;
+	request_t* next;
+
+	list_head_t* rq_list = (list_head_t*) mp_malloc(sizeof(list_head_t));
+
+	list_head_init(rq_list, "rqs-%s-out", tp->tp_name);
+	list_splice_init(&tp->tp_rq_head, list_head_node(rq_list));
+
+	/* Lock all queues at once, otherwise idle worker may steal request from
+	 * queue which is not processed yet and put it into already processed one */
+	for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+		mutex_lock(&tp->tp_workers[wid].w_rq_mutex);
+	}
+
+	for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+		worker = tp->tp_workers + wid;
+
+		if(tp->tp_discard) {
+			/* Discard requests which are not picked by workers. Request that is
+			 * picked remains in queue until worker finishes it. */
+			list_for_each_entry_safe(request_t, rq, next, &worker->w_rq_head, rq_w_node) {
+				if(!(rq->rq_flags & RQF_DEQUEUED))
+					list_del_init(&rq->rq_w_node);
+			}
+		}
+		else {
+			/* Return requests that not yet finished back to TP queue */
+			list_for_each_entry(request_t, rq, &worker->w_rq_head, rq_w_node) {
+				list_del(&rq->rq_node);
+				list_add(&rq->rq_node, &tp->tp_rq_head);
+			}
+		}
+	}
+
+	for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+		mutex_unlock(&tp->tp_workers[wid].w_rq_mutex);
+	}
+
+	if(tp->tp_discard) {
+		/* Nothing can be stolen now, so wait for picked requests */
+		for(wid = 0; wid < tp->tp_num_threads; ++wid) {
+			worker = tp->tp_workers + wid;
+
+			mutex_lock(&worker->w_rq_mutex);
+			while(!list_empty(&worker->w_rq_head)) {
+				cv_wait(&worker->w_rq_cv, &worker->w_rq_mutex);
+			}
+			mutex_unlock(&worker->w_rq_mutex);
+		}
+	}
+
+	wl_report_requests(rq_list);
+}
+
+void tpd_relink_request_steal(thread_pool_t* tp, request_t* rq) {
+	tp_worker_t* worker = NULL;
+	int wid;
+
+	if(list_node_alone(&rq->rq_w_node)) {
+		/* Request not yet linked by tpd_control_sleep_queue() - abandon it. */
+		return;
+	}
+
+	/* Request may be stolen while we are waiting for worker's mutex,
+	 * so recheck its worker id after lock is acquired. */
+	while(B_TRUE) {
+		wid = rq->rq_thread_id;
+		assert((wid >= 0) && (wid < tp->tp_num_threads));
+
+		worker = tp->tp_workers + wid;
+		mutex_lock(&worker->w_rq_mutex);
+
+		if(rq->rq_thread_id == wid)
+			break;
+
+		mutex_unlock(&worker->w_rq_mutex);
+	}
+
+	/* Picked requests should stay at the head of the queue */
+	if(!list_node_alone(&rq->rq_w_node) && !(rq->rq_flags & RQF_DEQUEUED)) {
+		tpd_relink_request_nolock(tp, worker, rq);
+	}
+
+	mutex_unlock(&worker->w_rq_mutex);
+}
+
+tp_disp_class_t tpd_steal_class = {
+	AAS_CONST_STR("work-stealing"),
+
+	"Queues requests at the beginning of step like queue-based "
+	"dispatchers, but idle worker steals already arrived requests "
+	"from queues of busy workers. Parameter `dispatch` selects initial "
+	"policy: round-robin (default), random, user or trace. `interval` "
+	"sets polling interval of idle worker in nanoseconds (default "
+	"is 200us).",
+
+	tpdisp_steal_params,
+
+	tpd_init_steal,
+	tpd_destroy_steal,
+	tsobj_proc_tpd_steal,
+	tpd_control_report_steal,
+	tpd_control_sleep_steal,
+	tpd_worker_pick_steal,
+	tpd_worker_done_queue,
+	tpd_wqueue_signal,
+	tpd_relink_request_steal
+};
@@ -53,6 +53,15 @@
  *    request using random generators and variators.
  *      * for integer and float wlparam types it will take pure generator/variator value
  *      * for other wlparam types it uses probability map and random generator only
+ *
+ * Random values are not generated one by one: each generator keeps a buffer
+ * of them which is refilled in bulk (see rg_buffer_t).
+ *
+ * Probability maps are sampled with Walker's alias method (in Vose's variant):
+ * after pmap is parsed, wlpgen_pmap_build_alias() splits it into pcount
+ * columns of equal probability, each of them is shared between an element
+ * and its "alias". So picking an element costs one random value and O(1)
+ * time regardless of pmap size.
  */
 
 DECLARE_FIELD_FUNCTIONS(wlp_integer_t);
@@ -101,6 +110,18 @@ wlp_generator_t* wlpgen_create_random(wlp_descr_t* wlp, struct workload* wl,
 	randgen->rv = rv;
 	randgen->pcount = 0;
 	randgen->pmap = NULL;
+	randgen->alias_prob = NULL;
+	randgen->alias = NULL;
+
+	if(rv != NULL) {
+		rg_buffer_init(&randgen->buffer, RGBUF_VARIATE, rg, rv);
+	}
+	else if(wlp_get_base_type(wlp) == WLP_INTEGER) {
+		rg_buffer_init(&randgen->buffer, RGBUF_INT, rg, NULL);
+	}
+	else {
+		rg_buffer_init(&randgen->buffer, RGBUF_DOUBLE, rg, NULL);
+	}
 
 	return gen;
 }
@@ -111,6 +132,13 @@ void wlpgen_destroy(wlp_generator_t* gen) {
 
 		wlpgen_destroy_pmap(gen, randgen->pcount, randgen->pmap);
 
+		if(randgen->alias != NULL) {
+			mp_free(randgen->alias_prob);
+			mp_free(randgen->alias);
+		}
+
+		rg_buffer_destroy(&randgen->buffer);
+
 		rg_destroy(randgen->rg);
 		if(randgen->rv != NULL) {
 			rv_destroy(randgen->rv);
@@ -171,6 +199,69 @@ void wlpgen_destroy_pmap(wlp_generator_t* gen, int pcount, wlpgen_probability_t*
 	}
 }
 
+/**
+ * Build alias table for probability map of randgen. Probabilities are
+ * normalized by their sum, so small errors allowed by wlpgen_pmap_eps
+ * do not skew the distribution.
+ */
+void wlpgen_pmap_build_alias(wlpgen_randgen_t* randgen) {
+	int pcount = randgen->pcount;
+	double* prob = mp_malloc(pcount * sizeof(double));
+	int* alias = mp_malloc(pcount * sizeof(int));
+	double total = 0.0;
+	int pid, s, l;
+
+	/* Worklist: indices of "small" columns (prob < 1) grow from the
+	 * beginning, "large" ones grow from the end. Both together never
+	 * exceed pcount elements. */
+	int* work = mp_malloc(pcount * sizeof(int));
+	int nsmall = 0, nlarge = 0;
+
+	for(pid = 0; pid < pcount; ++pid) {
+		total += randgen->pmap[pid].probability;
+	}
+
+	for(pid = 0; pid < pcount; ++pid) {
+		prob[pid] = randgen->pmap[pid].probability * pcount / total;
+		alias[pid] = pid;
+
+		if(prob[pid] < 1.0) {
+			work[nsmall++] = pid;
+		}
+		else {
+			work[pcount - ++nlarge] = pid;
+		}
+	}
+
+	/* Fill small column with excess of large one. If large column becomes
+	 * small after that, move it to small list. */
+	while(nsmall > 0 && nlarge > 0) {
+		s = work[--nsmall];
+		l = work[pcount - nlarge];
+
+		alias[s] = l;
+		prob[l] = (prob[l] + prob[s]) - 1.0;
+
+		if(prob[l] < 1.0) {
+			--nlarge;
+			work[nsmall++] = l;
+		}
+	}
+
+	/* Remaining columns are full (up to rounding errors) */
+	while(nsmall > 0) {
+		prob[work[--nsmall]] = 1.0;
+	}
+	while(nlarge > 0) {
+		prob[work[pcount - nlarge--]] = 1.0;
+	}
+
+	mp_free(work);
+
+	randgen->alias_prob = prob;
+	randgen->alias = alias;
+}
+
 /* Because wlpgen are dynamically generated, we couldn't know in compile-time
  * length of wlparam-string, so they are dynamically allocated and handled
  * specially in this helper function */
@@ -338,9 +429,9 @@ int tsobj_wlpgen_proc_pmap(tsobj_node_t* node, wlp_generator_t* gen) {
 
 		total += probability;
 
-		/* There are two levels of probability map values. Basically, pmap is O(n), because
-		 * there is cycle that used in wlpgen_gen_pmap() Second level (array) allows to pick
-		 * value with equal probabilities for O(1) complexity times and represented by valarray.  */
+		/* There are two levels of probability map values. First level is picked using
+		 * alias table built by wlpgen_pmap_build_alias(). Second level (array) allows to pick
+		 * value with equal probabilities and represented by valarray.  */
 		value = tsobj_find(el, "value");
 		valarray = tsobj_find_opt(el, "valarray");
 
@@ -401,6 +492,12 @@ int tsobj_wlpgen_proc_pmap(tsobj_node_t* node, wlp_generator_t* gen) {
 	randgen->pcount = pcount;
 	randgen->pmap = pmap;
 
+	wlpgen_pmap_build_alias(randgen);
+
+	/* Sampling pmap requires doubles */
+	rg_buffer_destroy(&randgen->buffer);
+	rg_buffer_init(&randgen->buffer, RGBUF_DOUBLE, randgen->rg, NULL);
+
 	return ret;
 
 bad_tsobj:
@@ -441,6 +538,10 @@ void wlpgen_gen_value(wlp_generator_t* gen, wlpgen_value_t* value, void* param)
 	}
 }
 
+/**
+ * Put value of pmap element to param. val is in [0.0; 1.0) and used to
+ * pick element of valarray.
+ */
 void wlpgen_gen_pmap_value(wlp_generator_t* gen, double val, wlpgen_probability_t* probability, void* param) {
 	int vi;
 
@@ -448,45 +549,43 @@ void wlpgen_gen_pmap_value(wlp_generator_t* gen, double val, wlpgen_probability_
 		wlpgen_gen_value(gen, &probability->value, param);
 	}
 	else {
-		/* Normalize value to [0.0; 1.0] then pick element from array */
-		val /= probability->probability;
 		vi = (int) (val * probability->length);
 
-		assert(vi < probability->length);
+		/* Normalization in wlpgen_gen_pmap() may round val up to 1.0 */
+		if(vi >= probability->length)
+			vi = probability->length - 1;
 
 		wlpgen_gen_value(gen, &probability->valarray[vi], param);
 	}
 }
 
 void wlpgen_gen_pmap(wlp_generator_t* gen, wlpgen_randgen_t* randgen, void* param) {
-	double val = rg_generate_double(randgen->rg);
+	double val = rg_buffer_get_double(&randgen->buffer) * randgen->pcount;
+	double prob;
 	int pid;
 
-	wlpgen_probability_t* probability;
-
-	/* `val` is in [0.0; 1.0)
-	 * If val is below than current probability then pick pmap element
-	 * Otherwise, reduce val by current probability then try next element
-	 *
-	 * Assuming that S is sum of probabilities for elements 1..n-1,
-	 * p is probability for current element and v is generated value,
-	 * element n would be picked if v < (S + p) and v >= S
-	 *
-	 * We do not keep S, but substruct it from v each time: v' < p  */
-	for(pid = 0; pid < randgen->pcount; ++pid) {
-		probability = &randgen->pmap[pid];
-
-		if(val < probability->probability) {
-			wlpgen_gen_pmap_value(gen, val, probability, param);
-			return;
-		}
-
-		val -= probability->probability;
+	/* `val` is in [0.0; pcount]. Its integer part selects column of alias
+	 * table, while fractional part v selects between column's own element
+	 * (if v < prob) and its alias. Then v is normalized back to [0.0; 1.0)
+	 * so it can be reused to pick element from valarray. */
+	pid = (int) val;
+	if(pid >= randgen->pcount)
+		pid = randgen->pcount - 1;
+
+	/* Uniform values may be exactly 1.0, so keep v below 1.0: otherwise
+	 * column with alias_prob of 1.0 gives 0 / 0 */
+	val = min(val - pid, 1.0 - DBL_EPSILON / 2);
+	prob = randgen->alias_prob[pid];
+
+	if(val < prob) {
+		val /= prob;
+	}
+	else {
+		val = (val - prob) / (1.0 - prob);
+		pid = randgen->alias[pid];
 	}
 
-	/* no match - maybe small calculations error -> use last pmap element */
-	probability = &randgen->pmap[randgen->pcount - 1];
-	wlpgen_gen_pmap_value(gen, val, probability, param);
+	wlpgen_gen_pmap_value(gen, val, &randgen->pmap[pid], param);
 }
 
 void wlpgen_gen_random(wlp_generator_t* gen, void* param) {
@@ -498,11 +597,11 @@ void wlpgen_gen_random(wlp_generator_t* gen, void* param) {
 		if(randgen->rv == NULL) {
 			switch(wlp_get_base_type(gen->wlp)) {
 			case WLP_INTEGER:
-				ival = rg_generate_int(randgen->rg);
+				ival = rg_buffer_get_int(&randgen->buffer);
 				WLPGEN_GEN_RANDOM(wlp_integer_t, ival, param);
 				break;
 			case WLP_FLOAT:
-				val = rg_generate_double(randgen->rg);
+				val = rg_buffer_get_double(&randgen->buffer);
 				WLPGEN_GEN_RANDOM(wlp_float_t, val, param);
 				break;
 			}
@@ -510,11 +609,11 @@ void wlpgen_gen_random(wlp_generator_t* gen, void* param) {
 		else {
 			switch(wlp_get_base_type(gen->wlp)) {
 			case WLP_INTEGER:
-				val = rv_variate_double(randgen->rv);
+				val = rg_buffer_get_double(&randgen->buffer);
 				WLPGEN_GEN_RANDOM(wlp_integer_t, round(val), param);
 				break;
 			case WLP_FLOAT:
-				val = rv_variate_double(randgen->rv);
+				val = rg_buffer_get_double(&randgen->buffer);
 				WLPGEN_GEN_RANDOM(wlp_float_t, val, param);
 				break;
 			}
@@ -527,27 +626,81 @@ void wlpgen_gen_random(wlp_generator_t* gen, void* param) {
 }
 
 /**
- * Generate request parameter structure for workload wl
+ * Find maximum value of integer request parameter that could be generated
+ * for workload wl. Values of random generators without probability map are
+ * not bounded, so maximum of parameter range is used for them.
  *
  * @param wl workload
+ * @param name name of request parameter
+ * @param p_max pointer where maximum value is saved
  *
- * @return pointer to that structure or NULL if no request params \
- *         exist for this workload type
- *
- * @note structure is freed on wl_request_destroy()
+ * @return B_FALSE if parameter is not generated or its values are not bounded
  */
-void* wlpgen_generate(struct workload* wl) {
+boolean_t wlpgen_get_max_integer(struct workload* wl, const char* name, wlp_integer_t* p_max) {
 	wlp_generator_t* gen;
-	char* rq_params;
-	char* param;
+	wlpgen_randgen_t* randgen;
+	wlpgen_probability_t* probability;
+	wlp_integer_t value;
+	boolean_t found;
+	int pid, vi;
 
-	int ret;
+	list_for_each_entry(wlp_generator_t, gen, &wl->wl_wlpgen_head, node) {
+		if(strcmp(gen->wlp->name, name) != 0 ||
+		   wlp_get_base_type(gen->wlp) != WLP_INTEGER)
+			continue;
 
-	if(wl->wl_type->wlt_rqparams_size == 0) {
-		return NULL;
+		if(gen->type == WLPG_VALUE) {
+			*p_max = FIELD_GET_VALUE(wlp_integer_t, gen->generator.value.value);
+			return B_TRUE;
+		}
+
+		randgen = &gen->generator.randgen;
+
+		if(randgen->pcount == 0) {
+			if(!gen->wlp->range.range)
+				return B_FALSE;
+
+			*p_max = gen->wlp->range.i_max;
+			return B_TRUE;
+		}
+
+		/* Entries with valarray don't set value, so maximum is seeded
+		 * with the first value that is actually found */
+		found = B_FALSE;
+
+		for(pid = 0; pid < randgen->pcount; ++pid) {
+			probability = &randgen->pmap[pid];
+
+			if(probability->length == 0) {
+				value = FIELD_GET_VALUE(wlp_integer_t, probability->value.value);
+				*p_max = (found) ? max(*p_max, value) : value;
+				found = B_TRUE;
+				continue;
+			}
+
+			for(vi = 0; vi < probability->length; ++vi) {
+				value = FIELD_GET_VALUE(wlp_integer_t, probability->valarray[vi].value);
+				*p_max = (found) ? max(*p_max, value) : value;
+				found = B_TRUE;
+			}
+		}
+
+		return found;
 	}
 
-	rq_params = mp_malloc(wl->wl_type->wlt_rqparams_size);
+	return B_FALSE;
+}
+
+/**
+ * Generate request parameter structure for workload wl
+ *
+ * @param wl workload
+ * @param rq_params storage for request params of wlt_rqparams_size bytes \
+ * 		(usually allocated inline with request)
+ */
+void wlpgen_generate(struct workload* wl, void* rq_params) {
+	wlp_generator_t* gen;
+	char* param;
 
 	list_for_each_entry(wlp_generator_t, gen, &wl->wl_wlpgen_head, node) {
 		param = ((char*) rq_params) + gen->wlp->off;
@@ -559,7 +712,5 @@ void* wlpgen_generate(struct workload* wl) {
 			wlpgen_gen_random(gen, param);
 		}
 	}
-
-	return rq_params;
 }
 
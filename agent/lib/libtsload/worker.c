@@ -75,6 +75,9 @@ thread_result_t control_thread(thread_arg_t arg) {
 			control_prepare_step(tp, wl);
 		}
 
+		/* Put requests of all workloads into tp_rq_head at once */
+		tp_flush_requests(tp);
+
 		mutex_unlock(&tp->tp_mutex);
 
 		tp->tp_disp->tpd_class->control_sleep(tp);
@@ -55,7 +55,6 @@ thread_t	t_wl_requests;
 thread_t	t_wl_notify;
 
 mp_cache_t	wl_cache;
-mp_cache_t	wl_rq_cache;
 
 #define	WL_SET_STATUS(wl, status)					\
 	do {											\
@@ -133,6 +132,7 @@ extern tsload_requests_report_func tsload_requests_report;
 workload_t* wl_create(const char* name, wl_type_t* wlt, thread_pool_t* tp) {
 	workload_t* wl = (workload_t*) mp_cache_alloc(&wl_cache);
 	workload_step_t* step;
+	char rq_cache_name[MPCACHENAMELEN];
 	int i;
 
 	if(wl == NULL)
@@ -160,6 +160,12 @@ workload_t* wl_create(const char* name, wl_type_t* wlt, thread_pool_t* tp) {
 
 	list_head_init(&wl->wl_requests, "wl-rq-%s", name);
 
+	/* Request params are allocated inline with request, so each
+	 * workload needs its own cache with entries of proper size */
+	snprintf(rq_cache_name, MPCACHENAMELEN, "wl-rq-%s", name);
+	mp_cache_init_impl(&wl->wl_rq_cache, rq_cache_name,
+					   sizeof(request_t) + wlt->wlt_rqparams_size);
+
 	list_node_init(&wl->wl_tp_node);
 
 	wl->wl_params = mp_malloc(wlt->wlt_params_size);
@@ -177,6 +183,7 @@ workload_t* wl_create(const char* name, wl_type_t* wlt, thread_pool_t* tp) {
 	wl->wl_rqsched_private = NULL;
 
 	mutex_init(&wl->wl_rq_mutex, "wl-%s-rq", name);
+	cv_init(&wl->wl_rq_cv, "wl-%s-rq", name);
 	mutex_init(&wl->wl_status_mutex, "wl-%s-st", name);
 	mutex_init(&wl->wl_step_mutex, "wl-%s-step", name);
 	wl->wl_ref_count = (atomic_t) 0ul;
@@ -222,12 +229,15 @@ void wl_destroy_impl(workload_t* wl) {
 
 	wlpgen_destroy_all(wl);
 
+	cv_destroy(&wl->wl_rq_cv);
 	mutex_destroy(&wl->wl_rq_mutex);
 	mutex_destroy(&wl->wl_status_mutex);
 	mutex_destroy(&wl->wl_step_mutex);
 
 	aas_free(&wl->wl_name);
 
+	mp_cache_destroy(&wl->wl_rq_cache);
+
 	mp_free(wl->wl_params);
 	mp_cache_free(&wl_cache, wl);
 
@@ -570,6 +580,24 @@ static void wl_init_request(workload_t* wl, request_t* rq) {
 	list_node_init(&rq->rq_node);
 	list_node_init(&rq->rq_w_node);
 	list_node_init(&rq->rq_wl_node);
+	list_node_init(&rq->rq_user_node);
+}
+
+/**
+ * Allocate request from workload's cache. Request params (if workload
+ * type has them) are placed right after request structure.
+ */
+static request_t* wl_alloc_request(workload_t* wl) {
+	request_t* rq = (request_t*) mp_cache_alloc(&wl->wl_rq_cache);
+
+	if(rq == NULL)
+		return NULL;
+
+	rq->rq_params = (wl->wl_type->wlt_rqparams_size == 0)
+						? NULL
+						: (void*) (rq + 1);
+
+	return rq;
 }
 
 
@@ -582,7 +610,7 @@ static void wl_init_request(workload_t* wl, request_t* rq) {
  * 		For unchained workloads should be set to NULL.
  * */
 request_t* wl_create_request(workload_t* wl, request_t* parent) {
-	request_t* rq = (request_t*) mp_cache_alloc(&wl_rq_cache);
+	request_t* rq = wl_alloc_request(wl);
 
 	double u;
 
@@ -601,7 +629,8 @@ request_t* wl_create_request(workload_t* wl, request_t* parent) {
 
 	wl_init_request(wl, rq);
 
-	rq->rq_params = wlpgen_generate(wl);
+	if(rq->rq_params != NULL)
+		wlpgen_generate(wl, rq->rq_params);
 
 	wl->wl_rqsched_class->rqsched_pre_request(rq);
 
@@ -630,7 +659,7 @@ request_t* wl_create_request(workload_t* wl, request_t* parent) {
  */
 request_t* wl_clone_request(request_t* origin) {
 	workload_t* wl = origin->rq_workload;
-	request_t* rq = (request_t*) mp_cache_alloc(&wl_rq_cache);
+	request_t* rq = wl_alloc_request(wl);
 
 	wl_hold(wl);
 
@@ -640,7 +669,8 @@ request_t* wl_clone_request(request_t* origin) {
 
 	wl_init_request(wl, rq);
 
-	rq->rq_params = wlpgen_generate(wl);
+	if(rq->rq_params != NULL)
+		wlpgen_generate(wl, rq->rq_params);
 
 	if(origin->rq_chain_next != NULL) {
 		rq->rq_chain_next = wl_clone_request(origin->rq_chain_next);
@@ -664,7 +694,7 @@ request_t* wl_clone_request(request_t* origin) {
  */
 request_t* wl_create_request_trace(workload_t* wl, int rq_id, long step, int user_id, int thread_id,
 								   ts_time_t sched_time, void* rq_params) {
-	request_t* rq = (request_t*) mp_cache_alloc(&wl_rq_cache);
+	request_t* rq = wl_alloc_request(wl);
 
 	wl_init_request(wl, rq);
 
@@ -675,8 +705,8 @@ request_t* wl_create_request_trace(workload_t* wl, int rq_id, long step, int use
 
 	rq->rq_sched_time = sched_time;
 
-	rq->rq_params = mp_malloc(wl->wl_type->wlt_rqparams_size);
-	memcpy(rq->rq_params, rq_params, wl->wl_type->wlt_rqparams_size);
+	if(rq->rq_params != NULL)
+		memcpy(rq->rq_params, rq_params, wl->wl_type->wlt_rqparams_size);
 
 	/* Let upper layer do it's job of creating chain requests */
 	rq->rq_chain_next = NULL;
@@ -696,19 +726,55 @@ request_t* wl_create_request_trace(workload_t* wl, int rq_id, long step, int use
 /**
  * Destroy request memory */
 void wl_request_destroy(request_t* rq) {
+	workload_t* wl = rq->rq_workload;
+	rqsched_class_t* rqs_class = wl->wl_rqsched_class;
+
 	logmsg(LOG_TRACE, "Destroyed request %s/%d step: %ld thread: %d", rq->rq_workload->wl_name,
 			rq->rq_id, rq->rq_step, rq->rq_thread_id);
 
 	list_del(&rq->rq_wl_node);
 
-	if(rq->rq_params != NULL) {
-		mp_free(rq->rq_params);
+	if(rqs_class != NULL && rqs_class->rqsched_destroy_request != NULL) {
+		rqs_class->rqsched_destroy_request(rq);
 	}
 
-	wl_rele(rq->rq_workload);
 	memset(rq, 0xba, sizeof(request_t));
+	mp_cache_free(&wl->wl_rq_cache, rq);
+
+	/* Release workload only after request is returned to its cache:
+	 * this may be last reference, so wl_rele() destroys the cache */
+	wl_rele(wl);
+}
+
+/**
+ * Set end time of request and pass it to request scheduler.
+ *
+ * Asynchronous requests may be completed while worker sets RQF_PENDING,
+ * so this function doesn't modify rq_flags but returns result flags
+ * (including RQF_FINISHED). Callers should merge them into rq_flags
+ * on their own (under wl_rq_mutex if request may be completed by other thread).
+ */
+static int wl_finish_request(workload_t* wl, request_t* rq, int ret) {
+	int flags = RQF_FINISHED;
+
+	rq->rq_end_time = tm_get_clock() - wl->wl_start_clock;
+
+	if(rq->rq_start_time <= rq->rq_sched_time)
+		flags |= RQF_ONTIME;
+
+	if(ret == 0)
+		flags |= RQF_SUCCESS;
+
+	if(!(rq->rq_flags & RQF_TRACE))
+		wl->wl_rqsched_class->rqsched_post_request(rq);
+
+	if(rq->rq_chain_next != NULL) {
+		rq->rq_chain_next->rq_sched_time = rq->rq_end_time;
+	}
+
+	ETRC_PROBE2(tsload__workload, request__finish, workload_t*, wl, request_t*, rq);
 
-	mp_cache_free(&wl_rq_cache, rq);
+	return flags;
 }
 
 /**
@@ -735,24 +801,58 @@ void wl_run_request(request_t* rq) {
 
 	ret = wl->wl_type->wlt_run_request(rq);
 
-	rq->rq_end_time = tm_get_clock() - wl->wl_start_clock;
+	if(ret == WLT_RUN_PENDING) {
+		/* Request may be already completed by module, so check it under lock.
+		 * Chained requests depend on end time of this request, so wait for it. */
+		mutex_lock(&wl->wl_rq_mutex);
+		if(!(rq->rq_flags & RQF_FINISHED)) {
+			rq->rq_flags |= RQF_PENDING;
 
-	if(rq->rq_start_time <= rq->rq_sched_time)
-		rq->rq_flags |= RQF_ONTIME;
+			while(rq->rq_chain_next != NULL && (rq->rq_flags & RQF_PENDING))
+				cv_wait(&wl->wl_rq_cv, &wl->wl_rq_mutex);
+		}
+		mutex_unlock(&wl->wl_rq_mutex);
 
-	if(ret == 0)
-		rq->rq_flags |= RQF_SUCCESS;
+		return;
+	}
 
-	rq->rq_flags |= RQF_FINISHED;
+	/* Module completed request synchronously, so no other thread may access
+	 * its flags: merge result flags with a single update */
+	rq->rq_flags |= wl_finish_request(wl, rq, ret);
+}
 
-	if(!(rq->rq_flags & RQF_TRACE))
-		wl->wl_rqsched_class->rqsched_post_request(rq);
+/**
+ * Complete request for which wlt_run_request() returned WLT_RUN_PENDING.
+ * May be called from any thread (and even before wlt_run_request() returns).
+ *
+ * @param rq request
+ * @param ret result of request: 0 if it was successful or -1 if it was failed
+ */
+void wl_request_complete(request_t* rq, int ret) {
+	workload_t* wl = rq->rq_workload;
+	int flags;
 
-	if(rq->rq_chain_next != NULL) {
-		rq->rq_chain_next->rq_sched_time = rq->rq_end_time;
+	flags = wl_finish_request(wl, rq, ret);
+
+	mutex_lock(&wl->wl_rq_mutex);
+	rq->rq_flags |= flags;
+	if(rq->rq_flags & RQF_PENDING) {
+		rq->rq_flags &= ~RQF_PENDING;
+		cv_notify_all(&wl->wl_rq_cv);
 	}
+	mutex_unlock(&wl->wl_rq_mutex);
+}
 
-	ETRC_PROBE2(tsload__workload, request__finish, workload_t*, wl, request_t*, rq);
+/**
+ * Wait until asynchronous request will be completed. Should be called
+ * before request is reported or destroyed */
+void wl_request_wait(request_t* rq) {
+	workload_t* wl = rq->rq_workload;
+
+	mutex_lock(&wl->wl_rq_mutex);
+	while(rq->rq_flags & RQF_PENDING)
+		cv_wait(&wl->wl_rq_cv, &wl->wl_rq_mutex);
+	mutex_unlock(&wl->wl_rq_mutex);
 }
 
 void wl_report_requests(list_head_t* rq_list) {
@@ -783,7 +883,7 @@ thread_result_t wl_requests_thread(thread_arg_t arg) {
 	THREAD_ENTRY(arg, void, unused);
 	list_head_t* rq_list;
 
-	request_t *rq, *rq_tmp;
+	request_t *rq, *rq_chain;
 
 	while(B_TRUE) {
 		rq_list =  (list_head_t*) squeue_pop(&wl_requests);
@@ -792,6 +892,15 @@ thread_result_t wl_requests_thread(thread_arg_t arg) {
 			THREAD_EXIT(0);
 		}
 
+		/* Requests which are still serviced asynchronously can't be reported yet */
+		list_for_each_entry(request_t, rq, rq_list, rq_node) {
+			rq_chain = rq;
+			do {
+				wl_request_wait(rq_chain);
+				rq_chain = rq_chain->rq_chain_next;
+			} while(rq_chain != NULL);
+		}
+
 		tsload_requests_report(rq_list);
 
 		wl_rq_list_destroy(rq_list);
@@ -989,7 +1098,6 @@ int wl_init(void) {
 	squeue_init(&wl_notifications, "wl-notify");
 	t_init(&t_wl_notify, NULL, wl_notification_thread, "wl_notification");
 
-	mp_cache_init(&wl_rq_cache, request_t);
 	mp_cache_init(&wl_cache, workload_t);
 
 	etrc_provider_init(&tsload__workload);
@@ -1014,7 +1122,6 @@ void wl_fini(void) {
 
 	hash_map_destroy(&workload_hash_map);
 
-	mp_cache_destroy(&wl_rq_cache);
 	mp_cache_destroy(&wl_cache);
 }
 
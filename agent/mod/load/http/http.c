@@ -26,6 +26,7 @@
 #include <tsload/mempool.h>
 #include <tsload/modapi.h>
 #include <tsload/netsock.h>
+#include <tsload/time.h>
 
 #include <tsload/load/workload.h>
 #include <tsload/load/wltype.h>
@@ -54,6 +55,12 @@ MODEXPORT wlp_descr_t http_params[] = {
 		"port",
 		"HTTP server port",
 		offsetof(struct http_workload, port) },
+	{ WLP_INTEGER, WLPF_OPTIONAL,
+		WLP_INT_RANGE(1, HTTP_MAX_CONCURRENCY),
+		WLP_INT_DEFAULT(1),
+		"concurrency",
+		"Number of concurrent requests per worker (if greater than 1, cURL multi interface is used)",
+		offsetof(struct http_workload, concurrency) },
 	{ WLP_RAW_STRING, WLPF_REQUEST,
 		WLP_STRING_LENGTH(MAXURILEN),
 		WLP_NO_DEFAULT(),
@@ -68,12 +75,281 @@ MODEXPORT wlp_descr_t http_params[] = {
 		"HTTP response status",
 		offsetof(struct http_request, status)
 	},
+	{ WLP_INTEGER, WLPF_OUTPUT,
+		WLP_NO_RANGE(),
+		WLP_NO_DEFAULT(),
+		"dns_time",
+		"Time spent to resolve server name (ns)",
+		offsetof(struct http_request, dns_time)
+	},
+	{ WLP_INTEGER, WLPF_OUTPUT,
+		WLP_NO_RANGE(),
+		WLP_NO_DEFAULT(),
+		"connect_time",
+		"Time until connection to server was established (ns)",
+		offsetof(struct http_request, connect_time)
+	},
+	{ WLP_INTEGER, WLPF_OUTPUT,
+		WLP_NO_RANGE(),
+		WLP_NO_DEFAULT(),
+		"ttfb",
+		"Time until first byte of response was received (ns)",
+		offsetof(struct http_request, ttfb)
+	},
+	{ WLP_INTEGER, WLPF_OUTPUT,
+		WLP_NO_RANGE(),
+		WLP_NO_DEFAULT(),
+		"total_time",
+		"Total time of HTTP request (ns)",
+		offsetof(struct http_request, total_time)
+	},
 	{ WLP_NULL }
 };
 
 module_t* self = NULL;
 thread_mutex_t resolver_mutex;
 
+/**
+ * Create easy handle and set options that are common for all requests
+ */
+static void http_transfer_init(struct http_data* hd, struct http_transfer* xfer, const char* urlprefix) {
+	xfer->curl = curl_easy_init();
+	xfer->rq = NULL;
+	xfer->next = NULL;
+
+	xfer->urilen = strlen(urlprefix);
+	strcpy(xfer->url, urlprefix);
+
+	if(xfer->curl == NULL)
+		return;
+
+	curl_easy_setopt(xfer->curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+	/* FIXME: Should be parameter */
+	curl_easy_setopt(xfer->curl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(xfer->curl, CURLOPT_WRITEDATA, hd->fnull);
+
+	curl_easy_setopt(xfer->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(xfer->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(xfer->curl, CURLOPT_PRIVATE, xfer);
+}
+
+static void http_transfer_prepare(struct http_transfer* xfer, request_t* rq) {
+	struct http_request* hrq = (struct http_request*) rq->rq_params;
+	size_t len = strlen(hrq->uri);
+
+	if(len > HTTP_URLLEN - xfer->urilen - 1)
+		len = HTTP_URLLEN - xfer->urilen - 1;
+
+	memcpy(xfer->url + xfer->urilen, hrq->uri, len);
+	xfer->url[xfer->urilen + len] = '\0';
+
+	curl_easy_setopt(xfer->curl, CURLOPT_URL, xfer->url);
+
+	xfer->rq = rq;
+}
+
+STATIC_INLINE wlp_integer_t http_get_time(CURL* curl, CURLINFO info) {
+	double t = 0.0;
+
+	curl_easy_getinfo(curl, info, &t);
+
+	return (wlp_integer_t) (t * T_SEC);
+}
+
+/**
+ * Collect response status and timings of finished transfer
+ *
+ * @return 0 on success or -1 if transfer failed (outputs are zeroed then)
+ */
+static int http_transfer_finish(struct http_transfer* xfer, CURLcode res) {
+	struct http_request* hrq = (struct http_request*) xfer->rq->rq_params;
+	long status;
+
+	if(res != CURLE_OK) {
+		logmsg(LOG_WARN, "HTTP request '%s' failed: %s",
+			   xfer->url, curl_easy_strerror(res));
+
+		hrq->status = 0;
+		hrq->dns_time = 0;
+		hrq->connect_time = 0;
+		hrq->ttfb = 0;
+		hrq->total_time = 0;
+
+		return -1;
+	}
+
+	curl_easy_getinfo(xfer->curl, CURLINFO_RESPONSE_CODE, &status);
+	hrq->status = status;
+
+	hrq->dns_time = http_get_time(xfer->curl, CURLINFO_NAMELOOKUP_TIME);
+	hrq->connect_time = http_get_time(xfer->curl, CURLINFO_CONNECT_TIME);
+	hrq->ttfb = http_get_time(xfer->curl, CURLINFO_STARTTRANSFER_TIME);
+	hrq->total_time = http_get_time(xfer->curl, CURLINFO_TOTAL_TIME);
+
+	return 0;
+}
+
+#ifdef HAVE_DECL_CURL_MULTI_WAKEUP
+
+/**
+ * Return transfer to the free list and complete its request. Failed
+ * transfers (res != CURLE_OK) complete request with an error.
+ */
+static void http_multi_complete(struct http_multi* hm, struct http_transfer* xfer,
+								CURLcode res) {
+	request_t* rq;
+	int ret;
+
+	ret = http_transfer_finish(xfer, res);
+	rq = xfer->rq;
+
+	mutex_lock(&hm->mutex);
+	xfer->next = hm->free;
+	hm->free = xfer;
+	--hm->inflight;
+	cv_notify_one(&hm->cv);
+	mutex_unlock(&hm->mutex);
+
+	wl_request_complete(rq, ret);
+}
+
+static thread_result_t http_multi_thread(thread_arg_t arg) {
+	THREAD_ENTRY(arg, struct http_multi, hm);
+	struct http_transfer* xfer;
+	struct http_transfer* next;
+
+	CURLMsg* msg;
+	int running, msgs;
+
+	mutex_lock(&hm->mutex);
+
+	while(!hm->stopping || hm->inflight > 0) {
+		xfer = hm->pending;
+		hm->pending = NULL;
+
+		mutex_unlock(&hm->mutex);
+
+		for( ; xfer != NULL; xfer = next) {
+			next = xfer->next;
+
+			/* Transfer which can't be added will never be reported
+			 * by curl_multi_info_read(), so fail it right away */
+			if(curl_multi_add_handle(hm->multi, xfer->curl) != CURLM_OK)
+				http_multi_complete(hm, xfer, CURLE_FAILED_INIT);
+		}
+
+		curl_multi_perform(hm->multi, &running);
+
+		while((msg = curl_multi_info_read(hm->multi, &msgs)) != NULL) {
+			if(msg->msg != CURLMSG_DONE)
+				continue;
+
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &xfer);
+			curl_multi_remove_handle(hm->multi, msg->easy_handle);
+
+			http_multi_complete(hm, xfer, msg->data.result);
+		}
+
+		/* Wakes up if there is activity on sockets or if worker
+		 * called curl_multi_wakeup() after it added transfer */
+		curl_multi_poll(hm->multi, NULL, 0, HTTP_POLL_TIMEOUT, NULL);
+
+		mutex_lock(&hm->mutex);
+	}
+
+	mutex_unlock(&hm->mutex);
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+static int http_multi_submit(struct http_multi* hm, request_t* rq) {
+	struct http_transfer* xfer;
+
+	mutex_lock(&hm->mutex);
+
+	/* Wait for idle transfer */
+	while(hm->free == NULL)
+		cv_wait(&hm->cv, &hm->mutex);
+
+	xfer = hm->free;
+	hm->free = xfer->next;
+	++hm->inflight;
+
+	mutex_unlock(&hm->mutex);
+
+	/* Transfer doesn't belong to multi handle now, so it is safe
+	 * to set its options without holding a lock */
+	http_transfer_prepare(xfer, rq);
+
+	mutex_lock(&hm->mutex);
+	xfer->next = hm->pending;
+	hm->pending = xfer;
+	mutex_unlock(&hm->mutex);
+
+	curl_multi_wakeup(hm->multi);
+
+	return WLT_RUN_PENDING;
+}
+
+#endif
+
+static void http_multi_init(struct http_data* hd, struct http_multi* hm, int concurrency,
+							const char* urlprefix, const char* wl_name, int wid) {
+	int i;
+
+	hm->multi = curl_multi_init();
+	hm->concurrency = concurrency;
+
+	/* Keep connection of each transfer alive */
+	curl_multi_setopt(hm->multi, CURLMOPT_MAXCONNECTS, (long) concurrency);
+
+	hm->transfers = mp_malloc(sizeof(struct http_transfer) * concurrency);
+	hm->free = NULL;
+	hm->pending = NULL;
+	hm->inflight = 0;
+	hm->stopping = B_FALSE;
+
+	for(i = 0; i < concurrency; ++i) {
+		http_transfer_init(hd, &hm->transfers[i], urlprefix);
+
+		hm->transfers[i].next = hm->free;
+		hm->free = &hm->transfers[i];
+	}
+
+	mutex_init(&hm->mutex, "http-%s-%d", wl_name, wid);
+	cv_init(&hm->cv, "http-%s-%d", wl_name, wid);
+
+#ifdef HAVE_DECL_CURL_MULTI_WAKEUP
+	t_init(&hm->thread, hm, http_multi_thread, "http-%s-%d", wl_name, wid);
+#endif
+}
+
+static void http_multi_destroy(struct http_multi* hm) {
+	int i;
+
+	mutex_lock(&hm->mutex);
+	hm->stopping = B_TRUE;
+	mutex_unlock(&hm->mutex);
+
+#ifdef HAVE_DECL_CURL_MULTI_WAKEUP
+	curl_multi_wakeup(hm->multi);
+	t_destroy(&hm->thread);
+#endif
+
+	for(i = 0; i < hm->concurrency; ++i) {
+		curl_easy_cleanup(hm->transfers[i].curl);
+	}
+
+	curl_multi_cleanup(hm->multi);
+
+	cv_destroy(&hm->cv);
+	mutex_destroy(&hm->mutex);
+
+	mp_free(hm->transfers);
+}
+
 MODEXPORT int http_wl_config(workload_t* wl) {
 	struct http_workload* hwp = (struct http_workload*) wl->wl_params;
 	struct http_data* hd = mp_malloc(sizeof(struct http_data));
@@ -83,6 +359,7 @@ MODEXPORT int http_wl_config(workload_t* wl) {
 
 	unsigned num_workers = wl->wl_tp->tp_num_threads;
 	int wid;
+	char urlprefix[HTTP_URLLEN];
 
 	/* Preliminary resolve hostname to reduce pressure on DNS server
 	 * (in some cases HTTP benchmark became DNS benchmark)
@@ -103,6 +380,14 @@ MODEXPORT int http_wl_config(workload_t* wl) {
 		return 1;
 	}
 
+#ifndef HAVE_DECL_CURL_MULTI_WAKEUP
+	if(hwp->concurrency > 1) {
+		wl_notify(wl, WLS_CFG_FAIL, -1, "Concurrent requests require cURL 7.68.0 or newer");
+		mp_free(hd);
+		return 1;
+	}
+#endif
+
 	hd->fnull = plat_open_null();
 	if(hd->fnull == NULL) {
 		wl_notify(wl, WLS_CFG_FAIL, -1, "Failed to open 'null' file");
@@ -110,10 +395,23 @@ MODEXPORT int http_wl_config(workload_t* wl) {
 		return 1;
 	}
 
-	hd->curl = mp_malloc(sizeof(CURL*) * num_workers);
+	snprintf(urlprefix, HTTP_URLLEN, "http://%s", hd->serveraddr);
+
 	hd->num_workers = num_workers;
-	for(wid = 0; wid < num_workers; ++wid) {
-		hd->curl[wid] = curl_easy_init();
+	hd->transfers = NULL;
+	hd->multi = NULL;
+
+	if(hwp->concurrency > 1) {
+		hd->multi = mp_malloc(sizeof(struct http_multi) * num_workers);
+		for(wid = 0; wid < num_workers; ++wid) {
+			http_multi_init(hd, &hd->multi[wid], hwp->concurrency, urlprefix, wl->wl_name, wid);
+		}
+	}
+	else {
+		hd->transfers = mp_malloc(sizeof(struct http_transfer) * num_workers);
+		for(wid = 0; wid < num_workers; ++wid) {
+			http_transfer_init(hd, &hd->transfers[wid], urlprefix);
+		}
 	}
 
 	wl->wl_private = hd;
@@ -127,8 +425,19 @@ MODEXPORT int http_wl_unconfig(workload_t* wl) {
 	unsigned num_workers = hd->num_workers;
 	int wid;
 
-	for(wid = 0; wid < num_workers; ++wid) {
-		curl_easy_cleanup(hd->curl[wid]);
+	if(hd->multi != NULL) {
+		for(wid = 0; wid < num_workers; ++wid) {
+			http_multi_destroy(&hd->multi[wid]);
+		}
+
+		mp_free(hd->multi);
+	}
+	else {
+		for(wid = 0; wid < num_workers; ++wid) {
+			curl_easy_cleanup(hd->transfers[wid].curl);
+		}
+
+		mp_free(hd->transfers);
 	}
 
 	mp_free(wl->wl_private);
@@ -137,44 +446,28 @@ MODEXPORT int http_wl_unconfig(workload_t* wl) {
 }
 
 MODEXPORT int http_run_request(request_t* rq) {
-  CURL* curl;
-  CURLcode res;
-  long status;
+	struct http_data* hd = (struct http_data*) rq->rq_workload->wl_private;
+	struct http_transfer* xfer;
+	CURLcode res;
 
-  struct http_workload* hwp = (struct http_workload*) rq->rq_workload->wl_params;
-  struct http_request* hrq = (struct http_request*) rq->rq_params;
-  struct http_data* hd = (struct http_data*) rq->rq_workload->wl_private;
+	unsigned wid = ((unsigned) rq->rq_thread_id) % hd->num_workers;
 
-  char url[MAXURILEN];
-
-  snprintf(url, MAXURILEN, "http://%s%s", hd->serveraddr, hrq->uri);
-
-  curl = hd->curl[rq->rq_thread_id];
+#ifdef HAVE_DECL_CURL_MULTI_WAKEUP
+	if(hd->multi != NULL) {
+		return http_multi_submit(&hd->multi[wid], rq);
+	}
+#endif
 
-  if(curl) {
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	xfer = &hd->transfers[wid];
 
-	/* FIXME: Should be parameter */
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
-	curl_easy_setopt(curl, CURLOPT_FILE, hd->fnull);
+	if(xfer->curl == NULL)
+		return 1;
 
-	res = curl_easy_perform(curl);
+	http_transfer_prepare(xfer, rq);
 
-	if(res != CURLE_OK) {
-	  logmsg(LOG_WARN, "curl_easy_perform() failed: %s\n",
-			  	  	    curl_easy_strerror(res));
-	}
-	else {
-		/* TODO: More curl information, i.e. times */
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
-		hrq->status = status;
-	}
-
-	return 0;
-  }
+	res = curl_easy_perform(xfer->curl);
 
-  return 1;
+	return http_transfer_finish(xfer, res);
 }
 
 wl_type_t http_wlt = {
@@ -23,6 +23,8 @@
 
 #include <tsload/defs.h>
 
+#include <tsload/threads.h>
+
 #include <tsload/load/wlparam.h>
 
 #include <stdio.h>
@@ -38,22 +40,81 @@
 #define RESPONSE_BUF_SIZE	4096
 #define USER_AGENT			"User-Agent: TSLoad HTTP Module"
 
+#define HTTP_MAX_CONCURRENCY	1024
+
+/* Maximum time multi handle thread sleeps in curl_multi_poll() */
+#define HTTP_POLL_TIMEOUT	100
+
+/* "http://" + server address + uri */
+#define HTTP_URLLEN			(MAXHOSTNAMELEN + MAXURILEN + 8)
+
 struct http_workload {
 	wlp_string_t 	server[MAXHOSTNAMELEN];
 	wlp_integer_t 	port;
+	wlp_integer_t	concurrency;
+};
+
+struct request;
+
+/**
+ * cURL easy handle which is reused between requests. Options that do not
+ * depend on request are set when handle is created, and url buffer already
+ * contains server address, so only uri is copied for each request.
+ */
+struct http_transfer {
+	CURL* curl;
+
+	struct request* rq;
+	struct http_transfer* next;
+
+	size_t urilen;
+	char url[HTTP_URLLEN];
+};
+
+/**
+ * Per-worker multi handle. Worker takes idle transfer from free list and
+ * puts it to pending list, while multi thread adds pending transfers to multi
+ * handle, drives them and completes requests. Keep-alive connections are
+ * cached by multi handle, so they are reused by following transfers.
+ */
+struct http_multi {
+	CURLM* multi;
+	thread_t thread;
+
+	thread_mutex_t mutex;
+	thread_cv_t cv;
+
+	struct http_transfer* transfers;
+	int concurrency;
+
+	/* Protected by mutex */
+	struct http_transfer* free;
+	struct http_transfer* pending;
+	int inflight;
+	boolean_t stopping;
 };
 
 struct http_data {
 	wlp_string_t 	serveraddr[MAXHOSTNAMELEN];
 	FILE* fnull;
 
-	CURL** curl;
 	unsigned num_workers;
+
+	/* Synchronous mode: one transfer per worker */
+	struct http_transfer* transfers;
+
+	/* Asynchronous mode (concurrency > 1): one multi handle per worker */
+	struct http_multi* multi;
 };
 
 struct http_request {
 	wlp_string_t 	uri[MAXURILEN];
 	wlp_integer_t	status;
+
+	wlp_integer_t	dns_time;
+	wlp_integer_t	connect_time;
+	wlp_integer_t	ttfb;
+	wlp_integer_t	total_time;
 };
 
 PLATAPI FILE* plat_open_null(void);
@@ -22,6 +22,7 @@
 #define MOD_LOAD_IOFILE_H_
 
 #include <tsload/pathutil.h>
+#include <tsload/time.h>
 
 #include <mod/simpleio/plat/iofile.h>
 
@@ -41,12 +42,38 @@ typedef struct {
 	AUTOSTRING char* iof_error_msg;
 } io_file_t;
 
+struct io_file_aio;
+
+typedef void (*io_file_aio_complete_func)(struct io_file_aio* aio);
+
+/**
+ * Asynchronous I/O operation. Caller fills buffer, count, offset and completion
+ * callback which is called from engine's thread when operation is finished.
+ * aio_result is set to number of bytes transferred or -1 if operation was failed.
+ * aio_submit_time is a clock (tm_get_clock()) when operation was actually submitted
+ * to the kernel, so it doesn't include time operation spent in the batch.
+ */
+typedef struct io_file_aio {
+	plat_io_file_aio_t	aio_impl;
+
+	void*			aio_buffer;
+	size_t			aio_count;
+	uint64_t		aio_offset;
+	boolean_t		aio_write;
+
+	long			aio_result;
+	ts_time_t		aio_submit_time;
+
+	io_file_aio_complete_func aio_complete;
+	void*			aio_private;
+} io_file_aio_t;
+
 /* I/O file interface provides cross-platform access
  * to both regular files and raw disks */
 PLATAPI int io_file_init(io_file_t* iof, io_file_type_t type, const char* path, uint64_t file_size);
 PLATAPI int io_file_stat(io_file_t* iof);
 
-PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync);
+PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync, boolean_t direct);
 PLATAPI void io_file_close(io_file_t* iof, boolean_t do_remove);
 
 PLATAPI int io_file_fsync(io_file_t* iof);
@@ -54,7 +81,21 @@ PLATAPI int io_file_fsync(io_file_t* iof);
 PLATAPI int io_file_seek(io_file_t* iof, uint64_t where);
 PLATAPI int io_file_seek_sparse(io_file_t* iof, uint64_t where);
 
+/* Allocate space for file without writing data to it */
+PLATAPI int io_file_allocate(io_file_t* iof, uint64_t size);
+
 PLATAPI int io_file_pread(io_file_t* iof, void* buffer, size_t count, uint64_t offset);
 PLATAPI int io_file_pwrite(io_file_t* iof, void* buffer, size_t count, uint64_t offset);
 
+/* Buffers for direct I/O should be aligned (normally to a page size) */
+PLATAPI void* io_file_alloc_buffer(size_t size, size_t align);
+PLATAPI void io_file_free_buffer(void* buffer);
+
+/* Asynchronous I/O engine keeps up to iodepth operations in flight and submits them
+ * in batches of up to batch operations. io_file_aio_destroy() waits until all
+ * in-flight operations will be completed. */
+PLATAPI int io_file_aio_init(io_file_t* iof, int iodepth, int batch);
+PLATAPI void io_file_aio_destroy(io_file_t* iof);
+PLATAPI int io_file_aio_submit(io_file_t* iof, io_file_aio_t* aio);
+
 #endif
\ No newline at end of file
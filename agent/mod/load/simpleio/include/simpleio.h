@@ -24,23 +24,33 @@
 #include <tsload/defs.h>
 
 #include <tsload/pathutil.h>
+#include <tsload/threads.h>
 
 #include <tsload/load/wlparam.h>
 
 #include <iofile.h>
 
+#define SIMPLEIO_MAX_IODEPTH	1024
+
 struct fileio_workload {
 	wlp_string_t 	 path[PATHMAXLEN];
 	wlp_integer_t 	 file_size;
 	wlp_bool_t 		 sync;
+	wlp_integer_t	 iodepth;
+	wlp_bool_t		 direct;
+	wlp_bool_t		 rotate;
 	wlp_bool_t	 	 sparse;
 	wlp_bool_t 		 overwrite;
+	wlp_bool_t		 preallocate;
 };
 
 struct diskio_workload {
 	wlp_hiobject_t   disk;
 	wlp_bool_t       force;
 	wlp_bool_t 		 sync;
+	wlp_integer_t	 iodepth;
+	wlp_bool_t		 direct;
+	wlp_bool_t		 rotate;
 	wlp_bool_t 		 rdwr;
 };
 
@@ -50,10 +60,46 @@ struct simpleio_request {
 	wlp_integer_t offset;
 };
 
+/**
+ * Preallocated I/O buffer. Buffers are page-aligned (so they may be used with
+ * direct I/O) and filled with pattern when they are allocated.
+ * Embeds asynchronous operation, so requests don't need extra allocations.
+ */
+typedef struct simpleio_buffer {
+	struct simpleio_buffer* sb_next;
+
+	void*	sb_data;
+	size_t	sb_size;
+	int		sb_worker;
+
+	io_file_aio_t sb_aio;
+	struct request* sb_rq;
+} simpleio_buffer_t;
+
+/**
+ * Free list of buffers owned by a worker. Lock is only contended when
+ * asynchronous requests return buffers from completion thread.
+ */
+typedef struct simpleio_buffer_list {
+	thread_mutex_t sbl_lock;
+	simpleio_buffer_t* sbl_free;
+} simpleio_buffer_list_t;
+
 struct simpleio_wldata {
 	io_file_t iof;
 	uint64_t size;
 	boolean_t do_remove;
+	boolean_t async;
+	boolean_t rotate;
+
+	size_t pgsz;
+	size_t align;
+
+	/* Size of buffers, requests with larger blocks are truncated */
+	size_t block_size;
+
+	int num_workers;
+	simpleio_buffer_list_t* buffers;
 };
 
 #endif
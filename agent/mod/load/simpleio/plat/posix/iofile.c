@@ -20,19 +20,86 @@
 
 #include <tsload/defs.h>
 
+#include <tsload/mempool.h>
+#include <tsload/threads.h>
+#include <tsload/time.h>
+
 #include <simpleio.h>
 #include <mod/simpleio/plat/iofile.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#ifdef HAVE_LIBAIO
+#include <libaio.h>
+#include <time.h>
+#endif
+
+/**
+ * Asynchronous I/O engine
+ *
+ * Worker threads prepare operations and put them onto submission queue (SQ ring
+ * of io_uring or iocb array for libaio). Queue is flushed by the submitter if
+ * batch is full or there is no submitted I/O which completion would flush it, so
+ * while device is busy submissions are coalesced. Completions are reaped by separate
+ * thread which calls aio_complete callbacks and then flushes the queue.
+ *
+ * Uses io_uring if it is supported by kernel and falls back to libaio otherwise.
+ */
+
+typedef enum {
+	IOF_AIO_URING,
+	IOF_AIO_LIBAIO
+} io_file_aio_type_t;
+
+/* Interval between checks of aio_stopping in libaio reaper */
+#define IOF_AIO_REAP_TIMEOUT	(100 * T_MS)
+
+typedef struct io_file_aio_engine {
+	io_file_aio_type_t	aio_type;
+	int					aio_iodepth;
+	int					aio_batch;
+
+	/* Operations that were submitted or queued. Protected by aio_lock */
+	int					aio_inflight;
+	int					aio_queued;
+	boolean_t			aio_stopping;
+
+	/* Queued operations in order of submission */
+	io_file_aio_t**		aio_queue;
+
+	thread_mutex_t		aio_lock;
+	thread_cv_t			aio_cv;
+
+	thread_t			aio_reaper;
+
+#ifdef HAVE_LIBURING
+	struct io_uring		aio_ring;
+
+	/* Failed operations which entries are still in SQ ring */
+	int					aio_cancelled;
+#endif
+
+#ifdef HAVE_LIBAIO
+	io_context_t		aio_ctx;
+	struct iocb**		aio_iocbs;
+	struct io_event*	aio_events;
+#endif
+} io_file_aio_engine_t;
+
 PLATAPI int io_file_init(io_file_t* iof, io_file_type_t type, const char* path, uint64_t file_size) {
 	iof->iof_impl.fd = -1;
+	iof->iof_impl.aio = NULL;
 	
 	aas_copy(aas_init(&iof->iof_path), path);
 	
@@ -56,12 +123,22 @@ PLATAPI int io_file_stat(io_file_t* iof) {
 	return 0;
 }
 
-PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync) {
+PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync, boolean_t direct) {
 	int o_flags = ((iof->iof_exists)? 0 : O_CREAT)	|
 				  ((rdwr) ? O_RDWR : O_RDONLY) |
 				  ((sync)? O_DSYNC : 0);
 	int fd;
 	
+#if defined(O_DIRECT)
+	if(direct)
+		o_flags |= O_DIRECT;
+#elif !defined(DIRECTIO_ON) && !defined(F_NOCACHE)
+	if(direct) {
+		aas_printf(&iof->iof_error_msg, "Direct I/O is not supported for '%s'", iof->iof_path);
+		return -1;
+	}
+#endif
+	
 	fd = open(iof->iof_path, o_flags, 0660);
 
 	if(fd == -1 && iof->iof_error_msg == NULL) {
@@ -70,12 +147,31 @@ PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync) {
 		return -1;
 	}
 	
+	/* Solaris and Mac OS X enable direct I/O on opened file */
+#if !defined(O_DIRECT) && defined(DIRECTIO_ON)
+	if(direct && directio(fd, DIRECTIO_ON) == -1) {
+		aas_printf(&iof->iof_error_msg, "Failed to directio('%s'): %s", 
+				   iof->iof_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+#elif !defined(O_DIRECT) && defined(F_NOCACHE)
+	if(direct && fcntl(fd, F_NOCACHE, 1) == -1) {
+		aas_printf(&iof->iof_error_msg, "Failed to fcntl('%s', F_NOCACHE): %s", 
+				   iof->iof_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+#endif
+	
 	iof->iof_impl.fd = fd;
 
 	return 0;
 }
 
 PLATAPI void io_file_close(io_file_t* iof, boolean_t do_remove) {
+	io_file_aio_destroy(iof);
+
 	if(iof->iof_impl.fd != -1) {
 		close(iof->iof_impl.fd);
 
@@ -112,6 +208,28 @@ PLATAPI int io_file_seek(io_file_t* iof, uint64_t where) {
 	return ret;
 }
 
+PLATAPI int io_file_allocate(io_file_t* iof, uint64_t size) {
+	int ret;
+	
+	/* Prefer Linux fallocate() because glibc posix_fallocate() silently falls
+	 * back to writing zeroes if filesystem doesn't support allocation */
+#if defined(HAVE_DECL_FALLOCATE)
+	ret = (fallocate(iof->iof_impl.fd, 0, 0, size) == 0) ? 0 : errno;
+#elif defined(HAVE_DECL_POSIX_FALLOCATE)
+	ret = posix_fallocate(iof->iof_impl.fd, 0, size);
+#else
+	ret = ENOTSUP;
+#endif
+	
+	if(ret != 0 && iof->iof_error_msg == NULL) {
+		aas_printf(&iof->iof_error_msg, "Failed to allocate %" PRIu64 " bytes for '%s': %s", 
+				   size, iof->iof_path, strerror(ret));
+		return -1;
+	}
+	
+	return (ret == 0) ? 0 : -1;
+}
+
 PLATAPI int io_file_pread(io_file_t* iof, void* buffer, size_t count, uint64_t offset) {
 	return pread(iof->iof_impl.fd, buffer, count, offset);
 }
@@ -120,3 +238,425 @@ PLATAPI int io_file_pwrite(io_file_t* iof, void* buffer, size_t count, uint64_t
 	return pwrite(iof->iof_impl.fd, buffer, count, offset);
 }
 
+PLATAPI void* io_file_alloc_buffer(size_t size, size_t align) {
+	void* buffer;
+	
+	if(posix_memalign(&buffer, align, size) != 0)
+		return NULL;
+	
+	return buffer;
+}
+
+PLATAPI void io_file_free_buffer(void* buffer) {
+	free(buffer);
+}
+
+
+
+#if defined(HAVE_LIBURING) || defined(HAVE_LIBAIO)
+
+STATIC_INLINE void io_file_aio_finish(io_file_aio_t* aio, long res) {
+	aio->aio_result = (res < 0) ? -1 : res;
+	aio->aio_complete(aio);
+}
+
+#ifdef HAVE_LIBURING
+/* User data of SQ entries of failed operations. Their completions are ignored */
+static char io_file_aio_cancelled;
+#endif
+
+static void io_file_aio_dequeue(io_file_aio_engine_t* engine, int count) {
+	engine->aio_queued -= count;
+
+	memmove(engine->aio_queue, engine->aio_queue + count,
+			engine->aio_queued * sizeof(io_file_aio_t*));
+
+#ifdef HAVE_LIBAIO
+	if(engine->aio_type == IOF_AIO_LIBAIO) {
+		memmove(engine->aio_iocbs, engine->aio_iocbs + count,
+				engine->aio_queued * sizeof(struct iocb*));
+	}
+#endif
+}
+
+/**
+ * Complete first queued operation with error res */
+static void io_file_aio_fail(io_file_aio_engine_t* engine, long res) {
+	io_file_aio_t* aio = engine->aio_queue[0];
+
+#ifdef HAVE_LIBURING
+	if(engine->aio_type == IOF_AIO_URING) {
+		/* Entry can't be removed from SQ ring, so make it NOP which
+		 * completion will be ignored if ring will ever accept it */
+		io_uring_prep_nop(aio->aio_impl.sqe);
+		io_uring_sqe_set_data(aio->aio_impl.sqe, &io_file_aio_cancelled);
+		++engine->aio_cancelled;
+	}
+#endif
+
+	io_file_aio_dequeue(engine, 1);
+	--engine->aio_inflight;
+
+	io_file_aio_finish(aio, res);
+	cv_notify_all(&engine->aio_cv);
+}
+
+/**
+ * Submit queued operations. Should be called with aio_lock held.
+ *
+ * Queued operations are stamped with aio_submit_time right before submission,
+ * so time spent waiting for batch or busy queue is not accounted as service time.
+ *
+ * If kernel rejects operation at submission time and there are no operations
+ * in flight which completion would retry submission, it is completed with error,
+ * so it won't stuck in a queue forever. */
+static void io_file_aio_flush(io_file_aio_engine_t* engine) {
+	ts_time_t now;
+	int ret;
+	int i;
+
+	while(engine->aio_queued > 0) {
+		now = tm_get_clock();
+		for(i = 0; i < engine->aio_queued; ++i)
+			engine->aio_queue[i]->aio_submit_time = now;
+
+#ifdef HAVE_LIBURING
+		if(engine->aio_type == IOF_AIO_URING) {
+			ret = io_uring_submit(&engine->aio_ring);
+
+			if(ret > 0) {
+				/* Cancelled entries are at the head of SQ ring */
+				i = min(ret, engine->aio_cancelled);
+				engine->aio_cancelled -= i;
+
+				io_file_aio_dequeue(engine, ret - i);
+				continue;
+			}
+
+			/* Ring is busy: if there are submitted operations, reaper
+			 * will retry after it reaps their completions */
+			if(ret == -EINTR || engine->aio_queued < engine->aio_inflight)
+				return;
+
+			if(ret == -EAGAIN || ret == -EBUSY)
+				continue;
+
+			/* Ring is broken and nobody will retry submission */
+			while(engine->aio_queued > 0)
+				io_file_aio_fail(engine, (ret < 0) ? ret : -EIO);
+
+			return;
+		}
+#endif
+
+#ifdef HAVE_LIBAIO
+		ret = io_submit(engine->aio_ctx, engine->aio_queued, engine->aio_iocbs);
+
+		if(ret > 0) {
+			io_file_aio_dequeue(engine, ret);
+			continue;
+		}
+
+		if(ret == -EINTR || ret == -EAGAIN) {
+			if(engine->aio_queued < engine->aio_inflight)
+				return;
+
+			continue;
+		}
+
+		/* First operation is invalid, fail it */
+		io_file_aio_fail(engine, ret);
+#else
+		return;
+#endif
+	}
+}
+
+/**
+ * Wait for at least one completion and call callbacks for all
+ * completed operations. Returns number of reaped operations or -1
+ * if reaper was asked to stop */
+static int io_file_aio_reap(io_file_aio_engine_t* engine) {
+	int count = 0;
+	int ret;
+
+#ifdef HAVE_LIBURING
+	struct io_uring_cqe* cqe;
+	io_file_aio_t* aio;
+	unsigned head;
+	unsigned reaped = 0;
+	boolean_t stop = B_FALSE;
+
+	if(engine->aio_type == IOF_AIO_URING) {
+		ret = io_uring_wait_cqe(&engine->aio_ring, &cqe);
+		if(ret < 0)
+			return 0;
+
+		io_uring_for_each_cqe(&engine->aio_ring, head, cqe) {
+			aio = (io_file_aio_t*) io_uring_cqe_get_data(cqe);
+
+			++reaped;
+
+			/* NOP with empty user data is posted by io_file_aio_destroy() */
+			if(aio == NULL) {
+				stop = B_TRUE;
+			}
+			else if(aio == (io_file_aio_t*) &io_file_aio_cancelled) {
+				continue;
+			}
+			else {
+				io_file_aio_finish(aio, cqe->res);
+			}
+
+			++count;
+		}
+
+		io_uring_cq_advance(&engine->aio_ring, reaped);
+
+		return (stop) ? -1 : count;
+	}
+#endif
+
+#ifdef HAVE_LIBAIO
+	{
+		struct timespec timeout;
+		int i;
+
+		timeout.tv_sec = IOF_AIO_REAP_TIMEOUT / T_SEC;
+		timeout.tv_nsec = IOF_AIO_REAP_TIMEOUT % T_SEC;
+
+		ret = io_getevents(engine->aio_ctx, 1, engine->aio_iodepth,
+						   engine->aio_events, &timeout);
+
+		for(i = 0; i < ret; ++i) {
+			io_file_aio_finish((io_file_aio_t*) engine->aio_events[i].data,
+							   (long) engine->aio_events[i].res);
+		}
+
+		count = (ret > 0) ? ret : 0;
+
+		if(count == 0 && engine->aio_stopping)
+			return -1;
+	}
+#endif
+
+	return count;
+}
+
+static thread_result_t io_file_aio_reaper_thread(thread_arg_t arg) {
+	THREAD_ENTRY(arg, io_file_aio_engine_t, engine);
+	int count;
+
+	while(B_TRUE) {
+		count = io_file_aio_reap(engine);
+
+		if(count < 0) {
+			THREAD_EXIT(0);
+		}
+
+		if(count == 0)
+			continue;
+
+		mutex_lock(&engine->aio_lock);
+
+		engine->aio_inflight -= count;
+		io_file_aio_flush(engine);
+
+		cv_notify_all(&engine->aio_cv);
+		mutex_unlock(&engine->aio_lock);
+	}
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+static int io_file_aio_setup(io_file_t* iof, io_file_aio_engine_t* engine) {
+	int ret = -ENOSYS;
+
+#ifdef HAVE_LIBURING
+	ret = io_uring_queue_init(engine->aio_iodepth, &engine->aio_ring, 0);
+	if(ret == 0) {
+		engine->aio_type = IOF_AIO_URING;
+		engine->aio_cancelled = 0;
+		return 0;
+	}
+#endif
+
+#ifdef HAVE_LIBAIO
+	memset(&engine->aio_ctx, 0, sizeof(io_context_t));
+
+	ret = io_setup(engine->aio_iodepth, &engine->aio_ctx);
+	if(ret == 0) {
+		engine->aio_type = IOF_AIO_LIBAIO;
+		engine->aio_iocbs = mp_malloc(engine->aio_iodepth * sizeof(struct iocb*));
+		engine->aio_events = mp_malloc(engine->aio_iodepth * sizeof(struct io_event));
+		return 0;
+	}
+#endif
+
+	aas_printf(&iof->iof_error_msg, "Failed to initialize asynchronous I/O for '%s': %s",
+			   iof->iof_path, strerror(-ret));
+
+	return -1;
+}
+
+PLATAPI int io_file_aio_init(io_file_t* iof, int iodepth, int batch) {
+	io_file_aio_engine_t* engine = mp_malloc(sizeof(io_file_aio_engine_t));
+
+	engine->aio_iodepth = iodepth;
+	engine->aio_batch = max(batch, 1);
+	engine->aio_inflight = 0;
+	engine->aio_queued = 0;
+	engine->aio_stopping = B_FALSE;
+
+	if(io_file_aio_setup(iof, engine) != 0) {
+		mp_free(engine);
+		return -1;
+	}
+
+	engine->aio_queue = mp_malloc(iodepth * sizeof(io_file_aio_t*));
+
+	mutex_init(&engine->aio_lock, "iof-aio-%d", iof->iof_impl.fd);
+	cv_init(&engine->aio_cv, "iof-aio-%d", iof->iof_impl.fd);
+
+	iof->iof_impl.aio = engine;
+
+	t_init(&engine->aio_reaper, engine, io_file_aio_reaper_thread,
+		   "iof-aio-%d", iof->iof_impl.fd);
+
+	return 0;
+}
+
+PLATAPI void io_file_aio_destroy(io_file_t* iof) {
+	io_file_aio_engine_t* engine = iof->iof_impl.aio;
+
+	if(engine == NULL)
+		return;
+
+	mutex_lock(&engine->aio_lock);
+
+	while(engine->aio_inflight > 0)
+		cv_wait(&engine->aio_cv, &engine->aio_lock);
+
+	engine->aio_stopping = B_TRUE;
+
+#ifdef HAVE_LIBURING
+	if(engine->aio_type == IOF_AIO_URING) {
+		struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->aio_ring);
+
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		io_uring_submit(&engine->aio_ring);
+	}
+#endif
+
+	mutex_unlock(&engine->aio_lock);
+
+	t_destroy(&engine->aio_reaper);
+
+#ifdef HAVE_LIBURING
+	if(engine->aio_type == IOF_AIO_URING)
+		io_uring_queue_exit(&engine->aio_ring);
+#endif
+
+#ifdef HAVE_LIBAIO
+	if(engine->aio_type == IOF_AIO_LIBAIO) {
+		io_destroy(engine->aio_ctx);
+		mp_free(engine->aio_iocbs);
+		mp_free(engine->aio_events);
+	}
+#endif
+
+	cv_destroy(&engine->aio_cv);
+	mutex_destroy(&engine->aio_lock);
+
+	mp_free(engine->aio_queue);
+	mp_free(engine);
+	iof->iof_impl.aio = NULL;
+}
+
+PLATAPI int io_file_aio_submit(io_file_t* iof, io_file_aio_t* aio) {
+	io_file_aio_engine_t* engine = iof->iof_impl.aio;
+	int fd = iof->iof_impl.fd;
+
+	mutex_lock(&engine->aio_lock);
+
+	/* Wait for free slot in queue */
+	while(engine->aio_inflight == engine->aio_iodepth)
+		cv_wait(&engine->aio_cv, &engine->aio_lock);
+
+#ifdef HAVE_LIBURING
+	if(engine->aio_type == IOF_AIO_URING) {
+		struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->aio_ring);
+
+		/* SQ ring may be filled with entries of failed operations */
+		if(sqe == NULL) {
+			mutex_unlock(&engine->aio_lock);
+			return -1;
+		}
+
+		if(aio->aio_write) {
+			io_uring_prep_write(sqe, fd, aio->aio_buffer, aio->aio_count, aio->aio_offset);
+		}
+		else {
+			io_uring_prep_read(sqe, fd, aio->aio_buffer, aio->aio_count, aio->aio_offset);
+		}
+
+		io_uring_sqe_set_data(sqe, aio);
+		aio->aio_impl.sqe = sqe;
+	}
+#endif
+
+#ifdef HAVE_LIBAIO
+	if(engine->aio_type == IOF_AIO_LIBAIO) {
+		struct iocb* iocb = &aio->aio_impl.iocb;
+
+		if(aio->aio_write) {
+			io_prep_pwrite(iocb, fd, aio->aio_buffer, aio->aio_count, aio->aio_offset);
+		}
+		else {
+			io_prep_pread(iocb, fd, aio->aio_buffer, aio->aio_count, aio->aio_offset);
+		}
+
+		iocb->data = aio;
+		engine->aio_iocbs[engine->aio_queued] = iocb;
+	}
+#endif
+
+	engine->aio_queue[engine->aio_queued] = aio;
+
+	++engine->aio_queued;
+	++engine->aio_inflight;
+
+	/* If nothing is in flight, there is no completion that will flush
+	 * this operation, so submit it right now */
+	if(engine->aio_queued >= engine->aio_batch ||
+	   engine->aio_queued == engine->aio_inflight) {
+		io_file_aio_flush(engine);
+	}
+
+	mutex_unlock(&engine->aio_lock);
+
+	return 0;
+}
+
+#else
+
+PLATAPI int io_file_aio_init(io_file_t* iof, int iodepth, int batch) {
+	if(iof->iof_error_msg == NULL) {
+		aas_printf(&iof->iof_error_msg, "Asynchronous I/O is not supported for '%s': "
+				   "TSLoad was built without io_uring and libaio", iof->iof_path);
+	}
+
+	return -1;
+}
+
+PLATAPI void io_file_aio_destroy(io_file_t* iof) {
+
+}
+
+PLATAPI int io_file_aio_submit(io_file_t* iof, io_file_aio_t* aio) {
+	return -1;
+}
+
+#endif
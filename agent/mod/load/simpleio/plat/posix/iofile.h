@@ -21,9 +21,33 @@
 #ifndef PLAT_POSIX_IOFILE_H_
 #define PLAT_POSIX_IOFILE_H_
 
+#include <tsload/defs.h>
+
+#ifdef HAVE_LIBAIO
+#include <libaio.h>
+#endif
+
+struct io_file_aio_engine;
+struct io_uring_sqe;
+
 typedef struct {
 	int fd;
+
+	struct io_file_aio_engine* aio;
 } plat_io_file_t;
 
+typedef struct {
+#ifdef HAVE_LIBURING
+	/* Entry of submission queue while operation is queued */
+	struct io_uring_sqe* sqe;
+#endif
+#ifdef HAVE_LIBAIO
+	struct iocb iocb;
+#endif
+#if !defined(HAVE_LIBURING) && !defined(HAVE_LIBAIO)
+	int unused;
+#endif
+} plat_io_file_aio_t;
+
 #endif /* IOFILE_H_ */
 
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <errno.h>
 
 #include <windows.h>
@@ -73,11 +74,12 @@ PLATAPI int io_file_stat(io_file_t* iof)
 	return 0;
 }
 
-PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync) {
+PLATAPI int io_file_open(io_file_t* iof, boolean_t rdwr, boolean_t sync, boolean_t direct) {
 	DWORD access = GENERIC_READ | ((rdwr) ? GENERIC_WRITE : 0);
 	DWORD share = FILE_SHARE_READ | 
 				  ((rdwr || iof->iof_file_type == IOF_BLOCKDEV) ? FILE_SHARE_WRITE : 0);
-	DWORD flags = (sync)?  FILE_FLAG_WRITE_THROUGH : 0;
+	DWORD flags = ((sync)?  FILE_FLAG_WRITE_THROUGH : 0) |
+				  ((direct)? FILE_FLAG_NO_BUFFERING : 0);
 	DWORD creat = (iof->iof_exists || iof->iof_file_type == IOF_BLOCKDEV) 
 						? OPEN_EXISTING : CREATE_NEW;
 	
@@ -138,6 +140,24 @@ PLATAPI int io_file_seek(io_file_t* iof, uint64_t where) {
 	return 0;
 }
 
+PLATAPI int io_file_allocate(io_file_t* iof, uint64_t size) {
+	LARGE_INTEGER where;
+	
+	where.QuadPart = (LONGLONG) size;
+	
+	if(!SetFilePointerEx(iof->iof_impl.hdl, where, NULL, FILE_BEGIN) ||
+	   !SetEndOfFile(iof->iof_impl.hdl)) {
+		if(iof->iof_error_msg == NULL) {
+			aas_printf(&iof->iof_error_msg, "Failed to SetEndOfFile('%s', %" PRId64 "): error %d", 
+					   iof->iof_path, size, GetLastError());
+		}
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
 PLATAPI int io_file_pread(io_file_t* iof, void* buffer, size_t count, uint64_t offset) {
 	DWORD nbytes;
 	OVERLAPPED overlapped;
@@ -174,3 +194,28 @@ PLATAPI int io_file_pwrite(io_file_t* iof, void* buffer, size_t count, uint64_t
 	return (int) nbytes;
 }
 
+
+PLATAPI void* io_file_alloc_buffer(size_t size, size_t align) {
+	return _aligned_malloc(size, align);
+}
+
+PLATAPI void io_file_free_buffer(void* buffer) {
+	_aligned_free(buffer);
+}
+
+PLATAPI int io_file_aio_init(io_file_t* iof, int iodepth, int batch) {
+	if(iof->iof_error_msg == NULL) {
+		aas_printf(&iof->iof_error_msg, "Asynchronous I/O is not supported for '%s'", 
+				   iof->iof_path);
+	}
+	
+	return -1;
+}
+
+PLATAPI void io_file_aio_destroy(io_file_t* iof) {
+	
+}
+
+PLATAPI int io_file_aio_submit(io_file_t* iof, io_file_aio_t* aio) {
+	return -1;
+}
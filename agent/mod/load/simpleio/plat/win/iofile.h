@@ -27,5 +27,9 @@ typedef struct {
 	HANDLE hdl;
 } plat_io_file_t;
 
+typedef struct {
+	int unused;
+} plat_io_file_aio_t;
+
 #endif 
 
@@ -29,6 +29,7 @@
 #include <tsload/plat/posixdecl.h>
 
 #include <tsload/load/workload.h>
+#include <tsload/load/threadpool.h>
 
 #include <hostinfo/diskinfo.h>
 #include <hostinfo/fsinfo.h>
@@ -54,6 +55,18 @@ size_t simpleio_max_block_size = 64 * SZ_MB;
 /** Tunable: maximum free space that fileio file may occupy (in percent)*/
 int fileio_size_threshold = 90;
 
+/** Tunable: maximum number of asynchronous operations submitted at once */
+int simpleio_aio_batch = 8;
+
+/** Tunable: number of threads writing fileio file during preparation */
+int fileio_prep_threads = 4;
+
+/** Tunable: size of block used to write fileio file during preparation */
+size_t fileio_prep_block_size = 4 * SZ_MB;
+
+/** Size of sector stamped by `rotate` option */
+#define SIMPLEIO_SECTOR_SIZE	512
+
 MODEXPORT wlp_descr_t simpleio_common_params[] = {
 	/* Common workload parameters */
 	{ WLP_BOOL, WLPF_OPTIONAL,
@@ -63,6 +76,28 @@ MODEXPORT wlp_descr_t simpleio_common_params[] = {
 		"Use synchronious I/O",
 		0
 	},
+	{ WLP_INTEGER, WLPF_OPTIONAL,
+		WLP_INT_RANGE(1, SIMPLEIO_MAX_IODEPTH),
+		WLP_INT_DEFAULT(1),
+		"iodepth",
+		"Number of asynchronous I/O requests in flight (1 means that requests are serviced synchronously)",
+		0
+	},
+	{ WLP_BOOL, WLPF_OPTIONAL,
+		WLP_NO_RANGE(),
+		WLP_BOOLEAN_DEFAULT(B_FALSE),
+		"direct",
+		"Use direct I/O bypassing page cache (offsets and block sizes are aligned to page size)",
+		0
+	},
+	{ WLP_BOOL, WLPF_OPTIONAL,
+		WLP_NO_RANGE(),
+		WLP_BOOLEAN_DEFAULT(B_TRUE),
+		"rotate",
+		"Stamp written blocks with per-request values so they are not deduplicated "
+		"(if disabled, all requests write same pre-generated pattern)",
+		0
+	},
 	
 	/* Common request parameters */
 	{ WLP_STRING_SET, WLPF_REQUEST,
@@ -110,6 +145,13 @@ MODEXPORT wlp_descr_t fileio_extra_params[] = {
 		"Overwrite file if it is already exists",
 		offsetof(struct fileio_workload, overwrite)
 	},
+	{ WLP_BOOL, WLPF_OPTIONAL,
+		WLP_NO_RANGE(),
+		WLP_BOOLEAN_DEFAULT(B_FALSE),
+		"preallocate",
+		"Allocate file without writing data to it if filesystem supports it",
+		offsetof(struct fileio_workload, preallocate)
+	},
 	{ WLP_SIZE, WLPF_NO_FLAGS,
 		WLP_NO_RANGE(),
 		WLP_NO_DEFAULT(),
@@ -160,40 +202,170 @@ static uint64_t simpleio_get_pagesz(void) {
 	return 4096;
 }
 
+/**
+ * Fill block with some data to confuse deduplication/compression
+ */
+static void simpleio_fill_block(void* block, size_t blksz, uint32_t seed) {
+	uint32_t* blkdata = (uint32_t*) block;
+	size_t i;
+	
+	for(i = 0; i < blksz / sizeof(uint32_t); ++i) {
+		*blkdata = ((uint32_t)(uintptr_t) blkdata) ^ seed;
+		seed = ~seed + (seed & 0x7fff);
+		++blkdata;
+	}
+}
+
+/**
+ * Writer thread which fills range of file during preparation
+ */
+typedef struct simpleio_writer {
+	thread_t sw_thread;
+	
+	struct simpleio_writer_ctl* sw_ctl;
+	
+	uint64_t sw_start;
+	uint64_t sw_end;
+	
+	int sw_ret;
+} simpleio_writer_t;
+
+typedef struct simpleio_writer_ctl {
+	io_file_t* ctl_iof;
+	size_t ctl_block_size;
+	size_t ctl_align;
+	
+	/* Number of written blocks */
+	atomic_t ctl_written;
+	boolean_t ctl_failed;
+	
+	int ctl_finished;
+	thread_mutex_t ctl_mutex;
+	thread_cv_t ctl_cv;
+} simpleio_writer_ctl_t;
+
+static thread_result_t simpleio_writer_thread(thread_arg_t arg) {
+	THREAD_ENTRY(arg, simpleio_writer_t, writer);
+	simpleio_writer_ctl_t* ctl = writer->sw_ctl;
+	
+	size_t blksz = ctl->ctl_block_size;
+	void* block = io_file_alloc_buffer(blksz, ctl->ctl_align);
+	uint64_t off = writer->sw_start;
+	size_t count;
+	
+	writer->sw_ret = 0;
+	
+	if(block == NULL) {
+		writer->sw_ret = -1;
+	}
+	else {
+		simpleio_fill_block(block, blksz, (uint32_t) writer->sw_start);
+		
+		for( ; off < writer->sw_end && !ctl->ctl_failed; off += count) {
+			count = (size_t) min(blksz, writer->sw_end - off);
+			
+			if(io_file_pwrite(ctl->ctl_iof, block, count, off) != count) {
+				writer->sw_ret = -1;
+				break;
+			}
+			
+			atomic_inc(&ctl->ctl_written);
+		}
+		
+		io_file_free_buffer(block);
+	}
+	
+	mutex_lock(&ctl->ctl_mutex);
+	if(writer->sw_ret != 0)
+		ctl->ctl_failed = B_TRUE;
+	++ctl->ctl_finished;
+	cv_notify_one(&ctl->ctl_cv);
+	mutex_unlock(&ctl->ctl_mutex);
+	
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
 /**
  * Fill file iof with raw data
+ * 
+ * File is split into disjoint ranges, each is written by its own thread with 
+ * large page-aligned blocks (tunables `fileio_prep_threads` and `fileio_prep_block_size`),
+ * while configuring thread reports progress.
  */
 int simpleio_write_file(workload_t* wl, struct fileio_workload* fiowl, struct simpleio_wldata* simpleio) {
-	/* Use page cache as a default block size to tolerate page cache */
 	uint64_t pgsz = simpleio_get_pagesz();
-	void* block = mp_malloc(pgsz);
-	io_file_t* iof = &simpleio->iof;
+	size_t blksz = max((fileio_prep_block_size / pgsz) * pgsz, pgsz);
+	
+	/* Only full pages are written */
+	uint64_t size = (fiowl->file_size / pgsz) * pgsz;
+	uint64_t num_blocks = (size + blksz - 1) / blksz;
+	uint64_t blocks_per_thread;
+	
+	simpleio_writer_ctl_t ctl;
+	simpleio_writer_t* writers;
+	int num_threads = (int) min(max(fileio_prep_threads, 1), max(num_blocks, 1));
+	int i, ret = 0;
 	
-	size_t i = 0, last = fiowl->file_size / pgsz;
-	off_t off = 0;
-	float one_percent = ((float) last) / 99;
 	int last_notify = 0, done = 1;
-
-	for(i = 0; i < last; ++i) {
-		if(io_file_pwrite(iof, block, pgsz, off) == -1) {
-			wl_notify(wl, WLS_CFG_FAIL, 0, "Failed to write to file '%s'", fiowl->path);
-			mp_free(block);
-			return -1;
-		}
+	uint64_t written;
+	
+	if(size == 0)
+		return 0;
+	
+	ctl.ctl_iof = &simpleio->iof;
+	ctl.ctl_block_size = blksz;
+	ctl.ctl_align = pgsz;
+	ctl.ctl_written = (atomic_t) 0l;
+	ctl.ctl_failed = B_FALSE;
+	ctl.ctl_finished = 0;
+	mutex_init(&ctl.ctl_mutex, "sio-%s-prep", wl->wl_name);
+	cv_init(&ctl.ctl_cv, "sio-%s-prep", wl->wl_name);
+	
+	/* Ranges are aligned to block size, so writers use aligned offsets */
+	blocks_per_thread = num_blocks / num_threads;
+	writers = mp_malloc(num_threads * sizeof(simpleio_writer_t));
+	
+	for(i = 0; i < num_threads; ++i) {
+		writers[i].sw_ctl = &ctl;
+		writers[i].sw_start = i * blocks_per_thread * blksz;
+		writers[i].sw_end = (i == num_threads - 1) 
+								? size 
+								: (i + 1) * blocks_per_thread * blksz;
+		
+		t_init(&writers[i].sw_thread, &writers[i], simpleio_writer_thread, 
+			   "sio-%s-prep-%d", wl->wl_name, i);
+	}
+	
+	mutex_lock(&ctl.ctl_mutex);
+	while(ctl.ctl_finished < num_threads) {
+		cv_wait_timed(&ctl.ctl_cv, &ctl.ctl_mutex, T_SEC / 10);
 		
-		off += pgsz;
+		written = (uint64_t) atomic_read(&ctl.ctl_written);
+		done = (int) (written * 99 / num_blocks);
 		
-		done = (int) (i / one_percent);
-
-		if(done > last_notify) {
-			wl_notify(wl, WLS_CONFIGURING, done, "Written %" PRIu64 " bytes", (uint64_t) i * pgsz);
+		if(done > last_notify && !ctl.ctl_failed) {
+			wl_notify(wl, WLS_CONFIGURING, done, "Written %" PRIu64 " bytes", 
+					  min(written * blksz, size));
 			last_notify = done;
 		}
 	}
-
-	mp_free(block);
+	mutex_unlock(&ctl.ctl_mutex);
 	
-	return 0;
+	for(i = 0; i < num_threads; ++i) {
+		t_destroy(&writers[i].sw_thread);
+	}
+	
+	if(ctl.ctl_failed) {
+		wl_notify(wl, WLS_CFG_FAIL, 0, "Failed to write to file '%s'", fiowl->path);
+		ret = -1;
+	}
+	
+	mp_free(writers);
+	cv_destroy(&ctl.ctl_cv);
+	mutex_destroy(&ctl.ctl_mutex);
+	
+	return ret;
 }
 
 /**
@@ -271,7 +443,7 @@ int simpleio_prepare_file(workload_t* wl, struct fileio_workload* fiowl, struct
 
 	logmsg(LOG_INFO, "Creating file '%s' with size %" PRIu64, fiowl->path, (uint64_t) fiowl->file_size);
 
-	ret = io_file_open(iof, B_TRUE, fiowl->sync);
+	ret = io_file_open(iof, B_TRUE, fiowl->sync, fiowl->direct);
 	if(ret < 0)
 		goto iof_error;
 	
@@ -288,12 +460,34 @@ int simpleio_prepare_file(workload_t* wl, struct fileio_workload* fiowl, struct
 	
 	if(fiowl->sparse) {
 		char eof = 3;
+		uint64_t pgsz;
+		void* block;
 		
 		ret = io_file_seek(iof, fiowl->file_size);
 		if(ret < 0)
 			goto iof_error;
 		
-		if(io_file_pwrite(iof, &eof, 1, fiowl->file_size) == -1) {
+		if(!fiowl->direct) {
+			ret = io_file_pwrite(iof, &eof, 1, fiowl->file_size);
+		}
+		else {
+			/* Direct I/O requires aligned writes, so write last full page instead. 
+			 * Like simpleio_write_file(), it doesn't write partial page at the end
+			 * of file, so file doesn't grow beyond file_size. */
+			pgsz = simpleio_get_pagesz();
+			
+			if(fiowl->file_size < pgsz)
+				return 0;
+			
+			block = io_file_alloc_buffer(pgsz, pgsz);
+			
+			memset(block, eof, pgsz);
+			ret = io_file_pwrite(iof, block, pgsz, (fiowl->file_size / pgsz - 1) * pgsz);
+			
+			io_file_free_buffer(block);
+		}
+		
+		if(ret == -1) {
 			wl_notify(wl, WLS_CFG_FAIL, 0, "Failed to write to file '%s'", fiowl->path);
 			goto error;
 		}
@@ -301,6 +495,16 @@ int simpleio_prepare_file(workload_t* wl, struct fileio_workload* fiowl, struct
 		return 0;
 	}
 	
+	if(fiowl->preallocate) {
+		ret = io_file_allocate(iof, fiowl->file_size);
+		if(ret == 0)
+			return 0;
+		
+		/* Filesystem doesn't support allocation, fall back to writing file */
+		logmsg(LOG_WARN, "%s, writing file instead", iof->iof_error_msg);
+		aas_free(&iof->iof_error_msg);
+	}
+	
 	ret = simpleio_write_file(wl, fiowl, simpleio);
 	if(ret < 0)
 		io_file_close(&simpleio->iof, B_TRUE);
@@ -315,6 +519,183 @@ error:
 	return -1;
 }
 
+/**
+ * Stamp each sector of the block with value unique for request. Much cheaper
+ * than regenerating pattern, but written blocks still differ.
+ */
+static void simpleio_rotate_block(void* block, size_t blksz, uint64_t seed) {
+	char* sector = (char*) block;
+	char* end = sector + blksz;
+	
+	for( ; sector + sizeof(uint64_t) <= end; sector += SIMPLEIO_SECTOR_SIZE) {
+		memcpy(sector, &seed, sizeof(uint64_t));
+		++seed;
+	}
+}
+
+static simpleio_buffer_t* simpleio_create_buffer(struct simpleio_wldata* simpleio, int worker) {
+	simpleio_buffer_t* buf = mp_malloc(sizeof(simpleio_buffer_t));
+	
+	buf->sb_next = NULL;
+	buf->sb_worker = worker;
+	buf->sb_rq = NULL;
+	
+	buf->sb_data = io_file_alloc_buffer(simpleio->block_size, simpleio->pgsz);
+	if(buf->sb_data == NULL) {
+		mp_free(buf);
+		return NULL;
+	}
+	
+	buf->sb_size = simpleio->block_size;
+	simpleio_fill_block(buf->sb_data, buf->sb_size, (uint32_t)(uintptr_t) buf);
+	
+	return buf;
+}
+
+static void simpleio_destroy_buffer(simpleio_buffer_t* buf) {
+	io_file_free_buffer(buf->sb_data);
+	mp_free(buf);
+}
+
+STATIC_INLINE simpleio_buffer_t* simpleio_take_buffer(simpleio_buffer_list_t* list) {
+	simpleio_buffer_t* buf;
+	
+	mutex_lock(&list->sbl_lock);
+	buf = list->sbl_free;
+	if(buf != NULL)
+		list->sbl_free = buf->sb_next;
+	mutex_unlock(&list->sbl_lock);
+	
+	return buf;
+}
+
+/**
+ * Take buffer from worker's free list. If worker has all its buffers in flight,
+ * buffer is taken from other workers. Pool is sized in simpleio_init_buffers()
+ * so it never runs out and request path doesn't allocate memory.
+ */
+static simpleio_buffer_t* simpleio_get_buffer(struct simpleio_wldata* simpleio, int worker) {
+	simpleio_buffer_t* buf;
+	int wi;
+	
+	buf = simpleio_take_buffer(simpleio->buffers + worker);
+	
+	for(wi = 1; buf == NULL && wi < simpleio->num_workers; ++wi) {
+		buf = simpleio_take_buffer(simpleio->buffers + 
+								   (worker + wi) % simpleio->num_workers);
+	}
+	
+	return buf;
+}
+
+static void simpleio_put_buffer(struct simpleio_wldata* simpleio, simpleio_buffer_t* buf) {
+	simpleio_buffer_list_t* list = simpleio->buffers + buf->sb_worker;
+	
+	mutex_lock(&list->sbl_lock);
+	buf->sb_next = list->sbl_free;
+	list->sbl_free = buf;
+	mutex_unlock(&list->sbl_lock);
+}
+
+/**
+ * Preallocate buffers for each worker of workload's threadpool. Buffers are large
+ * enough for maximum block size that may be generated for requests (capped by
+ * simpleio_max_block_size), so they are never reallocated. 
+ * 
+ * Each worker holds at most one buffer which is not in flight, while engine keeps 
+ * up to iodepth operations in flight, so one buffer per worker is enough for 
+ * synchronous I/O and iodepth + num_workers buffers are enough for asynchronous I/O.
+ */
+static int simpleio_init_buffers(workload_t* wl, struct simpleio_wldata* simpleio, 
+								 wlp_integer_t iodepth, boolean_t direct, boolean_t rotate) {
+	simpleio_buffer_list_t* list;
+	simpleio_buffer_t* buf;
+	wlp_integer_t max_block_size;
+	size_t block_size = simpleio_max_block_size;
+	int worker, i, count;
+	
+	simpleio->pgsz = simpleio_get_pagesz();
+	simpleio->align = (direct) ? simpleio->pgsz : 1;
+	simpleio->rotate = rotate;
+	
+	if(wlpgen_get_max_integer(wl, "block_size", &max_block_size) && max_block_size > 0)
+		block_size = min((size_t) max_block_size, simpleio_max_block_size);
+	
+	/* Round up to page size to keep aligned block sizes */
+	simpleio->block_size = (block_size + simpleio->pgsz - 1) & ~(simpleio->pgsz - 1);
+	
+	simpleio->num_workers = (wl->wl_tp != NULL) ? wl->wl_tp->tp_num_threads : 1;
+	simpleio->buffers = mp_malloc(simpleio->num_workers * sizeof(simpleio_buffer_list_t));
+	
+	count = (iodepth <= 1) ? 1 :
+			(iodepth + simpleio->num_workers - 1) / simpleio->num_workers + 1;
+	
+	for(worker = 0; worker < simpleio->num_workers; ++worker) {
+		list = simpleio->buffers + worker;
+		
+		mutex_init(&list->sbl_lock, "sio-%s-%d", wl->wl_name, worker);
+		list->sbl_free = NULL;
+		
+		for(i = 0; i < count; ++i) {
+			buf = simpleio_create_buffer(simpleio, worker);
+			if(buf == NULL) {
+				wl_notify(wl, WLS_CFG_FAIL, 0, "Failed to allocate I/O buffers");
+				
+				simpleio->num_workers = worker + 1;
+				return -1;
+			}
+			
+			simpleio_put_buffer(simpleio, buf);
+		}
+	}
+	
+	return 0;
+}
+
+static void simpleio_destroy_buffers(struct simpleio_wldata* simpleio) {
+	simpleio_buffer_list_t* list;
+	simpleio_buffer_t* buf;
+	int worker;
+	
+	for(worker = 0; worker < simpleio->num_workers; ++worker) {
+		list = simpleio->buffers + worker;
+		
+		while(list->sbl_free != NULL) {
+			buf = list->sbl_free;
+			list->sbl_free = buf->sb_next;
+			
+			simpleio_destroy_buffer(buf);
+		}
+		
+		mutex_destroy(&list->sbl_lock);
+	}
+	
+	mp_free(simpleio->buffers);
+}
+
+/**
+ * Start asynchronous I/O engine if workload asks for more than one
+ * request in flight. Called after file was opened.
+ */
+static int simpleio_init_aio(workload_t* wl, struct simpleio_wldata* simpleio, wlp_integer_t iodepth) {
+	io_file_t* iof = &simpleio->iof;
+
+	simpleio->async = B_FALSE;
+
+	if(iodepth <= 1)
+		return 0;
+
+	if(io_file_aio_init(iof, iodepth, simpleio_aio_batch) != 0) {
+		wl_notify(wl, WLS_CFG_FAIL, 0,
+				  (iof->iof_error_msg) ? iof->iof_error_msg : "Unknown iofile error");
+		return -1;
+	}
+
+	simpleio->async = B_TRUE;
+
+	return 0;
+}
+
 MODEXPORT int fileio_wl_config(workload_t* wl) {
 	int ret;
 	
@@ -327,6 +708,22 @@ MODEXPORT int fileio_wl_config(workload_t* wl) {
 		return -1;
 	}
 	
+	ret = simpleio_init_buffers(wl, simpleio, fiowl->iodepth, fiowl->direct, fiowl->rotate);
+	if(ret != 0) {
+		simpleio_destroy_buffers(simpleio);
+		io_file_close(&simpleio->iof, simpleio->do_remove);
+		mp_free(simpleio);
+		return -1;
+	}
+	
+	ret = simpleio_init_aio(wl, simpleio, fiowl->iodepth);
+	if(ret != 0) {
+		simpleio_destroy_buffers(simpleio);
+		io_file_close(&simpleio->iof, simpleio->do_remove);
+		mp_free(simpleio);
+		return -1;
+	}
+	
 	wl_notify(wl, WLS_CONFIGURING, 99, "Prepared file '%s'", fiowl->path);
 	
 	wl->wl_private = simpleio;
@@ -396,12 +793,26 @@ MODEXPORT int diskio_wl_config(workload_t* wl) {
 	
 	/* TODO: Check access flags */
 	
-	ret = io_file_open(iof, diowl->rdwr, diowl->sync);
+	ret = io_file_open(iof, diowl->rdwr, diowl->sync, diowl->direct);
 	if(ret < 0)
 		goto iof_error;
 	
 	simpleio->do_remove = B_FALSE;
 	
+	ret = simpleio_init_buffers(wl, simpleio, diowl->iodepth, diowl->direct, diowl->rotate);
+	if(ret != 0) {
+		simpleio_destroy_buffers(simpleio);
+		io_file_close(&simpleio->iof, B_FALSE);
+		goto error;
+	}
+	
+	ret = simpleio_init_aio(wl, simpleio, diowl->iodepth);
+	if(ret != 0) {
+		simpleio_destroy_buffers(simpleio);
+		io_file_close(&simpleio->iof, B_FALSE);
+		goto error;
+	}
+	
 	diskio_wl_notify(wl, di);
 	
 	wl->wl_private = simpleio;
@@ -421,7 +832,10 @@ MODEXPORT int simpleio_wl_unconfig(workload_t* wl) {
 	struct simpleio_wldata* simpleio = (struct simpleio_wldata*) wl->wl_private;
 	
 	if(simpleio) {
+		/* Closing file waits for asynchronous requests, so
+		 * all buffers are returned to pool after that */
 		io_file_close(&simpleio->iof, simpleio->do_remove);
+		simpleio_destroy_buffers(simpleio);
 		mp_free(simpleio);
 	}
 	
@@ -430,45 +844,87 @@ MODEXPORT int simpleio_wl_unconfig(workload_t* wl) {
 	return 0;
 }
 
-static void* simpleio_create_block(size_t blksz, uint32_t seed) {
-	void* block = mp_malloc(blksz);
+static void simpleio_aio_complete(io_file_aio_t* aio) {
+	simpleio_buffer_t* buf = (simpleio_buffer_t*) aio->aio_private;
+	request_t* rq = buf->sb_rq;
+	struct simpleio_wldata* simpleio = (struct simpleio_wldata*) rq->rq_workload->wl_private;
+	int ret = (aio->aio_result == aio->aio_count)? 0 : -1;
 	
-	/* Fill block with some data to confuse deduplication/compression */
-	uint32_t* blkdata = (uint32_t*) block;
-	size_t i;
+	/* Operation could wait in engine's queue for a batch, so start
+	 * request when it was actually submitted to the kernel */
+	rq->rq_start_time = aio->aio_submit_time - rq->rq_workload->wl_start_clock;
 	
-	for(i = 0; i < blksz / sizeof(uint32_t); ++i) {
-		*blkdata = ((uint32_t)(uintptr_t) blkdata) ^ seed;
-		seed = ~seed + (seed & 0x7fff);
-		++blkdata;
+	simpleio_put_buffer(simpleio, buf);
+	
+	wl_request_complete(rq, ret);
+}
+
+/**
+ * Submit request to asynchronous I/O engine. Buffer is returned
+ * to pool when request is completed in simpleio_aio_complete().
+ */
+static int simpleio_submit_request(request_t* rq, struct simpleio_wldata* simpleio, 
+								   simpleio_buffer_t* buf, size_t blksz) {
+	struct simpleio_request* siorq = (struct simpleio_request*) rq->rq_params;
+	io_file_aio_t* aio = &buf->sb_aio;
+	
+	buf->sb_rq = rq;
+	
+	aio->aio_buffer = buf->sb_data;
+	aio->aio_count = blksz;
+	aio->aio_offset = siorq->offset;
+	aio->aio_write = siorq->rw != 0;
+	aio->aio_complete = simpleio_aio_complete;
+	aio->aio_private = buf;
+	
+	if(io_file_aio_submit(&simpleio->iof, aio) != 0) {
+		simpleio_put_buffer(simpleio, buf);
+		return -1;
 	}
 	
-	return block;
+	return WLT_RUN_PENDING;
 }
 
 MODEXPORT int simpleio_run_request(request_t* rq) {
 	struct simpleio_wldata* simpleio = (struct simpleio_wldata*) rq->rq_workload->wl_private;
 	struct simpleio_request* siorq = (struct simpleio_request*) rq->rq_params;
 	
-	size_t blksz = min(siorq->block_size, simpleio_max_block_size);
+	size_t blksz = min(siorq->block_size, simpleio->block_size);
+	simpleio_buffer_t* buf;
 	
 	int ret;	
 	
-	void* block = simpleio_create_block(blksz, siorq->offset + rq->rq_step);
+	/* TODO: make aligning offset as parameter */
 	
-	/* TODO: make filling block and aligning offset as parameters */
+	/* Direct I/O needs aligned offsets and block sizes, for
+	 * buffered I/O align is 1 so it doesn't change them */
+	blksz = max(blksz & ~(simpleio->align - 1), simpleio->align);
 	
 	siorq->block_size = blksz;
 	siorq->offset = (siorq->offset * blksz) % (simpleio->iof.iof_file_size - blksz);
+	siorq->offset &= ~((wlp_integer_t) simpleio->align - 1);
+	
+	buf = simpleio_get_buffer(simpleio, (unsigned) rq->rq_thread_id % simpleio->num_workers);
+	if(buf == NULL)
+		return -1;
+	
+	if(siorq->rw != 0 && simpleio->rotate) {
+		simpleio_rotate_block(buf->sb_data, blksz, 
+							  ((uint64_t) rq->rq_step << 32) ^ (uint64_t) siorq->offset);
+	}
+	
+	if(simpleio->async) {
+		return simpleio_submit_request(rq, simpleio, buf, blksz);
+	}
 	
 	if(siorq->rw == 0) {
-		ret = io_file_pread(&simpleio->iof, block, blksz, siorq->offset);
+		ret = io_file_pread(&simpleio->iof, buf->sb_data, blksz, siorq->offset);
 	}
 	else {
-		ret = io_file_pwrite(&simpleio->iof, block, blksz, siorq->offset);
+		ret = io_file_pwrite(&simpleio->iof, buf->sb_data, blksz, siorq->offset);
 	}
 
-	mp_free(block);
+	simpleio_put_buffer(simpleio, buf);
 	
 	return (ret == blksz)? 0 : -1;
 }
@@ -537,16 +993,25 @@ MODEXPORT int mod_config(module_t* mod) {
 	
 	tuneit_set_int(size_t, simpleio_max_block_size);
 	tuneit_set_int(int, fileio_size_threshold);
+	tuneit_set_int(int, simpleio_aio_batch);
+	tuneit_set_int(int, fileio_prep_threads);
+	tuneit_set_int(size_t, fileio_prep_block_size);
 	
 	if(fileio_size_threshold > 100)
 		fileio_size_threshold = 100;
 	
 	fileio_wlt.wlt_params = simpleio_create_params(fileio_extra_params);
 	fileio_wlt.wlt_params[0].off = offsetof(struct fileio_workload, sync);
+	fileio_wlt.wlt_params[1].off = offsetof(struct fileio_workload, iodepth);
+	fileio_wlt.wlt_params[2].off = offsetof(struct fileio_workload, direct);
+	fileio_wlt.wlt_params[3].off = offsetof(struct fileio_workload, rotate);
 	wl_type_register(mod, &fileio_wlt);
 	
 	diskio_wlt.wlt_params = simpleio_create_params(diskio_extra_params);
 	diskio_wlt.wlt_params[0].off = offsetof(struct diskio_workload, sync);
+	diskio_wlt.wlt_params[1].off = offsetof(struct diskio_workload, iodepth);
+	diskio_wlt.wlt_params[2].off = offsetof(struct diskio_workload, direct);
+	diskio_wlt.wlt_params[3].off = offsetof(struct diskio_workload, rotate);
 	wl_type_register(mod, &diskio_wlt);
 
 	return 0;
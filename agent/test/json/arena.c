@@ -0,0 +1,208 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/json/json.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+/**
+ * Tests for arena-allocated documents and hash index of children
+ */
+
+#define NCHILDREN		200
+
+void dump_error(void);
+
+LIBIMPORT unsigned json_index_min_children;
+
+static json_buffer_t* create_wide_buffer(int count, boolean_t duplicate) {
+	char* data = mp_malloc(count * 32 + 64);
+	char* p = data;
+	int i;
+
+	p += sprintf(p, "{");
+	for(i = 0; i < count; ++i) {
+		p += sprintf(p, "%s\"attr%d\": %d", (i == 0) ? "" : ", ", i, i);
+	}
+
+	/* Duplicate of attr0 which should never be found */
+	if(duplicate)
+		p += sprintf(p, ", \"attr0\": -1");
+
+	p += sprintf(p, "}");
+
+	return json_buf_create(data, p - data, B_TRUE);
+}
+
+static void check_wide_node(json_node_t* obj, int count) {
+	char name[32];
+	int i, val;
+
+	for(i = 0; i < count; ++i) {
+		sprintf(name, "attr%d", i);
+
+		assert(json_get_integer_i(obj, name, &val) == JSON_OK);
+		assert(val == i);
+	}
+
+	assert(json_find_opt(obj, "attr") == NULL);
+	assert(json_find_opt(obj, "nonexistent") == NULL);
+}
+
+void test_arena_simple(void) {
+	json_buffer_t* buf = JSON_BUFFER(" { \"b\":true,  \"_int\":  10,   \"str\":\"hi\\tthere!\", "
+									 "\"arr\": [1, 2.5, null, {}] } ");
+	json_node_t* obj;
+	json_node_t* arr;
+
+	boolean_t b = B_FALSE;
+	int i = -1;
+	const char* s = "bye!";
+
+	assert(json_parse_ex(buf, &obj, JSON_PARSE_ARENA) == JSON_OK);
+	assert(json_size(obj) == 4);
+
+	assert(json_get_boolean(obj, "b", &b) == JSON_OK);
+	assert(b == B_TRUE);
+
+	assert(json_get_integer_i(obj, "_int", &i) == JSON_OK);
+	assert(i == 10);
+
+	assert(json_get_string(obj, "str", &s) == JSON_OK);
+	assert(strcmp(s, "hi\tthere!") == 0);
+
+	assert(json_get_array(obj, "arr", &arr) == JSON_OK);
+	assert(json_size(arr) == 4);
+	assert(json_as_double(json_getitem(arr, 1)) == 2.5);
+
+	assert(json_check_unused(obj) == JSON_OK);
+
+	json_node_destroy(obj);
+}
+
+/* Arena nodes may be mixed with heap nodes */
+void test_arena_mixed(void) {
+	json_buffer_t* buf = JSON_BUFFER(" { \"str\": \"hi!\", \"node\": { \"a\": 1 } } ");
+	json_node_t* obj;
+	json_node_t* node;
+	json_node_t* copy;
+
+	assert(json_parse_ex(buf, &obj, JSON_PARSE_ARENA) == JSON_OK);
+
+	json_add_string(obj, JSON_STR("const"), json_str_create("dynamic"));
+	json_set_string(json_find(obj, "str"), json_str_create("replaced"));
+
+	assert(json_get_node(obj, "node", &node) == JSON_OK);
+	copy = json_copy_node(node);
+
+	json_remove_node(obj, node);
+	json_node_destroy(node);
+
+	assert(json_size(obj) == 2);
+	assert(strcmp(json_as_string(json_find(obj, "const")), "dynamic") == 0);
+	assert(strcmp(json_as_string(json_find(obj, "str")), "replaced") == 0);
+
+	json_node_destroy(obj);
+
+	/* Copy outlives arena */
+	assert(json_as_integer(json_find(copy, "a")) == 1);
+	json_node_destroy(copy);
+}
+
+void test_arena_error(void) {
+	json_buffer_t* buf = JSON_BUFFER(" { \"a\": [1, 2, \"x\"],  \"b\":null ] ");
+	json_node_t* obj;
+
+	assert(json_parse_ex(buf, &obj, JSON_PARSE_ARENA) == JSON_OBJECT_INVALID);
+	assert(obj == NULL);
+
+	dump_error();
+}
+
+void test_index_find(boolean_t arena) {
+	json_buffer_t* buf = create_wide_buffer(NCHILDREN, B_TRUE);
+	json_node_t* obj;
+
+	assert(json_parse_ex(buf, &obj, arena ? JSON_PARSE_ARENA : JSON_PARSE_DEFAULT) == JSON_OK);
+	assert(json_size(obj) == NCHILDREN + 1);
+
+	check_wide_node(obj, NCHILDREN);
+	assert((obj->jn_index != NULL) == (json_index_min_children > 0));
+
+	json_node_destroy(obj);
+}
+
+/* Index should be updated when children are added or removed */
+void test_index_modify(void) {
+	json_buffer_t* buf = create_wide_buffer(NCHILDREN, B_FALSE);
+	json_node_t* obj;
+	json_node_t* node;
+	char name[32];
+	int i;
+
+	assert(json_parse(buf, &obj) == JSON_OK);
+	check_wide_node(obj, NCHILDREN);
+
+	for(i = NCHILDREN; i < 4 * NCHILDREN; ++i) {
+		sprintf(name, "attr%d", i);
+		json_add_integer(obj, json_str_create(name), i);
+
+		assert(json_as_integer(json_find(obj, name)) == i);
+	}
+
+	check_wide_node(obj, 4 * NCHILDREN);
+
+	node = json_find(obj, "attr10");
+	json_remove_node(obj, node);
+	json_node_destroy(node);
+
+	assert(json_find_opt(obj, "attr10") == NULL);
+	assert(json_as_integer(json_find(obj, "attr11")) == 11);
+
+	json_node_destroy(obj);
+}
+
+/* Lookup results should be same without index */
+void test_index_disabled(void) {
+	unsigned min_children = json_index_min_children;
+
+	json_index_min_children = 0;
+	test_index_find(B_FALSE);
+	json_index_min_children = min_children;
+}
+
+int json_test_main(void) {
+	test_arena_simple();
+	test_arena_mixed();
+	test_arena_error();
+
+	test_index_find(B_FALSE);
+	test_index_find(B_TRUE);
+	test_index_modify();
+	test_index_disabled();
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/json/json.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * Checks that vectorized scanners give same results and error
+ * positions as scalar one. Strings and whitespace runs are longer
+ * than vector width and special characters are put at each offset.
+ */
+
+#define MAXLEN		80
+
+void dump_error(void);
+
+const char* scanners[] = { "scalar", "sse2", "avx2", NULL };
+
+struct scan_result {
+	int ret;
+	int line;
+	size_t chr;
+	char str[MAXLEN * 2];
+	int64_t num;
+};
+
+static void scan_parse(const char* doc, struct scan_result* res) {
+	json_buffer_t* buf = json_buf_create((char*) doc, strlen(doc) + 1, B_FALSE);
+	json_node_t* root;
+	json_error_state_t* state;
+
+	memset(res, 0, sizeof(*res));
+
+	/* Exclude null-terminator */
+	buf->size = strlen(doc);
+
+	res->ret = json_parse(buf, &root);
+
+	if(res->ret != JSON_OK) {
+		state = json_get_error();
+
+		res->line = state->je_line;
+		res->chr = state->je_char;
+
+		return;
+	}
+
+	if(json_type(root) == JSON_NODE) {
+		json_get_string_copy(root, "s", res->str, MAXLEN * 2);
+		json_get_integer_i64(root, "n", &res->num);
+	}
+
+	json_node_destroy(root);
+}
+
+static void scan_compare(const char* doc) {
+	struct scan_result expected;
+	struct scan_result res;
+	int i;
+
+	json_select_scanner("scalar");
+	scan_parse(doc, &expected);
+
+	for(i = 1; scanners[i] != NULL; ++i) {
+		if(json_select_scanner(scanners[i]) != JSON_OK)
+			continue;
+
+		scan_parse(doc, &res);
+
+		if(res.ret != expected.ret || res.line != expected.line ||
+		   res.chr != expected.chr || res.num != expected.num ||
+		   strcmp(res.str, expected.str) != 0) {
+			fprintf(stderr, "Scanner %s mismatch on '%s': %d %d:%d '%s' != %d %d:%d '%s'\n",
+					scanners[i], doc, res.ret, res.line, (int) res.chr, res.str,
+					expected.ret, expected.line, (int) expected.chr, expected.str);
+			assert(B_FALSE);
+		}
+	}
+}
+
+static void fill(char* p, char c, int count) {
+	memset(p, c, count);
+	p[count] = '\0';
+}
+
+/* Whitespace runs with newline at each position */
+void test_scan_space(void) {
+	char space[MAXLEN + 1];
+	char doc[8 * MAXLEN];
+	int len, nl;
+
+	for(len = 0; len < MAXLEN; ++len) {
+		for(nl = 0; nl <= len; ++nl) {
+			fill(space, ' ', len);
+			if(nl < len)
+				space[nl] = '\n';
+			if(len > 3)
+				space[len - 3] = '\t';
+
+			sprintf(doc, "%s{%s\"n\"%s:%s-1234%s,\n\"s\":\"a\"%s}%s",
+					space, space, space, space, space, space, space);
+			scan_compare(doc);
+
+			/* Error after whitespace */
+			sprintf(doc, "{\"n\":1,%s\n%s\"s\" 1}", space, space);
+			scan_compare(doc);
+
+			/* End of buffer in whitespace */
+			sprintf(doc, "[1,%s", space);
+			scan_compare(doc);
+		}
+	}
+}
+
+/* Strings with special characters at each position */
+void test_scan_string(void) {
+	char str[MAXLEN + 1];
+	char doc[4 * MAXLEN];
+	const char* specials[] = { "\\\"", "\\\\", "\\n", "\\u0041", "\n", NULL };
+	int len, pos, i;
+
+	for(len = 0; len < MAXLEN; ++len) {
+		fill(str, 'x', len);
+
+		sprintf(doc, "{\"s\":\"%s\",\"n\":%d}", str, len);
+		scan_compare(doc);
+
+		/* Unterminated string */
+		sprintf(doc, "\n\n{\"s\":\"%s", str);
+		scan_compare(doc);
+
+		for(pos = 0; pos < len; ++pos) {
+			for(i = 0; specials[i] != NULL; ++i) {
+				sprintf(doc, "{\"s\":\"%.*s%s%s\",\"n\":%d}", pos, str, specials[i], str + pos, pos);
+				scan_compare(doc);
+			}
+
+			/* Backslash at the end of buffer */
+			sprintf(doc, "{\"s\":\"%.*s\\", pos, str);
+			scan_compare(doc);
+		}
+	}
+}
+
+struct scan_number {
+	const char* literal;
+	int ret;
+	int64_t value;
+};
+
+void test_scan_number(void) {
+	struct scan_number numbers[] = {
+		{ "0", JSON_OK, 0 },
+		{ "-0", JSON_OK, 0 },
+		{ "7", JSON_OK, 7 },
+		{ "-7", JSON_OK, -7 },
+		{ "007", JSON_OK, 7 },
+		{ "123456789012345678", JSON_OK, 123456789012345678ll },
+		{ "-123456789012345678", JSON_OK, -123456789012345678ll },
+		{ "1234567890123456789", JSON_OK, 1234567890123456789ll },
+		{ "-9223372036854775808", JSON_OK, -9223372036854775807ll - 1 },
+		{ "9223372036854775808", JSON_NUMBER_OVERFLOW, 0 },
+		{ "+5", JSON_OK, 5 },
+		{ "1-2", JSON_NUMBER_INVALID, 0 },
+		{ "-", JSON_NUMBER_INVALID, 0 },
+		{ "--1", JSON_NUMBER_INVALID, 0 },
+		{ NULL, 0, 0 }
+	};
+	struct scan_result res;
+	char doc[MAXLEN];
+	int i;
+
+	for(i = 0; numbers[i].literal != NULL; ++i) {
+		sprintf(doc, "{\"n\": %s}", numbers[i].literal);
+		scan_compare(doc);
+
+		scan_parse(doc, &res);
+		assert(res.ret == numbers[i].ret);
+		assert(res.num == numbers[i].value);
+	}
+}
+
+int json_test_main(void) {
+	int i;
+
+	for(i = 0; scanners[i] != NULL; ++i) {
+		printf("%s: %s\n", scanners[i],
+			   (json_select_scanner(scanners[i]) == JSON_OK) ? "supported" : "not supported");
+	}
+
+	test_scan_space();
+	test_scan_string();
+	test_scan_number();
+
+	json_select_scanner("auto");
+
+	return 0;
+}
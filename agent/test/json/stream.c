@@ -0,0 +1,232 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+
+#include <tsload/json/json.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+/**
+ * Checks that streaming writer gives same output as json_write_buf()
+ * for equivalent tree (compact and formatted), including output
+ * that is larger than stream buffer and is flushed to a file.
+ */
+
+#define NREQUESTS		4000
+
+void dump_error(void);
+
+static char* write_tree(json_node_t* node, boolean_t formatted) {
+	/* json_write_count() already accounts null-terminator, but json_write_buf()
+	 * puts it only if there is a spare byte */
+	size_t len = json_write_count(node, formatted) + 1;
+	char* buf = mp_malloc(len);
+
+	assert(json_write_buf(node, buf, len, formatted) == JSON_OK);
+
+	return buf;
+}
+
+static json_node_t* build_tree(int count) {
+	json_node_t* root = json_new_node("tsload.Test");
+	json_node_t* arr = json_new_array();
+	json_node_t* rq;
+	json_node_t* params;
+	int i;
+
+	json_add_integer(root, JSON_STR("min"), INT64_MIN);
+	json_add_integer(root, JSON_STR("max"), INT64_MAX);
+	json_add_double(root, JSON_STR("d"), 3.25);
+	json_add_string(root, JSON_STR("esc"), JSON_STR("a\"b\\c/\t\n"));
+	json_add_boolean(root, JSON_STR("f"), B_FALSE);
+	json_add_node(root, JSON_STR("null"), json_new_null());
+	json_add_node(root, JSON_STR("empty_obj"), json_new_node(NULL));
+	json_add_node(root, JSON_STR("empty_arr"), json_new_array());
+
+	params = json_new_node(NULL);
+	json_add_integer(params, JSON_STR("block_size"), 4096);
+	json_add_node(params, JSON_STR("nested"), json_new_array());
+	json_add_integer(json_find(params, "nested"), NULL, 1);
+	json_add_node(root, JSON_STR("params"), params);
+
+	for(i = 0; i < count; ++i) {
+		rq = json_new_node("tsload.Request");
+
+		json_add_string(rq, JSON_STR("workload_name"), JSON_STR("wl"));
+		json_add_integer(rq, JSON_STR("request"), i);
+		json_add_integer(rq, JSON_STR("start"), -i * 1000);
+		json_add_boolean(rq, JSON_STR("success"), i % 2);
+
+		json_add_node(arr, NULL, rq);
+	}
+
+	json_add_node(root, JSON_STR("requests"), arr);
+
+	return root;
+}
+
+static void stream_tree(json_stream_t* stream, int count) {
+	json_node_t* params;
+	int i;
+
+	json_stream_begin_object(stream, "tsload.Test");
+
+	json_stream_add_integer(stream, "min", INT64_MIN);
+	json_stream_add_integer(stream, "max", INT64_MAX);
+	json_stream_add_double(stream, "d", 3.25);
+	json_stream_add_string(stream, "esc", "a\"b\\c/\t\n");
+	json_stream_add_boolean(stream, "f", B_FALSE);
+
+	json_stream_key(stream, "null");
+	json_stream_null(stream);
+
+	json_stream_key(stream, "empty_obj");
+	json_stream_begin_object(stream, NULL);
+	json_stream_end_object(stream);
+
+	json_stream_key(stream, "empty_arr");
+	json_stream_begin_array(stream);
+	json_stream_end_array(stream);
+
+	/* Mix with nodes */
+	params = json_new_node(NULL);
+	json_add_integer(params, JSON_STR("block_size"), 4096);
+	json_add_node(params, JSON_STR("nested"), json_new_array());
+	json_add_integer(json_find(params, "nested"), NULL, 1);
+
+	json_stream_key(stream, "params");
+	json_stream_node(stream, params);
+
+	json_node_destroy(params);
+
+	json_stream_key(stream, "requests");
+	json_stream_begin_array(stream);
+
+	for(i = 0; i < count; ++i) {
+		json_stream_begin_object(stream, "tsload.Request");
+
+		json_stream_add_string(stream, "workload_name", "wl");
+		json_stream_add_integer(stream, "request", i);
+		json_stream_add_integer(stream, "start", -i * 1000);
+		json_stream_add_boolean(stream, "success", i % 2);
+
+		json_stream_end_object(stream);
+	}
+
+	json_stream_end_array(stream);
+	assert(json_stream_end_object(stream) == JSON_OK);
+}
+
+void test_stream_memory(boolean_t formatted) {
+	json_node_t* root = build_tree(10);
+	json_stream_t* stream = json_stream_create(formatted);
+	char* expected = write_tree(root, formatted);
+	const char* data;
+	size_t len;
+
+	stream_tree(stream, 10);
+
+	data = json_stream_data(stream, &len);
+
+	puts(data);
+
+	assert(strlen(expected) == len);
+	assert(strcmp(data, expected) == 0);
+
+	json_stream_destroy(stream);
+	json_node_destroy(root);
+	mp_free(expected);
+}
+
+/* Output is larger than buffer, so it is flushed several times */
+void test_stream_file(boolean_t formatted) {
+	json_node_t* root = build_tree(NREQUESTS);
+	char* expected = write_tree(root, formatted);
+	size_t len = strlen(expected);
+	char* data = mp_malloc(len + 1);
+
+	FILE* file = tmpfile();
+	json_stream_t* stream = json_stream_create_file(file, formatted);
+
+	assert(len > 2 * JSON_STREAM_BUFSIZE);
+
+	stream_tree(stream, NREQUESTS);
+
+	assert(json_stream_flush(stream) == JSON_OK);
+	json_stream_destroy(stream);
+
+	assert(ftell(file) == (long) len);
+
+	rewind(file);
+	assert(fread(data, 1, len, file) == len);
+	data[len] = '\0';
+
+	assert(strcmp(data, expected) == 0);
+
+	fclose(file);
+	json_node_destroy(root);
+	mp_free(expected);
+	mp_free(data);
+}
+
+/* Misuse of stream is reported and error is sticky */
+void test_stream_errors(void) {
+	json_stream_t* stream = json_stream_create(B_FALSE);
+
+	assert(json_stream_key(stream, "a") == JSON_INTERNAL_ERROR);
+	dump_error();
+	assert(json_stream_begin_array(stream) == JSON_INTERNAL_ERROR);
+	json_stream_destroy(stream);
+
+	stream = json_stream_create(B_FALSE);
+	json_stream_begin_object(stream, NULL);
+	assert(json_stream_integer(stream, 1) == JSON_INTERNAL_ERROR);
+	dump_error();
+	json_stream_destroy(stream);
+
+	stream = json_stream_create(B_FALSE);
+	json_stream_begin_array(stream);
+	assert(json_stream_end_object(stream) == JSON_INTERNAL_ERROR);
+	dump_error();
+	json_stream_destroy(stream);
+
+	stream = json_stream_create(B_FALSE);
+	json_stream_integer(stream, 1);
+	assert(json_stream_integer(stream, 2) == JSON_INTERNAL_ERROR);
+	dump_error();
+	json_stream_destroy(stream);
+}
+
+int json_test_main(void) {
+	test_stream_memory(B_FALSE);
+	test_stream_memory(B_TRUE);
+
+	test_stream_file(B_FALSE);
+	test_stream_file(B_TRUE);
+
+	test_stream_errors();
+
+	return 0;
+}
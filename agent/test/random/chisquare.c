@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 
 /**
@@ -37,6 +38,8 @@
  * chi - value of chi distributions for N intervals and p confidense
  * 	     (default: p = 0.95, N = 20)
  * number - number of test runs
+ * use_bulk - if set, values are generated by rv_variate_bulk() instead
+ * 		of calling rv_variate_double() for each value
  *
  * To generate sequences you may use CDF's of target distribution.
  * I.e. to calculate them for normal distribution:
@@ -72,6 +75,9 @@ int number = 20000;
 
 randgen_t* rg;
 
+boolean_t use_bulk = B_FALSE;
+double* values = NULL;
+
 typedef struct {
 	float d_min;
 	float d_max;
@@ -163,8 +169,11 @@ boolean_t chisquare_test_impl(distribution_t* d, randvar_t* rv) {
 
 	char index_str[16];
 
+	if(use_bulk)
+		rv_variate_bulk(rv, values, number);
+
 	for(i = 0; i < number; ++i) {
-		r = rv_variate_double(rv);
+		r = (use_bulk) ? values[i] : rv_variate_double(rv);
 
 		if(r < d->d_min) {
 			++below;
@@ -252,7 +261,7 @@ void test_erlang(distribution_t* d, int shape, double rate) {
 }
 
 void test_rg(randgen_class_t* rg_class, const char* rg_class_name) {
-	printf("Testing RG '%s'\n", rg_class_name);
+	printf("Testing RG '%s' (%s)\n", rg_class_name, (use_bulk) ? "bulk" : "scalar");
 
 	rg = rg_create(rg_class, tm_get_clock());
 
@@ -262,10 +271,9 @@ void test_rg(randgen_class_t* rg_class, const char* rg_class_name) {
 	rg_destroy(rg);
 }
 
-int test_main(void) {
-	/* Test all distributions with libc RG */
-	randgen_init();
-	
+void test_distributions(void) {
+	printf("Testing distributions (%s)\n", (use_bulk) ? "bulk" : "scalar");
+
 	rg = rg_create(randgen_find("libc"), tm_get_clock());
 
 	test_uniform();
@@ -283,13 +291,29 @@ int test_main(void) {
 	/* Test other RGs such as lcg, devrandom, etc. */
 
 	test_rg(randgen_find("lcg"), "lcg");
+	test_rg(randgen_find("xoshiro256"), "xoshiro256");
+	test_rg(randgen_find("pcg64"), "pcg64");
+	test_rg(randgen_find("philox"), "philox");
 
 #ifdef PLAT_POSIX
 	test_rg(randgen_find("devrandom"), "devrandom");
 #endif
+}
+
+int test_main(void) {
+	randgen_init();
+
+	values = malloc(number * sizeof(double));
+
+	/* Test all distributions with libc RG, then test bulk variators */
+	test_distributions();
+
+	use_bulk = B_TRUE;
+	test_distributions();
+
+	free(values);
 
 	randgen_fini();
 	
 	return 0;
 }
-
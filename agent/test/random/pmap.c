@@ -0,0 +1,217 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/time.h>
+#include <tsload/mempool.h>
+
+#include <tsload/load/randgen.h>
+#include <tsload/load/wlparam.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/**
+ * Chi-Square test for probability maps of workload parameter generators.
+ * Checks that values picked by wlpgen_gen_random() through alias table
+ * follow probabilities specified in pmap (including valarray elements
+ * which should be picked with equal probabilities).
+ *
+ * chi - value of chi distribution for p = 0.95 and (N - 1) degrees of freedom
+ * number - number of generated values
+ */
+
+#define RETRIES 3
+
+#define SMALL_N		7
+#define LARGE_N		100
+
+struct test_data {
+	wlp_integer_t i;
+};
+
+wlp_descr_t int_param = {
+	WLP_INTEGER, WLPF_REQUEST,
+	WLP_NO_RANGE(),
+	WLP_NO_DEFAULT(),
+	"i", "",
+	offsetof(struct test_data, i)
+};
+
+randgen_t* rg;
+
+static void pmap_set_value(wlpgen_value_t* value, wlp_integer_t i) {
+	* (wlp_integer_t*) value->value = i;
+}
+
+static void pmap_init_gen(wlp_generator_t* gen, wlpgen_probability_t* pmap, int pcount) {
+	wlpgen_randgen_t* randgen = &gen->generator.randgen;
+
+	gen->type = WLPG_RANDOM;
+	gen->wlp = &int_param;
+	gen->wl = NULL;
+
+	randgen->rg = rg;
+	randgen->rv = NULL;
+	randgen->pcount = pcount;
+	randgen->pmap = pmap;
+
+	wlpgen_pmap_build_alias(randgen);
+	rg_buffer_init(&randgen->buffer, RGBUF_DOUBLE, rg, NULL);
+}
+
+static void pmap_destroy_gen(wlp_generator_t* gen) {
+	mp_free(gen->generator.randgen.alias_prob);
+	mp_free(gen->generator.randgen.alias);
+	rg_buffer_destroy(&gen->generator.randgen.buffer);
+}
+
+/**
+ * Generate number values and compare frequencies of values 0..n-1
+ * with expected probabilities d
+ */
+boolean_t chisquare_test_impl(wlp_generator_t* gen, int n, double* d,
+							  int number, double chi) {
+	struct test_data data;
+	int* o = mp_malloc(n * sizeof(int));
+	double expected, error, D = 0.0;
+	int i;
+
+	for(i = 0; i < n; ++i)
+		o[i] = 0;
+
+	for(i = 0; i < number; ++i) {
+		wlpgen_gen_random(gen, &data);
+
+		assert(data.i >= 0 && data.i < n);
+		++o[data.i];
+	}
+
+	puts("   VALUE EXPECTED OBSERVED   ERROR");
+
+	for(i = 0; i < n; ++i) {
+		expected = d[i] * number;
+		error = pow(o[i] - expected, 2.0) / expected;
+
+		printf("%8d %8.0f %8d %12.7f\n", i, expected, o[i], error);
+
+		D += error;
+	}
+
+	printf("   D=%4.8f\n", D);
+
+	mp_free(o);
+
+	return D < chi;
+}
+
+boolean_t chisquare_test(wlp_generator_t* gen, int n, double* d,
+						 int number, double chi) {
+	boolean_t result = B_FALSE;
+	int retries = RETRIES;
+
+	while(--retries >= 0 && !result) {
+		result = chisquare_test_impl(gen, n, d, number, chi);
+		printf("%d attempts left\n", retries);
+	}
+
+	return result;
+}
+
+/* Values 0..3 are set directly, values 4..6 are picked from valarray */
+void test_pmap_small(void) {
+	wlpgen_probability_t pmap[5];
+	wlpgen_value_t valarray[3];
+	wlp_generator_t gen;
+
+	double d[SMALL_N] = { 0.05, 0.1, 0.2, 0.35, 0.1, 0.1, 0.1 };
+	int i;
+
+	puts("Small pmap test\n");
+
+	for(i = 0; i < 4; ++i) {
+		pmap[i].length = 0;
+		pmap[i].valarray = NULL;
+		pmap[i].probability = d[i];
+		pmap_set_value(&pmap[i].value, i);
+	}
+
+	for(i = 0; i < 3; ++i) {
+		pmap_set_value(&valarray[i], 4 + i);
+	}
+
+	pmap[4].length = 3;
+	pmap[4].valarray = valarray;
+	pmap[4].probability = 0.3;
+
+	pmap_init_gen(&gen, pmap, 5);
+
+	assert(chisquare_test(&gen, SMALL_N, d, 20000, 12.592));
+
+	pmap_destroy_gen(&gen);
+}
+
+/* Probability of value i is proportional to i + 1 */
+void test_pmap_large(void) {
+	wlpgen_probability_t pmap[LARGE_N];
+	wlp_generator_t gen;
+
+	double d[LARGE_N];
+	double total = LARGE_N * (LARGE_N + 1) / 2;
+	int i;
+
+	puts("Large pmap test\n");
+
+	for(i = 0; i < LARGE_N; ++i) {
+		d[i] = (i + 1) / total;
+
+		pmap[i].length = 0;
+		pmap[i].valarray = NULL;
+		pmap[i].probability = d[i];
+		pmap_set_value(&pmap[i].value, i);
+	}
+
+	pmap_init_gen(&gen, pmap, LARGE_N);
+
+	assert(chisquare_test(&gen, LARGE_N, d, 200000, 123.225));
+
+	pmap_destroy_gen(&gen);
+}
+
+int test_main(void) {
+	mempool_init();
+	randgen_init();
+
+	rg = rg_create(randgen_find("libc"), tm_get_clock());
+
+	test_pmap_small();
+	test_pmap_large();
+
+	rg_destroy(rg);
+
+	randgen_fini();
+	mempool_fini();
+
+	return 0;
+}
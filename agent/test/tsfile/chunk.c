@@ -0,0 +1,424 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/threads.h>
+#include <tsload/posixdecl.h>
+
+#include <tsload/json/json.h>
+
+#include <tsfile.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <assert.h>
+
+/**
+ * Writes same request-like entries to v1 file and v2 files with different
+ * chunk sizes and codecs and checks that all read calls return same entries
+ */
+
+#define NENTRIES	50000
+#define NSTEPS		50
+
+typedef struct {
+	uint32_t	rq_step;
+	uint32_t	rq_thread;
+	uint64_t	rq_id;
+	int64_t		rq_sched_time;
+	int64_t		rq_start_time;
+	int64_t		rq_end_time;
+	uint8_t		rq_flags;
+	int8_t		rq_delta;
+	boolean_t	rq_success;
+	double		rq_value;
+	char		rq_name[16];
+} chunk_test_entry_t;
+
+static const char* v1_path = "chunk-test-v1.tsf";
+static const char* v2_path = "chunk-test-v2.tsf";
+
+int rq_step_field = -1;
+
+static void test_error_msg(ts_errcode_t errcode, const char* format, ...) {
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+
+	fputc('\n', stderr);
+}
+
+static void add_field(tsfile_schema_t* schema, const char* name, tsfile_ftype_t type,
+					  size_t size, size_t offset) {
+	tsfile_field_t* field = &schema->fields[schema->hdr.count++];
+
+	strncpy(field->name, name, MAXFIELDLEN);
+	field->type = type;
+	field->size = size;
+	field->offset = offset;
+}
+
+#define ADD_INT_FIELD(schema, member)									\
+	add_field(schema, #member, TSFILE_FIELD_INT,						\
+			  sizeof(((chunk_test_entry_t*) 0)->member),				\
+			  offsetof(chunk_test_entry_t, member))
+
+static void init_schema(tsfile_schema_t* schema) {
+	memset(schema, 0, sizeof(tsfile_schema_t));
+
+	schema->hdr.entry_size = sizeof(chunk_test_entry_t);
+
+	ADD_INT_FIELD(schema, rq_step);
+	ADD_INT_FIELD(schema, rq_thread);
+	ADD_INT_FIELD(schema, rq_id);
+	ADD_INT_FIELD(schema, rq_sched_time);
+	ADD_INT_FIELD(schema, rq_start_time);
+	ADD_INT_FIELD(schema, rq_end_time);
+	ADD_INT_FIELD(schema, rq_flags);
+	ADD_INT_FIELD(schema, rq_delta);
+
+	add_field(schema, "rq_success", TSFILE_FIELD_BOOLEAN, sizeof(boolean_t),
+			  offsetof(chunk_test_entry_t, rq_success));
+	add_field(schema, "rq_value", TSFILE_FIELD_FLOAT, sizeof(double),
+			  offsetof(chunk_test_entry_t, rq_value));
+	add_field(schema, "rq_name", TSFILE_FIELD_STRING, 16,
+			  offsetof(chunk_test_entry_t, rq_name));
+}
+
+static chunk_test_entry_t* generate_entries(void) {
+	chunk_test_entry_t* entries = mp_malloc(NENTRIES * sizeof(chunk_test_entry_t));
+	chunk_test_entry_t* entry;
+	int64_t time = 1000000000ll;
+	int i;
+
+	memset(entries, 0, NENTRIES * sizeof(chunk_test_entry_t));
+	srand(42);
+
+	for(i = 0; i < NENTRIES; ++i) {
+		entry = &entries[i];
+
+		/* Some requests of previous step are reported late */
+		entry->rq_step = i / (NENTRIES / NSTEPS);
+		if(entry->rq_step > 0 && (rand() % 100) == 0)
+			--entry->rq_step;
+
+		/* Step #7 doesn't have requests */
+		if(entry->rq_step == 7)
+			entry->rq_step = 8;
+
+		entry->rq_thread = rand() % 8;
+		entry->rq_id = 0xffff0000ull + i;
+
+		time += rand() % 20000;
+		entry->rq_sched_time = time;
+		entry->rq_start_time = time + rand() % 1000;
+		entry->rq_end_time = entry->rq_start_time + rand() % 100000;
+
+		entry->rq_flags = (i % 3 == 0) ? 0x3 : 0x81;
+		entry->rq_delta = (rand() % 256) - 128;
+		entry->rq_success = (rand() % 1000) != 0;
+		entry->rq_value = ((double) rand()) / RAND_MAX;
+
+		snprintf(entry->rq_name, 16, "wl%d", i % 3);
+	}
+
+	/* Extreme values */
+	entries[100].rq_id = UINT64_MAX;
+	entries[101].rq_sched_time = INT64_MIN;
+	entries[102].rq_end_time = INT64_MAX;
+
+	return entries;
+}
+
+static void compare_entries(const chunk_test_entry_t* expected, const chunk_test_entry_t* entries,
+							int count, uint64_t field_mask) {
+	int i;
+
+	for(i = 0; i < count; ++i) {
+		assert(expected[i].rq_step == entries[i].rq_step);
+
+		if(field_mask != TSFILE_ALL_FIELDS)
+			continue;
+
+		assert(expected[i].rq_thread == entries[i].rq_thread);
+		assert(expected[i].rq_id == entries[i].rq_id);
+		assert(expected[i].rq_sched_time == entries[i].rq_sched_time);
+		assert(expected[i].rq_start_time == entries[i].rq_start_time);
+		assert(expected[i].rq_end_time == entries[i].rq_end_time);
+		assert(expected[i].rq_flags == entries[i].rq_flags);
+		assert(expected[i].rq_delta == entries[i].rq_delta);
+		assert(expected[i].rq_success == entries[i].rq_success);
+		assert(expected[i].rq_value == entries[i].rq_value);
+		assert(strcmp(expected[i].rq_name, entries[i].rq_name) == 0);
+	}
+}
+
+static void write_entries(tsfile_t* file, chunk_test_entry_t* entries) {
+	int i = 0;
+	int count;
+
+	/* First half is written by small unbuffered batches which produce short chunks */
+	while(i < NENTRIES / 2) {
+		count = 1 + rand() % 300;
+		count = min(count, NENTRIES / 2 - i);
+
+		assert(tsfile_add(file, entries + i, count) == TSFILE_OK);
+		i += count;
+	}
+
+	assert(tsfile_set_buffered(file, 1024) == TSFILE_OK);
+
+	while(i < NENTRIES) {
+		count = 1 + rand() % 300;
+		count = min(count, NENTRIES - i);
+
+		assert(tsfile_add(file, entries + i, count) == TSFILE_OK);
+		i += count;
+	}
+}
+
+static void check_file(tsfile_t* file, tsfile_t* v1_file, chunk_test_entry_t* expected) {
+	chunk_test_entry_t* entries = mp_malloc(NENTRIES * sizeof(chunk_test_entry_t));
+	const chunk_test_entry_t* mapped;
+	unsigned start, end, batch_end;
+	unsigned index, v1_index;
+	uint32_t count;
+	int i;
+
+	assert(tsfile_get_count(file, &count) == TSFILE_OK && count == NENTRIES);
+
+	assert(tsfile_get_entries(file, entries, 0, NENTRIES) == TSFILE_OK);
+	compare_entries(expected, entries, NENTRIES, TSFILE_ALL_FIELDS);
+
+	assert(tsfile_get_entries(file, entries, NENTRIES - 1, NENTRIES + 1) == TSFILE_INVAL_RANGE);
+	assert(tsfile_map_entries(file, 10, 10) == NULL);
+
+	/* Only key field is read */
+	memset(entries, 0, NENTRIES * sizeof(chunk_test_entry_t));
+	assert(tsfile_get_fields(file, entries, 17, NENTRIES - 17,
+							 TSFILE_FIELD_BIT(rq_step_field)) == TSFILE_OK);
+	compare_entries(expected + 17, entries, NENTRIES - 34, TSFILE_FIELD_BIT(rq_step_field));
+
+	/* Random ranges which may cross chunks */
+	for(i = 0; i < 200; ++i) {
+		start = rand() % NENTRIES;
+		end = min(NENTRIES - start, 10000);
+		end = start + 1 + rand() % end;
+
+		mapped = tsfile_map_entries(file, start, end);
+		assert(mapped != NULL);
+		compare_entries(expected + start, mapped, end - start, TSFILE_ALL_FIELDS);
+
+		assert(tsfile_get_entries(file, entries, start, end) == TSFILE_OK);
+		compare_entries(expected + start, entries, end - start, TSFILE_ALL_FIELDS);
+	}
+
+	for(start = 0; start < NENTRIES; start = batch_end) {
+		batch_end = tsfile_map_batch(file, start, NENTRIES);
+		assert(batch_end > start && batch_end <= NENTRIES);
+
+		mapped = tsfile_map_entries(file, start, batch_end);
+		assert(mapped != NULL);
+		compare_entries(expected + start, mapped, batch_end - start, TSFILE_ALL_FIELDS);
+	}
+
+	/* Index should be same as index of v1 file */
+	assert(tsfile_set_index(file, "rq_value") == TSFILE_INVAL_FIELD);
+	assert(tsfile_set_index(file, "rq_step") == TSFILE_OK);
+
+	for(i = 0; i <= NSTEPS; ++i) {
+		assert(tsfile_get_index(file, i, &index) == TSFILE_OK);
+		assert(tsfile_get_index(v1_file, i, &v1_index) == TSFILE_OK);
+		assert(index == v1_index);
+	}
+
+	mp_free(entries);
+}
+
+static void test_chunk_format(tsfile_schema_t* schema, chunk_test_entry_t* expected,
+							  tsfile_t* v1_file, uint32_t chunk_rows, const char* codec_name) {
+	tsfile_format_t format;
+	tsfile_t* file;
+	uint32_t count;
+	int codec = tsfile_codec_from_name(codec_name);
+
+	if(codec < 0) {
+		printf("Codec '%s' is not supported, skipping\n", codec_name);
+		return;
+	}
+
+	format.version = TSFILE_VERSION_V2;
+	format.chunk_rows = chunk_rows;
+	format.codec = codec;
+
+	unlink(v2_path);
+
+	file = tsfile_create_ex(v2_path, schema, &format);
+	assert(file != NULL);
+
+	write_entries(file, expected);
+
+	/* Last entries are not written yet, but are visible */
+	check_file(file, v1_file, expected);
+	tsfile_close(file);
+
+	file = tsfile_open(v2_path, schema);
+	assert(file != NULL);
+
+	check_file(file, v1_file, expected);
+
+	printf("chunk_rows=%u codec=%s size=%lu v1 size=%lu\n", chunk_rows, codec_name,
+		   (unsigned long) file->size, (unsigned long) v1_file->size);
+	assert(file->size < v1_file->size);
+
+	/* Add entries to reopened file */
+	assert(tsfile_add(file, expected, 10) == TSFILE_OK);
+	assert(tsfile_get_count(file, &count) == TSFILE_OK && count == NENTRIES + 10);
+	compare_entries(expected, tsfile_map_entries(file, NENTRIES, NENTRIES + 10),
+					10, TSFILE_ALL_FIELDS);
+
+	tsfile_close(file);
+}
+
+/* Index should keep only keys that were found in file, so sparse keys
+ * don't require allocating entry for each key up to maximum */
+static void test_index_sparse(tsfile_schema_t* schema) {
+	static const uint32_t steps[] = { 0, 0, 5, 3, 4000000000u, 4000000000u };
+	chunk_test_entry_t entries[6];
+	tsfile_t* file;
+	unsigned index;
+	int i;
+
+	memset(entries, 0, sizeof(entries));
+	for(i = 0; i < 6; ++i)
+		entries[i].rq_step = steps[i];
+
+	unlink(v2_path);
+
+	file = tsfile_create(v2_path, schema);
+	assert(file != NULL);
+	assert(tsfile_add(file, entries, 6) == TSFILE_OK);
+	assert(tsfile_set_index(file, "rq_step") == TSFILE_OK);
+
+	assert(tsfile_get_index(file, 0, &index) == TSFILE_OK && index == 0);
+	assert(tsfile_get_index(file, 1, &index) == TSFILE_OK && index == 2);
+	assert(tsfile_get_index(file, 5, &index) == TSFILE_OK && index == 2);
+	assert(tsfile_get_index(file, 6, &index) == TSFILE_OK && index == 4);
+	assert(tsfile_get_index(file, 4000000000u, &index) == TSFILE_OK && index == 4);
+	assert(tsfile_get_index(file, 4000000001u, &index) == TSFILE_OK && index == 6);
+
+	tsfile_close(file);
+}
+
+/* Failure to flush write-behind buffer should be reported by
+ * tsfile_get_count() and buffered entries shouldn't be counted */
+static void test_count_flush_error(tsfile_schema_t* schema, chunk_test_entry_t* expected) {
+	tsfile_t* file;
+	uint32_t count;
+	int fd;
+
+	unlink(v2_path);
+
+	file = tsfile_create(v2_path, schema);
+	assert(file != NULL);
+	assert(tsfile_add(file, expected, 10) == TSFILE_OK);
+	assert(tsfile_set_buffered(file, 100) == TSFILE_OK);
+	assert(tsfile_add(file, expected + 10, 10) == TSFILE_OK);
+
+	/* Make file descriptor read-only so writes fail */
+	fd = open("/dev/null", O_RDONLY);
+	assert(fd != -1);
+	dup2(fd, file->fd);
+	close(fd);
+
+	assert(tsfile_get_count(file, &count) != TSFILE_OK);
+	assert(count == 10);
+
+	/* Closing file reports failure to write buffered entries again */
+	tsfile_close(file);
+}
+
+static void test_chunk_corrupted(tsfile_schema_t* schema) {
+	int fd = open(v2_path, O_RDWR);
+	uint32_t garbage = 0xdeadbeef;
+
+	assert(fd != -1);
+	assert(lseek(fd, TSFILE_HEADER_SIZE, SEEK_SET) == TSFILE_HEADER_SIZE);
+	assert(write(fd, &garbage, sizeof(garbage)) == sizeof(garbage));
+	close(fd);
+
+	assert(tsfile_open(v2_path, schema) == NULL);
+}
+
+int test_main(void) {
+	tsfile_schema_t schema;
+	chunk_test_entry_t* entries;
+	tsfile_t* v1_file;
+
+	threads_init();
+	mempool_init();
+	json_init();
+	tsfile_init();
+
+	tsfile_register_error_msg_func(test_error_msg);
+
+	init_schema(&schema);
+	entries = generate_entries();
+
+	unlink(v1_path);
+
+	v1_file = tsfile_create(v1_path, &schema);
+	assert(v1_file != NULL);
+
+	rq_step_field = tsfile_find_field(v1_file, "rq_step");
+	assert(rq_step_field == 0);
+	assert(tsfile_find_field(v1_file, "rq_unknown") == -1);
+
+	write_entries(v1_file, entries);
+	assert(tsfile_set_index(v1_file, "rq_step") == TSFILE_OK);
+
+	test_chunk_format(&schema, entries, v1_file, TSFILE_CHUNK_ROWS, "none");
+	test_chunk_format(&schema, entries, v1_file, 1000, "lz4");
+	test_chunk_format(&schema, entries, v1_file, 777, "zstd");
+
+	test_chunk_corrupted(&schema);
+	test_count_flush_error(&schema, entries);
+	test_index_sparse(&schema);
+
+	tsfile_close(v1_file);
+	mp_free(entries);
+
+	unlink(v1_path);
+	unlink(v2_path);
+
+	tsfile_fini();
+	json_fini();
+	mempool_fini();
+	threads_fini();
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2013, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
+*/    
+
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/threads.h>
+
+#include <tsfile.h>
+#include <csv.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <assert.h>
+
+/**
+ * Writes entries with compiled CSV writer and reads them back
+ * with csv_read_entry()
+ */
+
+#define NENTRIES	20000
+
+typedef struct {
+	boolean_t	b;
+	uint8_t		i8;
+	int16_t		i16;
+	int32_t		i32;
+	int64_t		i64;
+	uint32_t	flags;
+	uint32_t	u32;
+	float		f;
+	double		d;
+	char		s[16];
+} csv_test_entry_t;
+
+static void add_field(tsfile_schema_t* schema, const char* name, tsfile_ftype_t type,
+					  size_t size, size_t offset) {
+	tsfile_field_t* field = &schema->fields[schema->hdr.count++];
+
+	strncpy(field->name, name, MAXFIELDLEN);
+	field->type = type;
+	field->size = size;
+	field->offset = offset;
+}
+
+static void init_schema(tsfile_schema_t* schema) {
+	memset(schema, 0, sizeof(tsfile_schema_t));
+
+	schema->hdr.entry_size = sizeof(csv_test_entry_t);
+
+	add_field(schema, "b", TSFILE_FIELD_BOOLEAN, sizeof(boolean_t), offsetof(csv_test_entry_t, b));
+	add_field(schema, "i8", TSFILE_FIELD_INT, 1, offsetof(csv_test_entry_t, i8));
+	add_field(schema, "i16", TSFILE_FIELD_INT, 2, offsetof(csv_test_entry_t, i16));
+	add_field(schema, "i32", TSFILE_FIELD_INT, 4, offsetof(csv_test_entry_t, i32));
+	add_field(schema, "i64", TSFILE_FIELD_INT, 8, offsetof(csv_test_entry_t, i64));
+	add_field(schema, "flags", TSFILE_FIELD_INT, 4, offsetof(csv_test_entry_t, flags));
+	add_field(schema, "u32", TSFILE_FIELD_INT, 4, offsetof(csv_test_entry_t, u32));
+	add_field(schema, "f", TSFILE_FIELD_FLOAT, sizeof(float), offsetof(csv_test_entry_t, f));
+	add_field(schema, "d", TSFILE_FIELD_FLOAT, sizeof(double), offsetof(csv_test_entry_t, d));
+	add_field(schema, "s", TSFILE_FIELD_STRING, 16, offsetof(csv_test_entry_t, s));
+}
+
+static void fill_entry(csv_test_entry_t* entry, int i) {
+	static const char* strings[] = {
+		"", "simple", "with,comma", "\"quoted\"", "123456789012345"
+	};
+
+	memset(entry, 0, sizeof(csv_test_entry_t));
+
+	entry->b = (i % 3) == 0;
+	entry->i8 = (uint8_t) i;
+	entry->i16 = (int16_t) (i * 7);
+	entry->i32 = -i * 1000;
+	entry->i64 = (int64_t) i * 1000000007ll * ((i % 2) ? -1 : 1);
+	entry->flags = (uint32_t) i * 0x9E3779B9u;
+	entry->u32 = (uint32_t) -i;
+	entry->f = (float) i / 3.0f;
+	entry->d = (double) i / 7.0 + 1e-9;
+
+	strcpy(entry->s, strings[i % 5]);
+}
+
+void test_csv_roundtrip(void) {
+	tsfile_schema_t schema;
+	csv_binding_t bindings[MAXFIELDCOUNT];
+	csv_chars_t chars;
+	csv_writer_t* writer;
+	csv_op_t* ops;
+	int bcount;
+
+	csv_test_entry_t entry, expected;
+	char line[512];
+	FILE* file = tmpfile();
+	int i;
+
+	chars.csv_separator = ',';
+	chars.csv_opt_separator = ':';
+
+	init_schema(&schema);
+
+	bcount = csv_generate_bindings(&chars, "b:yes:no,flags:hex,u32:unsigned", bindings,
+								   &schema, CSV_HDR_GENERATE_ALL);
+	assert(bcount == schema.hdr.count);
+
+	writer = csv_writer_create(&chars, file, bindings, bcount);
+
+	for(i = 0; i < NENTRIES; ++i) {
+		fill_entry(&entry, i);
+		assert(csv_writer_write(writer, &entry) == CSV_OK);
+	}
+
+	assert(csv_writer_flush(writer) == CSV_OK);
+	csv_writer_destroy(writer);
+
+	rewind(file);
+
+	/* Check some values as text */
+	assert(fgets(line, sizeof(line), file) != NULL);
+	assert(strcmp(line, "yes,0,0,0,0,0,0,0.0,1e-09,\n") == 0);
+	assert(fgets(line, sizeof(line), file) != NULL);
+	assert(strcmp(line, "no,1,7,-1000,-1000000007,9e3779b9,4294967295,"
+						"0.33333334,0.14285714385714285,simple\n") == 0);
+	assert(fgets(line, sizeof(line), file) != NULL);
+	assert(strstr(line, ",\"with,comma\"\n") != NULL);
+	assert(fgets(line, sizeof(line), file) != NULL);
+	assert(strstr(line, ",\"\"\"quoted\"\"\"\n") != NULL);
+
+	rewind(file);
+	ops = csv_compile_bindings(bindings, bcount);
+
+	for(i = 0; i < NENTRIES; ++i) {
+		assert(fgets(line, sizeof(line), file) != NULL);
+		line[strlen(line) - 1] = '\0';
+
+		memset(&entry, 0xff, sizeof(csv_test_entry_t));
+		assert(csv_read_entry(&chars, line, ops, bcount, &entry) == CSV_OK);
+
+		fill_entry(&expected, i);
+
+		assert(entry.b == expected.b);
+		assert(entry.i8 == expected.i8);
+		assert(entry.i16 == expected.i16);
+		assert(entry.i32 == expected.i32);
+		assert(entry.i64 == expected.i64);
+		assert(entry.flags == expected.flags);
+		assert(entry.u32 == expected.u32);
+		assert(entry.f == expected.f);
+		assert(entry.d == expected.d);
+		assert(memcmp(entry.s, expected.s, sizeof(entry.s)) == 0);
+	}
+
+	assert(fgets(line, sizeof(line), file) == NULL);
+
+	mp_free(ops);
+	fclose(file);
+}
+
+void test_csv_read_errors(void) {
+	tsfile_schema_t schema;
+	csv_binding_t bindings[MAXFIELDCOUNT];
+	csv_chars_t chars;
+	csv_test_entry_t entry;
+	csv_op_t* ops;
+	int bcount;
+
+	chars.csv_separator = ',';
+	chars.csv_opt_separator = ':';
+
+	init_schema(&schema);
+
+	bcount = csv_generate_bindings(&chars, NULL, bindings, &schema, CSV_HDR_GENERATE_ALL);
+	ops = csv_compile_bindings(bindings, bcount);
+
+	/* Spaces around numbers are allowed, long strings are truncated */
+	assert(csv_read_entry(&chars, "true, 1 ,2,3,4,5,6, 0.5 ,1e300,0123456789abcdefgh",
+						  ops, bcount, &entry) == CSV_OK);
+	assert(entry.b && entry.i8 == 1 && entry.f == 0.5f && entry.d == 1e300);
+	assert(strcmp(entry.s, "0123456789abcde") == 0);
+
+	assert(csv_read_entry(&chars, "true,1,2,3", ops, bcount, &entry) == CSV_PARSE_LINE_ERROR);
+	assert(csv_read_entry(&chars, "maybe,1,2,3,4,5,6,0,0,s", ops, bcount, &entry) == CSV_PARSE_BOOL_ERROR);
+	assert(csv_read_entry(&chars, "true,x,2,3,4,5,6,0,0,s", ops, bcount, &entry) == CSV_PARSE_FMT_ERROR);
+	assert(csv_read_entry(&chars, "true,1x,2,3,4,5,6,0,0,s", ops, bcount, &entry) == CSV_PARSE_FMT_ERROR);
+	assert(csv_read_entry(&chars, "true,1,2,3,4,5,6,0,0,s,extra", ops, bcount, &entry) == CSV_PARSE_FMT_ERROR);
+
+	mp_free(ops);
+}
+
+int test_main(void) {
+	threads_init();
+	mempool_init();
+
+	test_csv_roundtrip();
+	test_csv_read_errors();
+
+	mempool_fini();
+	threads_fini();
+
+	return 0;
+}
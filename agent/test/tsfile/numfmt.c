@@ -0,0 +1,259 @@
+
+/*
+    This file is part of TSLoad.
+    Copyright 2013, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
+*/    
+
+
+
+
+#include <tsload/defs.h>
+
+#include <numfmt.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+
+/**
+ * Checks number formatting against printf()/strtod() and parsers
+ * against strtod()
+ */
+
+#define NRANDOM		50000
+
+static uint64_t xorshift_state = 88172645463325252ull;
+
+static uint64_t xorshift(void) {
+	xorshift_state ^= xorshift_state << 13;
+	xorshift_state ^= xorshift_state >> 7;
+	xorshift_state ^= xorshift_state << 17;
+
+	return xorshift_state;
+}
+
+static void check_str(size_t len, char* buf, const char* expected) {
+	buf[len] = '\0';
+
+	if(strcmp(buf, expected) != 0) {
+		fprintf(stderr, "Expected '%s', got '%s'\n", expected, buf);
+		assert(strcmp(buf, expected) == 0);
+	}
+}
+
+void test_int(void) {
+	char buf[NUMFMT_MAX_LEN + 1];
+	char expected[NUMFMT_MAX_LEN + 1];
+	uint64_t u, parsed;
+	int i, shift;
+
+	check_str(numfmt_int(buf, 0), buf, "0");
+	check_str(numfmt_int(buf, INT64_MIN), buf, "-9223372036854775808");
+	check_str(numfmt_uint(buf, UINT64_MAX), buf, "18446744073709551615");
+	check_str(numfmt_hex(buf, 0), buf, "0");
+	check_str(numfmt_hex(buf, UINT64_MAX), buf, "ffffffffffffffff");
+
+	for(i = 0; i < NRANDOM; ++i) {
+		/* Vary number of digits */
+		shift = i % 64;
+		u = xorshift() >> shift;
+
+		snprintf(expected, sizeof(expected), "%" PRIu64, u);
+		check_str(numfmt_uint(buf, u), buf, expected);
+
+		snprintf(expected, sizeof(expected), "%" PRId64, (int64_t) u);
+		check_str(numfmt_int(buf, (int64_t) u), buf, expected);
+
+		snprintf(expected, sizeof(expected), "%" PRIx64, u);
+		check_str(numfmt_hex(buf, u), buf, expected);
+
+		snprintf(expected, sizeof(expected), "%" PRId64, (int64_t) u);
+		assert(numfmt_parse_int(expected, &parsed) == expected + strlen(expected));
+		assert(parsed == u);
+
+		snprintf(expected, sizeof(expected), "%" PRIx64, u);
+		assert(numfmt_parse_hex(expected, &parsed) == expected + strlen(expected));
+		assert(parsed == u);
+	}
+}
+
+void test_double_fixed(void) {
+	char buf[NUMFMT_MAX_LEN + 1];
+
+	check_str(numfmt_double(buf, 0.0), buf, "0.0");
+	check_str(numfmt_double(buf, -0.0), buf, "-0.0");
+	check_str(numfmt_double(buf, 1.0), buf, "1.0");
+	check_str(numfmt_double(buf, 0.1), buf, "0.1");
+	check_str(numfmt_double(buf, 0.3), buf, "0.3");
+	check_str(numfmt_double(buf, 0.1 + 0.2), buf, "0.30000000000000004");
+	check_str(numfmt_double(buf, 3.25), buf, "3.25");
+	check_str(numfmt_double(buf, -1234.5), buf, "-1234.5");
+	check_str(numfmt_double(buf, 0.0001), buf, "0.0001");
+	check_str(numfmt_double(buf, 0.00001), buf, "1e-05");
+	check_str(numfmt_double(buf, 1.5e-5), buf, "1.5e-05");
+	check_str(numfmt_double(buf, 1e15), buf, "1000000000000000.0");
+	check_str(numfmt_double(buf, 1e16), buf, "1e+16");
+	check_str(numfmt_double(buf, 123456789012345680.0), buf, "1.2345678901234568e+17");
+	check_str(numfmt_double(buf, DBL_MAX), buf, "1.7976931348623157e+308");
+	check_str(numfmt_double(buf, DBL_MIN), buf, "2.2250738585072014e-308");
+	check_str(numfmt_double(buf, 5e-324), buf, "5e-324");
+	check_str(numfmt_double(buf, HUGE_VAL), buf, "inf");
+	check_str(numfmt_double(buf, -HUGE_VAL), buf, "-inf");
+
+	check_str(numfmt_float(buf, 0.1f), buf, "0.1");
+	check_str(numfmt_float(buf, 3.4028235e38f), buf, "3.4028235e+38");
+	check_str(numfmt_float(buf, 1e-45f), buf, "1e-45");
+	check_str(numfmt_float(buf, 16777216.0f), buf, "16777216.0");
+}
+
+/* Number of significant digits in formatted number */
+static int count_digits(const char* buf) {
+	const char* p = buf;
+	int digits = 0, zeroes = 0;
+
+	while(*p == '-' || *p == '0' || *p == '.')
+		++p;
+
+	for( ; *p != '\0' && *p != 'e'; ++p) {
+		if(*p == '.')
+			continue;
+
+		if(*p == '0') {
+			++zeroes;
+			continue;
+		}
+
+		digits += zeroes + 1;
+		zeroes = 0;
+	}
+
+	return digits;
+}
+
+/* Shortest representation parses back to the same value and
+ * no shorter representation does */
+void test_double_roundtrip(void) {
+	char buf[NUMFMT_MAX_LEN + 1];
+	char shorter[64];
+	uint64_t bits;
+	uint32_t fbits;
+	double d, d2;
+	float f, f2;
+	size_t len;
+	int i, prec;
+
+	for(i = 0; i < NRANDOM; ++i) {
+		bits = xorshift();
+		if(i % 4 == 1)
+			bits &= 0x800FFFFFFFFFFFFFull;	/* subnormals */
+		memcpy(&d, &bits, sizeof(double));
+
+		if(d != d || d - d != 0.0)
+			continue;
+
+		len = numfmt_double(buf, d);
+		assert(len < NUMFMT_MAX_LEN);
+		buf[len] = '\0';
+
+		d2 = strtod(buf, NULL);
+		assert(memcmp(&d, &d2, sizeof(double)) == 0);
+
+		assert(numfmt_parse_double(buf, &d2) == buf + len);
+		assert(memcmp(&d, &d2, sizeof(double)) == 0);
+
+		for(prec = 0; prec < 16; ++prec) {
+			snprintf(shorter, sizeof(shorter), "%.*e", prec, d);
+			if(strtod(shorter, NULL) == d)
+				break;
+		}
+		assert(count_digits(buf) <= prec + 1);
+
+		fbits = (uint32_t) bits;
+		if(i % 4 == 2)
+			fbits &= 0x807FFFFF;
+		memcpy(&f, &fbits, sizeof(float));
+
+		if(f != f || f - f != 0.0f)
+			continue;
+
+		len = numfmt_float(buf, f);
+		buf[len] = '\0';
+
+		f2 = strtof(buf, NULL);
+		assert(memcmp(&f, &f2, sizeof(float)) == 0);
+
+		assert(numfmt_parse_float(buf, &f2) == buf + len);
+		assert(memcmp(&f, &f2, sizeof(float)) == 0);
+
+		for(prec = 0; prec < 8; ++prec) {
+			snprintf(shorter, sizeof(shorter), "%.*e", prec, f);
+			if(strtof(shorter, NULL) == f)
+				break;
+		}
+		assert(count_digits(buf) <= prec + 1);
+	}
+}
+
+void test_parse(void) {
+	static const char* numbers[] = {
+		"0", "-0", "1", "-1", "3.25", "0.1", ".5", "5.", "1e10", "1E-10",
+		"123456789012345678901234567890", "0.000000000000000000000000001234",
+		"9007199254740993", "1.7976931348623157e308", "4.9e-324", "1e400",
+		"  42", "+7", "2.5e+3", NULL
+	};
+
+	const char** number;
+	const char* end;
+	char* expected_end;
+	double d, expected;
+	uint64_t u;
+
+	for(number = numbers; *number != NULL; ++number) {
+		expected = strtod(*number, &expected_end);
+
+		end = numfmt_parse_double(*number, &d);
+		assert(end == expected_end);
+		assert(memcmp(&d, &expected, sizeof(double)) == 0);
+	}
+
+	assert(numfmt_parse_double("", &d) == NULL);
+	assert(numfmt_parse_double("-", &d) == NULL);
+	assert(numfmt_parse_double("abc", &d) == NULL);
+
+	/* Exponent without digits is not a part of number */
+	end = numfmt_parse_double("1e,", &d);
+	assert(end != NULL && *end == 'e' && d == 1.0);
+
+	end = numfmt_parse_int(" -12,", &u);
+	assert(end != NULL && *end == ',' && (int64_t) u == -12);
+
+	end = numfmt_parse_hex("0xFf,", &u);
+	assert(end != NULL && *end == ',' && u == 255);
+
+	assert(numfmt_parse_int("x", &u) == NULL);
+	assert(numfmt_parse_hex("g", &u) == NULL);
+}
+
+int test_main(void) {
+	test_int();
+	test_double_fixed();
+	test_double_roundtrip();
+	test_parse();
+
+	return 0;
+}
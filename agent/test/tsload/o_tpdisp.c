@@ -96,6 +96,74 @@ void test_tpd_fillup_unused(void) {
 	json_node_destroy(node);
 }
 
+void test_tpd_ring(void) {
+	tp_disp_t* disp;
+	TEST_PREAMBLE("{ " JSON_PROP("type", "ring") " }");
+
+	disp = tsobj_tp_disp_proc(node);
+	assert(disp != NULL);
+
+	tpd_destroy_impl(disp);
+	json_node_destroy(node);
+}
+
+void test_tpd_ring_invalid_dispatch(void) {
+	TEST_PREAMBLE("{ " JSON_PROP("type", "ring") ",  "
+					   JSON_PROP("dispatch", "first-free") " }");
+	assert(tsobj_tp_disp_proc(node) == NULL);
+	json_node_destroy(node);
+}
+
+void test_tpd_ring_fillup_no_n(void) {
+	TEST_PREAMBLE("{ " JSON_PROP("type", "ring") ",  "
+					   JSON_PROP("dispatch", "fill-up") ",  "
+					   JSON_PROP("wid", 1)" }");
+	assert(tsobj_tp_disp_proc(node) == NULL);
+	json_node_destroy(node);
+}
+
+void test_tpd_ring_fillup(void) {
+	tp_disp_t* disp;
+	TEST_PREAMBLE("{ " JSON_PROP("type", "ring") ",  "
+					   JSON_PROP("dispatch", "fill-up") ",  "
+					   JSON_PROP("size", 1000) ",  "
+					   JSON_PROP("n", 10) ",  "
+					   JSON_PROP("wid", 1)" }");
+
+	disp = tsobj_tp_disp_proc(node);
+	assert(disp != NULL);
+
+	tpd_destroy_impl(disp);
+	json_node_destroy(node);
+}
+
+void test_tpd_steal(void) {
+	tp_disp_t* disp;
+	TEST_PREAMBLE("{ " JSON_PROP("type", "work-stealing") ",  "
+					   JSON_PROP("dispatch", "user") ",  "
+					   JSON_PROP("interval", 100000) " }");
+
+	disp = tsobj_tp_disp_proc(node);
+	assert(disp != NULL);
+
+	tpd_destroy_impl(disp);
+	json_node_destroy(node);
+}
+
+void test_tpd_steal_invalid_dispatch(void) {
+	TEST_PREAMBLE("{ " JSON_PROP("type", "work-stealing") ",  "
+					   JSON_PROP("dispatch", "fill-up") " }");
+	assert(tsobj_tp_disp_proc(node) == NULL);
+	json_node_destroy(node);
+}
+
+void test_tpd_steal_invalid_interval(void) {
+	TEST_PREAMBLE("{ " JSON_PROP("type", "work-stealing") ",  "
+					   JSON_PROP("interval", 0) " }");
+	assert(tsobj_tp_disp_proc(node) == NULL);
+	json_node_destroy(node);
+}
+
 int tsload_test_main() {
 	test_tpd_bad();
 	test_tpd_empty();
@@ -109,5 +177,14 @@ int tsload_test_main() {
 	test_tpd_fillup();
 	test_tpd_fillup_unused();
 
+	test_tpd_ring();
+	test_tpd_ring_invalid_dispatch();
+	test_tpd_ring_fillup_no_n();
+	test_tpd_ring_fillup();
+
+	test_tpd_steal();
+	test_tpd_steal_invalid_dispatch();
+	test_tpd_steal_invalid_interval();
+
 	return 0;
 }
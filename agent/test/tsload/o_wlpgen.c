@@ -187,6 +187,8 @@ void test_int_randvar_ok(void) {
 }
 
 void test_int_randgen_ok(void) {
+	wlp_integer_t max;
+
 	WLP_TEST_PREAMBLE("i",
 		"{ " JSON_PROP2("i", "{ "
 					JSON_RANDGEN
@@ -195,6 +197,8 @@ void test_int_randgen_ok(void) {
 	assert(tsobj_wlpgen_proc(param, &int_param, wl)
 				== WLPARAM_TSOBJ_OK);
 	assert(!list_empty(&wl->wl_wlpgen_head));
+	assert(wlpgen_get_max_integer(wl, "i", &max) && max == 100);
+	assert(!wlpgen_get_max_integer(wl, "s", &max));
 	wlpgen_destroy_all(wl);
 
 	json_node_destroy(node);
@@ -298,6 +302,8 @@ void test_int_pmap_small_probability(void) {
 }
 
 void test_int_pmap_normal_probability(void) {
+	wlp_integer_t max;
+
 	PMAP_TEST_PREAMBLE("i", "["
 				"{"
 					JSON_PROP("probability", 0.3) ", "
@@ -320,6 +326,7 @@ void test_int_pmap_normal_probability(void) {
 	assert(tsobj_wlpgen_proc(param, &int_param, wl)
 				== WLPARAM_TSOBJ_OK);
 	assert(!list_empty(&wl->wl_wlpgen_head));
+	assert(wlpgen_get_max_integer(wl, "i", &max) && max == 10);
 	wlpgen_destroy_all(wl);
 
 	json_node_destroy(node);
@@ -383,6 +390,8 @@ void test_int_pmap_valarray_invalid_node(void) {
 }
 
 void test_int_pmap_valarray_ok(void) {
+	wlp_integer_t max;
+
 	PMAP_TEST_PREAMBLE("i", "["
 				"{"
 					JSON_PROP("probability", 0.4) ", "
@@ -397,6 +406,31 @@ void test_int_pmap_valarray_ok(void) {
 	assert(tsobj_wlpgen_proc(param, &int_param, wl)
 				== WLPARAM_TSOBJ_OK);
 	assert(!list_empty(&wl->wl_wlpgen_head));
+	assert(wlpgen_get_max_integer(wl, "i", &max) && max == 30);
+	wlpgen_destroy_all(wl);
+
+	json_node_destroy(node);
+}
+
+/* Maximum should be taken from values only: valarray entries do
+ * not initialize probability->value which may contain zero */
+void test_int_pmap_valarray_max_negative(void) {
+	wlp_integer_t max;
+
+	PMAP_TEST_PREAMBLE("i", "["
+				"{"
+					JSON_PROP("probability", 0.4) ", "
+					JSON_PROP2("valarray", "[ -5, -3 ]")
+				"}, "
+				"{"
+					JSON_PROP("probability", 0.6) ", "
+					JSON_PROP("value", -8)
+				"} "
+			"]");
+
+	assert(tsobj_wlpgen_proc(param, &int_param, wl)
+				== WLPARAM_TSOBJ_OK);
+	assert(wlpgen_get_max_integer(wl, "i", &max) && max == -3);
 	wlpgen_destroy_all(wl);
 
 	json_node_destroy(node);
@@ -470,6 +504,7 @@ int tsload_test_main() {
 	test_int_pmap_empty_valarray();
 	test_int_pmap_valarray_invalid_node();
 	test_int_pmap_valarray_ok();
+	test_int_pmap_valarray_max_negative();
 
 	test_string_randvar();
 	test_string_pmap_ok();
@@ -0,0 +1,425 @@
+/*
+    This file is part of TSLoad.
+    Copyright 2014, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+
+#include <tsload/json/json.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * jsonbench - compares parsing into heap-allocated DOM with parsing into
+ * arena (JSON_PARSE_ARENA) and lookups of children by name with and without
+ * hash index (dom mode), and parser throughput with each of JSON scanners
+ * (scan mode).
+ *
+ * If file is not specified, generates experiment result of JBSIZE bytes:
+ * JBWORKLOADS workloads with their parameters and an array of requests in
+ * format of tsobj_request_format_all(). Each round parses a fresh copy of
+ * the document, walks all requests reading their attributes, performs
+ * JBLOOKUPS lookups of random workloads, and destroys the document.
+ *
+ * Scan mode parses document into arena JBROUNDS times with scalar, SSE2
+ * and AVX2 scanners and reports throughput in MB/s for the document as is
+ * and reformatted with indentation (json_write_buf() with formatting).
+ *
+ * Write mode serializes JBWRITES requests by building a tree and calling
+ * json_write_count() and json_write_buf() and by streaming them into memory
+ * with json_stream_t.
+ *
+ * Usage: jsonbench [dom|scan|write] [file.json]
+ */
+
+#define JBSIZE			(100 * SZ_MB)
+#define JBWORKLOADS		2000
+#define JBLOOKUPS		1000000
+#define JBROUNDS		3
+#define JBWRITES		1000000
+
+#define CLOCK_DIFF(t2, t1)  (((double) (t2 - t1)) / T_MS)
+
+extern int init(void);
+
+LIBIMPORT unsigned json_index_min_children;
+
+struct jsonbench_result {
+	double parse;
+	double walk;
+	double lookup;
+	double destroy;
+
+	long requests;
+	long found;
+};
+
+static char* jsonbench_generate(size_t size, size_t* length) {
+	char* data = malloc(size + 4096);
+	char* p = data;
+	char* end = data + size;
+	long rqid = 0;
+	int wid;
+
+	p += sprintf(p, "{\"_type\": \"tsload.ExperimentResult\", \"workloads\": {");
+
+	for(wid = 0; wid < JBWORKLOADS; ++wid) {
+		p += sprintf(p, "%s\"wl%d\": {\"wltype\": \"simpleio_read\", \"threadpool\": \"tp%d\", "
+				  "\"params\": {\"filesize\": 16777216, \"block_size\": 4096, \"sparse\": false}}",
+				  (wid == 0) ? "" : ", ", wid, wid % 8);
+	}
+
+	p += sprintf(p, "}, \"requests\": [");
+
+	while(p < end) {
+		p += sprintf(p, "%s{\"_type\": \"tsload.Request\", \"workload_name\": \"wl%ld\", "
+				  "\"step\": %ld, \"request\": %ld, \"thread\": %ld, \"sched\": %ld, "
+				  "\"start\": %ld, \"end\": %ld, \"flags\": 3}",
+				  (rqid == 0) ? "" : ",\n", rqid % JBWORKLOADS, rqid / 1000, rqid,
+				  rqid % 16, rqid * 1000, rqid * 1000 + 17, rqid * 1000 + 1234);
+		++rqid;
+	}
+
+	p += sprintf(p, "]}");
+
+	*length = p - data;
+	return data;
+}
+
+static char* jsonbench_read(const char* path, size_t* length) {
+	FILE* file = fopen(path, "rb");
+	char* data;
+
+	if(file == NULL) {
+		fprintf(stderr, "Failed to open '%s'\n", path);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	*length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = malloc(*length);
+	if(fread(data, 1, *length, file) != *length) {
+		fprintf(stderr, "Failed to read '%s'\n", path);
+		free(data);
+		data = NULL;
+	}
+
+	fclose(file);
+	return data;
+}
+
+static void jsonbench_walk(json_node_t* root, struct jsonbench_result* result) {
+	json_node_t* requests;
+	json_node_t* rq;
+	const char* wl_name;
+	int64_t value;
+	int id;
+
+	if(json_get_array(root, "requests", &requests) != JSON_OK)
+		return;
+
+	json_for_each(requests, rq, id) {
+		if(json_get_string(rq, "workload_name", &wl_name) == JSON_OK &&
+		   json_get_integer_i64(rq, "start", &value) == JSON_OK &&
+		   json_get_integer_i64(rq, "end", &value) == JSON_OK &&
+		   json_get_integer_i64(rq, "flags", &value) == JSON_OK) {
+			++result->requests;
+		}
+	}
+}
+
+static void jsonbench_lookup(json_node_t* root, struct jsonbench_result* result) {
+	json_node_t* workloads;
+	char name[32];
+	int i;
+
+	if(json_get_node(root, "workloads", &workloads) != JSON_OK)
+		return;
+
+	for(i = 0; i < JBLOOKUPS; ++i) {
+		sprintf(name, "wl%d", rand() % JBWORKLOADS);
+
+		if(json_find_opt(workloads, name) != NULL)
+			++result->found;
+	}
+}
+
+static int jsonbench_run(const char* data, size_t length, int flags, struct jsonbench_result* result) {
+	json_buffer_t* buf;
+	json_node_t* root;
+	ts_time_t t1, t2, t3, t4, t5;
+	int ret;
+
+	memset(result, 0, sizeof(*result));
+
+	buf = json_buf_create((char*) data, length, B_FALSE);
+
+	t1 = tm_get_clock();
+	ret = json_parse_ex(buf, &root, flags);
+	t2 = tm_get_clock();
+
+	if(ret != JSON_OK) {
+		fprintf(stderr, "Parse error: %s\n", json_error_message());
+		return ret;
+	}
+
+	jsonbench_walk(root, result);
+	t3 = tm_get_clock();
+
+	jsonbench_lookup(root, result);
+	t4 = tm_get_clock();
+
+	json_node_destroy(root);
+	t5 = tm_get_clock();
+
+	result->parse = CLOCK_DIFF(t2, t1);
+	result->walk = CLOCK_DIFF(t3, t2);
+	result->lookup = CLOCK_DIFF(t4, t3);
+	result->destroy = CLOCK_DIFF(t5, t4);
+
+	return JSON_OK;
+}
+
+static void jsonbench_mode(const char* name, const char* data, size_t length,
+						   int flags, unsigned min_children) {
+	struct jsonbench_result result;
+	int round;
+
+	json_index_min_children = min_children;
+
+	for(round = 0; round < JBROUNDS; ++round) {
+		srand(1);
+
+		if(jsonbench_run(data, length, flags, &result) != JSON_OK)
+			return;
+
+		printf("%8s %8s %5d %10.2f %10.2f %10.2f %10.2f %10ld %10ld\n",
+			   name, (min_children > 0) ? "yes" : "no", round,
+			   result.parse, result.walk, result.lookup, result.destroy,
+			   result.requests, result.found);
+	}
+}
+
+static char* jsonbench_format(const char* data, size_t length, size_t* fmt_length) {
+	json_buffer_t* buf = json_buf_create((char*) data, length, B_FALSE);
+	json_node_t* root;
+	char* fmt_data;
+
+	if(json_parse_ex(buf, &root, JSON_PARSE_ARENA) != JSON_OK)
+		return NULL;
+
+	*fmt_length = json_write_count(root, B_TRUE);
+	fmt_data = malloc(*fmt_length + 1);
+
+	json_write_buf(root, fmt_data, *fmt_length + 1, B_TRUE);
+	json_node_destroy(root);
+
+	return fmt_data;
+}
+
+static void jsonbench_scan(const char* name, const char* data, size_t length) {
+	const char* scanners[] = { "scalar", "sse2", "avx2", NULL };
+
+	json_buffer_t* buf;
+	json_node_t* root;
+	ts_time_t t1, t2;
+	double best;
+	int si, round;
+
+	for(si = 0; scanners[si] != NULL; ++si) {
+		if(json_select_scanner(scanners[si]) != JSON_OK)
+			continue;
+
+		best = 0.0;
+
+		for(round = 0; round < JBROUNDS; ++round) {
+			buf = json_buf_create((char*) data, length, B_FALSE);
+
+			t1 = tm_get_clock();
+			if(json_parse_ex(buf, &root, JSON_PARSE_ARENA) != JSON_OK) {
+				fprintf(stderr, "Parse error: %s\n", json_error_message());
+				return;
+			}
+			t2 = tm_get_clock();
+
+			json_node_destroy(root);
+
+			if(best == 0.0 || CLOCK_DIFF(t2, t1) < best)
+				best = CLOCK_DIFF(t2, t1);
+		}
+
+		printf("%10s %8s %10.1f %10.2f %10.1f\n", name, scanners[si],
+			   ((double) length) / SZ_MB, best,
+			   (((double) length) / SZ_MB) / (best / 1000.0));
+	}
+
+	json_select_scanner("auto");
+}
+
+static void jsonbench_dom(const char* data, size_t length) {
+	unsigned min_children = json_index_min_children;
+
+	printf("document: %.1f MB, %d lookups\n", ((double) length) / SZ_MB, JBLOOKUPS);
+	printf("%8s %8s %5s %10s %10s %10s %10s %10s %10s\n",
+		   "alloc", "index", "round", "parse, ms", "walk, ms", "lookup, ms",
+		   "free, ms", "requests", "found");
+
+	jsonbench_mode("heap", data, length, JSON_PARSE_DEFAULT, 0);
+	jsonbench_mode("heap", data, length, JSON_PARSE_DEFAULT, min_children);
+	jsonbench_mode("arena", data, length, JSON_PARSE_ARENA, 0);
+	jsonbench_mode("arena", data, length, JSON_PARSE_ARENA, min_children);
+}
+
+static void jsonbench_write_request(json_node_t* arr, json_stream_t* stream, long rqid) {
+	json_node_t* rq;
+
+	if(stream == NULL) {
+		rq = json_new_node("tsload.Request");
+
+		json_add_string(rq, JSON_STR("workload_name"), json_str_create("wl"));
+		json_add_integer(rq, JSON_STR("step"), rqid / 1000);
+		json_add_integer(rq, JSON_STR("request"), rqid);
+		json_add_integer(rq, JSON_STR("thread"), rqid % 16);
+		json_add_integer(rq, JSON_STR("sched"), rqid * 1000);
+		json_add_integer(rq, JSON_STR("start"), rqid * 1000 + 17);
+		json_add_integer(rq, JSON_STR("end"), rqid * 1000 + 1234);
+		json_add_integer(rq, JSON_STR("flags"), 3);
+
+		json_add_node(arr, NULL, rq);
+		return;
+	}
+
+	json_stream_begin_object(stream, "tsload.Request");
+
+	json_stream_add_string(stream, "workload_name", "wl");
+	json_stream_add_integer(stream, "step", rqid / 1000);
+	json_stream_add_integer(stream, "request", rqid);
+	json_stream_add_integer(stream, "thread", rqid % 16);
+	json_stream_add_integer(stream, "sched", rqid * 1000);
+	json_stream_add_integer(stream, "start", rqid * 1000 + 17);
+	json_stream_add_integer(stream, "end", rqid * 1000 + 1234);
+	json_stream_add_integer(stream, "flags", 3);
+
+	json_stream_end_object(stream);
+}
+
+static void jsonbench_write(boolean_t formatted) {
+	json_node_t* arr;
+	json_stream_t* stream;
+	char* data;
+	size_t length;
+	ts_time_t t1, t2, t3;
+	long rqid;
+	int round;
+
+	for(round = 0; round < JBROUNDS; ++round) {
+		t1 = tm_get_clock();
+
+		arr = json_new_array();
+		for(rqid = 0; rqid < JBWRITES; ++rqid)
+			jsonbench_write_request(arr, NULL, rqid);
+
+		length = json_write_count(arr, formatted) + 1;
+		data = malloc(length);
+		json_write_buf(arr, data, length, formatted);
+
+		json_node_destroy(arr);
+		free(data);
+
+		t2 = tm_get_clock();
+
+		stream = json_stream_create(formatted);
+
+		json_stream_begin_array(stream);
+		for(rqid = 0; rqid < JBWRITES; ++rqid)
+			jsonbench_write_request(NULL, stream, rqid);
+		json_stream_end_array(stream);
+
+		json_stream_data(stream, &length);
+		json_stream_destroy(stream);
+
+		t3 = tm_get_clock();
+
+		printf("%10s %5d %10.1f %10.2f %10.2f\n", formatted ? "formatted" : "compact",
+			   round, ((double) length) / SZ_MB, CLOCK_DIFF(t2, t1), CLOCK_DIFF(t3, t2));
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const char* mode = NULL;
+	char* data;
+	char* fmt_data;
+	size_t length, fmt_length;
+
+	if(argc > 1)
+		mode = argv[1];
+
+	setenv("TS_LOGFILE", "-", B_FALSE);
+
+	init();
+
+	if(mode != NULL && strcmp(mode, "write") == 0) {
+		printf("%d requests\n", JBWRITES);
+		printf("%10s %5s %10s %10s %10s\n", "document", "round", "size, MB",
+			   "tree, ms", "stream, ms");
+
+		jsonbench_write(B_FALSE);
+		jsonbench_write(B_TRUE);
+
+		return 0;
+	}
+
+	if(argc > 2) {
+		data = jsonbench_read(argv[2], &length);
+		if(data == NULL)
+			return 1;
+	}
+	else {
+		data = jsonbench_generate(JBSIZE, &length);
+	}
+
+	if(mode == NULL || strcmp(mode, "dom") == 0) {
+		jsonbench_dom(data, length);
+	}
+
+	if(mode == NULL || strcmp(mode, "scan") == 0) {
+		fmt_data = jsonbench_format(data, length, &fmt_length);
+		if(fmt_data == NULL) {
+			fprintf(stderr, "Parse error: %s\n", json_error_message());
+			return 1;
+		}
+
+		printf("%10s %8s %10s %10s %10s\n", "document", "scanner", "size, MB",
+			   "parse, ms", "MB/s");
+
+		jsonbench_scan("compact", data, length);
+		jsonbench_scan("formatted", fmt_data, fmt_length);
+
+		free(fmt_data);
+	}
+
+	free(data);
+
+	return 0;
+}
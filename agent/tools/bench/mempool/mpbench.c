@@ -1,4 +1,3 @@
-
 /*
     This file is part of TSLoad.
     Copyright 2013, Sergey Klyaus, ITMO University
@@ -13,32 +12,86 @@
     GNU General Public License for more details.
 
     You should have received a copy of the GNU General Public License
-    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.    
-*/  
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
 
 
+#include <tsload/defs.h>
 
-#include <defs.h>
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+#include <tsload/threads.h>
 
-#include <log.h>
-#include <mempool.h>
-#include <tstime.h>
-#include <threads.h>
+#include <tsload/load/workload.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+/**
+ * mpbench - compares mempool allocators with libc ones
+ *
+ * malloc - each of MALLOCTHREADS threads allocates MALLOCCOUNT / 2 areas of
+ * 		random size, frees half of them, and allocates MALLOCCOUNT / 2 areas again
+ * slab - each thread allocates SLABBATCH items from a SLAB cache and frees them,
+ * 		SLABROUNDS times. Runs for 1 to 64 threads and compares libc, SLAB pages
+ * 		(mp_cache_alloc_array() with single item) and per-thread magazines
+ * 		(mp_cache_alloc()).
+ * small - each thread allocates SMALLBATCH areas of random size up to
+ * 		SMALLMAXSIZE bytes and frees them in random order, SMALLROUNDS times.
+ * 		Runs for 1 to 64 threads and compares libc and mp_malloc(). After that
+ * 		keeps SMALLLIVE areas allocated while replacing random ones SMALLCHURN
+ * 		times and reports ratio of allocated bytes to requested bytes
+ * 		(only for mempool allocator).
+ * request - each thread creates RQBATCH requests and destroys them, RQROUNDS
+ * 		times. Compares old scheme where request_t is allocated from SLAB cache
+ * 		and its params are allocated with mp_malloc() with params that are kept
+ * 		inline in cache entry of sizeof(request_t) + params size bytes.
+ *
+ * Usage: mpbench [malloc|slab|small|request]
+ */
+
 #define MALLOCCOUNT 		1000
 #define MALLOCMAXSIZE		512
 #define MALLOCTHREADS		4
 
-LIBIMPORT char log_filename[LOGFNMAXLEN];
+#define SLABBATCH			48
+#define SLABROUNDS			4000
+#define SLABMAXTHREADS		64
+
+#define SMALLBATCH			64
+#define SMALLROUNDS			2000
+#define SMALLMAXSIZE		256
+#define SMALLLIVE			4096
+#define SMALLCHURN			200000
+
+#define RQBATCH				64
+#define RQROUNDS			2000
 
 #define CLOCK_DIFF(t2, t1)  (((double) (t2 - t1)) / T_SEC)
 
+extern int init(void);
+
+#ifndef MEMPOOL_USE_LIBC_HEAP
+extern size_t mp_get_size(void* ptr);
+#endif
+
 int mallocs[MALLOCCOUNT];
 
+int slab_threads[] = { 1, 2, 4, 8, 16, 32, 64, -1 };
+
+typedef struct {
+	char data[64];
+} slab_item_t;
+
+mp_cache_t slab_cache;
+
+int rq_params_sizes[] = { 16, 64, 256, -1 };
+
+mp_cache_t rq_cache;
+size_t rq_params_size;
+
 struct benchmark {
 	void* (*alloc_func)(size_t sz);
 	void (*free_func)(void* ptr);
@@ -48,7 +101,51 @@ struct benchmark {
 	double tm_2nd_malloc;
 };
 
-thread_event_t bench_event;
+struct slab_benchmark {
+	void* (*alloc_func)(void);
+	void (*free_func)(void* ptr);
+
+	ts_time_t time;
+};
+
+struct small_benchmark {
+	void* (*alloc_func)(size_t sz);
+	void (*free_func)(void* ptr);
+
+	unsigned seed;
+	ts_time_t time;
+};
+
+/* Threads wait for bench_started, so all of them start simultaneously */
+thread_mutex_t bench_mutex;
+thread_cv_t bench_cv;
+boolean_t bench_started;
+
+static void bench_init(void) {
+	mutex_init(&bench_mutex, "bench_mutex");
+	cv_init(&bench_cv, "bench_cv");
+
+	bench_started = B_FALSE;
+}
+
+static void bench_wait(void) {
+	mutex_lock(&bench_mutex);
+	while(!bench_started)
+		cv_wait(&bench_cv, &bench_mutex);
+	mutex_unlock(&bench_mutex);
+}
+
+static void bench_start(void) {
+	mutex_lock(&bench_mutex);
+	bench_started = B_TRUE;
+	cv_notify_all(&bench_cv);
+	mutex_unlock(&bench_mutex);
+}
+
+static void bench_fini(void) {
+	cv_destroy(&bench_cv);
+	mutex_destroy(&bench_mutex);
+}
 
 thread_result_t bench(thread_arg_t arg) {
 	THREAD_ENTRY(arg, struct benchmark, b);
@@ -57,27 +154,27 @@ thread_result_t bench(thread_arg_t arg) {
 	void* ptrs[MALLOCCOUNT];
 	ts_time_t t1, t2, t3, t4;
 
-	event_wait(&bench_event);
+	bench_wait();
 
-	t1 = tm_get_time();
+	t1 = tm_get_clock();
 
 	for(i = 0; i < (MALLOCCOUNT / 2); ++i) {
 		ptrs[i] = b->alloc_func(mallocs[i]);
 	}
 
-	t2 = tm_get_time();
+	t2 = tm_get_clock();
 
 	for(i = 0; i < (MALLOCCOUNT / 2); i += 2) {
 		b->free_func(ptrs[i]);
 	}
 
-	t3 = tm_get_time();
+	t3 = tm_get_clock();
 
 	for(i = (MALLOCCOUNT / 2); i < MALLOCCOUNT; ++i) {
 		ptrs[i] = b->alloc_func(mallocs[i]);
 	}
 
-	t4 = tm_get_time();
+	t4 = tm_get_clock();
 
 	for(i = 1; i < (MALLOCCOUNT / 2); i += 2)
 		b->free_func(ptrs[i]);
@@ -91,14 +188,16 @@ THREAD_END:
 	THREAD_FINISH(arg);
 }
 
-int run_bechmark(const char* name,
-				 void* (*alloc_func)(size_t sz),
-				 void (*free_func)(void* ptr)) {
+void run_benchmark(const char* name,
+				   void* (*alloc_func)(size_t sz),
+				   void (*free_func)(void* ptr)) {
 	thread_t bench_threads[MALLOCTHREADS];
 	int j = 0;
 
 	struct benchmark b[MALLOCTHREADS];
 
+	bench_init();
+
 	for(j = 0; j < MALLOCTHREADS; ++j) {
 		b[j].alloc_func = alloc_func;
 		b[j].free_func  = free_func;
@@ -107,7 +206,7 @@ int run_bechmark(const char* name,
 		t_wait_start(bench_threads + j);
 	}
 
-	event_notify_all(&bench_event);
+	bench_start();
 
 	printf("%s results:\n", name);
 
@@ -117,29 +216,414 @@ int run_bechmark(const char* name,
 		printf("\t %d	%.12f %.12f %.12f\n", j, b[j].tm_malloc,
 				 b[j].tm_free, b[j].tm_2nd_malloc);
 	}
+
+	bench_fini();
+}
+
+static void* slab_libc_alloc(void) {
+	return malloc(sizeof(slab_item_t));
+}
+
+static void* slab_page_alloc(void) {
+	return mp_cache_alloc_array(&slab_cache, 1);
+}
+
+static void slab_page_free(void* ptr) {
+	mp_cache_free_array(&slab_cache, ptr, 1);
+}
+
+static void* slab_mag_alloc(void) {
+	return mp_cache_alloc(&slab_cache);
+}
+
+static void slab_mag_free(void* ptr) {
+	mp_cache_free(&slab_cache, ptr);
+}
+
+thread_result_t slab_bench(thread_arg_t arg) {
+	THREAD_ENTRY(arg, struct slab_benchmark, b);
+
+	void* ptrs[SLABBATCH];
+	ts_time_t t1;
+	int round, i;
+
+	bench_wait();
+
+	t1 = tm_get_clock();
+
+	for(round = 0; round < SLABROUNDS; ++round) {
+		for(i = 0; i < SLABBATCH; ++i) {
+			ptrs[i] = b->alloc_func();
+		}
+
+		for(i = 0; i < SLABBATCH; ++i) {
+			b->free_func(ptrs[i]);
+		}
+	}
+
+	b->time = tm_get_clock() - t1;
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+/**
+ * Run slab benchmark on nthreads threads
+ *
+ * @return number of alloc/free pairs per second (in millions)
+ */
+double run_slab_benchmark(int nthreads, void* (*alloc_func)(void),
+						  void (*free_func)(void* ptr)) {
+	thread_t bench_threads[SLABMAXTHREADS];
+	struct slab_benchmark b[SLABMAXTHREADS];
+	ts_time_t max_time = 0;
+	int j;
+
+	bench_init();
+
+	for(j = 0; j < nthreads; ++j) {
+		b[j].alloc_func = alloc_func;
+		b[j].free_func  = free_func;
+
+		t_init(bench_threads + j, &b[j], slab_bench, "slab-bench-%d", j);
+		t_wait_start(bench_threads + j);
+	}
+
+	bench_start();
+
+	for(j = 0; j < nthreads; ++j) {
+		t_destroy(bench_threads + j);
+
+		if(b[j].time > max_time)
+			max_time = b[j].time;
+	}
+
+	bench_fini();
+
+	return ((double) nthreads * SLABROUNDS * SLABBATCH) / CLOCK_DIFF(max_time, 0) / 1e6;
+}
+
+void run_slab_benchmarks(void) {
+	double libc, page, mag;
+	int ti;
+
+	mp_cache_init(&slab_cache, slab_item_t);
+
+	printf("slab: %d rounds of %d allocs/frees of %d bytes per thread\n",
+		   SLABROUNDS, SLABBATCH, (int) sizeof(slab_item_t));
+	printf("%8s %12s %12s %12s\n", "threads", "libc, M/s", "page, M/s", "mag, M/s");
+
+	for(ti = 0; slab_threads[ti] > 0; ++ti) {
+		libc = run_slab_benchmark(slab_threads[ti], slab_libc_alloc, free);
+		page = run_slab_benchmark(slab_threads[ti], slab_page_alloc, slab_page_free);
+		mag = run_slab_benchmark(slab_threads[ti], slab_mag_alloc, slab_mag_free);
+
+		printf("%8d %12.2f %12.2f %12.2f\n", slab_threads[ti], libc, page, mag);
+	}
+
+	mp_cache_destroy(&slab_cache);
+}
+
+thread_result_t small_bench(thread_arg_t arg) {
+	THREAD_ENTRY(arg, struct small_benchmark, b);
+
+	void* ptrs[SMALLBATCH];
+	int sizes[SMALLBATCH];
+	int order[SMALLBATCH];
+	ts_time_t t1;
+	int round, i, j, tmp;
+
+	/* Pregenerate sizes and order of frees so rand_r() is not measured */
+	for(i = 0; i < SMALLBATCH; ++i) {
+		sizes[i] = 1 + rand_r(&b->seed) % SMALLMAXSIZE;
+		order[i] = i;
+	}
+
+	for(i = SMALLBATCH - 1; i > 0; --i) {
+		j = rand_r(&b->seed) % (i + 1);
+		tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+	}
+
+	bench_wait();
+
+	t1 = tm_get_clock();
+
+	for(round = 0; round < SMALLROUNDS; ++round) {
+		for(i = 0; i < SMALLBATCH; ++i) {
+			ptrs[i] = b->alloc_func(sizes[i]);
+		}
+
+		for(i = 0; i < SMALLBATCH; ++i) {
+			b->free_func(ptrs[order[i]]);
+		}
+	}
+
+	b->time = tm_get_clock() - t1;
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+/**
+ * Run small allocations benchmark on nthreads threads
+ *
+ * @return number of alloc/free pairs per second (in millions)
+ */
+double run_small_benchmark(int nthreads, void* (*alloc_func)(size_t sz),
+						   void (*free_func)(void* ptr)) {
+	thread_t bench_threads[SLABMAXTHREADS];
+	struct small_benchmark b[SLABMAXTHREADS];
+	ts_time_t max_time = 0;
+	int j;
+
+	bench_init();
+
+	for(j = 0; j < nthreads; ++j) {
+		b[j].alloc_func = alloc_func;
+		b[j].free_func  = free_func;
+		b[j].seed = j + 1;
+
+		t_init(bench_threads + j, &b[j], small_bench, "small-bench-%d", j);
+		t_wait_start(bench_threads + j);
+	}
+
+	bench_start();
+
+	for(j = 0; j < nthreads; ++j) {
+		t_destroy(bench_threads + j);
+
+		if(b[j].time > max_time)
+			max_time = b[j].time;
+	}
+
+	bench_fini();
+
+	return ((double) nthreads * SMALLROUNDS * SMALLBATCH) / CLOCK_DIFF(max_time, 0) / 1e6;
+}
+
+/**
+ * Keep SMALLLIVE areas allocated and replace random ones with areas
+ * of random size, then compare allocated and requested sizes
+ */
+void run_small_fragmentation(void) {
+	void** ptrs = malloc(SMALLLIVE * sizeof(void*));
+	int* sizes = malloc(SMALLLIVE * sizeof(int));
+	size_t requested = 0;
+	size_t allocated = 0;
+	ts_time_t t1, t2;
+	int i, j;
+
+	t1 = tm_get_clock();
+
+	for(i = 0; i < SMALLLIVE; ++i) {
+		sizes[i] = 1 + rand() % SMALLMAXSIZE;
+		ptrs[i] = mp_malloc(sizes[i]);
+	}
+
+	for(i = 0; i < SMALLCHURN; ++i) {
+		j = rand() % SMALLLIVE;
+
+		mp_free(ptrs[j]);
+
+		sizes[j] = 1 + rand() % SMALLMAXSIZE;
+		ptrs[j] = mp_malloc(sizes[j]);
+	}
+
+	t2 = tm_get_clock();
+
+	for(i = 0; i < SMALLLIVE; ++i) {
+		requested += sizes[i];
+#ifndef MEMPOOL_USE_LIBC_HEAP
+		allocated += mp_get_size(ptrs[i]);
+#endif
+		mp_free(ptrs[i]);
+	}
+
+	printf("churn: %d live areas, %d replacements in %.3f ms\n", SMALLLIVE,
+		   SMALLCHURN, CLOCK_DIFF(t2, t1) * 1000.0);
+
+	if(allocated > 0) {
+		printf("requested: %zu bytes allocated: %zu bytes ratio: %.3f\n",
+			   requested, allocated, ((double) allocated) / requested);
+	}
+
+	free(ptrs);
+	free(sizes);
+}
+
+void run_small_benchmarks(void) {
+	double libc, mp;
+	int ti;
+
+	printf("small: %d rounds of %d allocs/frees of 1-%d bytes per thread\n",
+		   SMALLROUNDS, SMALLBATCH, SMALLMAXSIZE);
+	printf("%8s %12s %12s\n", "threads", "libc, M/s", "mempool, M/s");
+
+	for(ti = 0; slab_threads[ti] > 0; ++ti) {
+		libc = run_small_benchmark(slab_threads[ti], malloc, free);
+		mp = run_small_benchmark(slab_threads[ti], mp_malloc, mp_free);
+
+		printf("%8d %12.2f %12.2f\n", slab_threads[ti], libc, mp);
+	}
+
+	run_small_fragmentation();
+}
+
+static void* rq_separate_alloc(void) {
+	request_t* rq = (request_t*) mp_cache_alloc(&rq_cache);
+
+	rq->rq_params = mp_malloc(rq_params_size);
+	memset(rq->rq_params, 0, rq_params_size);
+
+	return rq;
+}
+
+static void rq_separate_free(void* ptr) {
+	request_t* rq = (request_t*) ptr;
+
+	mp_free(rq->rq_params);
+	mp_cache_free(&rq_cache, rq);
+}
+
+static void* rq_inline_alloc(void) {
+	request_t* rq = (request_t*) mp_cache_alloc(&rq_cache);
+
+	rq->rq_params = (void*) (rq + 1);
+	memset(rq->rq_params, 0, rq_params_size);
+
+	return rq;
+}
+
+static void rq_inline_free(void* ptr) {
+	mp_cache_free(&rq_cache, ptr);
+}
+
+thread_result_t rq_bench(thread_arg_t arg) {
+	THREAD_ENTRY(arg, struct slab_benchmark, b);
+
+	void* ptrs[RQBATCH];
+	ts_time_t t1;
+	int round, i;
+
+	bench_wait();
+
+	t1 = tm_get_clock();
+
+	for(round = 0; round < RQROUNDS; ++round) {
+		for(i = 0; i < RQBATCH; ++i) {
+			ptrs[i] = b->alloc_func();
+		}
+
+		for(i = 0; i < RQBATCH; ++i) {
+			b->free_func(ptrs[i]);
+		}
+	}
+
+	b->time = tm_get_clock() - t1;
+
+THREAD_END:
+	THREAD_FINISH(arg);
+}
+
+/**
+ * Run request benchmark on nthreads threads
+ *
+ * @return number of created/destroyed requests per second (in millions)
+ */
+double run_rq_benchmark(int nthreads, void* (*alloc_func)(void),
+						void (*free_func)(void* ptr)) {
+	thread_t bench_threads[SLABMAXTHREADS];
+	struct slab_benchmark b[SLABMAXTHREADS];
+	ts_time_t max_time = 0;
+	int j;
+
+	bench_init();
+
+	for(j = 0; j < nthreads; ++j) {
+		b[j].alloc_func = alloc_func;
+		b[j].free_func  = free_func;
+
+		t_init(bench_threads + j, &b[j], rq_bench, "rq-bench-%d", j);
+		t_wait_start(bench_threads + j);
+	}
+
+	bench_start();
+
+	for(j = 0; j < nthreads; ++j) {
+		t_destroy(bench_threads + j);
+
+		if(b[j].time > max_time)
+			max_time = b[j].time;
+	}
+
+	bench_fini();
+
+	return ((double) nthreads * RQROUNDS * RQBATCH) / CLOCK_DIFF(max_time, 0) / 1e6;
 }
 
-int main() {
+void run_rq_benchmarks(void) {
+	double separate, inl;
+	int si, ti;
+
+	printf("request: %d rounds of %d requests per thread, sizeof(request_t) = %d\n",
+		   RQROUNDS, RQBATCH, (int) sizeof(request_t));
+	printf("%8s %8s %14s %14s\n", "params", "threads", "separate, M/s", "inline, M/s");
+
+	for(si = 0; rq_params_sizes[si] > 0; ++si) {
+		rq_params_size = rq_params_sizes[si];
+
+		for(ti = 0; slab_threads[ti] > 0; ++ti) {
+			mp_cache_init(&rq_cache, request_t);
+			separate = run_rq_benchmark(slab_threads[ti], rq_separate_alloc, rq_separate_free);
+			mp_cache_destroy(&rq_cache);
+
+			mp_cache_init_impl(&rq_cache, "request_t+params",
+							   sizeof(request_t) + rq_params_size);
+			inl = run_rq_benchmark(slab_threads[ti], rq_inline_alloc, rq_inline_free);
+			mp_cache_destroy(&rq_cache);
+
+			printf("%8d %8d %14.2f %14.2f\n", (int) rq_params_size,
+				   slab_threads[ti], separate, inl);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const char* mode = NULL;
 	int i;
 
-	strcpy(log_filename, "-");
+	if(argc > 1)
+		mode = argv[1];
+
+	setenv("TS_LOGFILE", "-", B_FALSE);
+
+	init();
 
-	log_init();
-	mempool_init();
-	threads_init();
+	srand(1);
 
-	event_init(&bench_event, "bench_event");
+	for(i = 0; i < MALLOCCOUNT; ++i) {
+		mallocs[i] = 1 + rand() % MALLOCMAXSIZE;
+	}
 
-	printf("%d mallocs, %d frees, %d mallocs \n", MALLOCCOUNT / 2,
-			MALLOCCOUNT / 4, MALLOCCOUNT / 2);
+	if(mode == NULL || strcmp(mode, "malloc") == 0) {
+		printf("%d mallocs, %d frees, %d mallocs \n", MALLOCCOUNT / 2,
+				MALLOCCOUNT / 4, MALLOCCOUNT / 2);
 
-	run_bechmark("libc", malloc, free);
-	run_bechmark("mempool", mp_malloc, mp_free);
+		run_benchmark("libc", malloc, free);
+		run_benchmark("mempool", mp_malloc, mp_free);
+	}
 
-	threads_fini();
-	mempool_fini();
-	log_fini();
+	if(mode == NULL || strcmp(mode, "slab") == 0) {
+		run_slab_benchmarks();
+	}
+
+	if(mode == NULL || strcmp(mode, "small") == 0) {
+		run_small_benchmarks();
+	}
+
+	if(mode == NULL || strcmp(mode, "request") == 0) {
+		run_rq_benchmarks();
+	}
 
 	return 0;
 }
-
@@ -0,0 +1,240 @@
+/*
+    This file is part of TSLoad.
+    Copyright 2013, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+#include <tsload/posixdecl.h>
+
+#include <tsload/pathutil.h>
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+#include <tsload/autostring.h>
+#include <tsload/list.h>
+
+#include <tsload/json/json.h>
+#include <tsload/obj/obj.h>
+
+#include <tsload/load/workload.h>
+#include <tsload/load/wltype.h>
+#include <tsload/load/rqsched.h>
+#include <tsload/load/threadpool.h>
+#include <tsload/load/tpdisp.h>
+#include <tsload.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * rqbench - measures per-step cost of request scheduler as function of
+ * number of requests in step. Creates fake workload and threadpool (no
+ * workers are run), generates requests for a single step and completes
+ * them in order of arrival, so post_request hook is the dominant cost for
+ * think-time scheduler.
+ *
+ * Usage: rqbench [think|iat|simple] [NUSERS]
+ */
+
+#define RQBENCH_QUANTUM		(1 * T_SEC)
+#define RQBENCH_SERVICE		(10 * T_US)
+
+#define CLOCK_DIFF(t2, t1)  (((double) (t2 - t1)) / T_MS)
+
+extern int init(void);
+
+static char mod_search_path[PATHMAXLEN];
+
+int rq_counts[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, -1 };
+
+long relink_count = 0;
+
+void rqbench_error_msg(ts_errcode_t code, const char* format, ...) {
+	va_list va;
+	char fmtstr[256];
+
+	snprintf(fmtstr, 256, "ERROR %d: %s\n", code, format);
+
+	va_start(va, format);
+	vfprintf(stderr, fmtstr, va);
+	va_end(va);
+}
+
+static void rqbench_relink_request(thread_pool_t* tp, request_t* rq) {
+	++relink_count;
+}
+
+tp_disp_class_t rqbench_disp_class;
+tp_disp_t rqbench_disp;
+thread_pool_t rqbench_tp;
+wl_type_t rqbench_wlt;
+
+static workload_t* rqbench_create_workload(const char* rqsched, int nusers) {
+	workload_t* wl = mp_malloc(sizeof(workload_t));
+	json_node_t* node;
+	char conf[256];
+
+	memset(wl, 0, sizeof(workload_t));
+
+	rqbench_disp_class.relink_request = rqbench_relink_request;
+	rqbench_disp.tpd_class = &rqbench_disp_class;
+	rqbench_disp.tpd_tp = &rqbench_tp;
+
+	rqbench_tp.tp_quantum = RQBENCH_QUANTUM;
+	rqbench_tp.tp_disp = &rqbench_disp;
+
+	rqbench_wlt.wlt_rqparams_size = 0;
+
+	aas_copy(aas_init(&wl->wl_name), "rqbench");
+	wl->wl_type = &rqbench_wlt;
+	wl->wl_tp = &rqbench_tp;
+
+	/* Hold workload forever so requests won't destroy it */
+	wl->wl_ref_count = (atomic_t) 1l;
+
+	mutex_init(&wl->wl_rq_mutex, "wl-%s-rq", wl->wl_name);
+	mutex_init(&wl->wl_status_mutex, "wl-%s-status", wl->wl_name);
+	list_head_init(&wl->wl_requests, "wl-%s-rqs", wl->wl_name);
+	list_head_init(&wl->wl_wlpgen_head, "wl-%s-wlpgen", wl->wl_name);
+
+	/* Requests are allocated from per-workload cache (see wl_create()) */
+	mp_cache_init_impl(&wl->wl_rq_cache, "wl-rq-rqbench",
+					   sizeof(request_t) + rqbench_wlt.wlt_rqparams_size);
+
+	if(strcmp(rqsched, "simple") == 0) {
+		snprintf(conf, 256, "{ \"type\": \"simple\" }");
+	}
+	else if(strcmp(rqsched, "iat") == 0) {
+		snprintf(conf, 256, "{ \"type\": \"iat\", \"distribution\": \"exponential\" }");
+	}
+	else {
+		snprintf(conf, 256, "{ \"type\": \"think\", \"distribution\": \"exponential\", "
+				"\"nusers\": %d }", nusers);
+	}
+
+	if(json_parse(JSON_BUFFER(conf), &node) != JSON_OK) {
+		fprintf(stderr, "JSON error: %s\n", json_error_message());
+		return NULL;
+	}
+
+	if(tsobj_rqsched_proc((tsobj_node_t*) node, wl) != RQSCHED_TSOBJ_OK) {
+		fprintf(stderr, "Failed to create request scheduler '%s'\n", rqsched);
+		json_node_destroy(node);
+		return NULL;
+	}
+
+	json_node_destroy(node);
+
+	return wl;
+}
+
+static void rqbench_destroy_workload(workload_t* wl) {
+	rqsched_destroy(wl);
+
+	mp_cache_destroy(&wl->wl_rq_cache);
+
+	mutex_destroy(&wl->wl_rq_mutex);
+	mutex_destroy(&wl->wl_status_mutex);
+
+	aas_free(&wl->wl_name);
+	mp_free(wl);
+}
+
+static void rqbench_step(workload_t* wl, int rq_count) {
+	workload_step_t step;
+	list_head_t rq_list;
+	request_t* rq;
+	ts_time_t t1, t2, t3, t4;
+	int i;
+
+	list_head_init(&rq_list, "rqbench-rqs");
+
+	step.wls_workload = wl;
+	step.wls_rq_count = rq_count;
+
+	relink_count = 0;
+
+	t1 = tm_get_clock();
+
+	wl->wl_rqsched_class->rqsched_step(&step);
+
+	for(i = 0; i < rq_count; ++i) {
+		rq = wl_create_request(wl, NULL);
+		list_add_tail(&rq->rq_node, &rq_list);
+	}
+
+	t2 = tm_get_clock();
+
+	list_for_each_entry(request_t, rq, &rq_list, rq_node) {
+		rq->rq_start_time = rq->rq_sched_time;
+		rq->rq_end_time = rq->rq_sched_time + RQBENCH_SERVICE;
+
+		wl->wl_rqsched_class->rqsched_post_request(rq);
+	}
+
+	t3 = tm_get_clock();
+
+	wl_destroy_request_list(&rq_list);
+
+	t4 = tm_get_clock();
+
+	printf("%8d %12.3f %12.3f %12.3f %12.3f %12.1f %12ld\n",
+		   rq_count, CLOCK_DIFF(t2, t1), CLOCK_DIFF(t3, t2), CLOCK_DIFF(t4, t3),
+		   CLOCK_DIFF(t4, t1), ((double) (t4 - t1)) / rq_count, relink_count);
+
+	++wl->wl_current_step;
+}
+
+int main(int argc, char* argv[]) {
+	const char* rqsched = "think";
+	int nusers = 4;
+	char cwd[PATHMAXLEN];
+	workload_t* wl;
+	int i;
+
+	if(argc > 1)
+		rqsched = argv[1];
+	if(argc > 2)
+		nusers = atoi(argv[2]);
+
+	setenv("TS_LOGFILE", "-", B_FALSE);
+
+	/* Randgen requires modules subsystem, but we do not need any modules */
+	getcwd(cwd, PATHMAXLEN);
+	path_join(mod_search_path, MODPATHLEN, cwd, "mod", NULL);
+	setenv("TS_MODPATH", mod_search_path, B_FALSE);
+
+	init();
+
+	tsload_register_error_msg_func(rqbench_error_msg);
+
+	wl = rqbench_create_workload(rqsched, nusers);
+	if(wl == NULL)
+		return 1;
+
+	printf("scheduler: %s users: %d\n", rqsched, nusers);
+	printf("%8s %12s %12s %12s %12s %12s %12s\n",
+		   "count", "create, ms", "post, ms", "destroy, ms", "step, ms", "ns/rq", "relinks");
+
+	for(i = 0; rq_counts[i] > 0; ++i) {
+		rqbench_step(wl, rq_counts[i]);
+	}
+
+	rqbench_destroy_workload(wl);
+
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+    This file is part of TSLoad.
+    Copyright 2013, Sergey Klyaus, ITMO University
+
+    TSLoad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation version 3.
+
+    TSLoad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with TSLoad.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <tsload/defs.h>
+
+#include <tsload/mempool.h>
+#include <tsload/time.h>
+#include <tsload/autostring.h>
+#include <tsload/list.h>
+
+#include <tsload/load/workload.h>
+#include <tsload/load/threadpool.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * tpqbench - compares cost of building threadpool request queue with
+ * sorted list insertion (tp_insert_request()) and with arrival heap
+ * (tp_rq_heap_push() + tp_flush_requests()) for 1, 4 and 16 workloads
+ * attached to a single threadpool.
+ *
+ * Arrivals of each workload are generated like "iat" request scheduler
+ * does (ascending) or like "think" scheduler does (round-robin over users,
+ * so arrivals go backwards).
+ *
+ * Usage: tpqbench [iat|think]
+ */
+
+#define TPQBENCH_QUANTUM	(1 * T_SEC)
+#define TPQBENCH_USERS		16
+
+#define CLOCK_DIFF(t2, t1)  (((double) (t2 - t1)) / T_MS)
+
+extern int init(void);
+
+int rq_counts[] = { 1000, 10000, 100000, -1 };
+int wl_counts[] = { 1, 4, 16, -1 };
+
+boolean_t think_mode = B_FALSE;
+
+static double tpqbench_exp(double mean) {
+	double u = ((double) rand() + 1.0) / ((double) RAND_MAX + 2.0);
+
+	return -mean * log(u);
+}
+
+static workload_t* tpqbench_create_workloads(int wl_count) {
+	workload_t* wls = mp_malloc(wl_count * sizeof(workload_t));
+	int wi;
+
+	memset(wls, 0, wl_count * sizeof(workload_t));
+
+	for(wi = 0; wi < wl_count; ++wi) {
+		aas_printf(aas_init(&wls[wi].wl_name), "wl%d", wi);
+		wls[wi].wl_start_clock = 0;
+	}
+
+	return wls;
+}
+
+static void tpqbench_destroy_workloads(workload_t* wls, int wl_count) {
+	int wi;
+
+	for(wi = 0; wi < wl_count; ++wi) {
+		aas_free(&wls[wi].wl_name);
+	}
+
+	mp_free(wls);
+}
+
+/**
+ * Generate requests for all workloads. Requests are ordered as
+ * tp_distribute_requests() would see them: workload by workload.
+ */
+static request_t* tpqbench_create_requests(workload_t* wls, int wl_count, int rq_count) {
+	request_t* rqs = mp_malloc(rq_count * sizeof(request_t));
+	ts_time_t user_time[TPQBENCH_USERS];
+	double mean;
+	int per_wl = rq_count / wl_count;
+	int wi, i, idx = 0, user;
+
+	memset(rqs, 0, rq_count * sizeof(request_t));
+
+	for(wi = 0; wi < wl_count; ++wi) {
+		memset(user_time, 0, sizeof(user_time));
+		mean = ((double) TPQBENCH_QUANTUM) / per_wl;
+
+		if(think_mode)
+			mean *= TPQBENCH_USERS;
+
+		for(i = 0; i < per_wl; ++i, ++idx) {
+			user = (think_mode) ? i % TPQBENCH_USERS : 0;
+
+			user_time[user] += (ts_time_t) tpqbench_exp(mean);
+
+			rqs[idx].rq_workload = &wls[wi];
+			rqs[idx].rq_id = i;
+			rqs[idx].rq_sched_time = user_time[user];
+		}
+	}
+
+	return rqs;
+}
+
+static void tpqbench_init_tp(thread_pool_t* tp) {
+	memset(tp, 0, sizeof(thread_pool_t));
+
+	list_head_init(&tp->tp_rq_head, "tpqbench-rqs");
+	tp_rq_heap_init(&tp->tp_rq_heap);
+}
+
+static void tpqbench_reset_requests(request_t* rqs, int rq_count) {
+	int i;
+
+	for(i = 0; i < rq_count; ++i) {
+		list_node_init(&rqs[i].rq_node);
+	}
+}
+
+static boolean_t tpqbench_check_sorted(thread_pool_t* tp, int rq_count) {
+	request_t* rq;
+	request_t* prev_rq = NULL;
+	int count = 0;
+
+	list_for_each_entry(request_t, rq, &tp->tp_rq_head, rq_node) {
+		if(prev_rq != NULL && tp_compare_requests(prev_rq, rq) < 0)
+			return B_FALSE;
+
+		prev_rq = rq;
+		++count;
+	}
+
+	return count == rq_count;
+}
+
+static ts_time_t tpqbench_list(thread_pool_t* tp, request_t* rqs, int wl_count, int rq_count) {
+	list_node_t* prev_rq_node = NULL;
+	list_node_t* next_rq_node = NULL;
+	int per_wl = rq_count / wl_count;
+	ts_time_t t1, t2;
+	int i;
+
+	t1 = tm_get_clock();
+
+	for(i = 0; i < rq_count; ++i) {
+		/* Hints are reset on each tp_distribute_requests() call */
+		if((i % per_wl) == 0)
+			tp_insert_request_initnodes(&tp->tp_rq_head, &prev_rq_node, &next_rq_node);
+
+		tp_insert_request(&tp->tp_rq_head, &rqs[i].rq_node, &prev_rq_node, &next_rq_node, rq_node);
+	}
+
+	t2 = tm_get_clock();
+
+	return t2 - t1;
+}
+
+static ts_time_t tpqbench_heap(thread_pool_t* tp, request_t* rqs, int rq_count) {
+	ts_time_t t1, t2;
+	int i;
+
+	t1 = tm_get_clock();
+
+	for(i = 0; i < rq_count; ++i) {
+		tp_rq_heap_push(&tp->tp_rq_heap, &rqs[i]);
+	}
+
+	tp_flush_requests(tp);
+
+	t2 = tm_get_clock();
+
+	return t2 - t1;
+}
+
+static void tpqbench_run(int wl_count, int rq_count) {
+	workload_t* wls = tpqbench_create_workloads(wl_count);
+	request_t* rqs;
+	thread_pool_t tp;
+	ts_time_t list_time, heap_time;
+	boolean_t list_ok, heap_ok;
+
+	rq_count -= rq_count % wl_count;
+	rqs = tpqbench_create_requests(wls, wl_count, rq_count);
+
+	tpqbench_init_tp(&tp);
+	tpqbench_reset_requests(rqs, rq_count);
+	list_time = tpqbench_list(&tp, rqs, wl_count, rq_count);
+	list_ok = tpqbench_check_sorted(&tp, rq_count);
+
+	tpqbench_init_tp(&tp);
+	tpqbench_reset_requests(rqs, rq_count);
+	heap_time = tpqbench_heap(&tp, rqs, rq_count);
+	heap_ok = tpqbench_check_sorted(&tp, rq_count);
+	tp_rq_heap_destroy(&tp.tp_rq_heap);
+
+	printf("%8d %8d %12.3f %12.3f %10.1f %6s\n",
+		   wl_count, rq_count, CLOCK_DIFF(list_time, 0), CLOCK_DIFF(heap_time, 0),
+		   ((double) list_time) / ((double) heap_time),
+		   (list_ok && heap_ok) ? "yes" : "NO");
+
+	mp_free(rqs);
+	tpqbench_destroy_workloads(wls, wl_count);
+}
+
+int main(int argc, char* argv[]) {
+	int wi, ri;
+
+	if(argc > 1 && strcmp(argv[1], "think") == 0)
+		think_mode = B_TRUE;
+
+	setenv("TS_LOGFILE", "-", B_FALSE);
+
+	init();
+
+	srand(1);
+
+	printf("arrivals: %s\n", (think_mode) ? "think" : "iat");
+	printf("%8s %8s %12s %12s %10s %6s\n",
+		   "wls", "count", "list, ms", "heap, ms", "speedup", "sorted");
+
+	for(wi = 0; wl_counts[wi] > 0; ++wi) {
+		for(ri = 0; rq_counts[ri] > 0; ++ri) {
+			tpqbench_run(wl_counts[wi], rq_counts[ri]);
+		}
+	}
+
+	return 0;
+}